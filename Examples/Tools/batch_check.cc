@@ -0,0 +1,252 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that a local bundle adjustment gives the same chi2 with the
+// reprojection errors evaluated edge by edge and with a g2o::ReprojectionBatch,
+// including after the outliers are moved to level 1 as in
+// Optimizer::LocalBundleAdjustment. Returns 1 if they differ.
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+using namespace std;
+
+struct Observation {
+  int nKF;
+  int nPoint;
+  double u, v, ur;
+  bool bStereo;
+};
+
+struct Problem {
+  vector<g2o::SE3Quat> vPoses;
+  vector<Eigen::Vector3d> vPoints;
+  vector<Observation> vObservations;
+};
+
+// Noisy observations of points seen by a few consecutive keyframes, far from
+// the origin as after a long sequence, with some gross outliers
+static Problem MakeProblem(const int nKFs, const int nPoints,
+                           const int nObsPerPoint) {
+  mt19937 rng(0);
+  uniform_real_distribution<double> noise(-1, 1);
+  uniform_real_distribution<double> unit(0, 1);
+  Problem problem;
+  const Eigen::Vector3d offset(250, -80, 30);
+
+  for (int i = 0; i < nKFs; i++)
+    problem.vPoses.push_back(g2o::SE3Quat(
+        Eigen::Quaterniond::Identity(),
+        -offset - Eigen::Vector3d(0.2 * i, 0.01 * noise(rng), 0)));
+  for (int j = 0; j < nPoints; j++)
+    problem.vPoints.push_back(offset +
+                              Eigen::Vector3d(0.2 * nKFs * unit(rng),
+                                              3 * noise(rng), 8 + noise(rng)));
+
+  uniform_int_distribution<int> firstKF(0, nKFs - nObsPerPoint);
+  for (int j = 0; j < nPoints; j++) {
+    const int first = firstKF(rng);
+    for (int k = first; k < first + nObsPerPoint; k++) {
+      const Eigen::Vector3d Xc = problem.vPoses[k].map(problem.vPoints[j]);
+      Observation obs;
+      obs.nKF = k;
+      obs.nPoint = j;
+      obs.u = 500 * Xc[0] / Xc[2] + 320 + noise(rng);
+      obs.v = 500 * Xc[1] / Xc[2] + 240 + noise(rng);
+      obs.ur = obs.u - 40 / Xc[2];
+      obs.bStereo = unit(rng) < 0.3;
+      if (unit(rng) < 0.05)
+        obs.u += 30;
+      problem.vObservations.push_back(obs);
+    }
+  }
+  return problem;
+}
+
+// Graph of a local bundle adjustment, the first two keyframes are fixed and
+// the estimates are perturbed
+static void BuildGraph(const Problem &problem, g2o::SparseOptimizer &optimizer,
+                       g2o::ReprojectionBatch *pBatch,
+                       vector<g2o::OptimizableGraph::Edge *> &vpEdges) {
+  g2o::BlockSolver_6_3::LinearSolverType *linearSolver =
+      new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+  optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+  const int nKFs = problem.vPoses.size();
+  for (int i = 0; i < nKFs; i++) {
+    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+    const g2o::SE3Quat delta(Eigen::Quaterniond(1, 0.001 * (i % 3), 0, 0),
+                             Eigen::Vector3d(0.01 * (i % 2), 0, 0));
+    vSE3->setEstimate(i < 2 ? problem.vPoses[i] : delta * problem.vPoses[i]);
+    vSE3->setId(i);
+    vSE3->setFixed(i < 2);
+    optimizer.addVertex(vSE3);
+  }
+  for (size_t j = 0; j < problem.vPoints.size(); j++) {
+    g2o::VertexSBAPointXYZ *vPoint = new g2o::VertexSBAPointXYZ();
+    vPoint->setEstimate(problem.vPoints[j] +
+                        Eigen::Vector3d(0.02, -0.01, 0.03 * (j % 2)));
+    vPoint->setId(nKFs + j);
+    vPoint->setMarginalized(true);
+    optimizer.addVertex(vPoint);
+  }
+
+  for (size_t i = 0; i < problem.vObservations.size(); i++) {
+    const Observation &obs = problem.vObservations[i];
+    g2o::OptimizableGraph::Vertex *vPoint =
+        static_cast<g2o::OptimizableGraph::Vertex *>(
+            optimizer.vertex(nKFs + obs.nPoint));
+    g2o::OptimizableGraph::Vertex *vKF =
+        static_cast<g2o::OptimizableGraph::Vertex *>(
+            optimizer.vertex(obs.nKF));
+    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+    if (!obs.bStereo) {
+      g2o::EdgeSE3ProjectXYZ *e = new g2o::EdgeSE3ProjectXYZ();
+      e->setVertex(0, vPoint);
+      e->setVertex(1, vKF);
+      e->setMeasurement(Eigen::Vector2d(obs.u, obs.v));
+      e->setInformation(Eigen::Matrix2d::Identity());
+      rk->setDelta(sqrt(5.991));
+      e->setRobustKernel(rk);
+      e->fx = 500;
+      e->fy = 500;
+      e->cx = 320;
+      e->cy = 240;
+      optimizer.addEdge(e);
+      if (pBatch)
+        pBatch->add(e);
+      vpEdges.push_back(e);
+    } else {
+      g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
+      e->setVertex(0, vPoint);
+      e->setVertex(1, vKF);
+      e->setMeasurement(Eigen::Vector3d(obs.u, obs.v, obs.ur));
+      e->setInformation(Eigen::Matrix3d::Identity());
+      rk->setDelta(sqrt(7.815));
+      e->setRobustKernel(rk);
+      e->fx = 500;
+      e->fy = 500;
+      e->cx = 320;
+      e->cy = 240;
+      e->bf = 40;
+      optimizer.addEdge(e);
+      if (pBatch)
+        pBatch->add(e);
+      vpEdges.push_back(e);
+    }
+  }
+  if (pBatch)
+    optimizer.addEdgeBatch(pBatch);
+}
+
+static bool Check(const string &name, const double plain, const double batched,
+                  const double tolerance) {
+  const double error = fabs(plain - batched) / max(fabs(plain), 1.0);
+  const bool bOk = error <= tolerance;
+  cout << (bOk ? "[ok] " : "[FAILED] ") << name << ": " << plain << " / "
+       << batched << endl;
+  return bOk;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 1) {
+    cerr << endl << "Usage: ./batch_check" << endl;
+    return 1;
+  }
+
+  const Problem problem = MakeProblem(10, 2000, 4);
+
+  g2o::SparseOptimizer plain, batched;
+  g2o::ReprojectionBatch batch;
+  vector<g2o::OptimizableGraph::Edge *> vpPlainEdges, vpBatchedEdges;
+  BuildGraph(problem, plain, NULL, vpPlainEdges);
+  BuildGraph(problem, batched, &batch, vpBatchedEdges);
+  bool bOk = true;
+
+  // Float residuals relative to the camera centers
+  plain.initializeOptimization(0);
+  batched.initializeOptimization(0);
+  plain.computeActiveErrors();
+  batched.computeActiveErrors();
+  bOk &= Check("initial chi2", plain.activeChi2(), batched.activeChi2(), 1e-5);
+
+  plain.optimize(5);
+  batched.optimize(5);
+  bOk &= Check("chi2 after 5 iterations", plain.activeChi2(),
+               batched.activeChi2(), 1e-4);
+
+  // Outliers out of the optimization, their errors must be left alone
+  vector<double> vOutlierChi2;
+  vector<g2o::OptimizableGraph::Edge *> vpOutliers;
+  for (size_t i = 0; i < vpPlainEdges.size(); i++) {
+    vpPlainEdges[i]->computeError();
+    vpBatchedEdges[i]->computeError();
+    const double th = vpPlainEdges[i]->dimension() == 2 ? 5.991 : 7.815;
+    if (vpPlainEdges[i]->chi2() > th) {
+      vpPlainEdges[i]->setLevel(1);
+      vpBatchedEdges[i]->setLevel(1);
+      vOutlierChi2.push_back(vpBatchedEdges[i]->chi2());
+      vpOutliers.push_back(vpBatchedEdges[i]);
+    }
+    vpPlainEdges[i]->setRobustKernel(0);
+    vpBatchedEdges[i]->setRobustKernel(0);
+  }
+  cout << vpOutliers.size() << " outliers out of " << vpPlainEdges.size()
+       << " edges" << endl;
+
+  plain.initializeOptimization(0);
+  batched.initializeOptimization(0);
+  bOk &= Check("active edges", plain.activeEdges().size(),
+               batched.activeEdges().size(), 0);
+  plain.optimize(10);
+  batched.optimize(10);
+  bOk &= Check("chi2 without the outliers", plain.activeChi2(),
+               batched.activeChi2(), 1e-4);
+
+  size_t nTouched = 0;
+  for (size_t i = 0; i < vpOutliers.size(); i++)
+    if (vpOutliers[i]->chi2() != vOutlierChi2[i])
+      nTouched++;
+  bOk &= Check("outliers evaluated by the batch", 0, nTouched, 0);
+
+  double maxDistance = 0;
+  for (size_t i = 0; i < problem.vPoses.size(); i++) {
+    const g2o::SE3Quat Tplain =
+        static_cast<g2o::VertexSE3Expmap *>(plain.vertex(i))->estimate();
+    const g2o::SE3Quat Tbatched =
+        static_cast<g2o::VertexSE3Expmap *>(batched.vertex(i))->estimate();
+    maxDistance = max(maxDistance, (Tplain.inverse().translation() -
+                                    Tbatched.inverse().translation())
+                                       .norm());
+  }
+  bOk &= Check("largest camera center difference (m)", 0, maxDistance, 1e-4);
+
+  batch.clear();
+  return bOk ? 0 : 1;
+}
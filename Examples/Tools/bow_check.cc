@@ -0,0 +1,214 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the flat BoW and feature vectors against the std::map containers they
+// replaced: same words and weights whichever way they are built, same nodes
+// and features, and the same L1 scores as the map-based scoring. The scores
+// accumulated from an inverted file as in KeyFrameDatabase must be those of
+// L1Scoring. Returns 1 if they differ.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "Thirdparty/DBoW2/DBoW2/BowVector.h"
+#include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
+#include "Thirdparty/DBoW2/DBoW2/ScoringObject.h"
+
+using namespace std;
+
+typedef map<DBoW2::WordId, DBoW2::WordValue> MapBowVector;
+typedef map<DBoW2::NodeId, vector<unsigned int>> MapFeatureVector;
+
+// Words of an image: ids drawn from a vocabulary of nWords, with repetitions
+static vector<pair<DBoW2::WordId, DBoW2::WordValue>>
+RandomWords(mt19937 &rng, const int nWords, const int nFeatures) {
+  uniform_int_distribution<DBoW2::WordId> word(0, nWords - 1);
+  uniform_real_distribution<DBoW2::WordValue> weight(0.1, 2);
+  vector<pair<DBoW2::WordId, DBoW2::WordValue>> vWords(nFeatures);
+  for (int i = 0; i < nFeatures; i++)
+    vWords[i] = make_pair(word(rng), weight(rng));
+  return vWords;
+}
+
+static void Normalize(MapBowVector &v) {
+  double norm = 0;
+  for (MapBowVector::iterator it = v.begin(); it != v.end(); it++)
+    norm += fabs(it->second);
+  for (MapBowVector::iterator it = v.begin(); it != v.end(); it++)
+    it->second /= norm;
+}
+
+// L1Scoring::score before the vectors were flat
+static double MapL1Score(const MapBowVector &v1, const MapBowVector &v2) {
+  MapBowVector::const_iterator v1_it = v1.begin(), v2_it = v2.begin();
+  double score = 0;
+  while (v1_it != v1.end() && v2_it != v2.end()) {
+    const DBoW2::WordValue &vi = v1_it->second;
+    const DBoW2::WordValue &wi = v2_it->second;
+    if (v1_it->first == v2_it->first) {
+      score += fabs(vi - wi) - fabs(vi) - fabs(wi);
+      ++v1_it;
+      ++v2_it;
+    } else if (v1_it->first < v2_it->first) {
+      v1_it = v1.lower_bound(v2_it->first);
+    } else {
+      v2_it = v2.lower_bound(v1_it->first);
+    }
+  }
+  return -score / 2.0;
+}
+
+static bool Equal(const DBoW2::BowVector &v, const MapBowVector &m) {
+  if (v.size() != m.size())
+    return false;
+  MapBowVector::const_iterator mit = m.begin();
+  for (DBoW2::BowVector::const_iterator vit = v.begin(); vit != v.end();
+       vit++, mit++)
+    if (vit->first != mit->first || vit->second != mit->second)
+      return false;
+  return true;
+}
+
+static bool Equal(const DBoW2::FeatureVector &v, const MapFeatureVector &m) {
+  if (v.size() != m.size())
+    return false;
+  MapFeatureVector::const_iterator mit = m.begin();
+  for (DBoW2::FeatureVector::const_iterator vit = v.begin(); vit != v.end();
+       vit++, mit++) {
+    const vector<unsigned int> vFeatures = vit->second;
+    if (vit->first != mit->first || vFeatures != mit->second)
+      return false;
+    if (v.find(mit->first) == v.end() || v.lower_bound(mit->first) != vit)
+      return false;
+  }
+  return true;
+}
+
+static bool Check(const string &name, const int nFailures, const int nTotal) {
+  cout << (nFailures == 0 ? "[ok] " : "[FAILED] ") << name << ": "
+       << nTotal - nFailures << "/" << nTotal << endl;
+  return nFailures == 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 1) {
+    cerr << endl << "Usage: ./bow_check" << endl;
+    return 1;
+  }
+
+  // Sizes of the ORB vocabulary and of the features of a keyframe
+  const int nWords = 1000000, nNodes = 1000, nFeatures = 1000;
+  const int nImages = 200;
+  mt19937 rng(0);
+  bool bOk = true;
+
+  // Vectors built word by word (addWeight, addIfNotExist) and sorted at once
+  // (sortWords, as the vocabulary transform)
+  vector<DBoW2::BowVector> vBowVectors(nImages);
+  vector<MapBowVector> vMapBowVectors(nImages);
+  int nBuildFailures = 0, nNormalizeFailures = 0;
+  for (int i = 0; i < nImages; i++) {
+    const vector<pair<DBoW2::WordId, DBoW2::WordValue>> vWords =
+        RandomWords(rng, i % 2 ? nWords : nFeatures, nFeatures);
+    DBoW2::BowVector added, kept;
+    DBoW2::BowVector &sorted = vBowVectors[i];
+    MapBowVector &mAdded = vMapBowVectors[i];
+    MapBowVector mKept;
+    for (size_t k = 0; k < vWords.size(); k++) {
+      added.addWeight(vWords[k].first, vWords[k].second);
+      kept.addIfNotExist(vWords[k].first, vWords[k].second);
+      sorted.push_back(vWords[k]);
+      mAdded[vWords[k].first] += vWords[k].second;
+      mKept.insert(vWords[k]);
+    }
+    DBoW2::BowVector sortedKept = sorted;
+    sorted.sortWords(true);
+    sortedKept.sortWords(false);
+    if (!Equal(added, mAdded) || !Equal(sorted, mAdded) ||
+        !Equal(kept, mKept) || !Equal(sortedKept, mKept))
+      nBuildFailures++;
+
+    sorted.normalize(DBoW2::L1);
+    Normalize(mAdded);
+    if (!Equal(sorted, mAdded))
+      nNormalizeFailures++;
+  }
+  bOk &= Check("BoW vectors built as maps", nBuildFailures, nImages);
+  bOk &= Check("L1 normalized BoW vectors", nNormalizeFailures, nImages);
+
+  // Scores of all the pairs, the words are visited in the same order
+  DBoW2::L1Scoring scoring;
+  int nScoreFailures = 0, nScores = 0;
+  for (int i = 0; i < nImages; i++)
+    for (int j = 0; j < nImages; j++, nScores++)
+      if (scoring.score(vBowVectors[i], vBowVectors[j]) !=
+          MapL1Score(vMapBowVectors[i], vMapBowVectors[j]))
+        nScoreFailures++;
+  bOk &= Check("L1 scores", nScoreFailures, nScores);
+
+  // Sum of the minimum weights of the common words, from the postings of the
+  // query words
+  vector<vector<pair<int, DBoW2::WordValue>>> vInvertedFile(nWords);
+  for (int i = 0; i < nImages; i++)
+    for (DBoW2::BowVector::const_iterator vit = vBowVectors[i].begin();
+         vit != vBowVectors[i].end(); vit++)
+      vInvertedFile[vit->first].push_back(make_pair(i, vit->second));
+  int nAccumulatedFailures = 0;
+  for (int i = 0; i < nImages; i++) {
+    vector<double> vScores(nImages, 0);
+    for (DBoW2::BowVector::const_iterator vit = vBowVectors[i].begin();
+         vit != vBowVectors[i].end(); vit++) {
+      const vector<pair<int, DBoW2::WordValue>> &vPostings =
+          vInvertedFile[vit->first];
+      for (size_t k = 0; k < vPostings.size(); k++)
+        vScores[vPostings[k].first] += min(vit->second, vPostings[k].second);
+    }
+    for (int j = 0; j < nImages; j++)
+      if (fabs(vScores[j] - scoring.score(vBowVectors[i], vBowVectors[j])) >
+          1e-9)
+        nAccumulatedFailures++;
+  }
+  bOk &= Check("L1 scores accumulated from the inverted file",
+               nAccumulatedFailures, nScores);
+
+  // Feature vectors built node by node (addFeature) and at once (assign)
+  int nFeatureFailures = 0;
+  for (int i = 0; i < nImages; i++) {
+    uniform_int_distribution<DBoW2::NodeId> node(0, nNodes - 1);
+    vector<pair<DBoW2::NodeId, unsigned int>> vFeatures(nFeatures);
+    DBoW2::FeatureVector added, assigned;
+    MapFeatureVector mFeatures;
+    for (int k = 0; k < nFeatures; k++) {
+      vFeatures[k] = make_pair(node(rng), k);
+      added.addFeature(vFeatures[k].first, k);
+      mFeatures[vFeatures[k].first].push_back(k);
+    }
+    assigned.assign(vFeatures);
+    if (!Equal(added, mFeatures) || !Equal(assigned, mFeatures))
+      nFeatureFailures++;
+  }
+  bOk &= Check("feature vectors built as maps", nFeatureFailures, nImages);
+
+  return bOk ? 0 : 1;
+}
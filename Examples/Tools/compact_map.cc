@@ -0,0 +1,90 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <KeyFrame.h>
+#include <KeyFrameDatabase.h>
+#include <Map.h>
+#include <MapCompactor.h>
+#include <MapSnapshot.h>
+#include <ORBVocabulary.h>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+  if (argc != 6) {
+    cerr << endl
+         << "Usage: ./compact_map path_to_vocabulary path_to_map "
+            "max_keyframes max_mappoints path_to_output"
+         << endl
+         << "A budget of 0 leaves the number of keyframes or map points "
+            "unchanged"
+         << endl;
+    return 1;
+  }
+
+  const long unsigned int nMaxKeyFrames = strtoul(argv[3], NULL, 10);
+  const long unsigned int nMaxMapPoints = strtoul(argv[4], NULL, 10);
+
+  cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+  ORB_SLAM2::ORBVocabulary vocabulary;
+  if (!vocabulary.loadFromBinFile(argv[1])) {
+    cerr << "Wrong path to vocabulary. " << endl;
+    cerr << "Failed to open at: " << argv[1] << endl;
+    return 1;
+  }
+
+  // The journal of the map file is not replayed, save the map from SLAM first
+  ORB_SLAM2::MapSnapshot input;
+  if (!input.Load(argv[2])) {
+    cerr << "Failed to load the map at: " << argv[2] << endl;
+    return 1;
+  }
+  if (!input.CheckConsistency())
+    cerr << "The map at " << argv[2] << " is inconsistent" << endl;
+
+  ORB_SLAM2::Map map;
+  ORB_SLAM2::KeyFrameDatabase database(vocabulary);
+  input.Restore(&map, &database, &vocabulary);
+
+  // Only stereo and RGB-D keyframes have depths, the close points of
+  // KeyFrameCulling are all the points in monocular
+  bool bMonocular = true;
+  const vector<ORB_SLAM2::KeyFrame *> vpKFs = map.GetAllKeyFrames();
+  for (size_t i = 0; i < vpKFs.size() && bMonocular; i++)
+    for (size_t j = 0; j < vpKFs[i]->mvDepth.size() && bMonocular; j++)
+      bMonocular = vpKFs[i]->mvDepth[j] < 0;
+
+  ORB_SLAM2::MapCompactor compactor(&map, bMonocular);
+  compactor.Compact(nMaxKeyFrames, nMaxMapPoints);
+
+  ORB_SLAM2::MapSnapshot output;
+  output.Capture(&map);
+  output.CopyState();
+  if (!output.Save(argv[5])) {
+    cerr << "Failed to save the map to: " << argv[5] << endl;
+    return 1;
+  }
+
+  cout << "Compacted map saved to " << argv[5] << endl;
+  return 0;
+}
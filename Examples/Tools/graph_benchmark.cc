@@ -0,0 +1,356 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Time to build the g2o graph of a local bundle adjustment, without solving it:
+// vertices and edges added to the optimizer and initializeOptimization(), with
+// a new optimizer for each graph as before and with the OptimizerWorkspace of
+// the thread. The containers of the graph are also timed alone, the hash map
+// of ids and the sets of edges g2o used before against the current
+// HyperGraph.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <OptimizerWorkspace.h>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+using namespace std;
+
+struct Observation {
+  int nKF;
+  int nPoint;
+  double u, v;
+};
+
+struct Problem {
+  // Ids as in LocalBundleAdjustment: keyframe ids, then point ids after the
+  // largest keyframe id
+  vector<int> vKFIds;
+  vector<int> vPointIds;
+  vector<g2o::SE3Quat> vPoses;
+  vector<Eigen::Vector3d> vPoints;
+  vector<Observation> vObservations;
+  int nLocalKFs;
+};
+
+static Problem MakeProblem(const int nLocalKFs, const int nFixedKFs,
+                           const int nPoints, const int nObsPerPoint) {
+  mt19937 rng(0);
+  uniform_real_distribution<double> noise(-1, 1);
+  Problem problem;
+  problem.nLocalKFs = nLocalKFs;
+
+  // Keyframes and points of a long sequence, their ids are not contiguous
+  const int nKFs = nLocalKFs + nFixedKFs;
+  for (int i = 0; i < nKFs; i++) {
+    problem.vKFIds.push_back(5000 + 3 * i);
+    problem.vPoses.push_back(g2o::SE3Quat(Eigen::Quaterniond::Identity(),
+                                          Eigen::Vector3d(-0.2 * i, 0, 0)));
+  }
+  const int maxKFid = problem.vKFIds.back();
+  for (int j = 0; j < nPoints; j++) {
+    problem.vPointIds.push_back(400000 + 2 * j + maxKFid + 1);
+    problem.vPoints.push_back(Eigen::Vector3d(
+        0.2 * nKFs * (noise(rng) + 1) / 2, 3 * noise(rng), 8 + noise(rng)));
+  }
+
+  uniform_int_distribution<int> firstKF(0, nKFs - nObsPerPoint);
+  for (int j = 0; j < nPoints; j++) {
+    const int first = firstKF(rng);
+    for (int k = first; k < first + nObsPerPoint; k++) {
+      const Eigen::Vector3d Xc = problem.vPoses[k].map(problem.vPoints[j]);
+      Observation obs;
+      obs.nKF = k;
+      obs.nPoint = j;
+      obs.u = 500 * Xc[0] / Xc[2] + 320 + noise(rng);
+      obs.v = 500 * Xc[1] / Xc[2] + 240 + noise(rng);
+      problem.vObservations.push_back(obs);
+    }
+  }
+  return problem;
+}
+
+static void SetAlgorithm(g2o::SparseOptimizer &optimizer) {
+  g2o::BlockSolver_6_3::LinearSolverType *linearSolver =
+      new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+  optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+}
+
+// Objects are allocated by New, a functor returning a new object of the type
+// of its argument
+template <class NewFunctor>
+static void BuildGraph(const Problem &problem, g2o::SparseOptimizer &optimizer,
+                       NewFunctor New) {
+  for (size_t i = 0; i < problem.vKFIds.size(); i++) {
+    g2o::VertexSE3Expmap *vSE3 = New((g2o::VertexSE3Expmap *)NULL);
+    vSE3->setEstimate(problem.vPoses[i]);
+    vSE3->setId(problem.vKFIds[i]);
+    vSE3->setFixed((int)i >= problem.nLocalKFs || i == 0);
+    optimizer.addVertex(vSE3);
+  }
+  for (size_t j = 0; j < problem.vPointIds.size(); j++) {
+    g2o::VertexSBAPointXYZ *vPoint = New((g2o::VertexSBAPointXYZ *)NULL);
+    vPoint->setEstimate(problem.vPoints[j]);
+    vPoint->setId(problem.vPointIds[j]);
+    vPoint->setMarginalized(true);
+    optimizer.addVertex(vPoint);
+  }
+
+  const float thHuberMono = sqrt(5.991);
+  for (size_t i = 0; i < problem.vObservations.size(); i++) {
+    const Observation &obs = problem.vObservations[i];
+    g2o::EdgeSE3ProjectXYZ *e = New((g2o::EdgeSE3ProjectXYZ *)NULL);
+    e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
+                        optimizer.vertex(problem.vPointIds[obs.nPoint])));
+    e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
+                        optimizer.vertex(problem.vKFIds[obs.nKF])));
+    e->setMeasurement(Eigen::Vector2d(obs.u, obs.v));
+    e->setInformation(Eigen::Matrix2d::Identity());
+    g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+    e->setRobustKernel(rk);
+    rk->setDelta(thHuberMono);
+    e->fx = 500;
+    e->fy = 500;
+    e->cx = 320;
+    e->cy = 240;
+    optimizer.addEdge(e);
+  }
+
+  optimizer.initializeOptimization();
+}
+
+struct NewObject {
+  template <class T> T *operator()(T *) { return new T(); }
+};
+
+struct NewFromWorkspace {
+  ORB_SLAM2::OptimizerWorkspace::Scope *pScope;
+  template <class T> T *operator()(T *) { return pScope->New<T>(); }
+};
+
+// Vertex keeping its edges in a set too, as g2o did before
+struct SetVertex : public g2o::HyperGraph::Vertex {
+  explicit SetVertex(int id) : g2o::HyperGraph::Vertex(id) {}
+  set<g2o::HyperGraph::Edge *> sEdges;
+};
+
+struct GraphElements {
+  vector<SetVertex *> vpVertices;
+  vector<g2o::HyperGraph::Edge *> vpEdges;
+};
+
+static GraphElements MakeElements(const Problem &problem) {
+  GraphElements elements;
+  for (size_t i = 0; i < problem.vKFIds.size(); i++)
+    elements.vpVertices.push_back(new SetVertex(problem.vKFIds[i]));
+  for (size_t j = 0; j < problem.vPointIds.size(); j++)
+    elements.vpVertices.push_back(new SetVertex(problem.vPointIds[j]));
+  for (size_t i = 0; i < problem.vObservations.size(); i++) {
+    g2o::HyperGraph::Edge *e = new g2o::HyperGraph::Edge((int)i);
+    e->resize(2);
+    elements.vpEdges.push_back(e);
+  }
+  return elements;
+}
+
+// Vertices added by id, then the edges added to the graph and to their
+// vertices after looking the vertices up by id, and the active edges collected
+// from the vertices as initializeOptimization() does. Returns the number of
+// active edges.
+static size_t BuildMapContainers(const Problem &problem,
+                                 GraphElements &elements) {
+  unordered_map<int, g2o::HyperGraph::Vertex *> mVertices;
+  set<g2o::HyperGraph::Edge *> sEdges;
+  for (size_t i = 0; i < elements.vpVertices.size(); i++)
+    mVertices.insert(
+        make_pair(elements.vpVertices[i]->id(), elements.vpVertices[i]));
+
+  for (size_t i = 0; i < problem.vObservations.size(); i++) {
+    const Observation &obs = problem.vObservations[i];
+    g2o::HyperGraph::Edge *e = elements.vpEdges[i];
+    e->setVertex(0, mVertices.find(problem.vPointIds[obs.nPoint])->second);
+    e->setVertex(1, mVertices.find(problem.vKFIds[obs.nKF])->second);
+    if (!sEdges.insert(e).second)
+      continue;
+    for (size_t k = 0; k < e->vertices().size(); k++)
+      static_cast<SetVertex *>(e->vertex(k))->sEdges.insert(e);
+  }
+
+  set<g2o::HyperGraph::Vertex *> sVertices;
+  for (unordered_map<int, g2o::HyperGraph::Vertex *>::iterator it =
+           mVertices.begin();
+       it != mVertices.end(); it++)
+    sVertices.insert(it->second);
+  set<g2o::HyperGraph::Edge *> sActiveEdges;
+  for (set<g2o::HyperGraph::Vertex *>::iterator it = sVertices.begin();
+       it != sVertices.end(); it++) {
+    const set<g2o::HyperGraph::Edge *> &sVertexEdges =
+        static_cast<SetVertex *>(*it)->sEdges;
+    for (set<g2o::HyperGraph::Edge *>::const_iterator eit =
+             sVertexEdges.begin();
+         eit != sVertexEdges.end(); eit++) {
+      bool bAllVertices = true;
+      for (size_t k = 0; k < (*eit)->vertices().size(); k++)
+        bAllVertices &= sVertices.count((*eit)->vertex(k)) > 0;
+      if (bAllVertices)
+        sActiveEdges.insert(*eit);
+    }
+  }
+  vector<g2o::HyperGraph::Edge *> vpActiveEdges(sActiveEdges.begin(),
+                                                sActiveEdges.end());
+
+  for (size_t i = 0; i < elements.vpVertices.size(); i++)
+    elements.vpVertices[i]->sEdges.clear();
+  return vpActiveEdges.size();
+}
+
+// Same steps with the containers of HyperGraph
+static size_t BuildGraphContainers(const Problem &problem,
+                                   GraphElements &elements,
+                                   g2o::HyperGraph &graph) {
+  for (size_t i = 0; i < elements.vpVertices.size(); i++)
+    graph.addVertex(elements.vpVertices[i]);
+
+  for (size_t i = 0; i < problem.vObservations.size(); i++) {
+    const Observation &obs = problem.vObservations[i];
+    g2o::HyperGraph::Edge *e = elements.vpEdges[i];
+    e->setVertex(0, graph.vertex(problem.vPointIds[obs.nPoint]));
+    e->setVertex(1, graph.vertex(problem.vKFIds[obs.nKF]));
+    graph.addEdge(e);
+  }
+
+  vector<g2o::HyperGraph::Edge *> vpActiveEdges;
+  vpActiveEdges.reserve(graph.edges().size());
+  for (g2o::HyperGraph::VertexIDMap::iterator it = graph.vertices().begin();
+       it != graph.vertices().end(); it++) {
+    g2o::HyperGraph::Vertex *v = it->second;
+    const g2o::HyperGraph::EdgeList &vEdges = v->edges();
+    for (size_t n = 0; n < vEdges.size(); n++) {
+      g2o::HyperGraph::Edge *e = vEdges[n];
+      bool bAllVertices = true;
+      for (size_t k = 0; k < e->vertices().size(); k++)
+        bAllVertices &= graph.vertex(e->vertex(k)->id()) == e->vertex(k);
+      if (bAllVertices && e->vertex(0) == v)
+        vpActiveEdges.push_back(e);
+    }
+  }
+
+  graph.release();
+  return vpActiveEdges.size();
+}
+
+int main(int argc, char **argv) {
+  if (argc != 1 && argc != 6) {
+    cerr << endl
+         << "Usage: ./graph_benchmark [local_keyframes fixed_keyframes "
+            "points observations_per_point repetitions]"
+         << endl;
+    return 1;
+  }
+
+  // Typical local bundle adjustment
+  int nLocalKFs = 20, nFixedKFs = 10, nPoints = 4000, nObsPerPoint = 5;
+  int nRepetitions = 50;
+  if (argc == 6) {
+    nLocalKFs = atoi(argv[1]);
+    nFixedKFs = atoi(argv[2]);
+    nPoints = atoi(argv[3]);
+    nObsPerPoint = atoi(argv[4]);
+    nRepetitions = atoi(argv[5]);
+  }
+  if (nLocalKFs < 1 || nFixedKFs < 0 || nPoints < 1 || nObsPerPoint < 1 ||
+      nObsPerPoint > nLocalKFs + nFixedKFs || nRepetitions < 1) {
+    cerr << "Invalid sizes" << endl;
+    return 1;
+  }
+
+  const Problem problem =
+      MakeProblem(nLocalKFs, nFixedKFs, nPoints, nObsPerPoint);
+  cout << problem.vKFIds.size() << " keyframes, " << problem.vPoints.size()
+       << " points, " << problem.vObservations.size() << " edges" << endl;
+
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  for (int r = 0; r < nRepetitions; r++) {
+    g2o::SparseOptimizer optimizer;
+    SetAlgorithm(optimizer);
+    BuildGraph(problem, optimizer, NewObject());
+  }
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  for (int r = 0; r < nRepetitions; r++) {
+    ORB_SLAM2::OptimizerWorkspace::Scope workspace(
+        ORB_SLAM2::OptimizerWorkspace::LOCAL_BUNDLE_ADJUSTMENT);
+    if (!workspace.Optimizer().algorithm())
+      SetAlgorithm(workspace.Optimizer());
+    NewFromWorkspace New = {&workspace};
+    BuildGraph(problem, workspace.Optimizer(), New);
+  }
+  chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+
+  const double tNew =
+      chrono::duration_cast<chrono::duration<double, milli>>(t1 - t0).count();
+  const double tWorkspace =
+      chrono::duration_cast<chrono::duration<double, milli>>(t2 - t1).count();
+  cout << "New optimizer: " << tNew / nRepetitions << " ms per graph" << endl;
+  cout << "Workspace: " << tWorkspace / nRepetitions << " ms per graph"
+       << endl;
+
+  GraphElements elements = MakeElements(problem);
+  g2o::HyperGraph graph;
+  size_t nMapActive = 0, nGraphActive = 0;
+  chrono::steady_clock::time_point t3 = chrono::steady_clock::now();
+  for (int r = 0; r < nRepetitions; r++)
+    nMapActive = BuildMapContainers(problem, elements);
+  chrono::steady_clock::time_point t4 = chrono::steady_clock::now();
+  for (int r = 0; r < nRepetitions; r++)
+    nGraphActive = BuildGraphContainers(problem, elements, graph);
+  chrono::steady_clock::time_point t5 = chrono::steady_clock::now();
+  for (size_t i = 0; i < elements.vpVertices.size(); i++)
+    delete elements.vpVertices[i];
+  for (size_t i = 0; i < elements.vpEdges.size(); i++)
+    delete elements.vpEdges[i];
+
+  const double tMap =
+      chrono::duration_cast<chrono::duration<double, milli>>(t4 - t3).count();
+  const double tGraph =
+      chrono::duration_cast<chrono::duration<double, milli>>(t5 - t4).count();
+  cout << "Containers, hash map and sets: " << tMap / nRepetitions
+       << " ms per graph" << endl;
+  cout << "Containers, HyperGraph: " << tGraph / nRepetitions
+       << " ms per graph" << endl;
+  if (nMapActive != problem.vObservations.size() ||
+      nGraphActive != problem.vObservations.size()) {
+    cerr << "Active edges differ: " << nMapActive << " and " << nGraphActive
+         << " for " << problem.vObservations.size() << " edges" << endl;
+    return 1;
+  }
+
+  return 0;
+}
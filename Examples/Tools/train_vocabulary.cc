@@ -0,0 +1,121 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <ORBVocabulary.h>
+#include <ORBextractor.h>
+#include <VocabularyTrainer.h>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+  if (argc < 5 || argc > 6) {
+    cerr << endl
+         << "Usage: ./train_vocabulary path_to_image_list k L path_to_output "
+            "[n_features]"
+         << endl
+         << "The image list has one image path per line. The ORBvoc shipped "
+            "with the project has k=10 and L=6"
+         << endl;
+    return 1;
+  }
+
+  const int k = atoi(argv[2]);
+  const int L = atoi(argv[3]);
+  const int nFeatures = argc == 6 ? atoi(argv[5]) : 1000;
+  // Limits of ORBVocabulary::loadFromBinFile
+  if (k < 2 || k > 20 || L < 1 || L > 10) {
+    cerr << "k must be in [2, 20] and L in [1, 10]" << endl;
+    return 1;
+  }
+
+  vector<string> vstrImages;
+  ifstream f(argv[1]);
+  string s;
+  while (getline(f, s))
+    if (!s.empty())
+      vstrImages.push_back(s);
+  if (vstrImages.empty()) {
+    cerr << "No images in: " << argv[1] << endl;
+    return 1;
+  }
+
+  // Same ORB as Tracking with the settings of the examples, an extractor per
+  // thread
+  cout << "Extracting ORB features of " << vstrImages.size() << " images"
+       << endl;
+  vector<cv::Mat> vDescriptors(vstrImages.size());
+  atomic<size_t> nNextImage(0);
+  vector<thread> vThreads;
+  const int nThreads = max(1u, thread::hardware_concurrency());
+  for (int t = 0; t < nThreads; t++)
+    vThreads.push_back(thread([&]() {
+      ORB_SLAM2::ORBextractor extractor(nFeatures, 1.2f, 8, 20, 7);
+      for (size_t i = nNextImage++; i < vstrImages.size(); i = nNextImage++) {
+        const cv::Mat im = cv::imread(vstrImages[i], CV_LOAD_IMAGE_GRAYSCALE);
+        if (im.empty()) {
+          cerr << "Failed to load image at: " << vstrImages[i] << endl;
+          continue;
+        }
+        vector<cv::KeyPoint> vKeys;
+        extractor(im, cv::Mat(), vKeys, vDescriptors[i]);
+      }
+    }));
+  for (size_t t = 0; t < vThreads.size(); t++)
+    vThreads[t].join();
+
+  ORB_SLAM2::VocabularyTrainer trainer(k, L, nThreads);
+  for (size_t i = 0; i < vDescriptors.size(); i++) {
+    trainer.AddImage(vDescriptors[i]);
+    vDescriptors[i].release();
+  }
+
+  cout << "Training a vocabulary with k=" << k << " and L=" << L << " on "
+       << trainer.Descriptors() << " descriptors of " << trainer.Images()
+       << " images" << endl;
+  trainer.Train();
+
+  if (!trainer.Save(argv[4])) {
+    cerr << "Failed to save the vocabulary to: " << argv[4] << endl;
+    return 1;
+  }
+
+  // The vocabulary is loaded as SLAM loads it
+  ORB_SLAM2::ORBVocabulary vocabulary;
+  if (!vocabulary.loadFromBinFile(argv[4]) ||
+      vocabulary.size() != trainer.Words()) {
+    cerr << "The vocabulary saved to " << argv[4] << " cannot be loaded"
+         << endl;
+    return 1;
+  }
+
+  cout << "Vocabulary of " << vocabulary.size() << " words saved to "
+       << argv[4] << endl;
+  return 0;
+}
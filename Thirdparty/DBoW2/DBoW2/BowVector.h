@@ -11,7 +11,7 @@
 #define __D_T_BOW_VECTOR__
 
 #include <iostream>
-#include <map>
+#include <utility>
 #include <vector>
 
 namespace DBoW2 {
@@ -52,9 +52,9 @@ enum ScoringType
   DOT_PRODUCT,
 };
 
-/// Vector of words to represent images
+/// Vector of words to represent images, sorted by word id
 class BowVector: 
-	public std::map<WordId, WordValue>
+	public std::vector<std::pair<WordId, WordValue> >
 {
 public:
 
@@ -83,6 +83,28 @@ public:
 	 */
 	void addIfNotExist(WordId id, WordValue v);
 
+	/**
+	 * Sorts the words appended with push_back in any order. The values of a
+	 * repeated word are added (as addWeight) or the first one is kept (as
+	 * addIfNotExist)
+	 * @param accumulate true to add the values of a repeated word
+	 */
+	void sortWords(bool accumulate);
+
+	/**
+	 * Returns the first word with id >= the given one
+	 * @param id word id to look for
+	 */
+	iterator lower_bound(WordId id);
+	const_iterator lower_bound(WordId id) const;
+
+	/**
+	 * Returns the word with the given id, or end()
+	 * @param id word id to look for
+	 */
+	iterator find(WordId id);
+	const_iterator find(WordId id) const;
+
 	/**
 	 * L1-Normalizes the values in the vector 
 	 * @param norm_type norm used
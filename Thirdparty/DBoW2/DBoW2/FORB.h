@@ -46,6 +46,15 @@ public:
    */
   static int distance(const TDescriptor &a, const TDescriptor &b);
 
+  /**
+   * Calculates the distance between two descriptors given by their L bytes,
+   * which do not need to be aligned
+   * @param a
+   * @param b
+   * @return distance
+   */
+  static int distance(const unsigned char *a, const unsigned char *b);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
@@ -8,7 +8,7 @@
  */
 
 #include "FeatureVector.h"
-#include <map>
+#include <algorithm>
 #include <vector>
 #include <iostream>
 
@@ -16,7 +16,7 @@ namespace DBoW2 {
 
 // ---------------------------------------------------------------------------
 
-FeatureVector::FeatureVector(void)
+FeatureVector::FeatureVector(void): m_offsets(1, 0)
 {
 }
 
@@ -30,18 +30,81 @@ FeatureVector::~FeatureVector(void)
 
 void FeatureVector::addFeature(NodeId id, unsigned int i_feature)
 {
-  FeatureVector::iterator vit = this->lower_bound(id);
+  const size_t i = std::lower_bound(m_nodes.begin(), m_nodes.end(), id) - 
+    m_nodes.begin();
   
-  if(vit != this->end() && vit->first == id)
+  if(i == m_nodes.size() || m_nodes[i] != id)
   {
-    vit->second.push_back(i_feature);
+    m_nodes.insert(m_nodes.begin() + i, id);
+    m_offsets.insert(m_offsets.begin() + i + 1, m_offsets[i]);
   }
-  else
+
+  m_features.insert(m_features.begin() + m_offsets[i+1], i_feature);
+  for(size_t j = i + 1; j < m_offsets.size(); ++j)
+    ++m_offsets[j];
+}
+
+// ---------------------------------------------------------------------------
+
+static bool lessNodeId(const std::pair<NodeId, unsigned int> &a,
+  const std::pair<NodeId, unsigned int> &b)
+{
+  return a.first < b.first;
+}
+
+void FeatureVector::assign(
+  std::vector<std::pair<NodeId, unsigned int> > &features)
+{
+  std::stable_sort(features.begin(), features.end(), lessNodeId);
+
+  clear();
+  m_features.reserve(features.size());
+  for(size_t i = 0; i < features.size(); ++i)
   {
-    vit = this->insert(vit, FeatureVector::value_type(id, 
-      std::vector<unsigned int>() ));
-    vit->second.push_back(i_feature);
+    if(m_nodes.empty() || m_nodes.back() != features[i].first)
+    {
+      if(!m_nodes.empty()) m_offsets.push_back(m_features.size());
+      m_nodes.push_back(features[i].first);
+    }
+    m_features.push_back(features[i].second);
   }
+  if(!m_nodes.empty()) m_offsets.push_back(m_features.size());
+}
+
+// ---------------------------------------------------------------------------
+
+FeatureVector::const_iterator FeatureVector::lower_bound(NodeId id) const
+{
+  return const_iterator(this, std::lower_bound(m_nodes.begin(), 
+    m_nodes.end(), id) - m_nodes.begin());
+}
+
+// ---------------------------------------------------------------------------
+
+FeatureVector::const_iterator FeatureVector::find(NodeId id) const
+{
+  const size_t i = std::lower_bound(m_nodes.begin(), m_nodes.end(), id) - 
+    m_nodes.begin();
+  return i < m_nodes.size() && m_nodes[i] == id ? const_iterator(this, i) : 
+    end();
+}
+
+// ---------------------------------------------------------------------------
+
+void FeatureVector::clear()
+{
+  m_nodes.clear();
+  m_offsets.assign(1, 0);
+  m_features.clear();
+}
+
+// ---------------------------------------------------------------------------
+
+void FeatureVector::swap(FeatureVector &fv)
+{
+  m_nodes.swap(fv.m_nodes);
+  m_offsets.swap(fv.m_offsets);
+  m_features.swap(fv.m_features);
 }
 
 // ---------------------------------------------------------------------------
@@ -53,25 +116,25 @@ std::ostream& operator<<(std::ostream &out,
   {
     FeatureVector::const_iterator vit = v.begin();
     
-    const std::vector<unsigned int>* f = &vit->second;
+    FeatureVector::Features f = vit->second;
 
     out << "<" << vit->first << ": [";
-    if(!f->empty()) out << (*f)[0];
-    for(unsigned int i = 1; i < f->size(); ++i)
+    if(!f.empty()) out << f[0];
+    for(unsigned int i = 1; i < f.size(); ++i)
     {
-      out << ", " << (*f)[i];
+      out << ", " << f[i];
     }
     out << "]>";
     
     for(++vit; vit != v.end(); ++vit)
     {
-      f = &vit->second;
+      f = vit->second;
       
       out << ", <" << vit->first << ": [";
-      if(!f->empty()) out << (*f)[0];
-      for(unsigned int i = 1; i < f->size(); ++i)
+      if(!f.empty()) out << f[0];
+      for(unsigned int i = 1; i < f.size(); ++i)
       {
-        out << ", " << (*f)[i];
+        out << ", " << f[i];
       }
       out << "]>";
     }
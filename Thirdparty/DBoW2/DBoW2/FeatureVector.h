@@ -11,18 +11,82 @@
 #define __D_T_FEATURE_VECTOR__
 
 #include "BowVector.h"
-#include <map>
+#include <cstddef>
+#include <utility>
 #include <vector>
 #include <iostream>
 
 namespace DBoW2 {
 
-/// Vector of nodes with indexes of local features
-class FeatureVector: 
-  public std::map<NodeId, std::vector<unsigned int> >
+/// Vector of nodes with indexes of local features, sorted by node id. The
+/// indexes of all the nodes are stored in a single buffer (compressed rows).
+class FeatureVector
 {
 public:
 
+  /// Indexes of the features of a node (view into the buffer of the vector)
+  class Features
+  {
+  public:
+    Features(): m_begin(NULL), m_end(NULL) {}
+    Features(const unsigned int *b, const unsigned int *e): 
+      m_begin(b), m_end(e) {}
+
+    inline size_t size() const { return m_end - m_begin; }
+    inline bool empty() const { return m_begin == m_end; }
+    inline const unsigned int& operator[](size_t i) const { return m_begin[i]; }
+    inline const unsigned int* begin() const { return m_begin; }
+    inline const unsigned int* end() const { return m_end; }
+
+    operator std::vector<unsigned int>() const 
+    { 
+      return std::vector<unsigned int>(m_begin, m_end); 
+    }
+
+  protected:
+    const unsigned int *m_begin;
+    const unsigned int *m_end;
+  };
+
+  typedef std::pair<NodeId, Features> value_type;
+
+  /// Iterator over (node id, features) pairs
+  class const_iterator
+  {
+  public:
+    const_iterator(): m_fv(NULL), m_i(0) {}
+    const_iterator(const FeatureVector *fv, size_t i): m_fv(fv), m_i(i) {}
+
+    inline value_type operator*() const { return m_fv->at(m_i); }
+
+    struct pointer
+    {
+      value_type v;
+      inline const value_type* operator->() const { return &v; }
+    };
+    inline pointer operator->() const { pointer p = {m_fv->at(m_i)}; return p; }
+
+    inline const_iterator& operator++() { ++m_i; return *this; }
+    inline const_iterator operator++(int) 
+    { 
+      const_iterator it = *this; ++m_i; return it; 
+    }
+    inline bool operator==(const const_iterator &it) const 
+    { 
+      return m_i == it.m_i && m_fv == it.m_fv; 
+    }
+    inline bool operator!=(const const_iterator &it) const 
+    { 
+      return !(*this == it); 
+    }
+
+  protected:
+    const FeatureVector *m_fv;
+    size_t m_i;
+  };
+
+  typedef const_iterator iterator;
+
   /**
    * Constructor
    */
@@ -41,13 +105,63 @@ public:
    */
   void addFeature(NodeId id, unsigned int i_feature);
 
+  /**
+   * Replaces the content with (node id, feature index) pairs given in any 
+   * order. The features of a node keep their order in the input.
+   * @param features pairs of node id and feature index
+   */
+  void assign(std::vector<std::pair<NodeId, unsigned int> > &features);
+
+  inline const_iterator begin() const { return const_iterator(this, 0); }
+  inline const_iterator end() const 
+  { 
+    return const_iterator(this, m_nodes.size()); 
+  }
+  inline size_t size() const { return m_nodes.size(); }
+  inline bool empty() const { return m_nodes.empty(); }
+
+  /// Node at position i
+  inline value_type at(size_t i) const
+  {
+    return value_type(m_nodes[i], Features(m_features.data() + m_offsets[i],
+      m_features.data() + m_offsets[i+1]));
+  }
+
+  /**
+   * Returns the first node with id >= the given one
+   * @param id node id to look for
+   */
+  const_iterator lower_bound(NodeId id) const;
+
+  /**
+   * Returns the node with the given id, or end()
+   * @param id node id to look for
+   */
+  const_iterator find(NodeId id) const;
+
+  void clear();
+  void swap(FeatureVector &fv);
+
+  /// Node ids, offsets of their features (one more than nodes) and features
+  inline const std::vector<NodeId>& nodes() const { return m_nodes; }
+  inline const std::vector<unsigned int>& offsets() const { return m_offsets; }
+  inline const std::vector<unsigned int>& features() const 
+  { 
+    return m_features; 
+  }
+
   /**
    * Sends a string versions of the feature vector through the stream
    * @param out stream
    * @param v feature vector
    */
   friend std::ostream& operator<<(std::ostream &out, const FeatureVector &v);
-    
+
+protected:
+
+  std::vector<NodeId> m_nodes;
+  std::vector<unsigned int> m_offsets;
+  std::vector<unsigned int> m_features;
 };
 
 } // namespace DBoW2
@@ -18,6 +18,7 @@
 #define __D_T_TEMPLATED_VOCABULARY__
 
 #include <cassert>
+#include <cstring>
 
 #include <vector>
 #include <numeric>
@@ -145,6 +146,19 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features,
     BowVector &v, FeatureVector &fv, int levelsup) const;
 
+  /**
+   * Same as above, from n descriptors of F::L bytes stored in one block,
+   * such as the rows of a descriptor matrix
+   * @param descriptors first descriptor
+   * @param n number of descriptors
+   * @param stride bytes from one descriptor to the next
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  virtual void transform(const unsigned char *descriptors, size_t n,
+    size_t stride, BowVector &v, FeatureVector &fv, int levelsup) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -242,6 +256,15 @@ public:
 
   bool loadFromBinFile(const std::string &filename);
 
+  /**
+   * Loads the vocabulary from the contents of a binary file. The node
+   * descriptors are not copied, they point to the buffer, which must outlive
+   * the vocabulary (e.g. a file mapped by several processes)
+   * @param data contents of the binary file
+   * @param size size of data in bytes
+   */
+  bool loadFromBinBuffer(const unsigned char *data, size_t size);
+
   /**
    * Saves the vocabulary into a text file
    * @param filename
@@ -363,6 +386,32 @@ protected:
    * @param id (out) word id
    */
   virtual void transform(const TDescriptor &feature, WordId &id) const;
+
+  /**
+   * Returns the word id associated to a feature given by its F::L bytes
+   * @param feature
+   * @param id (out) word id
+   * @param weight (out) word weight
+   * @param nid (out) if given, id of the node "levelsup" levels up
+   * @param levelsup
+   */
+  void transform(const unsigned char *feature, 
+    WordId &id, WordValue &weight, NodeId* nid, int levelsup) const;
+
+  /**
+   * Returns the F::L bytes of the descriptor of a node other than the root
+   * @param id node id
+   */
+  inline const unsigned char* nodeDescriptor(NodeId id) const
+  {
+    return m_node_descriptors + (id - 1) * m_descriptor_stride;
+  }
+
+  /**
+   * Copies the descriptors of the nodes to one block, the descriptor of each
+   * node becomes a header on its bytes in the block
+   */
+  void packNodeDescriptors();
       
   /**
    * Creates a level in the tree, under the parent, by running kmeans with
@@ -427,6 +476,14 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Descriptors of the nodes, see nodeDescriptor. They are in
+  /// m_descriptor_block, or in the buffer given to loadFromBinBuffer
+  const unsigned char *m_node_descriptors;
+  /// Bytes from the descriptor of a node to the next one
+  size_t m_descriptor_stride;
+  /// Descriptors of the nodes in node order, without the root
+  std::vector<unsigned char> m_descriptor_block;
   
 };
 
@@ -436,7 +493,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_node_descriptors(NULL), m_descriptor_stride(F::L)
 {
   createScoringObject();
 }
@@ -445,7 +502,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL),
+  m_node_descriptors(NULL), m_descriptor_stride(F::L)
 {
   load(filename);
 }
@@ -454,7 +512,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL),
+  m_node_descriptors(NULL), m_descriptor_stride(F::L)
 {
   load(filename);
 }
@@ -518,7 +577,8 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_node_descriptors(NULL),
+  m_descriptor_stride(F::L)
 {
   *this = voc;
 }
@@ -550,6 +610,7 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   
   this->m_nodes = voc.m_nodes;
   this->createWords();
+  this->packNodeDescriptors();
   
   return *this;
 }
@@ -579,6 +640,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
   
   // create the tree
   HKmeansStep(0, features, 1);
+  packNodeDescriptors();
 
   // create the words
   createWords();
@@ -1091,9 +1153,10 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
       
       transform(*fit, id, w);
       
-      // not stopped
-      if(w > 0) v.addWeight(id, w);
+      // not stopped (words are sorted and merged below)
+      if(w > 0) v.push_back(BowVector::value_type(id, w));
     }
+    v.sortWords(true);
     
     if(!v.empty() && !must)
     {
@@ -1114,10 +1177,11 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
       
       transform(*fit, id, w);
       
-      // not stopped
-      if(w > 0) v.addIfNotExist(id, w);
+      // not stopped (words are sorted and merged below)
+      if(w > 0) v.push_back(BowVector::value_type(id, w));
       
     } // if add_features
+    v.sortWords(false);
   } // if m_weighting == ...
   
   if(must) v.normalize(norm);
@@ -1143,6 +1207,11 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
   bool must = m_scoring_object->mustNormalize(norm);
   
   typename vector<TDescriptor>::const_iterator fit;
+
+  // words and nodes are appended in feature order, then sorted
+  std::vector<std::pair<NodeId, unsigned int> > node_features;
+  node_features.reserve(features.size());
+  v.reserve(features.size());
   
   if(m_weighting == TF || m_weighting == TF_IDF)
   {
@@ -1158,10 +1227,11 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
       
       if(w > 0) // not stopped
       { 
-        v.addWeight(id, w);
-        fv.addFeature(nid, i_feature);
+        v.push_back(BowVector::value_type(id, w));
+        node_features.push_back(std::make_pair(nid, i_feature));
       }
     }
+    v.sortWords(true);
     
     if(!v.empty() && !must)
     {
@@ -1186,11 +1256,76 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
       
       if(w > 0) // not stopped
       {
-        v.addIfNotExist(id, w);
-        fv.addFeature(nid, i_feature);
+        v.push_back(BowVector::value_type(id, w));
+        node_features.push_back(std::make_pair(nid, i_feature));
       }
     }
+    v.sortWords(false);
   } // if m_weighting == ...
+
+  fv.assign(node_features);
+  
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const unsigned char *descriptors, size_t n, size_t stride,
+  BowVector &v, FeatureVector &fv, int levelsup) const
+{
+  v.clear();
+  fv.clear();
+  
+  if(empty()) // safe for subclasses
+  {
+    return;
+  }
+  
+  // normalize 
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+
+  // words and nodes are appended in feature order, then sorted
+  std::vector<std::pair<NodeId, unsigned int> > node_features;
+  node_features.reserve(n);
+  v.reserve(n);
+
+  for(unsigned int i_feature = 0; i_feature < n; ++i_feature)
+  {
+    WordId id;
+    NodeId nid;
+    WordValue w;
+    // w is the idf value if TF_IDF, 1 if TF, idf if IDF, or 1 if BINARY
+
+    transform(descriptors + i_feature * stride, id, w, &nid, levelsup);
+
+    if(w > 0) // not stopped
+    {
+      v.push_back(BowVector::value_type(id, w));
+      node_features.push_back(std::make_pair(nid, i_feature));
+    }
+  }
+  
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    v.sortWords(true);
+    
+    if(!v.empty() && !must)
+    {
+      // unnecessary when normalizing
+      const double nd = v.size();
+      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
+        vit->second /= nd;
+    }
+  }
+  else // IDF || BINARY
+  {
+    v.sortWords(false);
+  }
+
+  fv.assign(node_features);
   
   if(must) v.normalize(norm);
 }
@@ -1221,7 +1356,6 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
 { 
   // propagate the feature down the tree
-  vector<NodeId> nodes;
   typename vector<NodeId>::const_iterator nit;
 
   // level at which the node must be stored in nid, if given
@@ -1234,7 +1368,7 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   do
   {
     ++current_level;
-    nodes = m_nodes[final_id].children;
+    const vector<NodeId> &nodes = m_nodes[final_id].children;
     final_id = nodes[0];
  
     double best_d = F::distance(feature, m_nodes[final_id].descriptor);
@@ -1262,6 +1396,74 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::transform(const unsigned char *feature,
+  WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
+{ 
+  // propagate the feature down the tree, comparing it to the packed
+  // descriptors of the children
+  typename vector<NodeId>::const_iterator nit;
+
+  // level at which the node must be stored in nid, if given
+  const int nid_level = m_L - levelsup;
+  if(nid_level <= 0 && nid != NULL) *nid = 0; // root
+
+  NodeId final_id = 0; // root
+  int current_level = 0;
+
+  do
+  {
+    ++current_level;
+    const vector<NodeId> &nodes = m_nodes[final_id].children;
+    final_id = nodes[0];
+ 
+    int best_d = F::distance(feature, nodeDescriptor(final_id));
+
+    for(nit = nodes.begin() + 1; nit != nodes.end(); ++nit)
+    {
+      NodeId id = *nit;
+      int d = F::distance(feature, nodeDescriptor(id));
+      if(d < best_d)
+      {
+        best_d = d;
+        final_id = id;
+      }
+    }
+    
+    if(nid != NULL && current_level == nid_level)
+      *nid = final_id;
+    
+  } while( !m_nodes[final_id].isLeaf() );
+
+  // turn node id into word id
+  word_id = m_nodes[final_id].word_id;
+  weight = m_nodes[final_id].weight;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::packNodeDescriptors()
+{
+  std::vector<unsigned char> block(m_nodes.empty() ? 0 :
+    (m_nodes.size() - 1) * F::L);
+
+  for(size_t i = 1; i < m_nodes.size(); ++i)
+  {
+    unsigned char *p = &block[(i - 1) * F::L];
+    if(!m_nodes[i].descriptor.empty())
+      memcpy(p, m_nodes[i].descriptor.data, F::L);
+    m_nodes[i].descriptor = cv::Mat(1, F::L, CV_8U, p);
+  }
+
+  m_descriptor_block.swap(block);
+  m_node_descriptors = m_descriptor_block.empty() ? NULL :
+    &m_descriptor_block[0];
+  m_descriptor_stride = F::L;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
@@ -1334,6 +1536,85 @@ int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
   return c;
 }
 
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinBuffer(
+  const unsigned char *data, size_t size)
+{
+  // Same layout as loadFromBinFile: header of 4 ints, then for every node
+  // parent id, leaf flag, descriptor and weight
+  const size_t header = 4 * sizeof(int);
+  const size_t record = sizeof(int) + 1 + F::L + sizeof(WordValue);
+  if(size < header) return false;
+
+  m_words.clear();
+  m_nodes.clear();
+
+  int n1, n2;
+  memcpy(&m_k, data, sizeof(int));
+  memcpy(&m_L, data + sizeof(int), sizeof(int));
+  memcpy(&n1, data + 2 * sizeof(int), sizeof(int));
+  memcpy(&n2, data + 3 * sizeof(int), sizeof(int));
+
+  if(m_k<0 || m_k>20 || m_L<1 || m_L>10 || n1<0 || n1>5 || n2<0 || n2>3)
+  {
+    std::cerr << "Vocabulary loading failure: This is not a correct Binary file!" << endl;
+    return false;
+  }
+
+  m_scoring = (ScoringType)n1;
+  m_weighting = (WeightingType)n2;
+  createScoringObject();
+
+  int expected_nodes =
+    (int)((pow((double)m_k, (double)m_L + 1) - 1)/(m_k - 1));
+  m_nodes.reserve(expected_nodes);
+  m_words.reserve(pow((double)m_k, (double)m_L + 1));
+  m_nodes.resize(1);
+  m_nodes[0].id = 0;
+
+  // The descriptors are not copied, node 1 is the first record
+  m_descriptor_block.clear();
+  m_node_descriptors = data + header + sizeof(int) + 1;
+  m_descriptor_stride = record;
+
+  for(size_t pos = header; pos + record <= size &&
+    m_nodes.size() < (unsigned int)expected_nodes; pos += record)
+  {
+    const unsigned char *p = data + pos;
+    int nid = m_nodes.size();
+    m_nodes.resize(m_nodes.size()+1);
+    m_nodes[nid].id = nid;
+
+    int pid;
+    memcpy(&pid, p, sizeof(pid));
+    if(pid < 0 || pid >= nid) return false;
+    m_nodes[nid].parent = pid;
+    m_nodes[pid].children.push_back(nid);
+
+    const int nIsLeaf = p[sizeof(int)];
+    // Header only, the descriptor stays in the buffer
+    m_nodes[nid].descriptor =
+      cv::Mat(1, F::L, CV_8U, (void*)(p + sizeof(int) + 1));
+    memcpy(&m_nodes[nid].weight, p + sizeof(int) + 1 + F::L,
+      sizeof(m_nodes[nid].weight));
+
+    if(nIsLeaf>0)
+    {
+      int wid = m_words.size();
+      m_words.resize(wid+1);
+      m_nodes[nid].word_id = wid;
+      m_words[wid] = &m_nodes[nid];
+    }
+    else
+    {
+      m_nodes[nid].children.reserve(m_k);
+    }
+  }
+  return true;
+}
+
 // --------------------------------------------------------------------------
     template<class TDescriptor, class F>
     bool TemplatedVocabulary<TDescriptor,F>::loadFromBinFile(const std::string &filename)
@@ -1374,11 +1655,13 @@ int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
       // while(!f.eof())
       while((!f.eof()) && ( m_nodes.size()<(unsigned int)expected_nodes) )
       {
+        int pid ;
+        f.read((char*)&pid,sizeof(pid));
+        // end of a tree with less nodes than k^L leaves
+        if(!f) break;
         int nid = m_nodes.size();
         m_nodes.resize(m_nodes.size()+1);
         m_nodes[nid].id = nid;
-        int pid ;
-        f.read((char*)&pid,sizeof(pid));
         m_nodes[nid].parent = pid;
         m_nodes[pid].children.push_back(nid);
         int nIsLeaf;
@@ -1404,6 +1687,7 @@ int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
         delete[] array;
       }
       f.close();
+      packNodeDescriptors();
       return true;
 
     }
@@ -1494,6 +1778,7 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    packNodeDescriptors();
     return true;
 
 }
@@ -1694,6 +1979,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  packNodeDescriptors();
 }
 
 // --------------------------------------------------------------------------
@@ -173,6 +173,9 @@ namespace g2o {
 
       int _numPoses, _numLandmarks;
       int _sizePoses, _sizeLandmarks;
+
+      //! block layout and blocks of the edges the Hessian was last built for
+      std::vector<int> _structure;
   };
 
 
@@ -168,7 +168,37 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
     }
     sparseDim += dim;
   }
-  resize(blockPoseIndices, _numPoses, blockLandmarkIndices, _numLandmarks, sparseDim);
+
+  // The Hessian blocks and the symbolic decomposition of the linear solver are
+  // kept while the structure repeats, i.e. between the calls of optimize() on
+  // the same graph or on a graph built again the same way
+  std::vector<int> structure;
+  structure.reserve(_structure.size());
+  structure.push_back(_doSchur);
+  structure.insert(structure.end(), blockPoseIndices, blockPoseIndices + _numPoses);
+  structure.push_back(-1);
+  structure.insert(structure.end(), blockLandmarkIndices, blockLandmarkIndices + _numLandmarks);
+  for (SparseOptimizer::EdgeContainer::const_iterator it=_optimizer->activeEdges().begin(); it!=_optimizer->activeEdges().end(); ++it){
+    const OptimizableGraph::Edge* e = *it;
+    for (size_t viIdx = 0; viIdx < e->vertices().size(); ++viIdx) {
+      int ind1 = static_cast<const OptimizableGraph::Vertex*>(e->vertex(viIdx))->hessianIndex();
+      if (ind1 == -1)
+        continue;
+      for (size_t vjIdx = viIdx + 1; vjIdx < e->vertices().size(); ++vjIdx) {
+        int ind2 = static_cast<const OptimizableGraph::Vertex*>(e->vertex(vjIdx))->hessianIndex();
+        if (ind2 == -1)
+          continue;
+        structure.push_back(ind1);
+        structure.push_back(ind2);
+      }
+    }
+  }
+  const bool sameStructure = _Hpp && structure == _structure;
+  if (! sameStructure) {
+    resize(blockPoseIndices, _numPoses, blockLandmarkIndices, _numLandmarks, sparseDim);
+    _linearSolver->init();
+    _structure.swap(structure);
+  }
   delete[] blockLandmarkIndices;
   delete[] blockPoseIndices;
 
@@ -196,7 +226,7 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
 
   // temporary structures for building the pattern of the Schur complement
   SparseBlockMatrixHashMap<PoseMatrixType>* schurMatrixLookup = 0;
-  if (_doSchur) {
+  if (_doSchur && ! sameStructure) {
     schurMatrixLookup = new SparseBlockMatrixHashMap<PoseMatrixType>(_Hschur->rowBlockIndices(), _Hschur->colBlockIndices());
     schurMatrixLookup->blockCols().resize(_Hschur->blockCols().size());
   }
@@ -227,7 +257,7 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
           if (zeroBlocks)
             m->setZero();
           e->mapHessianMemory(m->data(), viIdx, vjIdx, transposedBlock);
-          if (_Hschur) {// assume this is only needed in case we solve with the schur complement
+          if (schurMatrixLookup) {// assume this is only needed in case we solve with the schur complement
             schurMatrixLookup->addBlock(ind1, ind2);
           }
         } else if (v1->marginalized() && v2->marginalized()){
@@ -253,7 +283,7 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
     }
   }
 
-  if (! _doSchur)
+  if (! _doSchur || sameStructure)
     return true;
 
   _DInvSchur->diagonal().resize(landmarkIdx);
@@ -262,14 +292,14 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
   for (size_t i = 0; i < _optimizer->indexMapping().size(); ++i) {
     OptimizableGraph::Vertex* v = _optimizer->indexMapping()[i];
     if (v->marginalized()){
-      const HyperGraph::EdgeSet& vedges=v->edges();
-      for (HyperGraph::EdgeSet::const_iterator it1=vedges.begin(); it1!=vedges.end(); ++it1){
+      const HyperGraph::EdgeList& vedges=v->edges();
+      for (HyperGraph::EdgeList::const_iterator it1=vedges.begin(); it1!=vedges.end(); ++it1){
         for (size_t i=0; i<(*it1)->vertices().size(); ++i)
         {
           OptimizableGraph::Vertex* v1= (OptimizableGraph::Vertex*) (*it1)->vertex(i);
           if (v1->hessianIndex()==-1 || v1==v)
             continue;
-          for  (HyperGraph::EdgeSet::const_iterator it2=vedges.begin(); it2!=vedges.end(); ++it2){
+          for  (HyperGraph::EdgeList::const_iterator it2=vedges.begin(); it2!=vedges.end(); ++it2){
             for (size_t j=0; j<(*it2)->vertices().size(); ++j)
             {
               OptimizableGraph::Vertex* v2= (OptimizableGraph::Vertex*) (*it2)->vertex(j);
@@ -297,6 +327,8 @@ bool BlockSolver<Traits>::buildStructure(bool zeroBlocks)
 template <typename Traits>
 bool BlockSolver<Traits>::updateStructure(const std::vector<HyperGraph::Vertex*>& vset, const HyperGraph::EdgeSet& edges)
 {
+  // blocks added to the last structure
+  _structure.clear();
   for (std::vector<HyperGraph::Vertex*>::const_iterator vit = vset.begin(); vit != vset.end(); ++vit) {
     OptimizableGraph::Vertex* v = static_cast<OptimizableGraph::Vertex*>(*vit);
     int dim = v->dimension();
@@ -516,6 +548,9 @@ bool BlockSolver<Traits>::buildSystem()
     _Hpl->clear();
   }
 
+  // Jacobians of the edges evaluated in batches, read by their linearizeOplus()
+  _optimizer->linearizeEdgeBatches();
+
   // resetting the terms for the pairwise constraints
   // built up the current system by storing the Hessian blocks in the edges and vertices
 # ifndef G2O_OPENMP
@@ -615,7 +650,9 @@ bool BlockSolver<Traits>::init(SparseOptimizer* optimizer, bool online)
     if (_Hll)
       _Hll->clear();
   }
-  _linearSolver->init();
+  // otherwise by buildStructure() if the structure changed
+  if (online)
+    _linearSolver->init();
   return true;
 }
 
@@ -0,0 +1,62 @@
+// g2o - General Graph Optimization
+// Copyright (C) 2011 R. Kuemmerle, G. Grisetti, W. Burgard
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+// TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef G2O_EDGE_BATCH_H
+#define G2O_EDGE_BATCH_H
+
+#include "optimizable_graph.h"
+
+namespace g2o {
+
+  /**
+   * \brief edges evaluated together instead of one at a time
+   *
+   * The edges of a batch are flagged with OptimizableGraph::Edge::setBatch().
+   * Once the batch is added to the SparseOptimizer (addEdgeBatch()),
+   * computeActiveErrors() calls computeErrors() in place of their
+   * computeError(), and the solver calls linearizeOplus() before linearizing
+   * the edges, which then read their Jacobians from the batch. Calling
+   * computeError() on an edge still evaluates it alone.
+   *
+   * Only the active edges of the optimizer are evaluated. The optimizer calls
+   * setActiveEdges() whenever they change (initializeOptimization(),
+   * updateInitialization(), addEdgeBatch()), so the edges of another level,
+   * or moved out of the optimized one by setLevel(), are left alone.
+   */
+  class EdgeBatch {
+    public:
+      virtual ~EdgeBatch() {}
+      //! computes and stores the errors of the edges of the batch
+      virtual void computeErrors() = 0;
+      //! computes the Jacobians of the edges of the batch
+      virtual void linearizeOplus() = 0;
+      //! restricts the batch to its edges in activeEdges
+      virtual void setActiveEdges(const OptimizableGraph::EdgeContainer& activeEdges) = 0;
+  };
+
+} // end namespace
+
+#endif
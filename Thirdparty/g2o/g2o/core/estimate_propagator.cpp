@@ -125,7 +125,7 @@ namespace g2o {
       }
 
       /* std::pair< OptimizableGraph::VertexSet::iterator, bool> insertResult = */ _visited.insert(u);
-      OptimizableGraph::EdgeSet::iterator et = u->edges().begin();
+      OptimizableGraph::EdgeList::iterator et = u->edges().begin();
       while (et != u->edges().end()){
         OptimizableGraph::Edge* edge = static_cast<OptimizableGraph::Edge*>(*et);
         ++et;
@@ -113,7 +113,7 @@ namespace g2o{
       double uDistance=ut->second.distance();
 
       std::pair< HyperGraph::VertexSet::iterator, bool> insertResult=_visited.insert(u); (void) insertResult;
-      HyperGraph::EdgeSet::iterator et=u->edges().begin();
+      HyperGraph::EdgeList::iterator et=u->edges().begin();
       while (et != u->edges().end()){
         HyperGraph::Edge* edge=*et;
         ++et;
@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include <queue>
+#include <algorithm>
 
 namespace g2o {
 
@@ -39,7 +40,7 @@ namespace g2o {
   {
   }
 
-  HyperGraph::Edge::Edge(int id) : _id(id)
+  HyperGraph::Edge::Edge(int id) : _id(id), _graphIndex(-1)
   {
   }
 
@@ -57,6 +58,62 @@ namespace g2o {
     _id = id;
   }
 
+  std::pair<HyperGraph::VertexIDMap::iterator, bool> HyperGraph::VertexIDMap::insert(const value_type& element)
+  {
+    int id = element.first;
+    if (id < 0)
+      return std::make_pair(end(), false);
+    if (position(id) >= 0)
+      return std::make_pair(_elements.begin() + position(id), false);
+    slot(id) = _elements.size();
+    _elements.push_back(element);
+    return std::make_pair(_elements.end() - 1, true);
+  }
+
+  size_t HyperGraph::VertexIDMap::erase(int id)
+  {
+    iterator it = find(id);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+
+  void HyperGraph::VertexIDMap::erase(iterator it)
+  {
+    slot(it->first) = -1;
+    if (it != _elements.end() - 1) {
+      *it = _elements.back();
+      slot(it->first) = it - _elements.begin();
+    }
+    _elements.pop_back();
+  }
+
+  void HyperGraph::VertexIDMap::clear()
+  {
+    _elements.clear();
+    _blocks.clear();
+    _pages.clear();
+    _positions.clear();
+  }
+
+  int& HyperGraph::VertexIDMap::slot(int id)
+  {
+    const int block = id >> (PageBits + BlockBits);
+    if (block >= static_cast<int>(_blocks.size()))
+      _blocks.resize(block + 1, -1);
+    if (_blocks[block] < 0) {
+      _blocks[block] = _pages.size();
+      _pages.resize(_pages.size() + BlockSize, -1);
+    }
+    int& page = _pages[_blocks[block] + ((id >> PageBits) & (BlockSize - 1))];
+    if (page < 0) {
+      page = _positions.size();
+      _positions.resize(_positions.size() + PageSize, -1);
+    }
+    return _positions[page + (id & (PageSize - 1))];
+  }
+
   HyperGraph::Vertex* HyperGraph::vertex(int id)
   {
     VertexIDMap::iterator it=_vertices.find(id);
@@ -75,11 +132,7 @@ namespace g2o {
 
   bool HyperGraph::addVertex(Vertex* v)
   {
-    Vertex* vn=vertex(v->id());
-    if (vn)
-      return false;
-    _vertices.insert( std::make_pair(v->id(),v) );
-    return true;
+    return _vertices.insert( std::make_pair(v->id(),v) ).second;
   }
 
   /**
@@ -90,20 +143,24 @@ namespace g2o {
     Vertex* v2 = vertex(v->id());
     if (v != v2)
       return false;
+    if (vertex(newId))
+      return false;
     _vertices.erase(v->id());
     v->setId(newId);
-    _vertices.insert(std::make_pair(v->id(), v));
-    return true;
+    return _vertices.insert(std::make_pair(v->id(), v)).second;
   }
 
   bool HyperGraph::addEdge(Edge* e)
   {
-    std::pair<EdgeSet::iterator, bool> result = _edges.insert(e);
-    if (! result.second)
+    if (e->_graphIndex >= 0 && e->_graphIndex < static_cast<int>(_edges.size()) && _edges[e->_graphIndex] == e)
       return false;
+    e->_graphIndex = _edges.size();
+    _edges.push_back(e);
     for (std::vector<Vertex*>::iterator it = e->vertices().begin(); it != e->vertices().end(); ++it) {
       Vertex* v = *it;
-      v->edges().insert(e);
+      // an edge connecting the same vertex twice is listed once
+      if (std::find(e->vertices().begin(), it, v) == it)
+        v->edges().push_back(e);
     }
     return true;
   }
@@ -115,8 +172,8 @@ namespace g2o {
       return false;
     assert(it->second==v);
     //remove all edges which are entering or leaving v;
-    EdgeSet tmp(v->edges());
-    for (EdgeSet::iterator it=tmp.begin(); it!=tmp.end(); ++it){
+    EdgeList tmp(v->edges());
+    for (EdgeList::iterator it=tmp.begin(); it!=tmp.end(); ++it){
       if (!removeEdge(*it)){
         assert(0);
       }
@@ -128,16 +185,21 @@ namespace g2o {
 
   bool HyperGraph::removeEdge(Edge* e)
   {
-    EdgeSet::iterator it = _edges.find(e);
-    if (it == _edges.end())
+    if (e->_graphIndex < 0 || e->_graphIndex >= static_cast<int>(_edges.size()) || _edges[e->_graphIndex] != e)
       return false;
-    _edges.erase(it);
+    // the last edge takes its place
+    _edges[e->_graphIndex] = _edges.back();
+    _edges[e->_graphIndex]->_graphIndex = e->_graphIndex;
+    _edges.pop_back();
+    e->_graphIndex = -1;
 
     for (std::vector<Vertex*>::iterator vit = e->vertices().begin(); vit != e->vertices().end(); ++vit) {
       Vertex* v = *vit;
-      it = v->edges().find(e);
-      assert(it!=v->edges().end());
-      v->edges().erase(it);
+      EdgeList::iterator it = std::find(v->edges().begin(), v->edges().end(), e);
+      if (it == v->edges().end())
+        continue; // vertex connected twice, already removed
+      *it = v->edges().back();
+      v->edges().pop_back();
     }
 
     delete e;
@@ -152,12 +214,22 @@ namespace g2o {
   {
     for (VertexIDMap::iterator it=_vertices.begin(); it!=_vertices.end(); ++it)
       delete (it->second);
-    for (EdgeSet::iterator it=_edges.begin(); it!=_edges.end(); ++it)
+    for (EdgeList::iterator it=_edges.begin(); it!=_edges.end(); ++it)
       delete (*it);
     _vertices.clear();
     _edges.clear();
   }
 
+  void HyperGraph::release()
+  {
+    for (VertexIDMap::iterator it=_vertices.begin(); it!=_vertices.end(); ++it)
+      it->second->edges().clear();
+    for (EdgeList::iterator it=_edges.begin(); it!=_edges.end(); ++it)
+      (*it)->_graphIndex = -1;
+    _vertices.clear();
+    _edges.clear();
+  }
+
   HyperGraph::~HyperGraph()
   {
     clear();
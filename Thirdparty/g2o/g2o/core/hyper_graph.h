@@ -34,12 +34,7 @@
 #include <vector>
 #include <limits>
 #include <cstddef>
-
-#ifdef _MSC_VER
-#include <unordered_map>
-#else
-#include <tr1/unordered_map>
-#endif
+#include <utility>
 
 
 /** @addtogroup graph */
@@ -90,8 +85,68 @@ namespace g2o {
       typedef std::set<Edge*>                           EdgeSet;
       typedef std::set<Vertex*>                         VertexSet;
 
-      typedef std::tr1::unordered_map<int, Vertex*>     VertexIDMap;
       typedef std::vector<Vertex*>                      VertexContainer;
+      typedef std::vector<Edge*>                        EdgeList;
+
+      /**
+       * map <i>id -> vertex</i> of the graph. The vertices are stored in a
+       * compact array, iterated in insertion order, and found by id, which
+       * must not be negative, through a two-level table of pages of positions.
+       * Only the blocks and pages of the ids in use are allocated, so that
+       * clusters of ids far apart (keyframes and offset map points) stay small.
+       */
+      class  VertexIDMap {
+        public:
+          typedef std::pair<int, Vertex*>                       value_type;
+          typedef std::vector<value_type>::iterator             iterator;
+          typedef std::vector<value_type>::const_iterator       const_iterator;
+
+          iterator begin() { return _elements.begin();}
+          iterator end() { return _elements.end();}
+          const_iterator begin() const { return _elements.begin();}
+          const_iterator end() const { return _elements.end();}
+
+          size_t size() const { return _elements.size();}
+          bool empty() const { return _elements.empty();}
+
+          //! returns the element with the given id, or end() if not present
+          iterator find(int id) { return position(id) < 0 ? end() : _elements.begin() + position(id);}
+          //! returns the element with the given id, or end() if not present
+          const_iterator find(int id) const { return position(id) < 0 ? end() : _elements.begin() + position(id);}
+
+          /**
+           * inserts the element, it fails if its id is negative or already present.
+           * @returns the element with that id and true on success
+           */
+          std::pair<iterator, bool> insert(const value_type& element);
+          //! removes the element, the last one takes its place. Returns the number of removed elements
+          size_t erase(int id);
+          //! removes the element, the last one takes its place
+          void erase(iterator it);
+          //! removes all the elements and pages, the memory is kept for the next ones
+          void clear();
+
+        protected:
+          static const int PageBits = 6; ///< ids per page
+          static const int BlockBits = 10; ///< pages per block
+          static const int PageSize = 1 << PageBits;
+          static const int BlockSize = 1 << BlockBits;
+
+          int position(int id) const {
+            const int block = id >> (PageBits + BlockBits);
+            if (id < 0 || block >= static_cast<int>(_blocks.size()) || _blocks[block] < 0)
+              return -1;
+            const int page = _pages[_blocks[block] + ((id >> PageBits) & (BlockSize - 1))];
+            return page < 0 ? -1 : _positions[page + (id & (PageSize - 1))];
+          }
+          //! position of a non negative id, its block and page are allocated if needed
+          int& slot(int id);
+
+          std::vector<value_type> _elements;
+          std::vector<int> _blocks; ///< offset in _pages of each block of pages, -1 if not allocated
+          std::vector<int> _pages; ///< offset in _positions of each page of ids, -1 if not allocated
+          std::vector<int> _positions; ///< index in _elements of each id, -1 if not present
+      };
 
       //! abstract Vertex, your types must derive from that one
       class  Vertex : public HyperGraphElement {
@@ -102,14 +157,14 @@ namespace g2o {
           //! returns the id
           int id() const {return _id;}
 	  virtual void setId( int newId) { _id=newId; }
-          //! returns the set of hyper-edges that are leaving/entering in this vertex
-          const EdgeSet& edges() const {return _edges;}
-          //! returns the set of hyper-edges that are leaving/entering in this vertex
-          EdgeSet& edges() {return _edges;}
+          //! returns the hyper-edges that are leaving/entering in this vertex, each once
+          const EdgeList& edges() const {return _edges;}
+          //! returns the hyper-edges that are leaving/entering in this vertex, each once
+          EdgeList& edges() {return _edges;}
           virtual HyperGraphElementType elementType() const { return HGET_VERTEX;}
         protected:
           int _id;
-          EdgeSet _edges;
+          EdgeList _edges;
       };
 
       /** 
@@ -153,6 +208,9 @@ namespace g2o {
         protected:
           VertexContainer _vertices;
           int _id; ///< unique id
+        private:
+          friend class HyperGraph;
+          int _graphIndex; ///< index in the edges of the graph, -1 if not in a graph
       };
 
     public:
@@ -172,16 +230,22 @@ namespace g2o {
       virtual bool removeEdge(Edge* e);
       //! clears the graph and empties all structures.
       virtual void clear();
+      /**
+       * empties the graph like clear(), but without deleting the vertices and
+       * the edges. Their ownership goes back to the caller, who can add them
+       * again to this graph.
+       */
+      virtual void release();
 
       //! @returns the map <i>id -> vertex</i> where the vertices are stored
       const VertexIDMap& vertices() const {return _vertices;}
       //! @returns the map <i>id -> vertex</i> where the vertices are stored
       VertexIDMap& vertices() {return _vertices;}
 
-      //! @returns the set of edges of the hyper graph
-      const EdgeSet& edges() const {return _edges;}
-      //! @returns the set of edges of the hyper graph
-      EdgeSet& edges() {return _edges;}
+      //! @returns the edges of the hyper graph
+      const EdgeList& edges() const {return _edges;}
+      //! @returns the edges of the hyper graph
+      EdgeList& edges() {return _edges;}
 
       /**
        * adds a vertex to the graph. The id of the vertex should be set before
@@ -205,7 +269,7 @@ namespace g2o {
 
     protected:
       VertexIDMap _vertices;
-      EdgeSet _edges;
+      EdgeList _edges;
 
     private:
       // Disable the copy constructor and assignment operator
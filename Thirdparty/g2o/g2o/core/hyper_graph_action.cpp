@@ -258,7 +258,7 @@ namespace g2o {
         (*action)(it->second, params);
       }
     }
-    for (HyperGraph::EdgeSet::iterator it=graph->edges().begin(); 
+    for (HyperGraph::EdgeList::iterator it=graph->edges().begin(); 
         it!=graph->edges().end(); ++it){
       if ( typeName.empty() || typeid(**it).name()==typeName)
         (*action)(*it, params);
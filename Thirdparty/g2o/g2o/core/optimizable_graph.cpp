@@ -131,7 +131,7 @@ namespace g2o {
 
   OptimizableGraph::Edge::Edge() :
     HyperGraph::Edge(),
-    _dimension(-1), _level(0), _robustKernel(0)
+    _dimension(-1), _level(0), _robustKernel(0), _batch(0), _batchIndex(-1)
   {
   }
 
@@ -289,7 +289,7 @@ namespace g2o {
 double OptimizableGraph::chi2() const
 {
   double chi = 0.0;
-  for (OptimizableGraph::EdgeSet::const_iterator it = this->edges().begin(); it != this->edges().end(); ++it) {
+  for (OptimizableGraph::EdgeList::const_iterator it = this->edges().begin(); it != this->edges().end(); ++it) {
     const OptimizableGraph::Edge* e = static_cast<const OptimizableGraph::Edge*>(*it);
     chi += e->chi2();
   }
@@ -591,7 +591,7 @@ bool OptimizableGraph::save(ostream& os, int level) const
   if (! _parameters.write(os))
     return false;
   set<Vertex*, VertexIDCompare> verticesToSave;
-  for (HyperGraph::EdgeSet::const_iterator it = edges().begin(); it != edges().end(); ++it) {
+  for (HyperGraph::EdgeList::const_iterator it = edges().begin(); it != edges().end(); ++it) {
     OptimizableGraph::Edge* e = static_cast<OptimizableGraph::Edge*>(*it);
     if (e->level() == level) {
       for (vector<HyperGraph::Vertex*>::const_iterator it = e->vertices().begin(); it != e->vertices().end(); ++it) {
@@ -606,7 +606,7 @@ bool OptimizableGraph::save(ostream& os, int level) const
   }
 
   EdgeContainer edgesToSave;
-  for (HyperGraph::EdgeSet::const_iterator it = edges().begin(); it != edges().end(); ++it) {
+  for (HyperGraph::EdgeList::const_iterator it = edges().begin(); it != edges().end(); ++it) {
     const OptimizableGraph::Edge* e = dynamic_cast<const OptimizableGraph::Edge*>(*it);
     if (e->level() == level)
       edgesToSave.push_back(const_cast<Edge*>(e));
@@ -631,7 +631,7 @@ bool OptimizableGraph::saveSubset(ostream& os, HyperGraph::VertexSet& vset, int
     OptimizableGraph::Vertex* v = dynamic_cast<OptimizableGraph::Vertex*>(*it);
     saveVertex(os, v);
   }
-  for (HyperGraph::EdgeSet::const_iterator it = edges().begin(); it != edges().end(); ++it) {
+  for (HyperGraph::EdgeList::const_iterator it = edges().begin(); it != edges().end(); ++it) {
     OptimizableGraph::Edge* e = dynamic_cast< OptimizableGraph::Edge*>(*it);
     if (e->level() != level)
       continue;
@@ -688,7 +688,7 @@ void OptimizableGraph::addGraph(OptimizableGraph* g){
     v2->setHessianIndex(-1);
     addVertex(v2);
   }
-  for (HyperGraph::EdgeSet::iterator it=g->edges().begin(); it!=g->edges().end(); ++it){
+  for (HyperGraph::EdgeList::iterator it=g->edges().begin(); it!=g->edges().end(); ++it){
     OptimizableGraph::Edge* e = (OptimizableGraph::Edge*)(*it);
     OptimizableGraph::Edge* en = e->clone();
     en->resize(e->vertices().size());
@@ -868,7 +868,7 @@ bool OptimizableGraph::verifyInformationMatrices(bool verbose) const
 {
   bool allEdgeOk = true;
   SelfAdjointEigenSolver<MatrixXd> eigenSolver;
-  for (OptimizableGraph::EdgeSet::const_iterator it = edges().begin(); it != edges().end(); ++it) {
+  for (OptimizableGraph::EdgeList::const_iterator it = edges().begin(); it != edges().end(); ++it) {
     OptimizableGraph::Edge* e = static_cast<OptimizableGraph::Edge*>(*it);
     Eigen::MatrixXd::MapType information(e->informationData(), e->dimension(), e->dimension());
     // test on symmetry
@@ -49,6 +49,7 @@ namespace g2o {
   class Cache;
   class CacheContainer;
   class RobustKernel;
+  class EdgeBatch;
 
   /**
      @addtogroup g2o
@@ -471,6 +472,13 @@ namespace g2o {
         //! returns the dimensions of the error function
         int dimension() const { return _dimension;}
 
+        //! returns the batch evaluating the edge, 0 if it is evaluated alone
+        EdgeBatch* batch() const { return _batch;}
+        //! returns the index of the edge in its batch
+        int batchIndex() const { return _batchIndex;}
+        //! sets the batch evaluating the edge, see EdgeBatch
+        void setBatch(EdgeBatch* batch, int index) { _batch = batch; _batchIndex = index;}
+
         virtual Vertex* createFrom() {return 0;}
         virtual Vertex* createTo()   {return 0;}
 
@@ -498,6 +506,8 @@ namespace g2o {
         int _level;
         RobustKernel* _robustKernel;
         long long _internalId;
+        EdgeBatch* _batch;
+        int _batchIndex;
 
         std::vector<int> _cacheIds;
 
@@ -37,6 +37,7 @@
 #include "optimization_algorithm.h"
 #include "batch_stats.h"
 #include "hyper_graph_action.h"
+#include "edge_batch.h"
 #include "robust_kernel.h"
 #include "../stuff/timeutil.h"
 #include "../stuff/macros.h"
@@ -67,11 +68,18 @@ namespace g2o{
         (*(*it))(this);
     }
 
+    // the edges of the batches are evaluated by them
+    for (size_t i = 0; i < _edgeBatches.size(); ++i)
+      _edgeBatches[i]->computeErrors();
+    const bool batched = !_edgeBatches.empty();
+
 #   ifdef G2O_OPENMP
 #   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
 #   endif
     for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
       OptimizableGraph::Edge* e = _activeEdges[k];
+      if (batched && e->batch())
+        continue;
       e->computeError();
     }
 
@@ -153,7 +161,7 @@ namespace g2o{
           return false;
         }
         // test for full dimension prior
-        for (HyperGraph::EdgeSet::const_iterator eit = v->edges().begin(); eit != v->edges().end(); ++eit) {
+        for (HyperGraph::EdgeList::const_iterator eit = v->edges().begin(); eit != v->edges().end(); ++eit) {
           OptimizableGraph::Edge* e = static_cast<OptimizableGraph::Edge*>(*eit);
           if (e->vertices().size() == 1 && e->dimension() == maxDim)
             return false;
@@ -197,10 +205,22 @@ namespace g2o{
   }
 
   bool SparseOptimizer::initializeOptimization(int level){
-    HyperGraph::VertexSet vset;
+    if (edges().size() == 0) {
+      cerr << __PRETTY_FUNCTION__ << ": Attempt to initialize an empty graph" << endl;
+      return false;
+    }
+    bool workspaceAllocated = _jacobianWorkspace.allocate(); (void) workspaceAllocated;
+    assert(workspaceAllocated && "Error while allocating memory for the Jacobians");
+    clearIndexMapping();
+    _activeVertices.clear();
+    _activeVertices.reserve(vertices().size());
+    _activeEdges.clear();
+    _activeEdges.reserve(edges().size());
     for (VertexIDMap::iterator it=vertices().begin(); it!=vertices().end(); ++it)
-      vset.insert(it->second);
-    return initializeOptimization(vset,level);
+      activateVertex(static_cast<OptimizableGraph::Vertex*>(it->second), 0, level);
+
+    sortVectorContainers();
+    return buildIndexMapping(_activeVertices);
   }
 
   bool SparseOptimizer::initializeOptimization(HyperGraph::VertexSet& vset, int level){
@@ -214,56 +234,55 @@ namespace g2o{
     _activeVertices.clear();
     _activeVertices.reserve(vset.size());
     _activeEdges.clear();
-    set<Edge*> auxEdgeSet; // temporary structure to avoid duplicates
-    for (HyperGraph::VertexSet::iterator it=vset.begin(); it!=vset.end(); ++it){
-      OptimizableGraph::Vertex* v= (OptimizableGraph::Vertex*) *it;
-      const OptimizableGraph::EdgeSet& vEdges=v->edges();
-      // count if there are edges in that level. If not remove from the pool
-      int levelEdges=0;
-      for (OptimizableGraph::EdgeSet::const_iterator it=vEdges.begin(); it!=vEdges.end(); ++it){
-        OptimizableGraph::Edge* e=reinterpret_cast<OptimizableGraph::Edge*>(*it);
-        if (level < 0 || e->level() == level) {
-
-          bool allVerticesOK = true;
-          for (vector<HyperGraph::Vertex*>::const_iterator vit = e->vertices().begin(); vit != e->vertices().end(); ++vit) {
-            if (vset.find(*vit) == vset.end()) {
-              allVerticesOK = false;
-              break;
-            }
-          }
-          if (allVerticesOK && !e->allVerticesFixed()) {
-            auxEdgeSet.insert(e);
-            levelEdges++;
-          }
+    for (HyperGraph::VertexSet::iterator it=vset.begin(); it!=vset.end(); ++it)
+      activateVertex(static_cast<OptimizableGraph::Vertex*>(*it), &vset, level);
 
-        }
-      }
-      if (levelEdges){
-        _activeVertices.push_back(v);
-
-        // test for NANs in the current estimate if we are debugging
-#      ifndef NDEBUG
-        int estimateDim = v->estimateDimension();
-        if (estimateDim > 0) {
-          Eigen::VectorXd estimateData(estimateDim);
-          if (v->getEstimateData(estimateData.data()) == true) {
-            int k;
-            bool hasNan = arrayHasNaN(estimateData.data(), estimateDim, &k);
-            if (hasNan)
-              cerr << __PRETTY_FUNCTION__ << ": Vertex " << v->id() << " contains a nan entry at index " << k << endl;
+    sortVectorContainers();
+    return buildIndexMapping(_activeVertices);
+  }
+
+  void SparseOptimizer::activateVertex(OptimizableGraph::Vertex* v, const HyperGraph::VertexSet* vset, int level){
+    const OptimizableGraph::EdgeList& vEdges=v->edges();
+    // count if there are edges in that level. If not remove from the pool
+    int levelEdges=0;
+    for (OptimizableGraph::EdgeList::const_iterator it=vEdges.begin(); it!=vEdges.end(); ++it){
+      OptimizableGraph::Edge* e=reinterpret_cast<OptimizableGraph::Edge*>(*it);
+      if (level < 0 || e->level() == level) {
+
+        bool allVerticesOK = true;
+        for (vector<HyperGraph::Vertex*>::const_iterator vit = e->vertices().begin(); vit != e->vertices().end(); ++vit) {
+          if (vset ? vset->find(*vit) == vset->end() : vertex((*vit)->id()) != *vit) {
+            allVerticesOK = false;
+            break;
           }
         }
-#      endif
+        if (allVerticesOK && !e->allVerticesFixed()) {
+          // the edge is active for each of its vertices, it is added once
+          if (e->vertices()[0] == v)
+            _activeEdges.push_back(e);
+          levelEdges++;
+        }
 
       }
     }
+    if (levelEdges){
+      _activeVertices.push_back(v);
+
+      // test for NANs in the current estimate if we are debugging
+#    ifndef NDEBUG
+      int estimateDim = v->estimateDimension();
+      if (estimateDim > 0) {
+        Eigen::VectorXd estimateData(estimateDim);
+        if (v->getEstimateData(estimateData.data()) == true) {
+          int k;
+          bool hasNan = arrayHasNaN(estimateData.data(), estimateDim, &k);
+          if (hasNan)
+            cerr << __PRETTY_FUNCTION__ << ": Vertex " << v->id() << " contains a nan entry at index " << k << endl;
+        }
+      }
+#    endif
 
-    _activeEdges.reserve(auxEdgeSet.size());
-    for (set<Edge*>::iterator it = auxEdgeSet.begin(); it != auxEdgeSet.end(); ++it)
-      _activeEdges.push_back(*it);
-
-    sortVectorContainers();
-    return buildIndexMapping(_activeVertices);
+    }
   }
 
   bool SparseOptimizer::initializeOptimization(HyperGraph::EdgeSet& eset){
@@ -315,7 +334,7 @@ namespace g2o{
         if (v->fixed())
           fixedVertices.insert(v);
         else { // check for having a prior which is able to fully initialize a vertex
-          for (EdgeSet::const_iterator vedgeIt = v->edges().begin(); vedgeIt != v->edges().end(); ++vedgeIt) {
+          for (EdgeList::const_iterator vedgeIt = v->edges().begin(); vedgeIt != v->edges().end(); ++vedgeIt) {
             OptimizableGraph::Edge* vedge = static_cast<OptimizableGraph::Edge*>(*vedgeIt);
             if (vedge->vertices().size() == 1 && vedge->initialEstimatePossible(emptySet, v) > 0.) {
               //cerr << "Initialize with prior for " << v->id() << endl;
@@ -474,6 +493,8 @@ namespace g2o{
       }
     }
 
+    activateEdgeBatches();
+
     //if (newVertices.size() != vset.size())
     //cerr << __PRETTY_FUNCTION__ << ": something went wrong " << PVAR(vset.size()) << " " << PVAR(newVertices.size()) << endl;
     return _algorithm->updateStructure(newVertices, eset);
@@ -484,6 +505,7 @@ namespace g2o{
     // sort vector structures to get deterministic ordering based on IDs
     sort(_activeVertices.begin(), _activeVertices.end(), VertexIDCompare());
     sort(_activeEdges.begin(), _activeEdges.end(), EdgeIDCompare());
+    activateEdgeBatches();
   }
 
   void SparseOptimizer::clear() {
@@ -493,6 +515,14 @@ namespace g2o{
     OptimizableGraph::clear();
   }
 
+  void SparseOptimizer::release() {
+    clearIndexMapping();
+    _ivMap.clear();
+    _activeVertices.clear();
+    _activeEdges.clear();
+    OptimizableGraph::release();
+  }
+
   SparseOptimizer::VertexContainer::const_iterator SparseOptimizer::findActiveVertex(const OptimizableGraph::Vertex* v) const
   {
     VertexContainer::const_iterator lower = lower_bound(_activeVertices.begin(), _activeVertices.end(), v, VertexIDCompare());
@@ -597,6 +627,36 @@ namespace g2o{
     return _graphActions[AT_COMPUTEACTIVERROR].erase(action) > 0;
   }
 
+  bool SparseOptimizer::addEdgeBatch(EdgeBatch* batch)
+  {
+    if (std::find(_edgeBatches.begin(), _edgeBatches.end(), batch) != _edgeBatches.end())
+      return false;
+    _edgeBatches.push_back(batch);
+    batch->setActiveEdges(_activeEdges);
+    return true;
+  }
+
+  bool SparseOptimizer::removeEdgeBatch(EdgeBatch* batch)
+  {
+    std::vector<EdgeBatch*>::iterator it = std::find(_edgeBatches.begin(), _edgeBatches.end(), batch);
+    if (it == _edgeBatches.end())
+      return false;
+    _edgeBatches.erase(it);
+    return true;
+  }
+
+  void SparseOptimizer::activateEdgeBatches()
+  {
+    for (size_t i = 0; i < _edgeBatches.size(); ++i)
+      _edgeBatches[i]->setActiveEdges(_activeEdges);
+  }
+
+  void SparseOptimizer::linearizeEdgeBatches()
+  {
+    for (size_t i = 0; i < _edgeBatches.size(); ++i)
+      _edgeBatches[i]->linearizeOplus();
+  }
+
   void SparseOptimizer::push()
   {
     push(_activeVertices);
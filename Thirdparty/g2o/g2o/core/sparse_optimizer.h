@@ -244,6 +244,12 @@ namespace g2o {
      */
     virtual void clear();
 
+    /**
+     * same as clear(), but the vertices and edges are not deleted, see
+     * HyperGraph::release()
+     */
+    virtual void release();
+
     /**
      * computes the error vectors of all edges in the activeSet, and caches them
      */
@@ -284,6 +290,17 @@ namespace g2o {
     //! remove an action that should no longer be execured before computing the error vectors
     bool removeComputeErrorAction(HyperGraphAction* action);
 
+    /**** edge batches ****/
+    //! add a batch evaluating some of the edges, see EdgeBatch
+    bool addEdgeBatch(EdgeBatch* batch);
+    //! remove a batch, its edges must no longer be flagged with it
+    bool removeEdgeBatch(EdgeBatch* batch);
+    /**
+     * computes the Jacobians of the edge batches, called by the solver before
+     * linearizing the active edges
+     */
+    void linearizeEdgeBatches();
+
     
 
     protected:
@@ -295,6 +312,15 @@ namespace g2o {
     EdgeContainer _activeEdges;        ///< sorted according to EdgeIDCompare
 
     void sortVectorContainers();
+    //! passes the active edges to the edge batches
+    void activateEdgeBatches();
+
+    /**
+     * adds v to the active vertices if it has an edge in the level (any level
+     * if negative) whose vertices are all in vset, or in the graph if vset is 0.
+     * Such edges are added to the active edges by their first vertex.
+     */
+    void activateVertex(OptimizableGraph::Vertex* v, const HyperGraph::VertexSet* vset, int level);
  
     OptimizationAlgorithm* _algorithm;
 
@@ -306,6 +332,7 @@ namespace g2o {
 
     BatchStatisticsContainer _batchStatistics;   ///< global statistics of the optimizer, e.g., timing, num-non-zeros
     bool _computeBatchStatistics;
+    std::vector<EdgeBatch*> _edgeBatches;
   };
 } // end namespace
 
@@ -101,6 +101,13 @@ bool EdgeSE3ProjectXYZ::write(std::ostream& os) const {
 
 
 void EdgeSE3ProjectXYZ::linearizeOplus() {
+  if (_batch && _batchIndex >= 0) {
+    const ReprojectionBatch* batch = static_cast<const ReprojectionBatch*>(_batch);
+    batch->pointJacobian(_batchIndex, _jacobianOplusXi);
+    batch->poseJacobian(_batchIndex, _jacobianOplusXj);
+    return;
+  }
+
   VertexSE3Expmap * vj = static_cast<VertexSE3Expmap *>(_vertices[1]);
   SE3Quat T(vj->estimate());
   VertexSBAPointXYZ* vi = static_cast<VertexSBAPointXYZ*>(_vertices[0]);
@@ -186,6 +193,13 @@ bool EdgeStereoSE3ProjectXYZ::write(std::ostream& os) const {
 }
 
 void EdgeStereoSE3ProjectXYZ::linearizeOplus() {
+  if (_batch && _batchIndex >= 0) {
+    const ReprojectionBatch* batch = static_cast<const ReprojectionBatch*>(_batch);
+    batch->pointJacobian(_batchIndex, _jacobianOplusXi);
+    batch->poseJacobian(_batchIndex, _jacobianOplusXj);
+    return;
+  }
+
   VertexSE3Expmap * vj = static_cast<VertexSE3Expmap *>(_vertices[1]);
   SE3Quat T(vj->estimate());
   VertexSBAPointXYZ* vi = static_cast<VertexSBAPointXYZ*>(_vertices[0]);
@@ -264,6 +278,11 @@ bool EdgeSE3ProjectXYZOnlyPose::write(std::ostream& os) const {
 
 
 void EdgeSE3ProjectXYZOnlyPose::linearizeOplus() {
+  if (_batch && _batchIndex >= 0) {
+    static_cast<const ReprojectionBatch*>(_batch)->poseJacobian(_batchIndex, _jacobianOplusXi);
+    return;
+  }
+
   VertexSE3Expmap * vi = static_cast<VertexSE3Expmap *>(_vertices[0]);
   Vector3d xyz_trans = vi->estimate().map(Xw);
 
@@ -296,6 +315,69 @@ Vector2d EdgeSE3ProjectXYZOnlyPose::cam_project(const Vector3d & trans_xyz) cons
 }
 
 
+bool EdgeSE3ProjectXYZOnlyPoseRig::read(std::istream& is){
+  for (int i=0; i<2; i++){
+    is >> _measurement[i];
+  }
+  for (int i=0; i<2; i++)
+    for (int j=i; j<2; j++) {
+      is >> information()(i,j);
+      if (i!=j)
+        information()(j,i)=information()(i,j);
+    }
+  return true;
+}
+
+bool EdgeSE3ProjectXYZOnlyPoseRig::write(std::ostream& os) const {
+
+  for (int i=0; i<2; i++){
+    os << measurement()[i] << " ";
+  }
+
+  for (int i=0; i<2; i++)
+    for (int j=i; j<2; j++){
+      os << " " <<  information()(i,j);
+    }
+  return os.good();
+}
+
+
+void EdgeSE3ProjectXYZOnlyPoseRig::linearizeOplus() {
+  VertexSE3Expmap * vi = static_cast<VertexSE3Expmap *>(_vertices[0]);
+  Vector3d xyz_body = vi->estimate().map(Xw);
+  Vector3d xyz_trans = Tcb.map(xyz_body);
+
+  double x = xyz_trans[0];
+  double y = xyz_trans[1];
+  double invz = 1.0/xyz_trans[2];
+  double invz_2 = invz*invz;
+
+  // Projection in the observing camera
+  Matrix<double,2,3> proj_jac;
+  proj_jac(0,0) = fx*invz;
+  proj_jac(0,1) = 0;
+  proj_jac(0,2) = -x*invz_2 *fx;
+  proj_jac(1,0) = 0;
+  proj_jac(1,1) = fy*invz;
+  proj_jac(1,2) = -y*invz_2 *fy;
+
+  // Point in the body camera w.r.t. the pose update (rotation first)
+  Matrix<double,3,6> body_jac;
+  body_jac.leftCols<3>() = -skew(xyz_body);
+  body_jac.rightCols<3>() = Matrix3d::Identity();
+
+  _jacobianOplusXi = -proj_jac * Tcb.rotation().toRotationMatrix() * body_jac;
+}
+
+Vector2d EdgeSE3ProjectXYZOnlyPoseRig::cam_project(const Vector3d & trans_xyz) const{
+  Vector2d proj = project2d(trans_xyz);
+  Vector2d res;
+  res[0] = proj[0]*fx + cx;
+  res[1] = proj[1]*fy + cy;
+  return res;
+}
+
+
 Vector3d EdgeStereoSE3ProjectXYZOnlyPose::cam_project(const Vector3d & trans_xyz) const{
   const float invz = 1.0f/trans_xyz[2];
   Vector3d res;
@@ -333,6 +415,11 @@ bool EdgeStereoSE3ProjectXYZOnlyPose::write(std::ostream& os) const {
 }
 
 void EdgeStereoSE3ProjectXYZOnlyPose::linearizeOplus() {
+  if (_batch && _batchIndex >= 0) {
+    static_cast<const ReprojectionBatch*>(_batch)->poseJacobian(_batchIndex, _jacobianOplusXi);
+    return;
+  }
+
   VertexSE3Expmap * vi = static_cast<VertexSE3Expmap *>(_vertices[0]);
   Vector3d xyz_trans = vi->estimate().map(Xw);
 
@@ -364,4 +451,294 @@ void EdgeStereoSE3ProjectXYZOnlyPose::linearizeOplus() {
 }
 
 
+ReprojectionBatch::ReprojectionBatch() : _sorted(true) {
+}
+
+void ReprojectionBatch::add(const Observation& o) {
+  o.edge->setBatch(this, -1);
+  _observations.push_back(o);
+  _observations.back().active = true;
+  _sorted = false;
+}
+
+void ReprojectionBatch::add(EdgeSE3ProjectXYZ* e) {
+  Observation o;
+  o.edge = e;
+  o.camera = static_cast<VertexSE3Expmap*>(e->vertex(1));
+  o.point = &static_cast<VertexSBAPointXYZ*>(e->vertex(0))->estimate();
+  o.dimension = 2;
+  o.u = e->measurement()[0];
+  o.v = e->measurement()[1];
+  o.ur = 0;
+  o.fx = e->fx;
+  o.fy = e->fy;
+  o.cx = e->cx;
+  o.cy = e->cy;
+  o.bf = 0;
+  add(o);
+}
+
+void ReprojectionBatch::add(EdgeStereoSE3ProjectXYZ* e) {
+  Observation o;
+  o.edge = e;
+  o.camera = static_cast<VertexSE3Expmap*>(e->vertex(1));
+  o.point = &static_cast<VertexSBAPointXYZ*>(e->vertex(0))->estimate();
+  o.dimension = 3;
+  o.u = e->measurement()[0];
+  o.v = e->measurement()[1];
+  o.ur = e->measurement()[2];
+  o.fx = e->fx;
+  o.fy = e->fy;
+  o.cx = e->cx;
+  o.cy = e->cy;
+  o.bf = e->bf;
+  add(o);
+}
+
+void ReprojectionBatch::add(EdgeSE3ProjectXYZOnlyPose* e) {
+  Observation o;
+  o.edge = e;
+  o.camera = static_cast<VertexSE3Expmap*>(e->vertex(0));
+  o.point = &e->Xw;
+  o.dimension = 2;
+  o.u = e->measurement()[0];
+  o.v = e->measurement()[1];
+  o.ur = 0;
+  o.fx = e->fx;
+  o.fy = e->fy;
+  o.cx = e->cx;
+  o.cy = e->cy;
+  o.bf = 0;
+  add(o);
+}
+
+void ReprojectionBatch::add(EdgeStereoSE3ProjectXYZOnlyPose* e) {
+  Observation o;
+  o.edge = e;
+  o.camera = static_cast<VertexSE3Expmap*>(e->vertex(0));
+  o.point = &e->Xw;
+  o.dimension = 3;
+  o.u = e->measurement()[0];
+  o.v = e->measurement()[1];
+  o.ur = e->measurement()[2];
+  o.fx = e->fx;
+  o.fy = e->fy;
+  o.cx = e->cx;
+  o.cy = e->cy;
+  o.bf = e->bf;
+  add(o);
+}
+
+void ReprojectionBatch::clear() {
+  for (size_t i=0; i<_observations.size(); i++)
+    _observations[i].edge->setBatch(0, -1);
+  _observations.clear();
+  _sorted = false;
+}
+
+void ReprojectionBatch::setActiveEdges(const OptimizableGraph::EdgeContainer& activeEdges) {
+  // The edges are flagged with their observation until the next sort()
+  for (size_t i=0; i<_observations.size(); i++) {
+    _observations[i].edge->setBatch(this, i);
+    _observations[i].active = false;
+  }
+  for (size_t i=0; i<activeEdges.size(); i++)
+    if (activeEdges[i]->batch() == this)
+      _observations[activeEdges[i]->batchIndex()].active = true;
+  _sorted = false;
+}
+
+void ReprojectionBatch::sort() {
+  // Active observations of a camera together, in the order they were added
+  std::vector<std::pair<VertexSE3Expmap*, size_t> > order;
+  order.reserve(_observations.size());
+  for (size_t i=0; i<_observations.size(); i++) {
+    if (_observations[i].active)
+      order.push_back(std::make_pair(_observations[i].camera, i));
+    else
+      _observations[i].edge->setBatch(this, -1);
+  }
+  std::sort(order.begin(), order.end());
+
+  const size_t n = order.size();
+  _cameras.clear();
+  _cameraBegin.clear();
+  _points.resize(n);
+  _errors.resize(n);
+  _dimensions.resize(n);
+  _fx.resize(n); _fy.resize(n); _cx.resize(n); _cy.resize(n); _bf.resize(n);
+  _u.resize(n); _v.resize(n); _ur.resize(n);
+  _dx.resize(n); _dy.resize(n); _dz.resize(n);
+  _x.resize(n); _y.resize(n); _z.resize(n);
+  _eu.resize(n); _ev.resize(n); _eur.resize(n);
+  for (int k=0; k<9; k++)
+    _pointJacobians[k].resize(n);
+  for (int k=0; k<18; k++)
+    _poseJacobians[k].resize(n);
+
+  for (size_t i=0; i<n; i++) {
+    const Observation& o = _observations[order[i].second];
+    if (_cameras.empty() || _cameras.back() != o.camera) {
+      _cameras.push_back(o.camera);
+      _cameraBegin.push_back(i);
+    }
+    o.edge->setBatch(this, i);
+    _points[i] = o.point;
+    _errors[i] = o.edge->errorData();
+    _dimensions[i] = o.dimension;
+    _fx[i] = o.fx; _fy[i] = o.fy; _cx[i] = o.cx; _cy[i] = o.cy; _bf[i] = o.bf;
+    _u[i] = o.u; _v[i] = o.v; _ur[i] = o.ur;
+  }
+  _cameraBegin.push_back(n);
+  _rotations.resize(9*_cameras.size());
+  _sorted = true;
+}
+
+void ReprojectionBatch::transform() {
+  if (!_sorted)
+    sort();
+
+  for (size_t c=0; c<_cameras.size(); c++) {
+    const SE3Quat& T = _cameras[c]->estimate();
+    const Matrix3d R = T.rotation().toRotationMatrix();
+    const Vector3d C = -R.transpose()*T.translation();
+    float* r = &_rotations[9*c];
+    for (int k=0; k<9; k++)
+      r[k] = R(k/3, k%3);
+
+    // Relative to the camera center in double
+    const size_t begin = _cameraBegin[c];
+    const size_t end = _cameraBegin[c+1];
+    for (size_t i=begin; i<end; i++) {
+      const Vector3d d = *_points[i] - C;
+      _dx[i] = d[0];
+      _dy[i] = d[1];
+      _dz[i] = d[2];
+    }
+
+    float* x = &_x[0];
+    float* y = &_y[0];
+    float* z = &_z[0];
+    const float* dx = &_dx[0];
+    const float* dy = &_dy[0];
+    const float* dz = &_dz[0];
+    for (size_t i=begin; i<end; i++) {
+      x[i] = r[0]*dx[i] + r[1]*dy[i] + r[2]*dz[i];
+      y[i] = r[3]*dx[i] + r[4]*dy[i] + r[5]*dz[i];
+      z[i] = r[6]*dx[i] + r[7]*dy[i] + r[8]*dz[i];
+    }
+  }
+}
+
+void ReprojectionBatch::computeErrors() {
+  transform();
+  if (_points.empty())
+    return;
+
+  const size_t n = _points.size();
+  const float* x = &_x[0];
+  const float* y = &_y[0];
+  const float* z = &_z[0];
+  const float* fx = &_fx[0];
+  const float* fy = &_fy[0];
+  const float* cx = &_cx[0];
+  const float* cy = &_cy[0];
+  const float* bf = &_bf[0];
+  const float* u = &_u[0];
+  const float* v = &_v[0];
+  const float* ur = &_ur[0];
+  float* eu = &_eu[0];
+  float* ev = &_ev[0];
+  float* eur = &_eur[0];
+  for (size_t i=0; i<n; i++) {
+    const float invz = 1.0f/z[i];
+    const float pu = x[i]*invz*fx[i] + cx[i];
+    eu[i] = u[i] - pu;
+    ev[i] = v[i] - (y[i]*invz*fy[i] + cy[i]);
+    eur[i] = ur[i] - (pu - bf[i]*invz);
+  }
+
+  for (size_t i=0; i<n; i++) {
+    double* e = _errors[i];
+    e[0] = eu[i];
+    e[1] = ev[i];
+    if (_dimensions[i]==3)
+      e[2] = eur[i];
+  }
+}
+
+void ReprojectionBatch::linearizeOplus() {
+  transform();
+  if (_points.empty())
+    return;
+
+  const size_t n = _points.size();
+  const float* x = &_x[0];
+  const float* y = &_y[0];
+  const float* z = &_z[0];
+  const float* fx = &_fx[0];
+  const float* fy = &_fy[0];
+  const float* bf = &_bf[0];
+
+  // Pose, same as the linearizeOplus of the edges (rotation first)
+  float* J[18];
+  for (int k=0; k<18; k++)
+    J[k] = &_poseJacobians[k][0];
+  for (size_t i=0; i<n; i++) {
+    const float invz = 1.0f/z[i];
+    const float invz_2 = invz*invz;
+
+    J[0][i] =  x[i]*y[i]*invz_2 *fx[i];
+    J[1][i] = -(1+(x[i]*x[i]*invz_2)) *fx[i];
+    J[2][i] = y[i]*invz *fx[i];
+    J[3][i] = -invz *fx[i];
+    J[4][i] = 0;
+    J[5][i] = x[i]*invz_2 *fx[i];
+
+    J[6][i] = (1+y[i]*y[i]*invz_2) *fy[i];
+    J[7][i] = -x[i]*y[i]*invz_2 *fy[i];
+    J[8][i] = -x[i]*invz *fy[i];
+    J[9][i] = 0;
+    J[10][i] = -invz *fy[i];
+    J[11][i] = y[i]*invz_2 *fy[i];
+
+    J[12][i] = J[0][i]-bf[i]*y[i]*invz_2;
+    J[13][i] = J[1][i]+bf[i]*x[i]*invz_2;
+    J[14][i] = J[2][i];
+    J[15][i] = J[3][i];
+    J[16][i] = 0;
+    J[17][i] = J[5][i]-bf[i]*invz_2;
+  }
+
+  // Point, the projection Jacobian times the rotation of the camera
+  float* P[9];
+  for (int k=0; k<9; k++)
+    P[k] = &_pointJacobians[k][0];
+  for (size_t c=0; c<_cameras.size(); c++) {
+    const float* r = &_rotations[9*c];
+    for (size_t i=_cameraBegin[c]; i<_cameraBegin[c+1]; i++) {
+      const float invz = 1.0f/z[i];
+      const float invz_2 = invz*invz;
+      const float a = -fx[i]*invz;
+      const float b = fx[i]*x[i]*invz_2;
+      const float d = -fy[i]*invz;
+      const float e = fy[i]*y[i]*invz_2;
+      const float f = b - bf[i]*invz_2;
+
+      P[0][i] = a*r[0] + b*r[6];
+      P[1][i] = a*r[1] + b*r[7];
+      P[2][i] = a*r[2] + b*r[8];
+
+      P[3][i] = d*r[3] + e*r[6];
+      P[4][i] = d*r[4] + e*r[7];
+      P[5][i] = d*r[5] + e*r[8];
+
+      P[6][i] = a*r[0] + f*r[6];
+      P[7][i] = a*r[1] + f*r[7];
+      P[8][i] = a*r[2] + f*r[8];
+    }
+  }
+}
+
+
 } // end namespace
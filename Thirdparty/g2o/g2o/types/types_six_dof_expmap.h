@@ -37,6 +37,7 @@
 #include "../core/base_vertex.h"
 #include "../core/base_binary_edge.h"
 #include "../core/base_unary_edge.h"
+#include "../core/edge_batch.h"
 #include "se3_ops.h"
 #include "se3quat.h"
 #include "types_sba.h"
@@ -171,6 +172,41 @@ public:
 };
 
 
+// Observation of a camera rigidly attached to the optimized one (e.g. the
+// other cameras of a rig): Tcb is the pose of the optimized (body) camera in
+// the observing camera.
+class  EdgeSE3ProjectXYZOnlyPoseRig: public  BaseUnaryEdge<2, Vector2d, VertexSE3Expmap>{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  EdgeSE3ProjectXYZOnlyPoseRig(){}
+
+  bool read(std::istream& is);
+
+  bool write(std::ostream& os) const;
+
+  void computeError()  {
+    const VertexSE3Expmap* v1 = static_cast<const VertexSE3Expmap*>(_vertices[0]);
+    Vector2d obs(_measurement);
+    _error = obs-cam_project(Tcb.map(v1->estimate().map(Xw)));
+  }
+
+  bool isDepthPositive() {
+    const VertexSE3Expmap* v1 = static_cast<const VertexSE3Expmap*>(_vertices[0]);
+    return (Tcb.map(v1->estimate().map(Xw)))(2)>0.0;
+  }
+
+
+  virtual void linearizeOplus();
+
+  Vector2d cam_project(const Vector3d & trans_xyz) const;
+
+  Vector3d Xw;
+  SE3Quat Tcb;
+  double fx, fy, cx, cy;
+};
+
+
 class  EdgeStereoSE3ProjectXYZOnlyPose: public  BaseUnaryEdge<3, Vector3d, VertexSE3Expmap>{
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -203,6 +239,91 @@ public:
 
 
 
+/**
+ * \brief reprojection errors and Jacobians of many edges at once
+ *
+ * Evaluates EdgeSE3ProjectXYZ, EdgeStereoSE3ProjectXYZ and their OnlyPose
+ * variants in single precision. The observations are sorted by camera and
+ * stored in structure-of-arrays buffers, the projections are loops the compiler
+ * vectorizes. The points are taken relative to the camera center in double
+ * before the conversion, so the residuals keep their precision far from the
+ * origin. The Hessian is still accumulated in double by the solver.
+ *
+ * The vertices and the camera parameters (and Xw) of an edge must be set
+ * before it is added. The batch must be added to the optimizer of its edges,
+ * see SparseOptimizer::addEdgeBatch(). The edges added after the last
+ * initializeOptimization() are evaluated until the next one.
+ */
+class ReprojectionBatch : public EdgeBatch {
+public:
+  ReprojectionBatch();
+
+  void add(EdgeSE3ProjectXYZ* e);
+  void add(EdgeStereoSE3ProjectXYZ* e);
+  void add(EdgeSE3ProjectXYZOnlyPose* e);
+  void add(EdgeStereoSE3ProjectXYZOnlyPose* e);
+  //! removes the edges, they are evaluated alone again
+  void clear();
+  size_t size() const { return _observations.size();}
+
+  virtual void computeErrors();
+  virtual void linearizeOplus();
+  virtual void setActiveEdges(const OptimizableGraph::EdgeContainer& activeEdges);
+
+  //! Jacobian w.r.t. the point of an edge, computed by linearizeOplus()
+  template <typename MatrixType>
+  void pointJacobian(int index, MatrixType& J) const {
+    for (int r=0; r<J.rows(); r++)
+      for (int c=0; c<3; c++)
+        J(r,c) = _pointJacobians[3*r+c][index];
+  }
+
+  //! Jacobian w.r.t. the pose of an edge, computed by linearizeOplus()
+  template <typename MatrixType>
+  void poseJacobian(int index, MatrixType& J) const {
+    for (int r=0; r<J.rows(); r++)
+      for (int c=0; c<6; c++)
+        J(r,c) = _poseJacobians[6*r+c][index];
+  }
+
+protected:
+  struct Observation {
+    OptimizableGraph::Edge* edge;
+    VertexSE3Expmap* camera;
+    // estimate of the point vertex or Xw of the OnlyPose edges
+    const Vector3d* point;
+    int dimension;
+    double u, v, ur;
+    double fx, fy, cx, cy, bf;
+    bool active;
+  };
+
+  void add(const Observation& o);
+  //! sorts the active observations by camera and fills the constant buffers
+  void sort();
+  //! points of the observations in their camera
+  void transform();
+
+  std::vector<Observation> _observations;
+  bool _sorted;
+
+  // Observations sorted by camera, those of _cameras[i] from _cameraBegin[i]
+  std::vector<VertexSE3Expmap*> _cameras;
+  std::vector<size_t> _cameraBegin;
+  std::vector<float> _rotations;
+  std::vector<const Vector3d*> _points;
+  std::vector<double*> _errors;
+  std::vector<int> _dimensions;
+  std::vector<float> _fx, _fy, _cx, _cy, _bf;
+  std::vector<float> _u, _v, _ur;
+  std::vector<float> _dx, _dy, _dz;
+  std::vector<float> _x, _y, _z;
+  std::vector<float> _eu, _ev, _eur;
+  std::vector<float> _pointJacobians[9];
+  std::vector<float> _poseJacobians[18];
+};
+
+
 } // end namespace
 
 #endif
@@ -21,10 +21,14 @@
 #include <boost/serialization/split_free.hpp>
 #include <boost/serialization/base_object.hpp>
 #include <opencv2/core/core.hpp>
+#include "Thirdparty/DBoW2/DBoW2/BowVector.h"
+#include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
 
 // #include "Thirdparty/fbow/include/fbow/fbow.h"
 
 BOOST_SERIALIZATION_SPLIT_FREE(::cv::Mat)
+BOOST_SERIALIZATION_SPLIT_FREE(DBoW2::BowVector)
+BOOST_SERIALIZATION_SPLIT_FREE(DBoW2::FeatureVector)
 namespace boost{
     namespace serialization {
 
@@ -41,6 +45,43 @@ namespace boost{
     //     ar & boost::serialization::base_object<fbow::fBow2::super>(fbowFeatVec);
     // }
 
+    /* serialization for DBoW2 BowVector */
+    // BowVector and FeatureVector are flat sorted vectors, they are archived as
+    // the std::map they used to be so that existing map files can be loaded
+    template<class Archive>
+    void save(Archive &ar, const DBoW2::BowVector &BowVec, const unsigned int file_version)
+    {
+        const std::map<DBoW2::WordId, DBoW2::WordValue> words(BowVec.begin(), BowVec.end());
+        ar & words;
+    }
+    template<class Archive>
+    void load(Archive &ar, DBoW2::BowVector &BowVec, const unsigned int file_version)
+    {
+        std::map<DBoW2::WordId, DBoW2::WordValue> words;
+        ar & words;
+        BowVec.assign(words.begin(), words.end());
+    }
+    /* serialization for DBoW2 FeatureVector */
+    template<class Archive>
+    void save(Archive &ar, const DBoW2::FeatureVector &FeatVec, const unsigned int file_version)
+    {
+        std::map<DBoW2::NodeId, std::vector<unsigned int> > nodes;
+        for (DBoW2::FeatureVector::const_iterator it = FeatVec.begin(); it != FeatVec.end(); ++it)
+            nodes[it->first] = it->second;
+        ar & nodes;
+    }
+    template<class Archive>
+    void load(Archive &ar, DBoW2::FeatureVector &FeatVec, const unsigned int file_version)
+    {
+        std::map<DBoW2::NodeId, std::vector<unsigned int> > nodes;
+        ar & nodes;
+        std::vector<std::pair<DBoW2::NodeId, unsigned int> > features;
+        for (std::map<DBoW2::NodeId, std::vector<unsigned int> >::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+            for (size_t i = 0; i < it->second.size(); i++)
+                features.push_back(std::make_pair(it->first, it->second[i]));
+        FeatVec.assign(features);
+    }
+
     /* serialization for CV KeyPoint */
     template<class Archive>
     void serialize(Archive &ar, ::cv::KeyPoint &kf, const unsigned int file_version)
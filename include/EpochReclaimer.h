@@ -0,0 +1,89 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EPOCHRECLAIMER_H
+#define EPOCHRECLAIMER_H
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class MapPoint;
+class KeyFrame;
+
+// Deferred deletion of MapPoints and KeyFrames erased from the map.
+//
+// Every thread that keeps MapPoint/KeyFrame pointers between iterations
+// registers a slot and periodically announces a quiescent state:
+//
+//   unsigned long nEpoch = GetEpoch();
+//   ... drop every reference to a bad MapPoint/KeyFrame ...
+//   Quiescent(nSlot, nEpoch);
+//
+// An object retired at epoch r is handed back for deletion once every
+// registered thread has announced an epoch >= r.
+class EpochReclaimer {
+public:
+  EpochReclaimer();
+
+  int RegisterThread();
+  void UnregisterThread(int nSlot);
+
+  unsigned long GetEpoch();
+  void Quiescent(int nSlot, unsigned long nEpoch);
+
+  void Retire(MapPoint *pMP);
+  void Retire(KeyFrame *pKF);
+
+  // Move the objects that no thread can reference anymore to the output
+  // vectors, in retirement order. The caller is responsible for deleting them.
+  void CollectMapPoints(std::vector<MapPoint *> &vpMPs);
+  void CollectKeyFrames(std::vector<KeyFrame *> &vpKFs);
+
+  // Give back keyframes returned by CollectKeyFrames that the caller could not
+  // delete yet. They are kept in front of the queue to preserve the order.
+  void DeferKeyFrames(const std::vector<KeyFrame *> &vpKFs);
+
+  size_t RetiredMapPoints();
+  size_t RetiredKeyFrames();
+
+  // Delete every pending object. Only safe when the map is being reset.
+  void clear();
+
+protected:
+  unsigned long MinAnnouncedEpoch();
+
+  unsigned long mnEpoch;
+
+  // Last epoch announced by each slot (-1 if the slot is free)
+  std::vector<unsigned long> mvnAnnounced;
+
+  std::deque<std::pair<unsigned long, MapPoint *>> mdRetiredMapPoints;
+  std::deque<std::pair<unsigned long, KeyFrame *>> mdRetiredKeyFrames;
+
+  std::mutex mMutex;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // EPOCHRECLAIMER_H
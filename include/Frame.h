@@ -57,6 +57,9 @@ public:
     // Constructor for Monocular cameras.
     Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
 
+    // Constructor for the other cameras of a rig (monocular). The image is part of the frame nId of the main camera.
+    Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor, cv::Mat &K, cv::Mat &distCoef, const long unsigned int &nId);
+
     // Extract ORB on the image. 0 for left image and 1 for right image.
     void ExtractORB(int flag, const cv::Mat &im);
 
@@ -108,14 +111,14 @@ public:
     // Frame timestamp.
     double mTimeStamp;
 
-    // Calibration matrix and OpenCV distortion parameters.
+    // Calibration matrix and OpenCV distortion parameters (one camera per frame, the cameras of a rig differ).
     cv::Mat mK;
-    static float fx;
-    static float fy;
-    static float cx;
-    static float cy;
-    static float invfx;
-    static float invfy;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+    float invfx;
+    float invfy;
     cv::Mat mDistCoef;
 
     // Stereo baseline multiplied by fx.
@@ -156,8 +159,8 @@ public:
     std::vector<bool> mvbOutlier;
 
     // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
-    static float mfGridElementWidthInv;
-    static float mfGridElementHeightInv;
+    float mfGridElementWidthInv;
+    float mfGridElementHeightInv;
     std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
 
     // Camera pose.
@@ -179,13 +182,11 @@ public:
     vector<float> mvLevelSigma2;
     vector<float> mvInvLevelSigma2;
 
-    // Undistorted Image Bounds (computed once).
-    static float mnMinX;
-    static float mnMaxX;
-    static float mnMinY;
-    static float mnMaxY;
-
-    static bool mbInitialComputations;
+    // Undistorted Image Bounds.
+    float mnMinX;
+    float mnMaxX;
+    float mnMinY;
+    float mnMaxY;
 
 
 private:
@@ -198,6 +199,9 @@ private:
     // Computes image bounds for the undistorted image (called in the constructor).
     void ComputeImageBounds(const cv::Mat &imLeft);
 
+    // Intrinsics, image bounds and grid size from the calibration (called in the constructor).
+    void ComputeCalibration(const cv::Mat &im);
+
     // Assign keypoints to the grid for speed up feature matching (called in the constructor).
     void AssignFeaturesToGrid();
 
@@ -34,6 +34,7 @@
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/vector.hpp>
+#include <atomic>
 #include <mutex>
 
 namespace ORB_SLAM2 {
@@ -42,12 +43,27 @@ class Map;
 class MapPoint;
 class Frame;
 class KeyFrameDatabase;
+struct KeyFrameState;
 
 class KeyFrame {
 public:
   KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB);
   KeyFrame();
 
+  // Keyframe loaded from a map snapshot, with its BoW vectors. Map point
+  // matches, covisibility graph, spanning tree and loop edges are restored
+  // afterwards by the snapshot.
+  KeyFrame(const KeyFrameState &state, Map *pMap, KeyFrameDatabase *pKFDB,
+           ORBVocabulary *pVoc);
+
+  // Copy the data that never changes after the creation of the keyframe
+  // (keypoints, descriptors, BoW, calibration, grid). No lock is taken.
+  void CopyConstantState(KeyFrameState &state) const;
+
+  // KeyFrames are allocated from per-thread slabs, see SlabAllocator
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   // Pose functions
   void SetPose(const cv::Mat &Tcw);
   cv::Mat GetPose();
@@ -70,6 +86,9 @@ public:
   std::vector<KeyFrame *> GetBestCovisibilityKeyFrames(const int &N);
   std::vector<KeyFrame *> GetCovisiblesByWeight(const int &w);
   int GetWeight(KeyFrame *pKF);
+  std::map<KeyFrame *, int> GetConnectionWeights();
+  // Replace the connections with already computed weights (map loading)
+  void SetConnections(const std::map<KeyFrame *, int> &weights);
 
   // Spanning tree functions
   void AddChild(KeyFrame *pKF);
@@ -90,7 +109,17 @@ public:
   void ReplaceMapPointMatch(const size_t &idx, MapPoint *pMP);
   std::set<MapPoint *> GetMapPoints();
   std::vector<MapPoint *> GetMapPointMatches();
+  // Changes each time a map point is added, erased or replaced. Versions are
+  // unique among all keyframes.
+  long unsigned int GetMapPointsVersion();
   int TrackedMapPoints(const int &minObs);
+  // Map points of the keyframe and those observed by three other keyframes at
+  // the same or a finer scale (see LocalMapping::KeyFrameCulling). With bClose
+  // only close stereo points are counted. MapPoint keeps the counters up to
+  // date as its observations change.
+  void GetRedundancy(const bool bClose, int &nMapPoints, int &nRedundant);
+  void UpdateRedundancy(const size_t &idx, const int nMapPoints,
+                        const int nRedundant);
   MapPoint *GetMapPoint(const size_t &idx);
 
   // KeyPoint functions
@@ -109,6 +138,11 @@ public:
   void SetBadFlag();
   bool isBad();
 
+  // Remove a keyframe paged out of memory (see MapTiles). Unlike SetBadFlag
+  // the map points are kept if other keyframes observe them, and the children
+  // are attached to pAnchor, a keyframe that stays in memory.
+  void Unload(KeyFrame *pAnchor);
+
   // Compute Scene Depth (q=2 median). Used in monocular.
   float ComputeSceneMedianDepth(const int q);
 
@@ -207,6 +241,15 @@ protected:
   // MapPoints associated to keypoints
   std::vector<MapPoint *> mvpMapPoints;
 
+  std::atomic<long unsigned int> mnMapPointsVersion;
+  static std::atomic<long unsigned int> nNextMapPointsVersion;
+
+  // Redundancy counters, all map points and close ones
+  std::atomic<int> mnObservedMapPoints;
+  std::atomic<int> mnRedundantMapPoints;
+  std::atomic<int> mnCloseMapPoints;
+  std::atomic<int> mnRedundantCloseMapPoints;
+
   // BoW
   KeyFrameDatabase *mpKeyFrameDB;
   ORBVocabulary *mpORBvocabulary;
@@ -68,8 +68,20 @@ protected:
   // Associated vocabulary
   const ORBVocabulary *mpVoc;
 
+  // Keyframe with a word and its weight in the keyframe, the L1 scores are
+  // accumulated from the postings of the query words
+  struct Posting {
+    KeyFrame *mpKF;
+    DBoW2::WordValue mWeight;
+
+    template <class Archive>
+    void serialize(Archive &ar, const unsigned int version) {
+      ar &mpKF &mWeight;
+    }
+  };
+
   // Inverted file
-  std::vector<list<KeyFrame *>> mvInvertedFile;
+  std::vector<std::vector<Posting>> mvInvertedFile;
 
   // Mutex
   std::mutex mMutex;
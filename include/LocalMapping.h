@@ -26,6 +26,7 @@
 #include "LoopClosing.h"
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
+#include "MapJournal.h"
 
 #include <mutex>
 
@@ -46,6 +47,11 @@ public:
 
     void SetTracker(Tracking* pTracker);
 
+    void SetJournal(MapJournal* pJournal);
+
+    // Local BA with the reprojection errors evaluated in batches (see Optimizer::LocalBundleAdjustment)
+    void SetBatchedBA(const bool bBatched);
+
     // Main function
     void Run();
 
@@ -67,11 +73,18 @@ public:
     void RequestFinish();
     bool isFinished();
 
+    // Duplicated MapPoints merged and observations added by the fusion with the neighbor keyframes since the start
+    void GetFusionCounters(long unsigned int &nFusedMapPoints, long unsigned int &nFusedObservations);
+
     int KeyframesInQueue(){
         unique_lock<std::mutex> lock(mMutexNewKFs);
         return mlNewKeyFrames.size();
     }
 
+    // Held while a keyframe is processed. Map snapshots take it to see the map
+    // between two keyframes.
+    std::mutex mMutexKeyFrameProcessing;
+
 protected:
 
     bool CheckNewKeyFrames();
@@ -83,6 +96,12 @@ protected:
 
     void KeyFrameCulling();
 
+    // Drop references to bad MapPoints, announce a quiescent state and delete
+    // the retired MapPoints that nobody can reference anymore.
+    void ReleaseRetired();
+    int mnReclaimSlot;
+    unsigned long mnLastReclaimEpoch;
+
     cv::Mat ComputeF12(KeyFrame* &pKF1, KeyFrame* &pKF2);
 
     cv::Mat SkewSymmetricMatrix(const cv::Mat &v);
@@ -103,6 +122,7 @@ protected:
 
     LoopClosing* mpLoopCloser;
     Tracking* mpTracker;
+    MapJournal* mpJournal;
 
     std::list<KeyFrame*> mlNewKeyFrames;
 
@@ -113,6 +133,7 @@ protected:
     std::mutex mMutexNewKFs;
 
     bool mbAbortBA;
+    bool mbBatchedBA;
 
     bool mbStopped;
     bool mbStopRequested;
@@ -121,6 +142,10 @@ protected:
 
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
+
+    long unsigned int mnFusedMapPoints;
+    long unsigned int mnFusedObservations;
+    std::mutex mMutexFusion;
 };
 
 } //namespace ORB_SLAM
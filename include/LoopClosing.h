@@ -28,6 +28,7 @@
 #include "Tracking.h"
 
 #include "KeyFrameDatabase.h"
+#include "MapJournal.h"
 
 #include <thread>
 #include <mutex>
@@ -40,12 +41,31 @@ class Tracking;
 class LocalMapping;
 class KeyFrameDatabase;
 
+// Keyframes waiting for loop detection, lags in seconds of keyframe timestamps
+struct LoopQueueStats
+{
+    // Keyframes in the queue, now and at most
+    long unsigned int mnQueued;
+    long unsigned int mnMaxQueued;
+    // Keyframes taken for loop detection, and those added to the database
+    // without it: covisible with a more distinctive one of the backlog, or
+    // left behind by more than the maximum lag
+    long unsigned int mnProcessed;
+    long unsigned int mnCoalesced;
+    long unsigned int mnStale;
+    // Lag of the last and the most delayed processed keyframe behind the
+    // newest keyframe inserted
+    double mLastLag;
+    double mMaxLag;
+};
+
 
 class LoopClosing
 {
 public:
 
-    typedef pair<set<KeyFrame*>,int> ConsistentGroup;    
+    // Ids of the keyframes of a covisibility group, sorted, and its consistency
+    typedef pair<vector<long unsigned int>,int> ConsistentGroup;
     typedef map<KeyFrame*,g2o::Sim3,std::less<KeyFrame*>,
         Eigen::aligned_allocator<std::pair<KeyFrame *const, g2o::Sim3> > > KeyFrameAndPose;
 
@@ -57,11 +77,26 @@ public:
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
 
+    void SetJournal(MapJournal* pJournal);
+
     // Main function
     void Run();
 
     void InsertKeyFrame(KeyFrame *pKF);
 
+    // When more than nQueueLimit keyframes wait (0 is unlimited), only the one
+    // with the most words of each covisible group of the queue is processed.
+    // Keyframes more than maxLag seconds older than the newest one are not
+    // processed (0 disables it). Skipped keyframes are still added to the
+    // database as future loop candidates.
+    void SetQueuePolicy(const int nQueueLimit, const double maxLag);
+
+    // Also fuse the map points closer than this radius (m) to the loop keyframe, found by the spatial index of
+    // the map, not only those of its covisible keyframes. 0 disables it.
+    void SetSpatialSearch(const float radius);
+
+    LoopQueueStats GetQueueStats();
+
     void RequestReset();
 
     // This function will run in a separate thread
@@ -88,12 +123,20 @@ protected:
 
     bool DetectLoop();
 
+    // Removes from the queue the keyframes skipped by the queue policy
+    void TrimQueue(std::vector<KeyFrame*> &vpSkippedKFs);
+
     bool ComputeSim3();
 
     void SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap);
 
     void CorrectLoop();
 
+    // Drop references to culled KeyFrames and announce a quiescent state
+    void ReleaseRetired();
+    int mnReclaimSlot;
+    unsigned long mnLastReclaimEpoch;
+
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
@@ -112,10 +155,20 @@ protected:
 
     LocalMapping *mpLocalMapper;
 
+    MapJournal* mpJournal;
+
     std::list<KeyFrame*> mlpLoopKeyFrameQueue;
 
     std::mutex mMutexLoopQueue;
 
+    // Queue policy and metrics
+    int mnQueueLimit;
+    double mQueueMaxLag;
+    double mLastInsertedTimeStamp;
+    LoopQueueStats mQueueStats;
+
+    float mfSpatialRadius;
+
     // Loop detector parameters
     float mnCovisibilityConsistencyTh;
 
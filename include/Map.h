@@ -24,6 +24,8 @@
 #include "KeyFrame.h"
 #include "MapPoint.h"
 #include "BoostArchiver.h"
+#include "EpochReclaimer.h"
+#include "MapPointIndex.h"
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/serialization/access.hpp>
@@ -60,6 +62,13 @@ public:
 
   void clear();
 
+  // Record the ids of the erased keyframes and map points, and whether the map
+  // was cleared, until they are taken by the MapJournal
+  void EnableJournal();
+  void TakeJournalChanges(std::vector<long unsigned int> &vnErasedKFs,
+                          std::vector<long unsigned int> &vnErasedMPs,
+                          bool &bCleared);
+
   std::vector<KeyFrame *> mvpKeyFrameOrigins;
 
   std::mutex mMutexMapUpdate;
@@ -68,6 +77,18 @@ public:
   // (id conflict)
   std::mutex mMutexPointCreation;
 
+  // Erased MapPoints and KeyFrames are deleted once no thread can reference
+  // them anymore
+  EpochReclaimer mReclaimer;
+
+  // Positions of the map points for geometric queries (disabled unless a voxel
+  // size is set, see map.VoxelSize)
+  MapPointIndex mPointIndex;
+
+  // Held while a snapshot copies keyframe data outside mMutexMapUpdate, the
+  // map is not cleared in the meantime
+  std::mutex mMutexSnapshot;
+
 private:
   friend class boost::serialization::access;
   template <class Archive>
@@ -85,6 +106,12 @@ protected:
   // Index related to a big change in the map (loop closure, global BA)
   int mnBigChangeIdx;
 
+  // Changes not yet taken by the journal
+  bool mbJournal;
+  bool mbJournalCleared;
+  std::vector<long unsigned int> mvnErasedKeyFrames;
+  std::vector<long unsigned int> mvnErasedMapPoints;
+
   std::mutex mMutexMap;
 };
 
@@ -0,0 +1,91 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPCOMPACTOR_H
+#define MAPCOMPACTOR_H
+
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class KeyFrame;
+class Map;
+class MapPoint;
+
+struct CompactionReport {
+  long unsigned int mnKeyFramesBefore;
+  long unsigned int mnKeyFramesAfter;
+  long unsigned int mnMapPointsBefore;
+  long unsigned int mnMapPointsAfter;
+
+  // Removed keyframes whose view can still be relocalized: a remaining
+  // keyframe observes enough of their remaining map points for the PnP of
+  // Tracking::Relocalization
+  long unsigned int mnRemovedKeyFrames;
+  long unsigned int mnRecalledKeyFrames;
+  float mfRecall;
+
+  // Remaining keyframes left with too few map points to relocalize
+  long unsigned int mnWeakKeyFrames;
+};
+
+// Shrinks a map to a keyframe and map point budget.
+//
+// Keyframes are removed from the most redundant, with the criterion of
+// LocalMapping::KeyFrameCulling applied to the whole map: the share of their
+// close map points observed by three other keyframes at the same or a finer
+// scale. A keyframe is only removed if a covisible keyframe shares enough map
+// points to relocalize its view. Map points are then removed from the lowest
+// utility (observations weighted by the found ratio), never leaving a keyframe
+// with too few points.
+//
+// The caller holds the map: Local Mapping stopped and mMutexMapUpdate locked
+// (see System::CompactMap), or no other thread (offline compaction).
+class MapCompactor {
+public:
+  MapCompactor(Map *pMap, const bool bMonocular);
+
+  // A budget of 0 leaves the number of keyframes or map points unchanged
+  CompactionReport Compact(const long unsigned int nMaxKeyFrames,
+                           const long unsigned int nMaxMapPoints);
+
+  // Keyframes are only removed above this share of redundant map points
+  float mfMinRedundancy;
+  // Map points shared with a covisible keyframe, and kept by every keyframe
+  int mnMinRelocPoints;
+  int mnMinKeyFramePoints;
+
+protected:
+  float Redundancy(KeyFrame *pKF);
+  bool CanRemove(KeyFrame *pKF);
+
+  void RemoveKeyFrames(const long unsigned int nMaxKeyFrames);
+  void RemoveMapPoints(const long unsigned int nMaxMapPoints);
+
+  Map *mpMap;
+  bool mbMonocular;
+
+  // Map points of the removed keyframes, to measure the recall
+  std::vector<std::vector<MapPoint *>> mvvpRemovedPoints;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // MAPCOMPACTOR_H
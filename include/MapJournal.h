@@ -0,0 +1,223 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPJOURNAL_H
+#define MAPJOURNAL_H
+
+#include "MapSnapshot.h"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class KeyFrame;
+class Map;
+class MapPoint;
+
+// Pose, spanning tree and covisibility of a keyframe already in the journal
+struct KeyFrameUpdate {
+  long unsigned int mnId;
+  cv::Mat Tcw;
+  long int mnParentId;
+  std::vector<long unsigned int> mvnLoopEdgeIds;
+  std::vector<std::pair<long unsigned int, int>> mvConnections;
+
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mnId &Tcw &mnParentId &mvnLoopEdgeIds &mvConnections;
+  }
+};
+
+// Changes of the map between two records. Keyframes and map points are
+// written whole when they are created or their observations change; only the
+// pose or position is written when they are moved by an optimization.
+struct JournalRecord {
+  JournalRecord() : mnSeq(0), mbReset(false) {}
+
+  long unsigned int mnSeq;
+
+  // The map was cleared before these changes
+  bool mbReset;
+
+  std::vector<KeyFrameState> mvKeyFrames;
+  std::vector<MapPointState> mvMapPoints;
+  std::vector<KeyFrameUpdate> mvKeyFrameUpdates;
+  std::vector<std::pair<long unsigned int, cv::Mat>> mvMapPointPositions;
+  std::vector<long unsigned int> mvnErasedKeyFrames;
+  std::vector<long unsigned int> mvnErasedMapPoints;
+  std::vector<long unsigned int> mvnOriginIds;
+
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mnSeq &mbReset;
+    ar &mvKeyFrames &mvMapPoints &mvKeyFrameUpdates &mvMapPointPositions;
+    ar &mvnErasedKeyFrames &mvnErasedMapPoints &mvnOriginIds;
+  }
+};
+
+// Append-only journal of the map changes since the last snapshot.
+//
+// The journal of a map file is written to numbered segments next to it
+// (mapfile.journal.0, mapfile.journal.1, ...). Records are built by the
+// mapping threads while they hold the map, and written and synced to disk by
+// the journal thread. When a snapshot of the map file is taken the journal is
+// rotated to a new segment, and the segments before it are removed once the
+// snapshot is safely written (compaction). The map saver takes such a snapshot
+// when the journal grows beyond its maximum size.
+//
+// Loading a map replays the journal over the last snapshot. A record torn by a
+// crash ends its segment, one torn by a write error is truncated (or the
+// journal continues in a new segment).
+class MapJournal {
+public:
+  MapJournal(Map *pMap, const std::string &mapfile);
+
+  // Replay the journal over the snapshot of the map file (empty if there is
+  // none). Returns false if there was nothing to replay.
+  bool Replay(MapSnapshot &snapshot);
+
+  // Start writing. After a replay the journal is continued in a new segment.
+  // Otherwise the segments of a previous session (e.g. one that crashed) are
+  // first recovered into the map file and removed once it is written, and the
+  // journal starts with a reset of the map.
+  bool Open();
+  bool isOpen();
+
+  // Bytes written since the last snapshot before the map file is saved again
+  // (0 is unlimited). It is also saved after a record was lost.
+  void SetMaxSize(const size_t nMaxBytes);
+  bool isFull();
+
+  // Main function
+  void Run();
+
+  // Called by Local Mapping once a keyframe is processed. Local BA, point
+  // creation, fusion and culling only modify the local window of pKF. Only
+  // the keyframes and map points of the window that changed since they were
+  // last logged are written.
+  void LogKeyFrame(KeyFrame *pKF);
+
+  // Called with mMutexMapUpdate locked after a loop correction or a global BA.
+  // Every keyframe and map point may have moved, the points of vpFusedKFs may
+  // also have been fused. The unchanged ones are not written.
+  void LogMapCorrection(const std::vector<KeyFrame *> &vpFusedKFs);
+
+  // Called while the snapshot of the map file is captured. The following
+  // records go to a new segment, the snapshot stores where it starts.
+  void Rotate(long unsigned int &nLastSeq, int &nSegment);
+
+  // Called once the snapshot is written, the previous segments are removed
+  void Compact(const int nSegment);
+
+  const std::string &GetMapFile() { return mMapFile; }
+
+  void RequestFinish();
+  bool isFinished();
+
+protected:
+  struct LoggedMapPoint {
+    uint64_t mnSignature;
+    float mPos[3];
+  };
+
+  struct Entry {
+    enum eType { RECORD = 0, ROTATE = 1, COMPACT = 2 };
+    Entry() : mType(RECORD), mnSegment(0), mnGeneration(0) {}
+    eType mType;
+    int mnSegment;
+    JournalRecord mRecord;
+
+    // Logged states of the record, remembered once it is written
+    unsigned int mnGeneration;
+    std::vector<std::pair<long unsigned int, uint64_t>> mvKeyFrameSignatures;
+    std::vector<std::pair<long unsigned int, LoggedMapPoint>> mvMapPoints;
+  };
+
+  // Replay the segments of a previous session into the map file. They are
+  // kept if the map file cannot be read or written.
+  void Recover();
+
+  void Push(Entry &entry);
+
+  // Erased and cleared objects of the map, forgotten by the logged states
+  void TakeMapChanges(Entry &entry);
+  // Add the pose and graph, state or position if it changed since it was
+  // last logged
+  void AddKeyFrameUpdate(KeyFrame *pKF, Entry &entry);
+  void AddMapPoint(MapPoint *pMP, Entry &entry);
+  void AddMapPointPosition(const long unsigned int nId, const cv::Mat &pos,
+                           Entry &entry);
+  // Called by the journal thread once the record of the entry is written
+  void Remember(const Entry &entry);
+
+  std::string SegmentName(const int nSegment);
+  std::vector<int> ListSegments();
+
+  bool OpenSegment(const int nSegment);
+  bool Write(const JournalRecord &record);
+
+  bool CheckFinish();
+  void SetFinish();
+
+  Map *mpMap;
+  std::string mMapFile;
+
+  // Last record and current segment
+  long unsigned int mnSeq;
+  int mnSegment;
+  bool mbReplayed;
+  bool mbOpen;
+
+  std::list<Entry> mlEntries;
+  std::mutex mMutexEntries;
+
+  // Bytes written since the last snapshot and maximum. After a write error
+  // the map file is saved as if the journal was full.
+  size_t mnBytes;
+  size_t mnMaxBytes;
+  bool mbWriteFailed;
+
+  // Signatures of the keyframe updates and map point states, and positions,
+  // last written to the journal. A state is only remembered once its record is
+  // on disk, so a lost record is logged again whole. Records are built one at
+  // a time so that they are logged in the order of the changes. The
+  // generation counts the resets of the map.
+  unsigned int mnGeneration;
+  std::unordered_map<long unsigned int, uint64_t> mKeyFrameSignatures;
+  std::unordered_map<long unsigned int, LoggedMapPoint> mLoggedMapPoints;
+  std::mutex mMutexLog;
+
+  // Only used by the journal thread
+  int mnFile;
+  int mnFileSegment;
+
+  bool mbFinishRequested;
+  bool mbFinished;
+  std::mutex mMutexFinish;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // MAPJOURNAL_H
@@ -41,6 +41,7 @@ namespace ORB_SLAM2 {
 class KeyFrame;
 class Map;
 class Frame;
+struct MapPointState;
 
 class MapPoint {
 public:
@@ -48,6 +49,17 @@ public:
   MapPoint(const cv::Mat &Pos, Map *pMap, Frame *pFrame, const int &idxF);
   MapPoint();
 
+  // MapPoint loaded from a map snapshot. Observations are added afterwards.
+  MapPoint(const MapPointState &state, KeyFrame *pRefKF, Map *pMap);
+
+  // Copy position, descriptor, viewing direction and counters. References to
+  // keyframes are filled by the snapshot.
+  void GetState(MapPointState &state);
+
+  // MapPoints are allocated from per-thread slabs, see SlabAllocator
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   void SetWorldPos(const cv::Mat &Pos);
   cv::Mat GetWorldPos();
 
@@ -55,10 +67,15 @@ public:
   KeyFrame *GetReferenceKeyFrame();
 
   std::map<KeyFrame *, size_t> GetObservations();
+  // Appends the observing keyframes to vpKFs, without copying the observations
+  void GetObservingKeyFrames(std::vector<KeyFrame *> &vpKFs);
   int Observations();
 
   void AddObservation(KeyFrame *pKF, size_t idx);
   void EraseObservation(KeyFrame *pKF);
+  // Observation of a keyframe paged out of memory (see MapTiles). The point is
+  // only discarded when no keyframe in memory observes it anymore.
+  void UnloadObservation(KeyFrame *pKF);
 
   int GetIndexInKeyFrame(KeyFrame *pKF);
   bool IsInKeyFrame(KeyFrame *pKF);
@@ -127,6 +144,15 @@ protected:
   // Keyframes observing the point and associated index in keyframe
   std::map<KeyFrame *, size_t> mObservations;
 
+  // Other keyframes observing the point at the same or a finer scale than each
+  // observation. The observation is redundant from REDUNDANT_OBSERVERS on and
+  // counted by KeyFrame::UpdateRedundancy. Called under mMutexFeatures.
+  std::map<KeyFrame *, int> mFinerObservers;
+  static const int REDUNDANT_OBSERVERS = 3;
+  void AddRedundancy(KeyFrame *pKF, size_t idx);
+  void EraseRedundancy(KeyFrame *pKF, size_t idx);
+  void ClearRedundancy();
+
   // Mean viewing direction
   cv::Mat mNormalVector;
 
@@ -0,0 +1,101 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPOINTINDEX_H
+#define MAPPOINTINDEX_H
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class MapPoint;
+
+// Spatial hash of the map point positions in cubic voxels.
+//
+// Map keeps it up to date as points are added and erased, and MapPoint as
+// they move (creation, bundle adjustment, loop correction). A position is
+// only as recent as the last SetWorldPos seen by the index, queries return
+// candidates to be checked against the current position (e.g.
+// Frame::isInFrustum).
+class MapPointIndex {
+public:
+  MapPointIndex();
+
+  // Edge of the voxels (m). The index is disabled with 0 (default), it must be
+  // set before any point is added.
+  void SetVoxelSize(const float voxelSize);
+  // Without locking, a disabled index costs nothing to the map updates
+  bool IsEnabled();
+
+  // Positions are read from the point with the index locked (MapPoint mutexes
+  // are never held when calling in)
+  void Insert(MapPoint *pMP);
+  void Update(MapPoint *pMP);
+  void Erase(MapPoint *pMP);
+  void clear();
+
+  // Points closer than radius to Pos
+  std::vector<MapPoint *> GetPointsInRadius(const cv::Mat &Pos,
+                                            const float radius);
+
+  // Points in front of a camera Tcw, closer than maxDepth and projected in the
+  // image bounds
+  std::vector<MapPoint *>
+  GetPointsInFrustum(const cv::Mat &Tcw, const float fx, const float fy,
+                     const float cx, const float cy, const float minX,
+                     const float maxX, const float minY, const float maxY,
+                     const float maxDepth);
+
+  size_t size();
+
+protected:
+  typedef long long int VoxelKey;
+
+  struct Entry {
+    VoxelKey key;
+    float x, y, z;
+  };
+
+  // 21 bits per coordinate
+  static VoxelKey Key(const int i, const int j, const int k);
+  VoxelKey Key(const float x, const float y, const float z);
+
+  void Remove(MapPoint *pMP, const VoxelKey key);
+
+  float mfVoxelSize;
+  float mfInvVoxelSize;
+
+  std::unordered_map<VoxelKey, std::vector<MapPoint *>> mVoxels;
+  std::unordered_map<MapPoint *, Entry> mPoints;
+
+  // mfVoxelSize > 0, read without the mutex
+  std::atomic<bool> mbEnabled;
+
+  std::mutex mMutexIndex;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // MAPPOINTINDEX_H
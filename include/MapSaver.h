@@ -0,0 +1,104 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPSAVER_H
+#define MAPSAVER_H
+
+#include "MapSnapshot.h"
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace ORB_SLAM2 {
+
+class Map;
+class LocalMapping;
+class MapJournal;
+
+// Saves the map while tracking and local mapping keep running.
+//
+// Tracking and local mapping are only held while the snapshot records the
+// keyframes and map points of the map. Their state is copied and the file is
+// written afterwards, from the saver thread for background saves and
+// checkpoints.
+class MapSaver {
+public:
+  MapSaver(Map *pMap, LocalMapping *pLocalMapper);
+
+  // Saving the map file of the journal compacts it
+  void SetJournal(MapJournal *pJournal);
+
+  // Write the map to filename every period seconds if it changed (0 disables)
+  void SetCheckpoint(const std::string &filename, const double period);
+
+  // Main function
+  void Run();
+
+  // Snapshot the map and write it from the calling thread
+  bool Save(const std::string &filename);
+
+  // Same as Save, but the snapshot and the writing are done by the saver
+  // thread. Returns immediately.
+  void RequestSave(const std::string &filename);
+  bool isSaving();
+
+  void RequestFinish();
+  bool isFinished();
+
+protected:
+  void TakeSnapshot(MapSnapshot &snapshot, const bool bRotateJournal);
+
+  bool CheckpointDue();
+
+  bool CheckFinish();
+  void SetFinish();
+
+  Map *mpMap;
+  LocalMapping *mpLocalMapper;
+  MapJournal *mpJournal;
+
+  // Saves are not interleaved, a snapshot never overwrites a newer one
+  std::mutex mMutexSave;
+
+  std::string mCheckpointFile;
+  double mCheckpointPeriod;
+  std::chrono::steady_clock::time_point mLastCheckpoint;
+
+  // Map state at the last checkpoint (last keyframe id, big change index,
+  // number of keyframes and map points)
+  long unsigned int mnCheckpointMaxKFid;
+  int mnCheckpointBigChange;
+  long unsigned int mnCheckpointKFs;
+  long unsigned int mnCheckpointMPs;
+
+  std::list<std::string> mlSaveRequests;
+  bool mbSaving;
+  std::mutex mMutexRequests;
+
+  bool mbFinishRequested;
+  bool mbFinished;
+  std::mutex mMutexFinish;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // MAPSAVER_H
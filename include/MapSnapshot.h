@@ -0,0 +1,222 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPSNAPSHOT_H
+#define MAPSNAPSHOT_H
+
+#include "BoostArchiver.h"
+#include "ORBVocabulary.h"
+
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/vector.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class KeyFrame;
+class KeyFrameDatabase;
+class Map;
+class MapPoint;
+
+// Copy of a keyframe. References to other keyframes and map points are stored
+// by id, -1 if there is none. Everything derived from the observations is kept
+// (BoW vectors, covisibility weights) so a map is loaded without recomputing
+// it.
+struct KeyFrameState {
+  long unsigned int mnId;
+  long unsigned int mnFrameId;
+  double mTimeStamp;
+
+  int mnGridCols;
+  int mnGridRows;
+  float mfGridElementWidthInv;
+  float mfGridElementHeightInv;
+  std::vector<std::vector<std::vector<size_t>>> mGrid;
+
+  float fx, fy, cx, cy, invfx, invfy, mbf, mb, mThDepth;
+
+  int N;
+  std::vector<cv::KeyPoint> mvKeys;
+  std::vector<cv::KeyPoint> mvKeysUn;
+  std::vector<float> mvuRight;
+  std::vector<float> mvDepth;
+  cv::Mat mDescriptors;
+
+  DBoW2::BowVector mBowVec;
+  DBoW2::FeatureVector mFeatVec;
+
+  int mnScaleLevels;
+  float mfScaleFactor;
+  float mfLogScaleFactor;
+  std::vector<float> mvScaleFactors;
+  std::vector<float> mvLevelSigma2;
+  std::vector<float> mvInvLevelSigma2;
+
+  int mnMinX;
+  int mnMinY;
+  int mnMaxX;
+  int mnMaxY;
+  cv::Mat mK;
+
+  cv::Mat Tcw;
+  std::vector<long int> mvnMapPointIds;
+  long int mnParentId;
+  std::vector<long unsigned int> mvnLoopEdgeIds;
+  // Covisibility graph, (keyframe id, weight) pairs
+  std::vector<std::pair<long unsigned int, int>> mvConnections;
+
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mnId &mnFrameId &mTimeStamp;
+    ar &mnGridCols &mnGridRows &mfGridElementWidthInv &mfGridElementHeightInv;
+    ar &mGrid;
+    ar &fx &fy &cx &cy &invfx &invfy &mbf &mb &mThDepth;
+    ar &N &mvKeys &mvKeysUn &mvuRight &mvDepth &mDescriptors;
+    ar &mBowVec &mFeatVec;
+    ar &mnScaleLevels &mfScaleFactor &mfLogScaleFactor;
+    ar &mvScaleFactors &mvLevelSigma2 &mvInvLevelSigma2;
+    ar &mnMinX &mnMinY &mnMaxX &mnMaxY &mK;
+    ar &Tcw &mvnMapPointIds &mnParentId &mvnLoopEdgeIds &mvConnections;
+  }
+};
+
+// Copy of a map point. Observations are (keyframe id, keypoint index) pairs.
+struct MapPointState {
+  long unsigned int mnId;
+  long int mnFirstKFid;
+  long int mnFirstFrame;
+
+  cv::Mat mWorldPos;
+  cv::Mat mNormalVector;
+  cv::Mat mDescriptor;
+
+  long int mnRefKFId;
+  std::vector<std::pair<long unsigned int, size_t>> mvObservations;
+
+  int mnVisible;
+  int mnFound;
+
+  float mfMinDistance;
+  float mfMaxDistance;
+
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mnId &mnFirstKFid &mnFirstFrame;
+    ar &mWorldPos &mNormalVector &mDescriptor;
+    ar &mnRefKFId &mvObservations;
+    ar &mnVisible &mnFound &mfMinDistance &mfMaxDistance;
+  }
+};
+
+// Immutable copy of the whole map, written with the Boost archives.
+//
+// Taking a snapshot of a live map is done in two steps:
+//   1. Capture(): records the keyframes, the map points and the spanning tree,
+//      only pointers and ids are copied. The caller must hold every lock that
+//      keeps the map from changing, see MapSaver.
+//   2. CopyState(): copies each keyframe and map point under its own mutexes
+//      while the SLAM threads keep running. The objects must not be deleted in
+//      between (the caller holds a slot in the EpochReclaimer of the map). A
+//      match changed during the copy may be seen from one side only, such
+//      references are dropped so the snapshot stays consistent. The changes
+//      made after Capture() are in the journal rotated with it.
+class MapSnapshot {
+public:
+  MapSnapshot();
+
+  void Capture(Map *pMap);
+  void CopyState();
+
+  // Mutable state of a single keyframe or map point, references to bad objects
+  // are dropped. Returns false for a map point without valid observations.
+  static void CaptureKeyFrame(KeyFrame *pKF, KeyFrameState &state);
+  static bool CaptureMapPoint(MapPoint *pMP, MapPointState &state);
+
+  // Spanning tree parent, loop edges and covisibility weights of a keyframe
+  static void
+  CaptureGraph(KeyFrame *pKF, long int &nParentId,
+               std::vector<long unsigned int> &vnLoopEdgeIds,
+               std::vector<std::pair<long unsigned int, int>> &vConnections);
+
+  // The file is written next to filename and renamed when complete, a crash
+  // never leaves a truncated map.
+  bool Save(const std::string &filename) const;
+  bool Load(const std::string &filename);
+
+  // Check that every reference between keyframes and map points is valid and
+  // two-sided. Problems are reported to cerr, returns false if any.
+  bool CheckConsistency() const;
+
+  // Create the keyframes and map points in an empty map. Nothing is recomputed
+  // (BoW, covisibility, descriptors, normals), the keyframe database is filled
+  // from the stored BoW vectors.
+  void Restore(Map *pMap, KeyFrameDatabase *pKFDB, ORBVocabulary *pVoc);
+
+  // Add the keyframes and map points to a map that already holds KFs and MPs
+  // (indexed by id), references between old and new objects are linked on both
+  // sides and the new objects are added to KFs and MPs. Keyframes whose parent
+  // is not in the map are attached to pDefaultParent. Used to page map tiles.
+  void Restore(Map *pMap, KeyFrameDatabase *pKFDB, ORBVocabulary *pVoc,
+               std::unordered_map<long unsigned int, KeyFrame *> &KFs,
+               std::unordered_map<long unsigned int, MapPoint *> &MPs,
+               KeyFrame *pDefaultParent);
+
+  bool empty() const { return mvKeyFrames.empty(); }
+
+  std::vector<KeyFrameState> mvKeyFrames;
+  std::vector<MapPointState> mvMapPoints;
+
+  std::vector<long unsigned int> mvnOriginIds;
+
+  long unsigned int mnNextKFId;
+  long unsigned int mnNextMPId;
+  long unsigned int mnNextFrameId;
+
+  // Last journal record included in the snapshot and first journal segment
+  // written after it, see MapJournal
+  long unsigned int mnJournalSeq;
+  int mnJournalSegment;
+
+private:
+  friend class boost::serialization::access;
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mvKeyFrames &mvMapPoints &mvnOriginIds;
+    ar &mnNextKFId &mnNextMPId &mnNextFrameId;
+    ar &mnJournalSeq &mnJournalSegment;
+  }
+
+  // Keeps the references found on both sides, see CopyState()
+  void Reconcile();
+
+  // Objects recorded by Capture() and not copied yet (keyframes in the same
+  // order as mvKeyFrames)
+  std::vector<KeyFrame *> mvpPendingKeyFrames;
+  std::vector<MapPoint *> mvpPendingMapPoints;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // MAPSNAPSHOT_H
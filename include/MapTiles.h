@@ -0,0 +1,192 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPTILES_H
+#define MAPTILES_H
+
+#include "MapSnapshot.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class KeyFrame;
+class KeyFrameDatabase;
+class Map;
+class MapPoint;
+class SharedMap;
+
+// Cell of the tile grid. Tiles split the ground plane (x, z of the world
+// frame) in squares of the tile size.
+struct TileInfo {
+  int mnX;
+  int mnZ;
+  long unsigned int mnKeyFrames;
+  // Size of the tile file, used as the memory cost of the tile
+  long unsigned int mnBytes;
+
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mnX &mnZ &mnKeyFrames &mnBytes;
+  }
+};
+
+struct MapTileIndex {
+  float mfTileSize;
+  std::vector<TileInfo> mvTiles;
+
+  // Global relocalization index: one (word, tile) pair per word of every
+  // keyframe, sorted. It only votes for a tile, the keyframes are matched once
+  // the tile is in memory.
+  std::vector<std::pair<DBoW2::WordId, int>> mvWordTiles;
+
+  // The first keyframe of the map anchors the spanning tree of the paged
+  // keyframes, its tile is never evicted
+  long unsigned int mnAnchorId;
+  int mnAnchorTile;
+
+  template <class Archive>
+  void serialize(Archive &ar, const unsigned int version) {
+    ar &mfTileSize &mvTiles &mvWordTiles &mnAnchorId &mnAnchorTile;
+  }
+};
+
+// Spatially tiled map for the localization mode.
+//
+// The keyframes of the map file are split by the position of their camera in
+// tiles written next to it (mapfile.tile.N, with the index in mapfile.tiles),
+// a map point goes with its reference keyframe. Only the tiles around the
+// camera and its position predicted by the motion are kept in memory, the
+// farthest tiles are evicted when the memory budget is exceeded. While the
+// camera is lost, the global relocalization index selects the tile to load.
+//
+// Tiles are loaded and evicted by the paging thread under mMutexMapUpdate,
+// evicted keyframes and map points are retired to the EpochReclaimer like
+// culled ones. The map is read-only while paged: there is no Local Mapping.
+class MapTiles {
+public:
+  MapTiles(Map *pMap, KeyFrameDatabase *pKFDB, ORBVocabulary *pVoc,
+           const std::string &mapfile);
+
+  // Read the tile index, or build the tiles from the map file if there is no
+  // index, it is older than the map file or has another tile size. The anchor
+  // tile is loaded. Returns false if there is no map.
+  bool Open(const float fTileSize);
+
+  // Descriptors of the loaded tiles point to the shared map if they are in it
+  void SetSharedMap(const SharedMap *pSharedMap);
+
+  // Tiles kept in memory around the camera and its predicted position (in
+  // tiles), memory budget (MB, 0 is unlimited) and prediction horizon (s)
+  void SetPaging(const int nRadius, const double budget,
+                 const double lookahead);
+
+  // Main function
+  void Run();
+
+  // Called by Tracking once the camera is localized, never blocks
+  void SetCameraCenter(const cv::Mat &Ow, const double &timestamp);
+
+  // Called by Tracking when the keyframes in memory cannot relocalize the
+  // frame, never blocks
+  void RequestRelocalization(const DBoW2::BowVector &BowVec);
+
+  // Called by Tracking before the map is cleared, the tiles are forgotten
+  void RequestReset();
+
+  void RequestFinish();
+  bool isFinished();
+
+protected:
+  // Objects are referred by id, mKFs and mMPs only hold the ones in memory
+  struct ResidentTile {
+    std::vector<long unsigned int> mvnKeyFrameIds;
+    std::vector<long unsigned int> mvnMapPointIds;
+  };
+
+  bool Build(const float fTileSize);
+  bool ReadIndex();
+  bool WriteIndex();
+
+  std::string TileName(const int nTile);
+  int FindTile(const int nX, const int nZ);
+  void Cell(const cv::Mat &pos, int &nX, int &nZ);
+
+  // Tiles that must be in memory, sorted from the nearest
+  std::vector<int> DesiredTiles();
+  int BestRelocalizationTile(const DBoW2::BowVector &BowVec);
+  int Distance(const int nTile);
+
+  bool LoadTile(const int nTile);
+  // False if the anchor keyframe is not loaded
+  bool UnloadTile(const int nTile);
+  void ResetIfRequested();
+
+  bool CheckFinish();
+  void SetFinish();
+
+  Map *mpMap;
+  KeyFrameDatabase *mpKeyFrameDB;
+  ORBVocabulary *mpORBVocabulary;
+  std::string mMapFile;
+  const SharedMap *mpSharedMap;
+
+  MapTileIndex mIndex;
+  std::map<std::pair<int, int>, int> mmCellTiles;
+
+  int mnRadius;
+  long unsigned int mnBudget;
+  double mLookahead;
+
+  // Only used by the paging thread (and Open)
+  std::map<int, ResidentTile> mmResident;
+  // Tiles that could not be read and when they are read again
+  std::map<int, std::chrono::steady_clock::time_point> mmRetry;
+  long unsigned int mnResidentBytes;
+  std::unordered_map<long unsigned int, KeyFrame *> mKFs;
+  std::unordered_map<long unsigned int, MapPoint *> mMPs;
+  int mnRelocTile;
+  double mLastTimeStamp;
+
+  // Requests from Tracking
+  cv::Mat mOw;
+  cv::Mat mPredictedOw;
+  double mTimeStamp;
+  bool mbRelocRequested;
+  DBoW2::BowVector mRelocBowVec;
+  bool mbResetRequested;
+  std::mutex mMutexRequests;
+  std::mutex mMutexReset;
+
+  bool mbFinishRequested;
+  bool mbFinished;
+  std::mutex mMutexFinish;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // MAPTILES_H
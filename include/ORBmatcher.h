@@ -79,6 +79,12 @@ public:
     // Project MapPoints into KeyFrame and search for duplicated MapPoints.
     int Fuse(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, const float th=3.0);
 
+    // Same as Fuse in two steps. The search does not change the map and can run in parallel: vnMatches[i] is the
+    // keypoint of pKF matched with vpMapPoints[i] (-1 if none). The matches are then applied in a single thread,
+    // points replaced in the meantime are followed to the point that replaced them.
+    int SearchForFusion(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, vector<int> &vnMatches, const float th=3.0);
+    void ApplyFusion(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, const vector<int> &vnMatches, int &nReplaced, int &nAdded);
+
     // Project MapPoints into KeyFrame using a given Sim3 and search for duplicated MapPoints.
     int Fuse(KeyFrame* pKF, cv::Mat Scw, const std::vector<MapPoint*> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint);
 
@@ -37,13 +37,20 @@ class LoopClosing;
 class Optimizer
 {
 public:
+    // Each thread keeps the optimizer of each function between the calls and recycles its vertices and edges
+    // (see OptimizerWorkspace).
+    // With bBatched, the reprojection errors and Jacobians of the map point observations are evaluated together in
+    // float (see g2o::ReprojectionBatch) instead of edge by edge. The system is still accumulated in double.
     void static BundleAdjustment(const std::vector<KeyFrame*> &vpKF, const std::vector<MapPoint*> &vpMP,
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true, const bool bBatched = false);
     void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
                                        const unsigned long nLoopKF=0, const bool bRobust = true);
-    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap);
-    int static PoseOptimization(Frame* pFrame);
+    void static LocalBundleAdjustment(KeyFrame* pKF, bool *pbStopFlag, Map *pMap, const bool bBatched = false);
+    int static PoseOptimization(Frame* pFrame, const bool bBatched = false);
+    // Pose of pFrame with the observations of the other cameras of a rig, vTcb[i] is the pose of pFrame in vRigFrames[i]
+    int static PoseOptimization(Frame* pFrame, std::vector<Frame> &vRigFrames, const std::vector<cv::Mat> &vTcb,
+                                const bool bBatched = false);
 
     // if bFixScale is true, 6DoF optimization (stereo,rgbd), 7DoF otherwise (mono)
     void static OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
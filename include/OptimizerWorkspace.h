@@ -0,0 +1,108 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPTIMIZERWORKSPACE_H
+#define OPTIMIZERWORKSPACE_H
+
+#include "Thirdparty/g2o/g2o/core/sparse_optimizer.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+#include <new>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+// Optimizer kept by a thread between the calls of an Optimizer function.
+//
+// The vertices and edges of a call are recycled by the next ones instead of
+// being allocated again, and the block solver keeps the Hessian blocks and the
+// symbolic decomposition while the structure of the problem repeats (see
+// g2o::BlockSolver::buildStructure). Recycled objects are kept until the
+// thread exits.
+class OptimizerWorkspace {
+public:
+  // The problems use different solvers, each one has its workspace
+  enum eProblem {
+    POSE_OPTIMIZATION = 0,
+    LOCAL_BUNDLE_ADJUSTMENT = 1,
+    BUNDLE_ADJUSTMENT = 2,
+    ESSENTIAL_GRAPH = 3,
+    SIM3 = 4,
+    N_PROBLEMS = 5
+  };
+
+  // Workspace of the calling thread during an optimization. The graph is
+  // emptied when the scope ends, its vertices and edges must not be used
+  // afterwards.
+  class Scope {
+  public:
+    explicit Scope(const eProblem problem);
+    ~Scope();
+
+    // Without algorithm until the first optimization sets it
+    g2o::SparseOptimizer &Optimizer() { return mpWorkspace->mOptimizer; }
+
+    // Added to the optimizer by the first call
+    g2o::ReprojectionBatch &Batch();
+
+    // Vertex or edge to add to the optimizer, default constructed
+    template <class T> T *New() { return mpWorkspace->New<T>(); }
+
+  private:
+    OptimizerWorkspace *mpWorkspace;
+    // Owned by the scope if the workspace of the thread is already in use
+    bool mbOwned;
+  };
+
+  ~OptimizerWorkspace();
+
+protected:
+  OptimizerWorkspace();
+
+  typedef std::vector<g2o::HyperGraph::HyperGraphElement *> Elements;
+
+  template <class T> T *New() {
+    Elements &vpFree = mFree[std::type_index(typeid(T))];
+    if (vpFree.empty())
+      return new T();
+    T *pObject = static_cast<T *>(vpFree.back());
+    vpFree.pop_back();
+    pObject->~T();
+    return new (pObject) T();
+  }
+
+  // Takes back the vertices and edges still in the graph
+  void Release();
+
+  g2o::SparseOptimizer mOptimizer;
+  g2o::ReprojectionBatch mBatch;
+  bool mbBatchAdded;
+  bool mbInUse;
+
+  // Vertices and edges of the previous optimizations by type
+  std::unordered_map<std::type_index, Elements> mFree;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // OPTIMIZERWORKSPACE_H
@@ -0,0 +1,60 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+// Runs f(begin, end) on contiguous blocks of [0, n), one per thread, with at
+// least nMinBlock elements per block. The calling thread runs the first block.
+// nThreads is the number of cores by default.
+template <class Function>
+void ParallelFor(const size_t n, const size_t nMinBlock, const Function &f,
+                 size_t nThreads = 0) {
+  if (nThreads == 0)
+    nThreads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t nBlocks = std::max(
+      (size_t)1, std::min(nThreads, n / std::max(nMinBlock, (size_t)1)));
+  if (nBlocks == 1) {
+    f((size_t)0, n);
+    return;
+  }
+
+  std::vector<std::thread> vThreads;
+  vThreads.reserve(nBlocks - 1);
+  for (size_t b = 1; b < nBlocks; b++) {
+    const size_t begin = n * b / nBlocks;
+    const size_t end = n * (b + 1) / nBlocks;
+    vThreads.push_back(std::thread([&f, begin, end]() { f(begin, end); }));
+  }
+  f((size_t)0, n / nBlocks);
+  for (size_t i = 0; i < vThreads.size(); i++)
+    vThreads[i].join();
+}
+
+} // namespace ORB_SLAM2
+
+#endif // PARALLEL_H
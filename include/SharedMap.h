@@ -0,0 +1,111 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHAREDMAP_H
+#define SHAREDMAP_H
+
+#include <opencv2/core/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ORB_SLAM2 {
+
+class MapSnapshot;
+
+// Read-only view of a whole file, mapped in memory and shared with every
+// process mapping the same file (the pages are only loaded once).
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  bool Open(const std::string &filename);
+  void Close();
+
+  const unsigned char *data() const { return mpData; }
+  size_t size() const { return mnSize; }
+
+protected:
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+  const unsigned char *mpData;
+  size_t mnSize;
+};
+
+// Descriptors of a map file, shared by the localization processes of the same
+// map (one per camera).
+//
+// The descriptors are most of the memory of a map and never change once a
+// keyframe is created. They are written contiguously to mapfile.shared, which
+// is mapped read-only; the descriptors of the loaded keyframes and map points
+// point to it instead of being copied in every process. The rest of the
+// keyframes and map points, including the tracking fields, is per process.
+//
+// The mapping must outlive the keyframes and map points restored with it.
+class SharedMap {
+public:
+  SharedMap();
+
+  // Map mapfile.shared, written first from the map file if it is missing or
+  // older. pSnapshot is the loaded map file if there is one, it is only read
+  // if the shared file is written.
+  bool Open(const std::string &mapfile, const MapSnapshot *pSnapshot = NULL);
+
+  // Point the descriptors of the snapshot to the shared file, only if they are
+  // equal (the shared file of a journaled map lags behind it). Returns the
+  // number of descriptors shared.
+  size_t Share(MapSnapshot &snapshot) const;
+
+  static bool Write(const MapSnapshot &snapshot, const std::string &filename);
+
+protected:
+  // Tables sorted by id, offsets from the beginning of the file
+  struct KeyFrameEntry {
+    uint64_t mnId;
+    uint64_t mnOffset;
+    uint32_t mnRows;
+    uint32_t mnCols;
+  };
+  struct MapPointEntry {
+    uint64_t mnId;
+    uint64_t mnOffset;
+  };
+  struct Header {
+    char mMagic[8];
+    uint32_t mnVersion;
+    uint32_t mnDescriptorBytes;
+    uint64_t mnKeyFrames;
+    uint64_t mnMapPoints;
+  };
+
+  bool Validate();
+
+  MappedFile mFile;
+  const Header *mpHeader;
+  const KeyFrameEntry *mpKeyFrames;
+  const MapPointEntry *mpMapPoints;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // SHAREDMAP_H
@@ -0,0 +1,156 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SLABALLOCATOR_H
+#define SLABALLOCATOR_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+// Fixed-size block allocator for objects of type T.
+//
+// Blocks are carved out of slabs of N objects. Each thread allocates from its
+// own cache, so the objects created by one thread in a row (the MapPoints of a
+// new keyframe, the temporal points of a frame) are adjacent in memory and no
+// lock is taken in the common case. Released blocks go back to the cache of
+// the releasing thread and are handed over to a shared pool in batches.
+// Slabs are never returned to the system. A request for another size than T
+// (an object of a derived class) is served by the global operator new.
+template <class T, size_t N = 512> class SlabAllocator {
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "Slabs only provide the default new alignment");
+
+public:
+  static void *Allocate(const size_t size = sizeof(T)) {
+    if (size != sizeof(T))
+      return ::operator new(size);
+
+    Cache &cache = GetCache();
+    if (!cache.vpFree.empty()) {
+      void *p = cache.vpFree.back();
+      cache.vpFree.pop_back();
+      return p;
+    }
+
+    if (cache.pNext == cache.pEnd)
+      Refill(cache);
+
+    if (!cache.vpFree.empty()) {
+      void *p = cache.vpFree.back();
+      cache.vpFree.pop_back();
+      return p;
+    }
+
+    void *p = cache.pNext;
+    cache.pNext += BlockSize();
+    return p;
+  }
+
+  static void Deallocate(void *p, const size_t size = sizeof(T)) {
+    if (!p)
+      return;
+    if (size != sizeof(T)) {
+      ::operator delete(p);
+      return;
+    }
+
+    Cache &cache = GetCache();
+    cache.vpFree.push_back(p);
+
+    // Do not let one thread hoard the blocks released by the others
+    if (cache.vpFree.size() >= 2 * Batch()) {
+      Pool &pool = GetPool();
+      std::unique_lock<std::mutex> lock(pool.mMutex);
+      pool.vpFree.insert(pool.vpFree.end(), cache.vpFree.end() - Batch(),
+                         cache.vpFree.end());
+      cache.vpFree.resize(cache.vpFree.size() - Batch());
+    }
+  }
+
+protected:
+  struct Pool {
+    std::vector<char *> vpSlabs;
+    std::vector<void *> vpFree;
+    std::mutex mMutex;
+  };
+
+  struct Cache {
+    Cache() : pNext(NULL), pEnd(NULL) {}
+
+    // Blocks of a finished thread go back to the shared pool
+    ~Cache() {
+      Pool &pool = GetPool();
+      std::unique_lock<std::mutex> lock(pool.mMutex);
+      pool.vpFree.insert(pool.vpFree.end(), vpFree.begin(), vpFree.end());
+      for (; pNext != pEnd; pNext += BlockSize())
+        pool.vpFree.push_back(pNext);
+    }
+
+    std::vector<void *> vpFree;
+    char *pNext;
+    char *pEnd;
+  };
+
+  static size_t BlockSize() {
+    const size_t align = alignof(std::max_align_t);
+    return (sizeof(T) + align - 1) / align * align;
+  }
+
+  static size_t Batch() { return N / 4 > 0 ? N / 4 : 1; }
+
+  static void Refill(Cache &cache) {
+    Pool &pool = GetPool();
+    std::unique_lock<std::mutex> lock(pool.mMutex);
+
+    // Reuse released blocks before growing
+    if (!pool.vpFree.empty()) {
+      const size_t n = pool.vpFree.size() < Batch() ? pool.vpFree.size()
+                                                      : Batch();
+      cache.vpFree.insert(cache.vpFree.end(), pool.vpFree.end() - n,
+                          pool.vpFree.end());
+      pool.vpFree.resize(pool.vpFree.size() - n);
+      return;
+    }
+
+    char *pSlab = static_cast<char *>(::operator new(N * BlockSize()));
+    pool.vpSlabs.push_back(pSlab);
+    cache.pNext = pSlab;
+    cache.pEnd = pSlab + N * BlockSize();
+  }
+
+  // Never destroyed, threads still running at exit may release blocks
+  static Pool &GetPool() {
+    static Pool *pPool = new Pool();
+    return *pPool;
+  }
+
+  static Cache &GetCache() {
+    static thread_local Cache cache;
+    return cache;
+  }
+};
+
+} // namespace ORB_SLAM2
+
+#endif // SLABALLOCATOR_H
@@ -26,9 +26,15 @@
 #include "LocalMapping.h"
 #include "LoopClosing.h"
 #include "Map.h"
+#include "MapCompactor.h"
 #include "MapDrawer.h"
+#include "MapJournal.h"
+#include "MapSaver.h"
+#include "MapTiles.h"
 #include "ORBVocabulary.h"
+#include "SharedMap.h"
 #include "Tracking.h"
+#include "TrajectorySink.h"
 #include "Viewer.h"
 #include <opencv2/core/core.hpp>
 #include <string>
@@ -58,20 +64,31 @@ public:
   // Proccess the given stereo frame. Images must be synchronized and rectified.
   // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to
   // grayscale. Returns the camera pose (empty if tracking fails).
+  // With a camera rig (Rig.nCameras in the settings file), vRigImages are the
+  // images of the other cameras taken with the main one, in the order of the
+  // settings, here and in TrackRGBD/TrackMonocular. Their features are
+  // extracted in parallel and constrain the pose of the main camera, which
+  // alone builds the map.
   cv::Mat TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
-                      const double &timestamp);
+                      const double &timestamp,
+                      const std::vector<cv::Mat> &vRigImages =
+                          std::vector<cv::Mat>());
 
   // Process the given rgbd frame. Depthmap must be registered to the RGB frame.
   // Input image: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to
   // grayscale. Input depthmap: Float (CV_32F). Returns the camera pose (empty
   // if tracking fails).
   cv::Mat TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap,
-                    const double &timestamp);
+                    const double &timestamp,
+                    const std::vector<cv::Mat> &vRigImages =
+                        std::vector<cv::Mat>());
 
   // Proccess the given monocular frame
   // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to
   // grayscale. Returns the camera pose (empty if tracking fails).
-  cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp);
+  cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp,
+                         const std::vector<cv::Mat> &vRigImages =
+                             std::vector<cv::Mat>());
 
   // This stops local mapping thread (map building) and performs only camera
   // tracking.
@@ -94,6 +111,8 @@ public:
   // Save camera trajectory in the TUM RGB-D dataset format.
   // Only for stereo and RGB-D. This method does not work for monocular.
   // Call first Shutdown()
+  // If the trajectory was streamed, the frames already written are corrected
+  // with the final keyframe poses.
   // See format details at: http://vision.in.tum.de/data/datasets/rgbd-dataset
   void SaveTrajectoryTUM(const string &filename);
 
@@ -110,24 +129,60 @@ public:
   // http://www.cvlibs.net/datasets/kitti/eval_odometry.php
   void SaveTrajectoryKITTI(const string &filename);
 
-  // TODO: Save/Load functions
+  // Receive the pose of every frame once its reference keyframe left the local
+  // map. Poses can still be corrected afterwards by loop closures, the
+  // trajectory saved at the end of the execution includes those corrections.
+  // The stream file is set by Trajectory.StreamFile in the settings file.
+  // Frames also reach the callback once Trajectory.MaxHistory newer frames are
+  // waiting. The callback runs on the tracking thread without the trajectory
+  // lock held. Without a stream file the frames passed to the callback are
+  // dropped, SaveTrajectoryTUM/KITTI only write the last ones.
+  void SetTrajectoryCallback(const TrajectorySink::PoseCallback &callback);
+
+  // Save the map. It can be called while tracking, tracking and local mapping
+  // are only held while the snapshot of the map is taken.
   void SaveMap(const string &filename);
+  // Same as SaveMap, the map is written by the map saver thread and this
+  // function returns immediately. Periodic checkpoints to map.mapfile are set
+  // by map.CheckpointPeriod (seconds) in the settings file.
+  void SaveMapInBackground(const string &filename);
+  // With map.Journal set, the changes of map.mapfile since its last save are
+  // logged and replayed by LoadMap, saving map.mapfile compacts the journal.
+  // It is saved when the journal exceeds map.JournalMaxSize (MB, 64 by
+  // default, 0 is unlimited).
+  // With map.TileSize set, OnlyRelocalization pages the map in spatial tiles
+  // instead (see MapTiles), such a map cannot be saved.
+  // With map.Shared set, the vocabulary and, in OnlyRelocalization, the
+  // descriptors of map.mapfile are mapped read-only and shared by every process
+  // using them (see SharedMap).
+  // With map.VoxelSize set, the map points are indexed by position (see
+  // MapPointIndex). Tracking also searches the points in view up to
+  // map.SpatialDepth, and loop closing fuses the points within that distance
+  // of the loop keyframe.
   bool LoadMap(const string &filename);
 
+  // Remove redundant keyframes and low-utility map points until the map fits
+  // the budget (0 is unlimited), see MapCompactor. Local Mapping is stopped
+  // during the pass, tracking waits for the map. Offline, the map file is
+  // compacted by the compact_map tool.
+  CompactionReport CompactMap(const long unsigned int nMaxKeyFrames,
+                              const long unsigned int nMaxMapPoints);
+
   // Information from most recent processed frame
   // You can call this right after TrackMonocular (or stereo or RGBD)
+  // The returned MapPoints are only guaranteed to be alive until the next call
+  // to TrackMonocular (or stereo or RGBD), erased points are deleted after it.
   int GetTrackingState();
   std::vector<MapPoint *> GetTrackedMapPoints();
   std::vector<cv::KeyPoint> GetTrackedKeyPointsUn();
 
+  // Depth and lag of the loop closing queue. With LoopClosing.QueueLimit set,
+  // the backlog beyond it is coalesced to one keyframe per covisible group,
+  // with LoopClosing.MaxLag (s) the keyframes left further behind are skipped.
+  LoopQueueStats GetLoopQueueStats();
+
 private:
   void SetSlamParams(const string &strSettingsFile);
-  void LoadMapPoints(const std::vector<MapPoint *> &saved_map_points,
-                     Map *pMap);
-  void LoadKeyFrames(const std::vector<KeyFrame *> &vpKFs, Map *pMap,
-                     std::atomic_size_t *const pCount,
-                     std::atomic_bool *const p_is_finished);
-  void AddKeyFrame(KeyFrame *keyframe, Map *pMap);
 
 private:
   // Input sensor
@@ -135,6 +190,9 @@ private:
 
   // ORB vocabulary used for place recognition and feature matching.
   ORBVocabulary *mpVocabulary;
+  // Vocabulary file mapped by every process of a shared map (NULL if the
+  // vocabulary is copied)
+  MappedFile *mpVocabularyFile;
 
   // KeyFrame database for place recognition (relocalization and loop
   // detection).
@@ -160,15 +218,34 @@ private:
   // The viewer draws the map and the current camera pose. It uses Pangolin.
   Viewer *mpViewer;
 
+  // Map Saver. It writes snapshots of the map taken while the other threads
+  // keep running (background saves and checkpoints).
+  MapSaver *mpMapSaver;
+
+  // Map Journal. It logs the changes of the map file between two saves (NULL
+  // if disabled).
+  MapJournal *mpJournal;
+
+  // Paged map of the localization mode (NULL if the whole map is loaded)
+  MapTiles *mpMapTiles;
+
+  // Descriptors of the map file shared with the other localization processes
+  // (NULL if not shared)
+  SharedMap *mpSharedMap;
+
   FrameDrawer *mpFrameDrawer;
   MapDrawer *mpMapDrawer;
 
-  // System threads: Local Mapping, Loop Closing, Viewer.
+  // System threads: Local Mapping, Loop Closing, Viewer, Map Saver, Journal,
+  // Map Tiles.
   // The Tracking thread "lives" in the main execution thread that creates the
   // System object.
   std::thread *mptLocalMapping;
   std::thread *mptLoopClosing;
   std::thread *mptViewer;
+  std::thread *mptMapSaver;
+  std::thread *mptJournal;
+  std::thread *mptMapTiles;
 
   // Reset flag
   std::mutex mMutexReset;
@@ -187,6 +264,35 @@ private:
   std::mutex mMutexState;
 
   std::string mMapFile;
+  double mCheckpointPeriod;
+  bool mbJournal;
+  double mJournalMaxSize;
+  bool mbSharedMap;
+
+  // Map tiles: size (m), tiles kept around the camera, memory budget (MB) and
+  // prediction horizon (s)
+  float mTileSize;
+  int mnTileRadius;
+  double mTileBudget;
+  double mTileLookahead;
+
+  // Spatial index of the map points: voxel size (m), 0 disables it, and depth
+  // of the local points searched with it (m)
+  float mVoxelSize;
+  float mSpatialDepth;
+
+  // Loop closing queue policy: keyframes waiting before the backlog is
+  // coalesced and maximum lag (s), 0 disables them
+  int mnLoopQueueLimit;
+  double mLoopMaxLag;
+
+  // Local BA with the reprojection errors evaluated in float batches
+  bool mbBatchedBA;
+
+  // Trajectory streaming
+  std::string mTrajectoryFile;
+  bool mbTrajectoryKITTI;
+  int mnTrajectoryHistory;
 };
 
 } // namespace ORB_SLAM2
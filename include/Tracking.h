@@ -37,8 +37,10 @@
 #include "Initializer.h"
 #include "MapDrawer.h"
 #include "System.h"
+#include "TrajectorySink.h"
 
 #include <mutex>
+#include <thread>
 
 namespace ORB_SLAM2
 {
@@ -48,6 +50,7 @@ class FrameDrawer;
 class Map;
 class LocalMapping;
 class LoopClosing;
+class MapTiles;
 class System;
 
 class Tracking
@@ -58,13 +61,22 @@ public:
              KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor);
 
     // Preprocess the input and call Track(). Extract features and performs stereo matching.
-    cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const double &timestamp);
-    cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp);
-    cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
+    // vRigImages are the images of the other cameras of the rig (Rig.nCameras in the settings), taken at the same time.
+    cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const double &timestamp,
+                            const std::vector<cv::Mat> &vRigImages = std::vector<cv::Mat>());
+    cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp,
+                          const std::vector<cv::Mat> &vRigImages = std::vector<cv::Mat>());
+    cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp,
+                               const std::vector<cv::Mat> &vRigImages = std::vector<cv::Mat>());
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
     void SetViewer(Viewer* pViewer);
+    // Paged map of the localization mode
+    void SetMapTiles(MapTiles* pMapTiles);
+    // Also search the map points in view up to this depth (m), found by the spatial index of the map. It brings
+    // back points the covisibility graph does not reach, e.g. revisited places. 0 disables it.
+    void SetSpatialSearch(const float depth);
 
     // Load new settings
     // The focal lenght should be similar or scale prediction will fail when projecting points
@@ -103,12 +115,9 @@ public:
     std::vector<cv::Point3f> mvIniP3D;
     Frame mInitialFrame;
 
-    // Lists used to recover the full camera trajectory at the end of the execution.
+    // Used to recover the full camera trajectory, during or at the end of the execution.
     // Basically we store the reference keyframe for each frame and its relative transformation
-    list<cv::Mat> mlRelativeFramePoses;
-    list<KeyFrame*> mlpReferences;
-    list<double> mlFrameTimes;
-    list<bool> mlbLost;
+    TrajectorySink mTrajectory;
 
     // True if local mapping is deactivated and we are performing only localization
     bool mbOnlyTracking;
@@ -141,9 +150,27 @@ protected:
     bool TrackLocalMap();
     void SearchLocalPoints();
 
+    // Rig: features of the other cameras are extracted while the current frame is built, and matched
+    // to the local map once the pose is predicted
+    void StartRigExtraction(const std::vector<cv::Mat> &vRigImages, const double &timestamp);
+    void ExtractRigFrame(const size_t i, const cv::Mat &im, const double timestamp, const long unsigned int nId);
+    void FinishRigExtraction();
+    // Joins the rig threads when it goes out of scope, also if the current frame cannot be built
+    struct RigExtractionGuard
+    {
+        RigExtractionGuard(Tracking* pTracker) : mpTracker(pTracker) {}
+        ~RigExtractionGuard() { mpTracker->FinishRigExtraction(); }
+        Tracking* mpTracker;
+    };
+    void SearchRigPoints();
+
     bool NeedNewKeyFrame();
     void CreateNewKeyFrame();
 
+    // Drop the references to bad MapPoints and KeyFrames, announce a quiescent
+    // state and delete the retired keyframes that nobody can reference anymore.
+    void ReleaseRetired();
+
     // In case of performing only localization, this flag is true when there are no matches to
     // points in the map. Still tracking will continue if there are enough matches with temporal points.
     // In that case we are doing visual odometry. The system will try to do relocalization to recover
@@ -153,6 +180,11 @@ protected:
     //Other Thread Pointers
     LocalMapping* mpLocalMapper;
     LoopClosing* mpLoopClosing;
+    MapTiles* mpMapTiles;
+
+    // Spatial search of the local points
+    float mfSpatialDepth;
+    std::vector<MapPoint*> mvpSpatialMapPoints;
 
     //ORB
     ORBextractor* mpORBextractorLeft, *mpORBextractorRight;
@@ -169,6 +201,14 @@ protected:
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+
+    // Buffers reused by UpdateLocalKeyFrames (votes indexed by keyframe id) and UpdateLocalPoints (map point
+    // versions of the local keyframes of the last and the current frame)
+    std::vector<int> mvnKeyFrameVotes;
+    std::vector<KeyFrame*> mvpVotedKeyFrames;
+    std::vector<KeyFrame*> mvpObservingKeyFrames;
+    std::vector<std::pair<KeyFrame*,long unsigned int> > mvLocalKeyFrameVersions;
+    std::vector<std::pair<KeyFrame*,long unsigned int> > mvLastLocalKeyFrameVersions;
     
     // System
     System* mpSystem;
@@ -186,6 +226,22 @@ protected:
     cv::Mat mDistCoef;
     float mbf;
 
+    // Other cameras of the rig, rigidly attached to the main camera. Their observations only
+    // constrain the pose of the current frame, keyframes and map points come from the main camera.
+    struct RigCamera
+    {
+        cv::Mat K;
+        cv::Mat DistCoef;
+        // Pose of the main camera in this camera
+        cv::Mat Tcb;
+        ORBextractor* pORBextractor;
+    };
+    std::vector<RigCamera> mvRigCameras;
+    std::vector<cv::Mat> mvRigTcb;
+    std::vector<Frame> mvRigFrames;
+    std::vector<std::thread> mvRigThreads;
+    bool mbRigMismatchReported;
+
     //New KeyFrame rules (according to fps)
     int mMinFrames;
     int mMaxFrames;
@@ -214,6 +270,10 @@ protected:
     bool mbRGB;
 
     list<MapPoint*> mlpTemporalPoints;
+
+    //Reclamation of erased MapPoints and KeyFrames
+    int mnReclaimSlot;
+    unsigned long mnLastReclaimEpoch;
 };
 
 } //namespace ORB_SLAM
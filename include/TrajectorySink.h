@@ -0,0 +1,144 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRAJECTORYSINK_H
+#define TRAJECTORYSINK_H
+
+#include <opencv2/core/core.hpp>
+
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+class KeyFrame;
+class Map;
+
+// Camera trajectory of every processed frame.
+//
+// Each frame pose is stored relative to its reference keyframe, which is
+// optimized by BA and pose graph. By default the whole history is kept in
+// memory until the trajectory is saved. When streaming is enabled, frames whose
+// reference keyframe left the local window are finalized: their pose is written
+// to the stream file and/or passed to the callback, and a compact record
+// (timestamp, keyframe id, relative pose) is kept on disk instead of memory.
+// Save() then performs a final correction pass over those records with the
+// final keyframe poses. With only a callback, finalized frames are dropped
+// once passed to it, Save() then only writes the frames still in memory.
+class TrajectorySink {
+public:
+  enum eFormat { TUM = 0, KITTI = 1 };
+
+  // Called with the timestamp and the camera to world transformation (4x4)
+  typedef std::function<void(const double &, const cv::Mat &)> PoseCallback;
+
+  TrajectorySink(Map *pMap);
+
+  // Stream finalized poses to filename. The records for the final correction
+  // pass are written to filename + ".rec".
+  bool Open(const std::string &filename, const eFormat format);
+  void SetCallback(const PoseCallback &callback);
+
+  // Frames not finalized yet, whatever their reference keyframe. Older frames
+  // are finalized even if Local BA may still refine them (e.g. no new keyframes
+  // in localization mode).
+  void SetMaxHistory(const size_t nMaxFrames);
+
+  void Add(const cv::Mat &Tcr, KeyFrame *pRef, const double &timestamp,
+           const bool bLost);
+  // Used when the pose of the frame could not be computed (nothing if there is
+  // no frame)
+  void RepeatLast(const bool bLost);
+
+  bool empty();
+  // Empty if there is no frame
+  cv::Mat LastRelativePose();
+
+  // Move the frames referenced to the given culled keyframes to their parent
+  // in the spanning tree. Must be called before deleting them.
+  void ReplaceReferences(const std::set<KeyFrame *> &spKFs);
+
+  // Finalize the frames whose reference keyframe is older than the local
+  // window of the last keyframe. The newest frame is never finalized.
+  void Flush(const long unsigned int nLastKFid);
+
+  // Final correction pass. Write the whole trajectory with the current
+  // keyframe poses. Returns false if part of it was dropped (only passed to
+  // the callback).
+  bool Save(const std::string &filename, const eFormat format);
+
+  void clear();
+
+protected:
+  struct FramePose {
+    cv::Mat Tcr;
+    KeyFrame *pRef;
+    double timestamp;
+    bool bLost;
+  };
+
+  // Pose of the frame in the world frame of the first keyframe
+  cv::Mat ComputeTwc(const FramePose &pose, const cv::Mat &Two,
+                     KeyFrame *&pKF, cv::Mat &Tck);
+  cv::Mat GetOriginInverse();
+
+  // Poses for the callback are appended to vCallbackPoses, it is called once
+  // the mutex is released
+  void Finalize(const FramePose &pose, const cv::Mat &Two,
+                std::vector<std::pair<double, cv::Mat>> &vCallbackPoses);
+
+  void WritePose(std::ostream &f, const eFormat format,
+                 const double &timestamp, const cv::Mat &Twc);
+
+  Map *mpMap;
+
+  std::deque<FramePose> mdHistory;
+
+  // Frames passed to the callback and dropped (only when not streaming to
+  // disk), they are missing from Save()
+  size_t mnDropped;
+
+  bool mbStreaming;
+  eFormat mFormat;
+  std::string mRecordsFile;
+  std::ofstream mfStream;
+  std::ofstream mfRecords;
+  PoseCallback mCallback;
+
+  size_t mnMaxHistory;
+
+  // Keyframes newer than this lag are still refined by Local BA
+  long unsigned int mnKeyFrameLag;
+
+  // Records written before a reset refer to keyframes of the previous map
+  unsigned int mnGeneration;
+
+  std::mutex mMutex;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // TRAJECTORYSINK_H
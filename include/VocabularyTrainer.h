@@ -0,0 +1,112 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOCABULARYTRAINER_H
+#define VOCABULARYTRAINER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+// Trains an ORB vocabulary for ORBVocabulary::loadFromBinFile (TF-IDF weights
+// and L1 scoring, as the ORBvoc shipped with the project).
+//
+// The tree is clustered by hierarchical k-majority: k-means++ seeding, then
+// every cluster takes the bitwise majority of its descriptors, with the Hamming
+// distance. The descriptors are packed in 64-bit words. Each level of the tree
+// is clustered at once: the nodes are shared by the threads, or the
+// descriptors of a node if there are less nodes than threads.
+class VocabularyTrainer {
+public:
+  // Branching factor k and depth L, nThreads 0 uses every core
+  VocabularyTrainer(const int k, const int L, const int nThreads = 0);
+
+  // ORB descriptors of a training image, one per row (CV_8U, 32 columns)
+  void AddImage(const cv::Mat &descriptors);
+
+  void Train();
+
+  bool Save(const std::string &filename) const;
+
+  size_t Images() const { return mvImageOffsets.size() - 1; }
+  size_t Descriptors() const { return mvDescriptors.size(); }
+  size_t Nodes() const { return mvNodes.size(); }
+  size_t Words() const { return mnWords; }
+
+  // k-majority iterations of a node, if it has not converged before
+  int mnMaxIterations;
+
+protected:
+  struct Descriptor {
+    uint64_t mBits[4];
+  };
+
+  struct Node {
+    int mnParent;
+    Descriptor mDescriptor;
+    std::vector<int> mvChildren;
+    // idf of the words, 0 for the other nodes
+    double mWeight;
+  };
+
+  // Node to cluster and its descriptors
+  struct Job {
+    int mnNode;
+    std::vector<uint32_t> mvIndices;
+  };
+
+  // Centers and descriptors of the clusters of a job
+  struct Clusters {
+    std::vector<Descriptor> mvCenters;
+    std::vector<std::vector<uint32_t>> mvGroups;
+  };
+
+  static int Distance(const Descriptor &a, const Descriptor &b);
+
+  void Cluster(const Job &job, const int nThreads, Clusters &clusters) const;
+  void Seed(const std::vector<uint32_t> &vIndices, const int nThreads,
+            std::mt19937 &rng, std::vector<Descriptor> &vCenters) const;
+  void Majority(const std::vector<uint32_t> &vIndices,
+                Descriptor &center) const;
+
+  // Word (node id) of a descriptor, descending as ORBVocabulary::transform
+  int Transform(const Descriptor &d) const;
+  void ComputeWeights();
+
+  int mk;
+  int mL;
+  int mnThreads;
+
+  // Descriptors of the images, those of image i from mvImageOffsets[i]
+  std::vector<Descriptor> mvDescriptors;
+  std::vector<size_t> mvImageOffsets;
+
+  std::vector<Node> mvNodes;
+  size_t mnWords;
+};
+
+} // namespace ORB_SLAM2
+
+#endif // VOCABULARYTRAINER_H
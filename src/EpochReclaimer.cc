@@ -0,0 +1,133 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EpochReclaimer.h"
+
+#include "KeyFrame.h"
+#include "MapPoint.h"
+
+#include <climits>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+static const unsigned long FREE_SLOT = ULONG_MAX;
+
+EpochReclaimer::EpochReclaimer() : mnEpoch(0) {}
+
+int EpochReclaimer::RegisterThread() {
+  unique_lock<mutex> lock(mMutex);
+
+  // A thread that has just registered cannot reference any retired object
+  for (size_t i = 0; i < mvnAnnounced.size(); i++) {
+    if (mvnAnnounced[i] == FREE_SLOT) {
+      mvnAnnounced[i] = mnEpoch;
+      return i;
+    }
+  }
+
+  mvnAnnounced.push_back(mnEpoch);
+  return mvnAnnounced.size() - 1;
+}
+
+void EpochReclaimer::UnregisterThread(int nSlot) {
+  unique_lock<mutex> lock(mMutex);
+  mvnAnnounced[nSlot] = FREE_SLOT;
+}
+
+unsigned long EpochReclaimer::GetEpoch() {
+  unique_lock<mutex> lock(mMutex);
+  return mnEpoch;
+}
+
+void EpochReclaimer::Quiescent(int nSlot, unsigned long nEpoch) {
+  unique_lock<mutex> lock(mMutex);
+  mvnAnnounced[nSlot] = nEpoch;
+}
+
+void EpochReclaimer::Retire(MapPoint *pMP) {
+  unique_lock<mutex> lock(mMutex);
+  mdRetiredMapPoints.push_back(make_pair(++mnEpoch, pMP));
+}
+
+void EpochReclaimer::Retire(KeyFrame *pKF) {
+  unique_lock<mutex> lock(mMutex);
+  mdRetiredKeyFrames.push_back(make_pair(++mnEpoch, pKF));
+}
+
+unsigned long EpochReclaimer::MinAnnouncedEpoch() {
+  unsigned long nMin = mnEpoch;
+  for (size_t i = 0; i < mvnAnnounced.size(); i++)
+    if (mvnAnnounced[i] < nMin)
+      nMin = mvnAnnounced[i];
+  return nMin;
+}
+
+void EpochReclaimer::CollectMapPoints(vector<MapPoint *> &vpMPs) {
+  unique_lock<mutex> lock(mMutex);
+  const unsigned long nSafe = MinAnnouncedEpoch();
+  while (!mdRetiredMapPoints.empty() &&
+         mdRetiredMapPoints.front().first <= nSafe) {
+    vpMPs.push_back(mdRetiredMapPoints.front().second);
+    mdRetiredMapPoints.pop_front();
+  }
+}
+
+void EpochReclaimer::CollectKeyFrames(vector<KeyFrame *> &vpKFs) {
+  unique_lock<mutex> lock(mMutex);
+  const unsigned long nSafe = MinAnnouncedEpoch();
+  while (!mdRetiredKeyFrames.empty() &&
+         mdRetiredKeyFrames.front().first <= nSafe) {
+    vpKFs.push_back(mdRetiredKeyFrames.front().second);
+    mdRetiredKeyFrames.pop_front();
+  }
+}
+
+void EpochReclaimer::DeferKeyFrames(const vector<KeyFrame *> &vpKFs) {
+  unique_lock<mutex> lock(mMutex);
+  // They were already safe, epoch 0 keeps them collectable
+  for (vector<KeyFrame *>::const_reverse_iterator rit = vpKFs.rbegin(),
+                                                  rend = vpKFs.rend();
+       rit != rend; rit++)
+    mdRetiredKeyFrames.push_front(make_pair(0UL, *rit));
+}
+
+size_t EpochReclaimer::RetiredMapPoints() {
+  unique_lock<mutex> lock(mMutex);
+  return mdRetiredMapPoints.size();
+}
+
+size_t EpochReclaimer::RetiredKeyFrames() {
+  unique_lock<mutex> lock(mMutex);
+  return mdRetiredKeyFrames.size();
+}
+
+void EpochReclaimer::clear() {
+  unique_lock<mutex> lock(mMutex);
+  for (size_t i = 0; i < mdRetiredMapPoints.size(); i++)
+    delete mdRetiredMapPoints[i].second;
+  for (size_t i = 0; i < mdRetiredKeyFrames.size(); i++)
+    delete mdRetiredKeyFrames[i].second;
+  mdRetiredMapPoints.clear();
+  mdRetiredKeyFrames.clear();
+}
+
+} // namespace ORB_SLAM2
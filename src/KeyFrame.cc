@@ -20,12 +20,15 @@
 
 #include "KeyFrame.h"
 #include "Converter.h"
+#include "MapSnapshot.h"
 #include "ORBmatcher.h"
+#include "SlabAllocator.h"
 #include <mutex>
 
 namespace ORB_SLAM2 {
 
 long unsigned int KeyFrame::nNextId = 0;
+atomic<long unsigned int> KeyFrame::nNextMapPointsVersion(0);
 
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB)
     : mnFrameId(F.mnId), mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS),
@@ -44,7 +47,10 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB)
       mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
       mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY),
       mnMaxX(F.mnMaxX), mnMaxY(F.mnMaxY), mK(F.mK),
-      mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
+      mvpMapPoints(F.mvpMapPoints),
+      mnMapPointsVersion(nNextMapPointsVersion++), mnObservedMapPoints(0),
+      mnRedundantMapPoints(0), mnCloseMapPoints(0),
+      mnRedundantCloseMapPoints(0), mpKeyFrameDB(pKFDB),
       mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true),
       mpParent(NULL), mbNotErase(false), mbToBeErased(false), mbBad(false),
       mHalfBaseline(F.mb / 2), mpMap(pMap) {
@@ -72,20 +78,110 @@ KeyFrame::KeyFrame()
       mvKeysUn(), mvuRight(), mvDepth(), mDescriptors(), mBowVec(), mFeatVec(),
       mnScaleLevels(0), mfScaleFactor(0), mfLogScaleFactor(0), mvScaleFactors(),
       mvLevelSigma2(), mvInvLevelSigma2(), mnMinX(0), mnMinY(0), mnMaxX(0),
-      mnMaxY(0), mK(), mvpMapPoints(), mpKeyFrameDB(NULL),
+      mnMaxY(0), mK(), mvpMapPoints(),
+      mnMapPointsVersion(nNextMapPointsVersion++), mnObservedMapPoints(0),
+      mnRedundantMapPoints(0), mnCloseMapPoints(0),
+      mnRedundantCloseMapPoints(0), mpKeyFrameDB(NULL),
       mpORBvocabulary(NULL), mbFirstConnection(true), mpParent(NULL),
       mbNotErase(false), mbToBeErased(false), mbBad(false), mHalfBaseline(0),
       mpMap(NULL) {
   // Other initialization logic (if needed)
 }
 
+KeyFrame::KeyFrame(const KeyFrameState &state, Map *pMap,
+                   KeyFrameDatabase *pKFDB, ORBVocabulary *pVoc)
+    : mnId(state.mnId), mnFrameId(state.mnFrameId),
+      mTimeStamp(state.mTimeStamp), mnGridCols(state.mnGridCols),
+      mnGridRows(state.mnGridRows),
+      mfGridElementWidthInv(state.mfGridElementWidthInv),
+      mfGridElementHeightInv(state.mfGridElementHeightInv),
+      mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0),
+      mnBAFixedForKF(0), mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0),
+      mnRelocWords(0), mnBAGlobalForKF(0), fx(state.fx), fy(state.fy),
+      cx(state.cx), cy(state.cy), invfx(state.invfx), invfy(state.invfy),
+      mbf(state.mbf), mb(state.mb), mThDepth(state.mThDepth), N(state.N),
+      mvKeys(state.mvKeys), mvKeysUn(state.mvKeysUn),
+      mvuRight(state.mvuRight), mvDepth(state.mvDepth),
+      mDescriptors(state.mDescriptors), mBowVec(state.mBowVec),
+      mFeatVec(state.mFeatVec), mnScaleLevels(state.mnScaleLevels),
+      mfScaleFactor(state.mfScaleFactor),
+      mfLogScaleFactor(state.mfLogScaleFactor),
+      mvScaleFactors(state.mvScaleFactors),
+      mvLevelSigma2(state.mvLevelSigma2),
+      mvInvLevelSigma2(state.mvInvLevelSigma2), mnMinX(state.mnMinX),
+      mnMinY(state.mnMinY), mnMaxX(state.mnMaxX), mnMaxY(state.mnMaxY),
+      mK(state.mK), mvpMapPoints(state.N, static_cast<MapPoint *>(NULL)),
+      mnMapPointsVersion(nNextMapPointsVersion++), mnObservedMapPoints(0),
+      mnRedundantMapPoints(0), mnCloseMapPoints(0),
+      mnRedundantCloseMapPoints(0), mpKeyFrameDB(pKFDB), mpORBvocabulary(pVoc),
+      mGrid(state.mGrid),
+      mbFirstConnection(false), mpParent(NULL), mbNotErase(false),
+      mbToBeErased(false), mbBad(false), mHalfBaseline(state.mb / 2),
+      mpMap(pMap) {
+  SetPose(state.Tcw);
+}
+
+void KeyFrame::CopyConstantState(KeyFrameState &state) const {
+  state.mnFrameId = mnFrameId;
+  state.mTimeStamp = mTimeStamp;
+
+  state.mnGridCols = mnGridCols;
+  state.mnGridRows = mnGridRows;
+  state.mfGridElementWidthInv = mfGridElementWidthInv;
+  state.mfGridElementHeightInv = mfGridElementHeightInv;
+  state.mGrid = mGrid;
+
+  state.fx = fx;
+  state.fy = fy;
+  state.cx = cx;
+  state.cy = cy;
+  state.invfx = invfx;
+  state.invfy = invfy;
+  state.mbf = mbf;
+  state.mb = mb;
+  state.mThDepth = mThDepth;
+
+  state.N = N;
+  state.mvKeys = mvKeys;
+  state.mvKeysUn = mvKeysUn;
+  state.mvuRight = mvuRight;
+  state.mvDepth = mvDepth;
+  // Never modified, the data can be shared
+  state.mDescriptors = mDescriptors;
+  // Computed before the keyframe is inserted in the map
+  state.mBowVec = mBowVec;
+  state.mFeatVec = mFeatVec;
+
+  state.mnScaleLevels = mnScaleLevels;
+  state.mfScaleFactor = mfScaleFactor;
+  state.mfLogScaleFactor = mfLogScaleFactor;
+  state.mvScaleFactors = mvScaleFactors;
+  state.mvLevelSigma2 = mvLevelSigma2;
+  state.mvInvLevelSigma2 = mvInvLevelSigma2;
+
+  state.mnMinX = mnMinX;
+  state.mnMinY = mnMinY;
+  state.mnMaxX = mnMaxX;
+  state.mnMaxY = mnMaxY;
+  state.mK = mK;
+}
+
+void *KeyFrame::operator new(size_t size) {
+  return SlabAllocator<KeyFrame, 64>::Allocate(size);
+}
+
+void KeyFrame::operator delete(void *p, size_t size) {
+  SlabAllocator<KeyFrame, 64>::Deallocate(p, size);
+}
+
 void KeyFrame::ComputeBoW() {
   if (mBowVec.empty() || mFeatVec.empty()) {
-    vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
     // Feature vector associate features with nodes in the 4th level (from
     // leaves up) We assume the vocabulary tree has 6 levels, change the 4
-    // otherwise
-    mpORBvocabulary->transform(vCurrentDesc, mBowVec, mFeatVec, 4);
+    // otherwise. Descriptors are read in place from the rows of mDescriptors.
+    mpORBvocabulary->transform(mDescriptors.ptr<unsigned char>(),
+                               mDescriptors.rows, mDescriptors.step, mBowVec,
+                               mFeatVec, 4);
   }
 }
 
@@ -169,6 +265,20 @@ void KeyFrame::UpdateBestCovisibles() {
   mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
 }
 
+map<KeyFrame *, int> KeyFrame::GetConnectionWeights() {
+  unique_lock<mutex> lock(mMutexConnections);
+  return mConnectedKeyFrameWeights;
+}
+
+void KeyFrame::SetConnections(const map<KeyFrame *, int> &weights) {
+  {
+    unique_lock<mutex> lock(mMutexConnections);
+    mConnectedKeyFrameWeights = weights;
+  }
+
+  UpdateBestCovisibles();
+}
+
 set<KeyFrame *> KeyFrame::GetConnectedKeyFrames() {
   unique_lock<mutex> lock(mMutexConnections);
   set<KeyFrame *> s;
@@ -221,23 +331,30 @@ int KeyFrame::GetWeight(KeyFrame *pKF) {
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx) {
   unique_lock<mutex> lock(mMutexFeatures);
   mvpMapPoints[idx] = pMP;
+  mnMapPointsVersion = nNextMapPointsVersion++;
 }
 
 void KeyFrame::EraseMapPointMatch(const size_t &idx) {
   unique_lock<mutex> lock(mMutexFeatures);
   mvpMapPoints[idx] = static_cast<MapPoint *>(NULL);
+  mnMapPointsVersion = nNextMapPointsVersion++;
 }
 
 void KeyFrame::EraseMapPointMatch(MapPoint *pMP) {
   int idx = pMP->GetIndexInKeyFrame(this);
-  if (idx >= 0)
+  if (idx >= 0) {
     mvpMapPoints[idx] = static_cast<MapPoint *>(NULL);
+    mnMapPointsVersion = nNextMapPointsVersion++;
+  }
 }
 
 void KeyFrame::ReplaceMapPointMatch(const size_t &idx, MapPoint *pMP) {
   mvpMapPoints[idx] = pMP;
+  mnMapPointsVersion = nNextMapPointsVersion++;
 }
 
+long unsigned int KeyFrame::GetMapPointsVersion() { return mnMapPointsVersion; }
+
 set<MapPoint *> KeyFrame::GetMapPoints() {
   unique_lock<mutex> lock(mMutexFeatures);
   set<MapPoint *> s;
@@ -272,6 +389,27 @@ int KeyFrame::TrackedMapPoints(const int &minObs) {
   return nPoints;
 }
 
+void KeyFrame::GetRedundancy(const bool bClose, int &nMapPoints,
+                             int &nRedundant) {
+  if (bClose) {
+    nMapPoints = mnCloseMapPoints;
+    nRedundant = mnRedundantCloseMapPoints;
+  } else {
+    nMapPoints = mnObservedMapPoints;
+    nRedundant = mnRedundantMapPoints;
+  }
+}
+
+void KeyFrame::UpdateRedundancy(const size_t &idx, const int nMapPoints,
+                                const int nRedundant) {
+  mnObservedMapPoints += nMapPoints;
+  mnRedundantMapPoints += nRedundant;
+  if (mvDepth[idx] >= 0 && mvDepth[idx] <= mThDepth) {
+    mnCloseMapPoints += nMapPoints;
+    mnRedundantCloseMapPoints += nRedundant;
+  }
+}
+
 vector<MapPoint *> KeyFrame::GetMapPointMatches() {
   unique_lock<mutex> lock(mMutexFeatures);
   return mvpMapPoints;
@@ -521,6 +659,48 @@ void KeyFrame::SetBadFlag() {
   mpKeyFrameDB->erase(this);
 }
 
+void KeyFrame::Unload(KeyFrame *pAnchor) {
+  // Tracking and local mapping may still read this keyframe, the containers
+  // are copied under their mutexes
+  const set<KeyFrame *> spConnectedKFs = GetConnectedKeyFrames();
+  for (set<KeyFrame *>::const_iterator sit = spConnectedKFs.begin(),
+                                       send = spConnectedKFs.end();
+       sit != send; sit++)
+    (*sit)->EraseConnection(this);
+
+  const vector<MapPoint *> vpMapPoints = GetMapPointMatches();
+  for (size_t i = 0; i < vpMapPoints.size(); i++)
+    if (vpMapPoints[i])
+      vpMapPoints[i]->UnloadObservation(this);
+
+  const cv::Mat Tcp = GetPose() * pAnchor->GetPoseInverse();
+  {
+    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<mutex> lock1(mMutexFeatures);
+
+    mConnectedKeyFrameWeights.clear();
+    mvpOrderedConnectedKeyFrames.clear();
+    mvOrderedWeights.clear();
+
+    for (set<KeyFrame *>::iterator sit = mspChildrens.begin(),
+                                   send = mspChildrens.end();
+         sit != send; sit++)
+      (*sit)->ChangeParent(pAnchor);
+    mspChildrens.clear();
+
+    // The trajectory refers the frames to the anchor from now on. The anchor
+    // does not keep it as a child, the keyframe is deleted once retired.
+    if (mpParent)
+      mpParent->EraseChild(this);
+    mpParent = pAnchor;
+    mTcp = Tcp;
+    mbBad = true;
+  }
+
+  mpMap->EraseKeyFrame(this);
+  mpKeyFrameDB->erase(this);
+}
+
 bool KeyFrame::isBad() {
   unique_lock<mutex> lock(mMutexConnections);
   return mbBad;
@@ -23,6 +23,7 @@
 #include "KeyFrame.h"
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 
+#include <algorithm>
 #include <mutex>
 
 using namespace std;
@@ -38,8 +39,12 @@ void KeyFrameDatabase::add(KeyFrame *pKF) {
 
   for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
                                         vend = pKF->mBowVec.end();
-       vit != vend; vit++)
-    mvInvertedFile[vit->first].push_back(pKF);
+       vit != vend; vit++) {
+    Posting posting;
+    posting.mpKF = pKF;
+    posting.mWeight = vit->second;
+    mvInvertedFile[vit->first].push_back(posting);
+  }
 }
 
 void KeyFrameDatabase::erase(KeyFrame *pKF) {
@@ -49,13 +54,14 @@ void KeyFrameDatabase::erase(KeyFrame *pKF) {
   for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
                                         vend = pKF->mBowVec.end();
        vit != vend; vit++) {
-    // List of keyframes that share the word
-    list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
-
-    for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-         lit != lend; lit++) {
-      if (pKF == *lit) {
-        lKFs.erase(lit);
+    // Keyframes that share the word
+    vector<Posting> &vPostings = mvInvertedFile[vit->first];
+
+    for (vector<Posting>::iterator pit = vPostings.begin(),
+                                   pend = vPostings.end();
+         pit != pend; pit++) {
+      if (pKF == pit->mpKF) {
+        vPostings.erase(pit);
         break;
       }
     }
@@ -70,7 +76,11 @@ void KeyFrameDatabase::clear() {
 vector<KeyFrame *> KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF,
                                                           float minScore) {
   set<KeyFrame *> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
-  list<KeyFrame *> lKFsSharingWords;
+  vector<KeyFrame *> vpKFsSharingWords;
+
+  // With L1 scoring the score of two normalized vectors is the sum of the
+  // minimum weights of their common words, accumulated here
+  const bool bAccumulate = mpVoc->getScoringType() == DBoW2::L1_NORM;
 
   // Search all keyframes that share a word with current keyframes
   // Discard keyframes connected to the query keyframe
@@ -80,74 +90,80 @@ vector<KeyFrame *> KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF,
     for (DBoW2::BowVector::const_iterator vit = pKF->mBowVec.begin(),
                                           vend = pKF->mBowVec.end();
          vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
+      const vector<Posting> &vPostings = mvInvertedFile[vit->first];
 
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
+      for (vector<Posting>::const_iterator pit = vPostings.begin(),
+                                           pend = vPostings.end();
+           pit != pend; pit++) {
+        KeyFrame *pKFi = pit->mpKF;
         if (pKFi->mnLoopQuery != pKF->mnId) {
+          if (spConnectedKeyFrames.count(pKFi))
+            continue;
+          pKFi->mnLoopQuery = pKF->mnId;
           pKFi->mnLoopWords = 0;
-          if (!spConnectedKeyFrames.count(pKFi)) {
-            pKFi->mnLoopQuery = pKF->mnId;
-            lKFsSharingWords.push_back(pKFi);
-          }
+          pKFi->mLoopScore = 0;
+          vpKFsSharingWords.push_back(pKFi);
         }
         pKFi->mnLoopWords++;
+        pKFi->mLoopScore += min(vit->second, pit->mWeight);
       }
     }
   }
 
-  if (lKFsSharingWords.empty())
+  if (vpKFsSharingWords.empty())
     return vector<KeyFrame *>();
 
-  list<pair<float, KeyFrame *>> lScoreAndMatch;
+  vector<pair<float, KeyFrame *>> vScoreAndMatch;
 
   // Only compare against those keyframes that share enough words
   int maxCommonWords = 0;
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    if ((*lit)->mnLoopWords > maxCommonWords)
-      maxCommonWords = (*lit)->mnLoopWords;
+  for (size_t i = 0; i < vpKFsSharingWords.size(); i++) {
+    if (vpKFsSharingWords[i]->mnLoopWords > maxCommonWords)
+      maxCommonWords = vpKFsSharingWords[i]->mnLoopWords;
   }
 
   int minCommonWords = maxCommonWords * 0.8f;
 
-  int nscores = 0;
-
-  // Compute similarity score. Retain the matches whose score is higher than
-  // minScore
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
+  // Retain the matches whose score is higher than minScore
+  float maxScore = 0;
+  for (size_t i = 0; i < vpKFsSharingWords.size(); i++) {
+    KeyFrame *pKFi = vpKFsSharingWords[i];
 
     if (pKFi->mnLoopWords > minCommonWords) {
-      nscores++;
-
-      float si = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
+      if (!bAccumulate)
+        pKFi->mLoopScore = mpVoc->score(pKF->mBowVec, pKFi->mBowVec);
 
-      pKFi->mLoopScore = si;
+      const float si = pKFi->mLoopScore;
+      maxScore = max(maxScore, si);
       if (si >= minScore)
-        lScoreAndMatch.push_back(make_pair(si, pKFi));
+        vScoreAndMatch.push_back(make_pair(si, pKFi));
     }
   }
 
-  if (lScoreAndMatch.empty())
+  if (vScoreAndMatch.empty())
     return vector<KeyFrame *>();
 
-  list<pair<float, KeyFrame *>> lAccScoreAndMatch;
+  vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
   float bestAccScore = minScore;
 
-  // Lets now accumulate score by covisibility
-  for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                               itend = lScoreAndMatch.end();
-       it != itend; it++) {
-    KeyFrame *pKFi = it->second;
-    vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-    float bestScore = it->first;
-    float accScore = it->first;
+  // Lets now accumulate score by covisibility, from the best scores. A group
+  // adds at most nCovisibles scores to the one of its keyframe, once it cannot
+  // reach 0.75*bestAccScore neither can the next ones.
+  const int nCovisibles = 10;
+  make_heap(vScoreAndMatch.begin(), vScoreAndMatch.end());
+  for (vector<pair<float, KeyFrame *>>::iterator send = vScoreAndMatch.end();
+       send != vScoreAndMatch.begin(); send--) {
+    pop_heap(vScoreAndMatch.begin(), send);
+    const pair<float, KeyFrame *> &match = *(send - 1);
+    if (match.first + nCovisibles * maxScore <= 0.75f * bestAccScore)
+      break;
+
+    KeyFrame *pKFi = match.second;
+    vector<KeyFrame *> vpNeighs =
+        pKFi->GetBestCovisibilityKeyFrames(nCovisibles);
+
+    float bestScore = match.first;
+    float accScore = match.first;
     KeyFrame *pBestKF = pKFi;
     for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
                                       vend = vpNeighs.end();
@@ -163,7 +179,7 @@ vector<KeyFrame *> KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF,
       }
     }
 
-    lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
+    vAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
     if (accScore > bestAccScore)
       bestAccScore = accScore;
   }
@@ -173,10 +189,11 @@ vector<KeyFrame *> KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF,
 
   set<KeyFrame *> spAlreadyAddedKF;
   vector<KeyFrame *> vpLoopCandidates;
-  vpLoopCandidates.reserve(lAccScoreAndMatch.size());
+  vpLoopCandidates.reserve(vAccScoreAndMatch.size());
 
-  for (list<pair<float, KeyFrame *>>::iterator it = lAccScoreAndMatch.begin(),
-                                               itend = lAccScoreAndMatch.end();
+  for (vector<pair<float, KeyFrame *>>::iterator
+           it = vAccScoreAndMatch.begin(),
+           itend = vAccScoreAndMatch.end();
        it != itend; it++) {
     if (it->first > minScoreToRetain) {
       KeyFrame *pKFi = it->second;
@@ -191,7 +208,10 @@ vector<KeyFrame *> KeyFrameDatabase::DetectLoopCandidates(KeyFrame *pKF,
 }
 
 vector<KeyFrame *> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F) {
-  list<KeyFrame *> lKFsSharingWords;
+  vector<KeyFrame *> vpKFsSharingWords;
+
+  // Same scoring as DetectLoopCandidates
+  const bool bAccumulate = mpVoc->getScoringType() == DBoW2::L1_NORM;
 
   // Search all keyframes that share a word with current frame
   {
@@ -200,73 +220,81 @@ vector<KeyFrame *> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F) {
     for (DBoW2::BowVector::const_iterator vit = F->mBowVec.begin(),
                                           vend = F->mBowVec.end();
          vit != vend; vit++) {
-      list<KeyFrame *> &lKFs = mvInvertedFile[vit->first];
+      const vector<Posting> &vPostings = mvInvertedFile[vit->first];
 
-      for (list<KeyFrame *>::iterator lit = lKFs.begin(), lend = lKFs.end();
-           lit != lend; lit++) {
-        KeyFrame *pKFi = *lit;
+      for (vector<Posting>::const_iterator pit = vPostings.begin(),
+                                           pend = vPostings.end();
+           pit != pend; pit++) {
+        KeyFrame *pKFi = pit->mpKF;
         if (pKFi->mnRelocQuery != F->mnId) {
           pKFi->mnRelocWords = 0;
+          pKFi->mRelocScore = 0;
           pKFi->mnRelocQuery = F->mnId;
-          lKFsSharingWords.push_back(pKFi);
+          vpKFsSharingWords.push_back(pKFi);
         }
         pKFi->mnRelocWords++;
+        pKFi->mRelocScore += min(vit->second, pit->mWeight);
       }
     }
   }
-  if (lKFsSharingWords.empty())
+  if (vpKFsSharingWords.empty())
     return vector<KeyFrame *>();
 
   // Only compare against those keyframes that share enough words
   int maxCommonWords = 0;
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    if ((*lit)->mnRelocWords > maxCommonWords)
-      maxCommonWords = (*lit)->mnRelocWords;
+  for (size_t i = 0; i < vpKFsSharingWords.size(); i++) {
+    if (vpKFsSharingWords[i]->mnRelocWords > maxCommonWords)
+      maxCommonWords = vpKFsSharingWords[i]->mnRelocWords;
   }
 
   int minCommonWords = maxCommonWords * 0.8f;
 
-  list<pair<float, KeyFrame *>> lScoreAndMatch;
-
-  int nscores = 0;
+  vector<pair<float, KeyFrame *>> vScoreAndMatch;
 
   // Compute similarity score.
-  for (list<KeyFrame *>::iterator lit = lKFsSharingWords.begin(),
-                                  lend = lKFsSharingWords.end();
-       lit != lend; lit++) {
-    KeyFrame *pKFi = *lit;
+  float maxScore = 0;
+  for (size_t i = 0; i < vpKFsSharingWords.size(); i++) {
+    KeyFrame *pKFi = vpKFsSharingWords[i];
 
     if (pKFi->mnRelocWords > minCommonWords) {
-      nscores++;
-      float si = mpVoc->score(F->mBowVec, pKFi->mBowVec);
-      pKFi->mRelocScore = si;
-      lScoreAndMatch.push_back(make_pair(si, pKFi));
+      if (!bAccumulate)
+        pKFi->mRelocScore = mpVoc->score(F->mBowVec, pKFi->mBowVec);
+
+      const float si = pKFi->mRelocScore;
+      maxScore = max(maxScore, si);
+      vScoreAndMatch.push_back(make_pair(si, pKFi));
     }
   }
 
-  if (lScoreAndMatch.empty())
+  if (vScoreAndMatch.empty())
     return vector<KeyFrame *>();
 
-  list<pair<float, KeyFrame *>> lAccScoreAndMatch;
+  vector<pair<float, KeyFrame *>> vAccScoreAndMatch;
   float bestAccScore = 0;
 
-  // Lets now accumulate score by covisibility
-  for (list<pair<float, KeyFrame *>>::iterator it = lScoreAndMatch.begin(),
-                                               itend = lScoreAndMatch.end();
-       it != itend; it++) {
-    KeyFrame *pKFi = it->second;
-    vector<KeyFrame *> vpNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
-
-    float bestScore = it->first;
+  // Lets now accumulate score by covisibility, from the best scores
+  const int nCovisibles = 10;
+  make_heap(vScoreAndMatch.begin(), vScoreAndMatch.end());
+  for (vector<pair<float, KeyFrame *>>::iterator send = vScoreAndMatch.end();
+       send != vScoreAndMatch.begin(); send--) {
+    pop_heap(vScoreAndMatch.begin(), send);
+    const pair<float, KeyFrame *> &match = *(send - 1);
+    if (match.first + nCovisibles * maxScore <= 0.75f * bestAccScore)
+      break;
+
+    KeyFrame *pKFi = match.second;
+    vector<KeyFrame *> vpNeighs =
+        pKFi->GetBestCovisibilityKeyFrames(nCovisibles);
+
+    float bestScore = match.first;
     float accScore = bestScore;
     KeyFrame *pBestKF = pKFi;
     for (vector<KeyFrame *>::iterator vit = vpNeighs.begin(),
                                       vend = vpNeighs.end();
          vit != vend; vit++) {
       KeyFrame *pKF2 = *vit;
-      if (pKF2->mnRelocQuery != F->mnId)
+      if (pKF2->mnRelocQuery != F->mnId ||
+          pKF2->mnRelocWords <= minCommonWords)
         continue;
 
       accScore += pKF2->mRelocScore;
@@ -275,7 +303,7 @@ vector<KeyFrame *> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F) {
         bestScore = pKF2->mRelocScore;
       }
     }
-    lAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
+    vAccScoreAndMatch.push_back(make_pair(accScore, pBestKF));
     if (accScore > bestAccScore)
       bestAccScore = accScore;
   }
@@ -284,9 +312,10 @@ vector<KeyFrame *> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F) {
   float minScoreToRetain = 0.75f * bestAccScore;
   set<KeyFrame *> spAlreadyAddedKF;
   vector<KeyFrame *> vpRelocCandidates;
-  vpRelocCandidates.reserve(lAccScoreAndMatch.size());
-  for (list<pair<float, KeyFrame *>>::iterator it = lAccScoreAndMatch.begin(),
-                                               itend = lAccScoreAndMatch.end();
+  vpRelocCandidates.reserve(vAccScoreAndMatch.size());
+  for (vector<pair<float, KeyFrame *>>::iterator
+           it = vAccScoreAndMatch.begin(),
+           itend = vAccScoreAndMatch.end();
        it != itend; it++) {
     const float &si = it->first;
     if (si > minScoreToRetain) {
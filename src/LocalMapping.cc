@@ -22,15 +22,18 @@
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
+#include "Parallel.h"
 
 #include<mutex>
+#include<thread>
 
 namespace ORB_SLAM2
 {
 
 LocalMapping::LocalMapping(Map *pMap, const float bMonocular):
     mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true)
+    mpJournal(NULL), mbAbortBA(false), mbBatchedBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
+    mnFusedMapPoints(0), mnFusedObservations(0)
 {
 }
 
@@ -39,6 +42,16 @@ void LocalMapping::SetLoopCloser(LoopClosing* pLoopCloser)
     mpLoopCloser = pLoopCloser;
 }
 
+void LocalMapping::SetJournal(MapJournal* pJournal)
+{
+    mpJournal = pJournal;
+}
+
+void LocalMapping::SetBatchedBA(const bool bBatched)
+{
+    mbBatchedBA = bBatched;
+}
+
 void LocalMapping::SetTracker(Tracking *pTracker)
 {
     mpTracker=pTracker;
@@ -49,6 +62,9 @@ void LocalMapping::Run()
 
     mbFinished = false;
 
+    mnReclaimSlot = mpMap->mReclaimer.RegisterThread();
+    mnLastReclaimEpoch = mpMap->mReclaimer.GetEpoch();
+
     while(1)
     {
         // Tracking will see that Local Mapping is busy
@@ -57,6 +73,8 @@ void LocalMapping::Run()
         // Check if there are keyframes in the queue
         if(CheckNewKeyFrames())
         {
+            unique_lock<mutex> lock(mMutexKeyFrameProcessing);
+
             // BoW conversion and insertion in Map
             ProcessNewKeyFrame();
 
@@ -78,12 +96,16 @@ void LocalMapping::Run()
             {
                 // Local BA
                 if(mpMap->KeyFramesInMap()>2)
-                    Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpMap);
+                    Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame,&mbAbortBA, mpMap, mbBatchedBA);
 
                 // Check redundant local Keyframes
                 KeyFrameCulling();
             }
 
+            // Record the changes of the local window
+            if(mpJournal)
+                mpJournal->LogKeyFrame(mpCurrentKeyFrame);
+
             mpLoopCloser->InsertKeyFrame(mpCurrentKeyFrame);
         }
         else if(Stop())
@@ -91,6 +113,7 @@ void LocalMapping::Run()
             // Safe area to stop
             while(isStopped() && !CheckFinish())
             {
+                ReleaseRetired();
                 usleep(3000);
             }
             if(CheckFinish())
@@ -99,6 +122,8 @@ void LocalMapping::Run()
 
         ResetIfRequested();
 
+        ReleaseRetired();
+
         // Tracking will see that Local Mapping is busy
         SetAcceptKeyFrames(true);
 
@@ -108,6 +133,8 @@ void LocalMapping::Run()
         usleep(3000);
     }
 
+    mpMap->mReclaimer.UnregisterThread(mnReclaimSlot);
+
     SetFinish();
 }
 
@@ -157,6 +184,11 @@ void LocalMapping::ProcessNewKeyFrame()
                     mlpRecentAddedMapPoints.push_back(pMP);
                 }
             }
+            else
+            {
+                // The point was erased while the keyframe was in the queue
+                mpCurrentKeyFrame->EraseMapPointMatch(i);
+            }
         }
     }    
 
@@ -212,8 +244,6 @@ void LocalMapping::CreateNewMapPoints()
         nn=20;
     const vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(nn);
 
-    ORBmatcher matcher(0.6,false);
-
     cv::Mat Rcw1 = mpCurrentKeyFrame->GetRotation();
     cv::Mat Rwc1 = Rcw1.t();
     cv::Mat tcw1 = mpCurrentKeyFrame->GetTranslation();
@@ -231,15 +261,32 @@ void LocalMapping::CreateNewMapPoints()
 
     const float ratioFactor = 1.5f*mpCurrentKeyFrame->mfScaleFactor;
 
-    int nnew=0;
-
-    // Search matches with epipolar restriction and triangulate
-    for(size_t i=0; i<vpNeighKFs.size(); i++)
+    // Match found with a neighbor, the map point is created in the merge step
+    struct Triangulation
+    {
+        size_t idx1;
+        size_t idx2;
+        cv::Mat x3D;
+    };
+
+    const size_t nNeighs = vpNeighKFs.size();
+    vector<vector<Triangulation> > vvTriangulations(nNeighs);
+    vector<char> vbAborted(nNeighs,false);
+
+    // Search matches with epipolar restriction and triangulate, a block of neighbors in each thread.
+    // Only keyframe poses and keypoints are read, the map is not changed.
+    auto triangulate = [&](const size_t i)
     {
         if(i>0 && CheckNewKeyFrames())
+        {
+            vbAborted[i]=true;
             return;
+        }
 
         KeyFrame* pKF2 = vpNeighKFs[i];
+        vector<Triangulation> &vTriangulations = vvTriangulations[i];
+
+        ORBmatcher matcher(0.6,false);
 
         // Check first that baseline is not too short
         cv::Mat Ow2 = pKF2->GetCameraCenter();
@@ -249,7 +296,7 @@ void LocalMapping::CreateNewMapPoints()
         if(!mbMonocular)
         {
             if(baseline<pKF2->mb)
-            continue;
+                return;
         }
         else
         {
@@ -257,7 +304,7 @@ void LocalMapping::CreateNewMapPoints()
             const float ratioBaselineDepth = baseline/medianDepthKF2;
 
             if(ratioBaselineDepth<0.01)
-                continue;
+                return;
         }
 
         // Compute Fundamental Matrix
@@ -431,7 +478,44 @@ void LocalMapping::CreateNewMapPoints()
                 continue;
 
             // Triangulation is succesfull
-            MapPoint* pMP = new MapPoint(x3D,mpCurrentKeyFrame,mpMap);
+            Triangulation triangulation;
+            triangulation.idx1 = idx1;
+            triangulation.idx2 = idx2;
+            triangulation.x3D = x3D;
+            vTriangulations.push_back(triangulation);
+        }
+    };
+
+    ParallelFor(nNeighs,1,[&](const size_t begin, const size_t end)
+    {
+        for(size_t i=begin; i<end; i++)
+            triangulate(i);
+    });
+
+    // Merge in the order of the neighbors, so that the result does not depend on the scheduling.
+    // Several neighbors can match the same keypoint of the current keyframe, the best covisible claims it.
+    vector<char> vbClaimed(mpCurrentKeyFrame->N,false);
+
+    int nnew=0;
+    for(size_t i=0; i<nNeighs; i++)
+    {
+        // Same as a sequential search interrupted by a new keyframe
+        if(vbAborted[i])
+            break;
+
+        KeyFrame* pKF2 = vpNeighKFs[i];
+        const vector<Triangulation> &vTriangulations = vvTriangulations[i];
+
+        for(size_t j=0; j<vTriangulations.size(); j++)
+        {
+            const size_t &idx1 = vTriangulations[j].idx1;
+            const size_t &idx2 = vTriangulations[j].idx2;
+
+            if(vbClaimed[idx1])
+                continue;
+            vbClaimed[idx1]=true;
+
+            MapPoint* pMP = new MapPoint(vTriangulations[j].x3D,mpCurrentKeyFrame,mpMap);
 
             pMP->AddObservation(mpCurrentKeyFrame,idx1);            
             pMP->AddObservation(pKF2,idx2);
@@ -480,14 +564,7 @@ void LocalMapping::SearchInNeighbors()
 
 
     // Search matches by projection from current KF in target KFs
-    ORBmatcher matcher;
     vector<MapPoint*> vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-    for(vector<KeyFrame*>::iterator vit=vpTargetKFs.begin(), vend=vpTargetKFs.end(); vit!=vend; vit++)
-    {
-        KeyFrame* pKFi = *vit;
-
-        matcher.Fuse(pKFi,vpMapPointMatches);
-    }
 
     // Search matches by projection from target KFs in current KF
     vector<MapPoint*> vpFuseCandidates;
@@ -511,7 +588,56 @@ void LocalMapping::SearchInNeighbors()
         }
     }
 
-    matcher.Fuse(mpCurrentKeyFrame,vpFuseCandidates);
+    // Both directions are searched in parallel without changing the map, the current keyframe in several
+    // blocks of candidates. The matches are then fused by this thread in the sequential order.
+    struct Fusion
+    {
+        KeyFrame* pKF;
+        vector<MapPoint*> vpMapPoints;
+        vector<int> vnMatches;
+    };
+
+    const size_t nCores = max(1u,thread::hardware_concurrency());
+    const size_t nBlocks = max((size_t)1,min(nCores,vpFuseCandidates.size()/500));
+    const size_t blockSize = (vpFuseCandidates.size()+nBlocks-1)/nBlocks;
+
+    vector<Fusion> vFusions(vpTargetKFs.size()+nBlocks);
+    for(size_t i=0; i<vpTargetKFs.size(); i++)
+    {
+        vFusions[i].pKF = vpTargetKFs[i];
+        vFusions[i].vpMapPoints = vpMapPointMatches;
+    }
+    for(size_t i=0; i<nBlocks; i++)
+    {
+        Fusion &fusion = vFusions[vpTargetKFs.size()+i];
+        fusion.pKF = mpCurrentKeyFrame;
+        const size_t begin = min(i*blockSize,vpFuseCandidates.size());
+        const size_t end = min(begin+blockSize,vpFuseCandidates.size());
+        fusion.vpMapPoints.assign(vpFuseCandidates.begin()+begin,vpFuseCandidates.begin()+end);
+    }
+
+    ParallelFor(vFusions.size(),1,[&](const size_t begin, const size_t end)
+    {
+        ORBmatcher matcher;
+        for(size_t i=begin; i<end; i++)
+            matcher.SearchForFusion(vFusions[i].pKF,vFusions[i].vpMapPoints,vFusions[i].vnMatches);
+    });
+
+    ORBmatcher matcher;
+    int nReplaced=0, nAdded=0;
+    for(size_t i=0; i<vFusions.size(); i++)
+    {
+        int nReplacedi, nAddedi;
+        matcher.ApplyFusion(vFusions[i].pKF,vFusions[i].vpMapPoints,vFusions[i].vnMatches,nReplacedi,nAddedi);
+        nReplaced+=nReplacedi;
+        nAdded+=nAddedi;
+    }
+
+    {
+        unique_lock<mutex> lock(mMutexFusion);
+        mnFusedMapPoints+=nReplaced;
+        mnFusedObservations+=nAdded;
+    }
 
 
     // Update points
@@ -552,6 +678,43 @@ cv::Mat LocalMapping::ComputeF12(KeyFrame *&pKF1, KeyFrame *&pKF2)
     return K1.t().inv()*t12x*R12*K2.inv();
 }
 
+void LocalMapping::ReleaseRetired()
+{
+    EpochReclaimer &reclaimer = mpMap->mReclaimer;
+    const unsigned long nEpoch = reclaimer.GetEpoch();
+
+    if(nEpoch!=mnLastReclaimEpoch)
+    {
+        list<MapPoint*>::iterator lit = mlpRecentAddedMapPoints.begin();
+        while(lit!=mlpRecentAddedMapPoints.end())
+        {
+            if((*lit)->isBad())
+                lit = mlpRecentAddedMapPoints.erase(lit);
+            else
+                lit++;
+        }
+
+        // Keyframes waiting in the queue are not observed yet by their MapPoints
+        unique_lock<mutex> lock(mMutexNewKFs);
+        for(list<KeyFrame*>::iterator lit=mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+        {
+            KeyFrame* pKF = *lit;
+            const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+            for(size_t i=0; i<vpMPs.size(); i++)
+                if(vpMPs[i] && vpMPs[i]->isBad())
+                    pKF->EraseMapPointMatch(i);
+        }
+    }
+
+    reclaimer.Quiescent(mnReclaimSlot,nEpoch);
+    mnLastReclaimEpoch = nEpoch;
+
+    vector<MapPoint*> vpMPs;
+    reclaimer.CollectMapPoints(vpMPs);
+    for(size_t i=0; i<vpMPs.size(); i++)
+        delete vpMPs[i];
+}
+
 void LocalMapping::RequestStop()
 {
     unique_lock<mutex> lock(mMutexStop);
@@ -642,53 +805,10 @@ void LocalMapping::KeyFrameCulling()
         KeyFrame* pKF = *vit;
         if(pKF->mnId==0)
             continue;
-        const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
 
-        int nObs = 3;
-        const int thObs=nObs;
-        int nRedundantObservations=0;
-        int nMPs=0;
-        for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
-        {
-            MapPoint* pMP = vpMapPoints[i];
-            if(pMP)
-            {
-                if(!pMP->isBad())
-                {
-                    if(!mbMonocular)
-                    {
-                        if(pKF->mvDepth[i]>pKF->mThDepth || pKF->mvDepth[i]<0)
-                            continue;
-                    }
-
-                    nMPs++;
-                    if(pMP->Observations()>thObs)
-                    {
-                        const int &scaleLevel = pKF->mvKeysUn[i].octave;
-                        const map<KeyFrame*, size_t> observations = pMP->GetObservations();
-                        int nObs=0;
-                        for(map<KeyFrame*, size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
-                        {
-                            KeyFrame* pKFi = mit->first;
-                            if(pKFi==pKF)
-                                continue;
-                            const int &scaleLeveli = pKFi->mvKeysUn[mit->second].octave;
-
-                            if(scaleLeveli<=scaleLevel+1)
-                            {
-                                nObs++;
-                                if(nObs>=thObs)
-                                    break;
-                            }
-                        }
-                        if(nObs>=thObs)
-                        {
-                            nRedundantObservations++;
-                        }
-                    }
-                }
-            }
-        }  
+        // Counted by the MapPoints as their observations change
+        int nMPs, nRedundantObservations;
+        pKF->GetRedundancy(!mbMonocular,nMPs,nRedundantObservations);
 
         if(nRedundantObservations>0.9*nMPs)
             pKF->SetBadFlag();
@@ -757,4 +877,11 @@ bool LocalMapping::isFinished()
     return mbFinished;
 }
 
+void LocalMapping::GetFusionCounters(long unsigned int &nFusedMapPoints, long unsigned int &nFusedObservations)
+{
+    unique_lock<mutex> lock(mMutexFusion);
+    nFusedMapPoints = mnFusedMapPoints;
+    nFusedObservations = mnFusedObservations;
+}
+
 } //namespace ORB_SLAM
@@ -28,8 +28,11 @@
 
 #include "ORBmatcher.h"
 
+#include "Parallel.h"
+
 #include<mutex>
 #include<thread>
+#include<algorithm>
 
 
 namespace ORB_SLAM2
@@ -37,10 +40,16 @@ namespace ORB_SLAM2
 
 LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale):
     mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
+    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpJournal(NULL), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
     mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0)
 {
     mnCovisibilityConsistencyTh = 3;
+
+    mnQueueLimit = 0;
+    mQueueMaxLag = 0;
+    mLastInsertedTimeStamp = 0;
+    mQueueStats = LoopQueueStats();
+    mfSpatialRadius = 0;
 }
 
 void LoopClosing::SetTracker(Tracking *pTracker)
@@ -53,11 +62,39 @@ void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
     mpLocalMapper=pLocalMapper;
 }
 
+void LoopClosing::SetJournal(MapJournal *pJournal)
+{
+    mpJournal=pJournal;
+}
+
+void LoopClosing::SetQueuePolicy(const int nQueueLimit, const double maxLag)
+{
+    unique_lock<mutex> lock(mMutexLoopQueue);
+    mnQueueLimit = nQueueLimit;
+    mQueueMaxLag = maxLag;
+}
+
+void LoopClosing::SetSpatialSearch(const float radius)
+{
+    mfSpatialRadius = radius;
+}
+
+LoopQueueStats LoopClosing::GetQueueStats()
+{
+    unique_lock<mutex> lock(mMutexLoopQueue);
+    LoopQueueStats stats = mQueueStats;
+    stats.mnQueued = mlpLoopKeyFrameQueue.size();
+    return stats;
+}
+
 
 void LoopClosing::Run()
 {
     mbFinished =false;
 
+    mnReclaimSlot = mpMap->mReclaimer.RegisterThread();
+    mnLastReclaimEpoch = mpMap->mReclaimer.GetEpoch();
+
     while(1)
     {
         // Check if there are keyframes in the queue
@@ -78,12 +115,16 @@ void LoopClosing::Run()
 
         ResetIfRequested();
 
+        ReleaseRetired();
+
         if(CheckFinish())
             break;
 
         usleep(5000);
     }
 
+    mpMap->mReclaimer.UnregisterThread(mnReclaimSlot);
+
     SetFinish();
 }
 
@@ -91,7 +132,11 @@ void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexLoopQueue);
     if(pKF->mnId!=0)
+    {
         mlpLoopKeyFrameQueue.push_back(pKF);
+        mLastInsertedTimeStamp = pKF->mTimeStamp;
+        mQueueStats.mnMaxQueued = max(mQueueStats.mnMaxQueued,(long unsigned int)mlpLoopKeyFrameQueue.size());
+    }
 }
 
 bool LoopClosing::CheckNewKeyFrames()
@@ -100,16 +145,105 @@ bool LoopClosing::CheckNewKeyFrames()
     return(!mlpLoopKeyFrameQueue.empty());
 }
 
+// Whether two sorted id vectors have an id in common
+static bool ShareKeyFrame(const vector<long unsigned int> &vA, const vector<long unsigned int> &vB)
+{
+    vector<long unsigned int>::const_iterator ait = vA.begin(), aend = vA.end();
+    vector<long unsigned int>::const_iterator bit = vB.begin(), bend = vB.end();
+    while(ait!=aend && bit!=bend)
+    {
+        if(*ait<*bit)
+            ait++;
+        else if(*bit<*ait)
+            bit++;
+        else
+            return true;
+    }
+    return false;
+}
+
+void LoopClosing::TrimQueue(vector<KeyFrame*> &vpSkippedKFs)
+{
+    // Keyframes are queued in time order, the stale ones are at the front
+    if(mQueueMaxLag>0)
+    {
+        while(mlpLoopKeyFrameQueue.size()>1 && mlpLoopKeyFrameQueue.front()->mTimeStamp<mLastInsertedTimeStamp-mQueueMaxLag)
+        {
+            vpSkippedKFs.push_back(mlpLoopKeyFrameQueue.front());
+            mlpLoopKeyFrameQueue.pop_front();
+            mQueueStats.mnStale++;
+        }
+    }
+
+    if(mnQueueLimit<=0 || mlpLoopKeyFrameQueue.size()<=(size_t)mnQueueLimit)
+        return;
+
+    // Covisible keyframes of the backlog see the same place, only the one with
+    // the most words of each group is queried. A keyframe joins the first
+    // group whose first keyframe it is connected to.
+    vector<KeyFrame*> vpFirstKFs;
+    vector<KeyFrame*> vpBestKFs;
+    for(list<KeyFrame*>::iterator lit=mlpLoopKeyFrameQueue.begin(), lend=mlpLoopKeyFrameQueue.end(); lit!=lend; lit++)
+    {
+        KeyFrame* pKF = *lit;
+        size_t iG=0;
+        while(iG<vpFirstKFs.size() && pKF->GetWeight(vpFirstKFs[iG])==0)
+            iG++;
+
+        if(iG==vpFirstKFs.size())
+        {
+            vpFirstKFs.push_back(pKF);
+            vpBestKFs.push_back(pKF);
+        }
+        else if(pKF->mBowVec.size()>vpBestKFs[iG]->mBowVec.size())
+            vpBestKFs[iG] = pKF;
+    }
+
+    const set<KeyFrame*> spBestKFs(vpBestKFs.begin(),vpBestKFs.end());
+    list<KeyFrame*>::iterator lit = mlpLoopKeyFrameQueue.begin();
+    while(lit!=mlpLoopKeyFrameQueue.end())
+    {
+        if(spBestKFs.count(*lit))
+        {
+            lit++;
+            continue;
+        }
+        vpSkippedKFs.push_back(*lit);
+        lit = mlpLoopKeyFrameQueue.erase(lit);
+        mQueueStats.mnCoalesced++;
+    }
+}
+
 bool LoopClosing::DetectLoop()
 {
+    vector<KeyFrame*> vpSkippedKFs;
     {
         unique_lock<mutex> lock(mMutexLoopQueue);
+        TrimQueue(vpSkippedKFs);
         mpCurrentKF = mlpLoopKeyFrameQueue.front();
         mlpLoopKeyFrameQueue.pop_front();
         // Avoid that a keyframe can be erased while it is being process by this thread
         mpCurrentKF->SetNotErase();
+
+        mQueueStats.mnProcessed++;
+        mQueueStats.mLastLag = mLastInsertedTimeStamp-mpCurrentKF->mTimeStamp;
+        mQueueStats.mMaxLag = max(mQueueStats.mMaxLag,mQueueStats.mLastLag);
     }
 
+    // Skipped keyframes can still be loop candidates of the next ones
+    for(size_t i=0; i<vpSkippedKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpSkippedKFs[i];
+        pKF->SetNotErase();
+        if(!pKF->isBad())
+            mpKeyFrameDB->add(pKF);
+        pKF->SetErase();
+    }
+
+    // The keyframe could have been culled by Local Mapping while in the queue
+    if(mpCurrentKF->isBad())
+        return false;
+
     //If the map contains less than 10 KF or less than 10 KF have passed from last loop detection
     if(mpCurrentKF->mnId<mLastLoopKFid+10)
     {
@@ -161,33 +295,30 @@ bool LoopClosing::DetectLoop()
     {
         KeyFrame* pCandidateKF = vpCandidateKFs[i];
 
-        set<KeyFrame*> spCandidateGroup = pCandidateKF->GetConnectedKeyFrames();
-        spCandidateGroup.insert(pCandidateKF);
+        // Groups are compared by keyframe ids, which are never reused
+        const set<KeyFrame*> spCandidateGroup = pCandidateKF->GetConnectedKeyFrames();
+        vector<long unsigned int> vCandidateGroup;
+        vCandidateGroup.reserve(spCandidateGroup.size()+1);
+        for(set<KeyFrame*>::const_iterator sit=spCandidateGroup.begin(), send=spCandidateGroup.end(); sit!=send; sit++)
+            vCandidateGroup.push_back((*sit)->mnId);
+        vCandidateGroup.push_back(pCandidateKF->mnId);
+        sort(vCandidateGroup.begin(),vCandidateGroup.end());
+        vCandidateGroup.erase(unique(vCandidateGroup.begin(),vCandidateGroup.end()),vCandidateGroup.end());
 
         bool bEnoughConsistent = false;
         bool bConsistentForSomeGroup = false;
         for(size_t iG=0, iendG=mvConsistentGroups.size(); iG<iendG; iG++)
         {
-            set<KeyFrame*> sPreviousGroup = mvConsistentGroups[iG].first;
-
-            bool bConsistent = false;
-            for(set<KeyFrame*>::iterator sit=spCandidateGroup.begin(), send=spCandidateGroup.end(); sit!=send;sit++)
-            {
-                if(sPreviousGroup.count(*sit))
-                {
-                    bConsistent=true;
-                    bConsistentForSomeGroup=true;
-                    break;
-                }
-            }
+            const bool bConsistent = ShareKeyFrame(vCandidateGroup,mvConsistentGroups[iG].first);
 
             if(bConsistent)
             {
+                bConsistentForSomeGroup=true;
                 int nPreviousConsistency = mvConsistentGroups[iG].second;
                 int nCurrentConsistency = nPreviousConsistency + 1;
                 if(!vbConsistentGroup[iG])
                 {
-                    ConsistentGroup cg = make_pair(spCandidateGroup,nCurrentConsistency);
+                    ConsistentGroup cg = make_pair(vCandidateGroup,nCurrentConsistency);
                     vCurrentConsistentGroups.push_back(cg);
                     vbConsistentGroup[iG]=true; //this avoid to include the same group more than once
                 }
@@ -202,13 +333,13 @@ bool LoopClosing::DetectLoop()
         // If the group is not consistent with any previous group insert with consistency counter set to zero
         if(!bConsistentForSomeGroup)
         {
-            ConsistentGroup cg = make_pair(spCandidateGroup,0);
+            ConsistentGroup cg = make_pair(vCandidateGroup,0);
             vCurrentConsistentGroups.push_back(cg);
         }
     }
 
     // Update Covisibility Consistent Groups
-    mvConsistentGroups = vCurrentConsistentGroups;
+    mvConsistentGroups.swap(vCurrentConsistentGroups);
 
 
     // Add Current Keyframe to database
@@ -371,6 +502,30 @@ bool LoopClosing::ComputeSim3()
         }
     }
 
+    // Points around the loop keyframe the covisibility graph does not reach (e.g. places seen again after a long
+    // gap). Those of the current side of the loop are left out, they are corrected and fused into it.
+    if(mfSpatialRadius>0 && mpMap->mPointIndex.IsEnabled())
+    {
+        set<MapPoint*> spCurrentMPs;
+        vector<KeyFrame*> vpCurrentConnectedKFs = mpCurrentKF->GetVectorCovisibleKeyFrames();
+        vpCurrentConnectedKFs.push_back(mpCurrentKF);
+        for(size_t i=0; i<vpCurrentConnectedKFs.size(); i++)
+        {
+            const vector<MapPoint*> vpMapPoints = vpCurrentConnectedKFs[i]->GetMapPointMatches();
+            spCurrentMPs.insert(vpMapPoints.begin(),vpMapPoints.end());
+        }
+
+        const vector<MapPoint*> vpSpatialMPs = mpMap->mPointIndex.GetPointsInRadius(mpMatchedKF->GetCameraCenter(),mfSpatialRadius);
+        for(size_t i=0; i<vpSpatialMPs.size(); i++)
+        {
+            MapPoint* pMP = vpSpatialMPs[i];
+            if(pMP->isBad() || pMP->mnLoopPointForKF==mpCurrentKF->mnId || spCurrentMPs.count(pMP))
+                continue;
+            mvpLoopMapPoints.push_back(pMP);
+            pMP->mnLoopPointForKF=mpCurrentKF->mnId;
+        }
+    }
+
     // Find more matches projecting with the computed Sim3
     matcher.SearchByProjection(mpCurrentKF, mScw, mvpLoopMapPoints, mvpCurrentMatchedPoints,10);
 
@@ -519,7 +674,7 @@ void LoopClosing::CorrectLoop()
         // Update matched map points and replace if duplicated
         for(size_t i=0; i<mvpCurrentMatchedPoints.size(); i++)
         {
-            if(mvpCurrentMatchedPoints[i])
+            if(mvpCurrentMatchedPoints[i] && !mvpCurrentMatchedPoints[i]->isBad())
             {
                 MapPoint* pLoopMP = mvpCurrentMatchedPoints[i];
                 MapPoint* pCurMP = mpCurrentKF->GetMapPoint(i);
@@ -572,6 +727,13 @@ void LoopClosing::CorrectLoop()
     mpMatchedKF->AddLoopEdge(mpCurrentKF);
     mpCurrentKF->AddLoopEdge(mpMatchedKF);
 
+    // Record the corrected map before Local Mapping resumes
+    if(mpJournal)
+    {
+        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+        mpJournal->LogMapCorrection(mvpCurrentConnectedKFs);
+    }
+
     // Launch a new thread to perform Global Bundle Adjustment
     mbRunningGBA = true;
     mbFinishedGBA = false;
@@ -613,6 +775,35 @@ void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap)
 }
 
 
+void LoopClosing::ReleaseRetired()
+{
+    EpochReclaimer &reclaimer = mpMap->mReclaimer;
+    const unsigned long nEpoch = reclaimer.GetEpoch();
+
+    if(nEpoch!=mnLastReclaimEpoch)
+    {
+        {
+            unique_lock<mutex> lock(mMutexLoopQueue);
+            list<KeyFrame*>::iterator lit = mlpLoopKeyFrameQueue.begin();
+            while(lit!=mlpLoopKeyFrameQueue.end())
+            {
+                if((*lit)->isBad())
+                    lit = mlpLoopKeyFrameQueue.erase(lit);
+                else
+                    lit++;
+            }
+        }
+
+        mvpEnoughConsistentCandidates.clear();
+        mvpCurrentConnectedKFs.clear();
+        mvpCurrentMatchedPoints.clear();
+        mvpLoopMapPoints.clear();
+    }
+
+    reclaimer.Quiescent(mnReclaimSlot,nEpoch);
+    mnLastReclaimEpoch = nEpoch;
+}
+
 void LoopClosing::RequestReset()
 {
     {
@@ -637,6 +828,7 @@ void LoopClosing::ResetIfRequested()
     if(mbResetRequested)
     {
         mlpLoopKeyFrameQueue.clear();
+        mvConsistentGroups.clear();
         mLastLoopKFid=0;
         mbResetRequested=false;
     }
@@ -646,6 +838,9 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
 {
     cout << "Starting Global Bundle Adjustment" << endl;
 
+    // Retired objects are kept alive until the optimization and the update finish
+    const int nReclaimSlot = mpMap->mReclaimer.RegisterThread();
+
     int idx =  mnFullBAIdx;
     Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false);
 
@@ -656,7 +851,10 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
     {
         unique_lock<mutex> lock(mMutexGBA);
         if(idx!=mnFullBAIdx)
+        {
+            mpMap->mReclaimer.UnregisterThread(nReclaimSlot);
             return;
+        }
 
         if(!mbStopGBA)
         {
@@ -670,10 +868,11 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
                 usleep(1000);
             }
 
-            // Get Map Mutex
-            unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+            // With Local Mapping stopped only this thread changes the map, the corrections are computed while
+            // tracking goes on and committed at once with the map mutex held
 
             // Correct keyframes starting at map first keyframe
+            vector<KeyFrame*> vpCorrectedKFs;
             list<KeyFrame*> lpKFtoCheck(mpMap->mvpKeyFrameOrigins.begin(),mpMap->mvpKeyFrameOrigins.end());
 
             while(!lpKFtoCheck.empty())
@@ -695,46 +894,69 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
                 }
 
                 pKF->mTcwBefGBA = pKF->GetPose();
-                pKF->SetPose(pKF->mTcwGBA);
+                vpCorrectedKFs.push_back(pKF);
                 lpKFtoCheck.pop_front();
             }
 
-            // Correct MapPoints
+            // Correct MapPoints, in blocks by several threads
             const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+            vector<cv::Mat> vCorrectedPos(vpMPs.size());
 
-            for(size_t i=0; i<vpMPs.size(); i++)
+            auto correctPoints = [&](const size_t begin, const size_t end)
             {
-                MapPoint* pMP = vpMPs[i];
+                for(size_t i=begin; i<end; i++)
+                {
+                    MapPoint* pMP = vpMPs[i];
 
-                if(pMP->isBad())
-                    continue;
+                    if(pMP->isBad())
+                        continue;
 
-                if(pMP->mnBAGlobalForKF==nLoopKF)
-                {
-                    // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
+                    if(pMP->mnBAGlobalForKF==nLoopKF)
+                    {
+                        // If optimized by Global BA, just update
+                        vCorrectedPos[i] = pMP->mPosGBA;
+                    }
+                    else
+                    {
+                        // Update according to the correction of its reference keyframe
+                        KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+
+                        if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                            continue;
+
+                        // Map to non-corrected camera
+                        cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+                        cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+                        cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+
+                        // Backproject using corrected camera
+                        cv::Mat Rwc = pRefKF->mTcwGBA.rowRange(0,3).colRange(0,3).t();
+                        cv::Mat twc = -Rwc*pRefKF->mTcwGBA.rowRange(0,3).col(3);
+
+                        vCorrectedPos[i] = Rwc*Xc+twc;
+                    }
                 }
-                else
-                {
-                    // Update according to the correction of its reference keyframe
-                    KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+            };
 
-                    if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                        continue;
+            ParallelFor(vpMPs.size(),1024,correctPoints);
 
-                    // Map to non-corrected camera
-                    cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                    cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                    cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+            {
+                // Get Map Mutex
+                unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
 
-                    // Backproject using corrected camera
-                    cv::Mat Twc = pRefKF->GetPoseInverse();
-                    cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
-                    cv::Mat twc = Twc.rowRange(0,3).col(3);
+                for(size_t i=0; i<vpCorrectedKFs.size(); i++)
+                    vpCorrectedKFs[i]->SetPose(vpCorrectedKFs[i]->mTcwGBA);
 
-                    pMP->SetWorldPos(Rwc*Xc+twc);
+                for(size_t i=0; i<vpMPs.size(); i++)
+                {
+                    if(!vCorrectedPos[i].empty())
+                        vpMPs[i]->SetWorldPos(vCorrectedPos[i]);
                 }
-            }            
+
+                // Record the corrected map before Local Mapping resumes
+                if(mpJournal)
+                    mpJournal->LogMapCorrection(vector<KeyFrame*>());
+            }
 
             mpMap->InformNewBigChange();
 
@@ -746,6 +968,8 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
         mbFinishedGBA = true;
         mbRunningGBA = false;
     }
+
+    mpMap->mReclaimer.UnregisterThread(nReclaimSlot);
 }
 
 void LoopClosing::RequestFinish()
@@ -25,7 +25,7 @@
 namespace ORB_SLAM2
 {
 
-Map::Map():mnMaxKFid(0),mnBigChangeIdx(0)
+Map::Map():mnMaxKFid(0),mnBigChangeIdx(0),mbJournal(false),mbJournalCleared(false)
 {
 }
 
@@ -39,26 +39,35 @@ void Map::AddKeyFrame(KeyFrame *pKF)
 
 void Map::AddMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.insert(pMP);
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        mspMapPoints.insert(pMP);
+    }
+    mPointIndex.Insert(pMP);
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
-    mspMapPoints.erase(pMP);
+    mPointIndex.Erase(pMP);
 
-    // TODO: This only erase the pointer.
-    // Delete the MapPoint
+    unique_lock<mutex> lock(mMutexMap);
+    if(mspMapPoints.erase(pMP))
+    {
+        if(mbJournal)
+            mvnErasedMapPoints.push_back(pMP->mnId);
+        mReclaimer.Retire(pMP);
+    }
 }
 
 void Map::EraseKeyFrame(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexMap);
-    mspKeyFrames.erase(pKF);
-
-    // TODO: This only erase the pointer.
-    // Delete the MapPoint
+    if(mspKeyFrames.erase(pKF))
+    {
+        if(mbJournal)
+            mvnErasedKeyFrames.push_back(pKF->mnId);
+        mReclaimer.Retire(pKF);
+    }
 }
 
 void Map::SetReferenceMapPoints(const vector<MapPoint *> &vpMPs)
@@ -117,6 +126,8 @@ long unsigned int Map::GetMaxKFid()
 
 void Map::clear()
 {
+    unique_lock<mutex> lock(mMutexSnapshot);
+
     for(set<MapPoint*>::iterator sit=mspMapPoints.begin(), send=mspMapPoints.end(); sit!=send; sit++)
         delete *sit;
 
@@ -125,9 +136,33 @@ void Map::clear()
 
     mspMapPoints.clear();
     mspKeyFrames.clear();
+    mPointIndex.clear();
+    mReclaimer.clear();
     mnMaxKFid = 0;
     mvpReferenceMapPoints.clear();
     mvpKeyFrameOrigins.clear();
+
+    unique_lock<mutex> lock2(mMutexMap);
+    mvnErasedKeyFrames.clear();
+    mvnErasedMapPoints.clear();
+    mbJournalCleared = mbJournal;
+}
+
+void Map::EnableJournal()
+{
+    unique_lock<mutex> lock(mMutexMap);
+    mbJournal = true;
+}
+
+void Map::TakeJournalChanges(vector<long unsigned int> &vnErasedKFs, vector<long unsigned int> &vnErasedMPs, bool &bCleared)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    vnErasedKFs.swap(mvnErasedKeyFrames);
+    vnErasedMPs.swap(mvnErasedMapPoints);
+    mvnErasedKeyFrames.clear();
+    mvnErasedMapPoints.clear();
+    bCleared = mbJournalCleared;
+    mbJournalCleared = false;
 }
 
 template<class Archive>
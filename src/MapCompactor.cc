@@ -0,0 +1,220 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MapCompactor.h"
+
+#include "KeyFrame.h"
+#include "Map.h"
+#include "MapPoint.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <unordered_map>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+MapCompactor::MapCompactor(Map *pMap, const bool bMonocular)
+    : mfMinRedundancy(0.5), mnMinRelocPoints(50), mnMinKeyFramePoints(100),
+      mpMap(pMap), mbMonocular(bMonocular) {}
+
+CompactionReport MapCompactor::Compact(const long unsigned int nMaxKeyFrames,
+                                       const long unsigned int nMaxMapPoints) {
+  CompactionReport report;
+  report.mnKeyFramesBefore = mpMap->KeyFramesInMap();
+  report.mnMapPointsBefore = mpMap->MapPointsInMap();
+
+  // The removed objects are read to measure the recall, they must not be
+  // deleted in the meantime
+  const int nSlot = mpMap->mReclaimer.RegisterThread();
+  mvvpRemovedPoints.clear();
+
+  if (nMaxKeyFrames > 0)
+    RemoveKeyFrames(nMaxKeyFrames);
+  if (nMaxMapPoints > 0)
+    RemoveMapPoints(nMaxMapPoints);
+
+  // Covisibility weights of the remaining keyframes
+  const vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+  report.mnWeakKeyFrames = 0;
+  for (size_t i = 0; i < vpKFs.size(); i++) {
+    if (vpKFs[i]->isBad())
+      continue;
+    vpKFs[i]->UpdateConnections();
+    if ((int)vpKFs[i]->GetMapPoints().size() < mnMinRelocPoints)
+      report.mnWeakKeyFrames++;
+  }
+
+  report.mnRemovedKeyFrames = mvvpRemovedPoints.size();
+  report.mnRecalledKeyFrames = 0;
+  for (size_t i = 0; i < mvvpRemovedPoints.size(); i++) {
+    map<KeyFrame *, int> KFcounter;
+    int nMax = 0;
+    const vector<MapPoint *> &vpMPs = mvvpRemovedPoints[i];
+    for (size_t j = 0; j < vpMPs.size(); j++) {
+      if (vpMPs[j]->isBad())
+        continue;
+      const map<KeyFrame *, size_t> observations = vpMPs[j]->GetObservations();
+      for (map<KeyFrame *, size_t>::const_iterator mit = observations.begin(),
+                                                   mend = observations.end();
+           mit != mend; mit++)
+        nMax = max(nMax, ++KFcounter[mit->first]);
+    }
+    if (nMax >= mnMinRelocPoints)
+      report.mnRecalledKeyFrames++;
+  }
+  report.mfRecall =
+      report.mnRemovedKeyFrames > 0
+          ? (float)report.mnRecalledKeyFrames / report.mnRemovedKeyFrames
+          : 1.0f;
+  mvvpRemovedPoints.clear();
+
+  mpMap->mReclaimer.UnregisterThread(nSlot);
+
+  report.mnKeyFramesAfter = mpMap->KeyFramesInMap();
+  report.mnMapPointsAfter = mpMap->MapPointsInMap();
+
+  cout << "[compactor] Keyframes: " << report.mnKeyFramesBefore << " -> "
+       << report.mnKeyFramesAfter << ", map points: "
+       << report.mnMapPointsBefore << " -> " << report.mnMapPointsAfter << endl;
+  cout << "[compactor] Relocalization recall of the removed keyframes: "
+       << report.mfRecall << " (" << report.mnRecalledKeyFrames << "/"
+       << report.mnRemovedKeyFrames << "), " << report.mnWeakKeyFrames
+       << " keyframes with less than " << mnMinRelocPoints << " map points"
+       << endl;
+
+  return report;
+}
+
+float MapCompactor::Redundancy(KeyFrame *pKF) {
+  // Same criterion as LocalMapping::KeyFrameCulling
+  int nMPs, nRedundantObservations;
+  pKF->GetRedundancy(!mbMonocular, nMPs, nRedundantObservations);
+
+  return nMPs > 0 ? (float)nRedundantObservations / nMPs : 0;
+}
+
+bool MapCompactor::CanRemove(KeyFrame *pKF) {
+  // Origins and loop keyframes anchor the map, SetBadFlag would defer them
+  if (pKF->isBad() || pKF->mnId == 0 || !pKF->GetLoopEdges().empty())
+    return false;
+  for (size_t i = 0; i < mpMap->mvpKeyFrameOrigins.size(); i++)
+    if (mpMap->mvpKeyFrameOrigins[i] == pKF)
+      return false;
+
+  // Its view is relocalized from a covisible keyframe
+  const vector<KeyFrame *> vpBest = pKF->GetBestCovisibilityKeyFrames(1);
+  return !vpBest.empty() && pKF->GetWeight(vpBest[0]) >= mnMinRelocPoints;
+}
+
+void MapCompactor::RemoveKeyFrames(const long unsigned int nMaxKeyFrames) {
+  // Most redundant first. Scores change when a covisible keyframe is removed,
+  // they are computed again when popped (lazy update).
+  priority_queue<pair<float, KeyFrame *>> queue;
+  const vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+  for (size_t i = 0; i < vpKFs.size(); i++) {
+    if (!CanRemove(vpKFs[i]))
+      continue;
+    const float redundancy = Redundancy(vpKFs[i]);
+    if (redundancy >= mfMinRedundancy)
+      queue.push(make_pair(redundancy, vpKFs[i]));
+  }
+
+  set<KeyFrame *> spDirty;
+  while (!queue.empty() && mpMap->KeyFramesInMap() > nMaxKeyFrames) {
+    KeyFrame *pKF = queue.top().second;
+    queue.pop();
+
+    if (spDirty.count(pKF)) {
+      spDirty.erase(pKF);
+      if (!CanRemove(pKF))
+        continue;
+      const float redundancy = Redundancy(pKF);
+      if (redundancy >= mfMinRedundancy)
+        queue.push(make_pair(redundancy, pKF));
+      continue;
+    }
+
+    if (!CanRemove(pKF))
+      continue;
+
+    const vector<KeyFrame *> vpNeighs = pKF->GetVectorCovisibleKeyFrames();
+    spDirty.insert(vpNeighs.begin(), vpNeighs.end());
+
+    const set<MapPoint *> spMPs = pKF->GetMapPoints();
+    mvvpRemovedPoints.push_back(
+        vector<MapPoint *>(spMPs.begin(), spMPs.end()));
+
+    pKF->SetBadFlag();
+  }
+}
+
+void MapCompactor::RemoveMapPoints(const long unsigned int nMaxMapPoints) {
+  const vector<MapPoint *> vpMPs = mpMap->GetAllMapPoints();
+  if (vpMPs.size() <= nMaxMapPoints)
+    return;
+
+  // Points tracked in many keyframes and rarely missed are kept
+  vector<pair<float, MapPoint *>> vUtilities;
+  vUtilities.reserve(vpMPs.size());
+  for (size_t i = 0; i < vpMPs.size(); i++) {
+    MapPoint *pMP = vpMPs[i];
+    if (pMP->isBad())
+      continue;
+    vUtilities.push_back(
+        make_pair(pMP->Observations() * pMP->GetFoundRatio(), pMP));
+  }
+  sort(vUtilities.begin(), vUtilities.end());
+
+  unordered_map<KeyFrame *, int> KFPoints;
+  long unsigned int nMPs = vUtilities.size();
+  for (size_t i = 0; i < vUtilities.size() && nMPs > nMaxMapPoints; i++) {
+    MapPoint *pMP = vUtilities[i].second;
+    if (pMP->isBad())
+      continue;
+
+    // Coverage: every observing keyframe keeps enough points
+    const map<KeyFrame *, size_t> observations = pMP->GetObservations();
+    bool bKeep = false;
+    for (map<KeyFrame *, size_t>::const_iterator mit = observations.begin(),
+                                                 mend = observations.end();
+         mit != mend && !bKeep; mit++) {
+      if (!KFPoints.count(mit->first))
+        KFPoints[mit->first] = mit->first->GetMapPoints().size();
+      bKeep = KFPoints[mit->first] <= mnMinKeyFramePoints;
+    }
+    if (bKeep)
+      continue;
+
+    for (map<KeyFrame *, size_t>::const_iterator mit = observations.begin(),
+                                                 mend = observations.end();
+         mit != mend; mit++)
+      KFPoints[mit->first]--;
+
+    pMP->SetBadFlag();
+    nMPs--;
+  }
+}
+
+} // namespace ORB_SLAM2
@@ -0,0 +1,766 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MapJournal.h"
+
+#include "KeyFrame.h"
+#include "Map.h"
+#include "MapPoint.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+static uint32_t Checksum(const string &data) {
+  boost::crc_32_type crc;
+  crc.process_bytes(data.data(), data.size());
+  return crc.checksum();
+}
+
+// FNV-1a, the signatures tell which states changed since they were logged
+static uint64_t Hash(const void *data, const size_t size,
+                     uint64_t h = 14695981039346656037ULL) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t Hash(const cv::Mat &m, const uint64_t h) {
+  if (m.empty())
+    return h;
+  const cv::Mat c = m.isContinuous() ? m : m.clone();
+  return Hash(c.data, c.total() * c.elemSize(), h);
+}
+
+// Pose and graph of a keyframe
+static uint64_t Signature(const KeyFrameUpdate &update) {
+  uint64_t h = Hash(update.Tcw, Hash(&update.mnParentId,
+                                     sizeof(update.mnParentId)));
+  for (size_t i = 0; i < update.mvnLoopEdgeIds.size(); i++)
+    h = Hash(&update.mvnLoopEdgeIds[i], sizeof(update.mvnLoopEdgeIds[i]), h);
+  for (size_t i = 0; i < update.mvConnections.size(); i++) {
+    h = Hash(&update.mvConnections[i].first,
+             sizeof(update.mvConnections[i].first), h);
+    h = Hash(&update.mvConnections[i].second,
+             sizeof(update.mvConnections[i].second), h);
+  }
+  return h;
+}
+
+// Observations and descriptor of a map point. The position is compared apart,
+// the visibility counters are not logged again when only they change.
+static uint64_t Signature(const MapPointState &state) {
+  uint64_t h = Hash(state.mDescriptor,
+                    Hash(&state.mnRefKFId, sizeof(state.mnRefKFId)));
+  for (size_t i = 0; i < state.mvObservations.size(); i++) {
+    h = Hash(&state.mvObservations[i].first,
+             sizeof(state.mvObservations[i].first), h);
+    h = Hash(&state.mvObservations[i].second,
+             sizeof(state.mvObservations[i].second), h);
+  }
+  return h;
+}
+
+static void CaptureKeyFrameUpdate(KeyFrame *pKF, KeyFrameUpdate &update) {
+  update.mnId = pKF->mnId;
+  update.Tcw = pKF->GetPose();
+
+  MapSnapshot::CaptureGraph(pKF, update.mnParentId, update.mvnLoopEdgeIds,
+                            update.mvConnections);
+}
+
+MapJournal::MapJournal(Map *pMap, const string &mapfile)
+    : mpMap(pMap), mMapFile(mapfile), mnSeq(0), mnSegment(0),
+      mbReplayed(false), mbOpen(false), mnBytes(0), mnMaxBytes(0),
+      mbWriteFailed(false), mnGeneration(0), mnFile(-1), mnFileSegment(-1),
+      mbFinishRequested(false), mbFinished(true) {}
+
+string MapJournal::SegmentName(const int nSegment) {
+  return mMapFile + ".journal." + to_string(nSegment);
+}
+
+vector<int> MapJournal::ListSegments() {
+  const size_t pos = mMapFile.find_last_of('/');
+  const string dirname = pos == string::npos ? "." : mMapFile.substr(0, pos);
+  const string prefix =
+      (pos == string::npos ? mMapFile : mMapFile.substr(pos + 1)) + ".journal.";
+
+  vector<int> vnSegments;
+  DIR *pDir = opendir(dirname.c_str());
+  if (!pDir)
+    return vnSegments;
+
+  while (dirent *pEntry = readdir(pDir)) {
+    const string name = pEntry->d_name;
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix))
+      continue;
+    const string suffix = name.substr(prefix.size());
+    if (suffix.find_first_not_of("0123456789") != string::npos)
+      continue;
+    vnSegments.push_back(atoi(suffix.c_str()));
+  }
+  closedir(pDir);
+
+  sort(vnSegments.begin(), vnSegments.end());
+  return vnSegments;
+}
+
+// Apply a record to the snapshot. KFs and MPs index the states by id, erased
+// states are removed from the index and dropped at the end of the replay.
+static void Apply(const JournalRecord &record, MapSnapshot &snapshot,
+                  unordered_map<long unsigned int, size_t> &KFs,
+                  unordered_map<long unsigned int, size_t> &MPs) {
+  vector<KeyFrameState> &vKFs = snapshot.mvKeyFrames;
+  vector<MapPointState> &vMPs = snapshot.mvMapPoints;
+
+  if (record.mbReset) {
+    vKFs.clear();
+    vMPs.clear();
+    snapshot.mvnOriginIds.clear();
+    KFs.clear();
+    MPs.clear();
+  }
+
+  for (size_t i = 0; i < record.mvnErasedMapPoints.size(); i++) {
+    const long unsigned int nId = record.mvnErasedMapPoints[i];
+    if (!MPs.count(nId))
+      continue;
+    const MapPointState &state = vMPs[MPs[nId]];
+    for (size_t j = 0; j < state.mvObservations.size(); j++) {
+      const long unsigned int nKFid = state.mvObservations[j].first;
+      const size_t idx = state.mvObservations[j].second;
+      if (KFs.count(nKFid) &&
+          idx < vKFs[KFs[nKFid]].mvnMapPointIds.size() &&
+          vKFs[KFs[nKFid]].mvnMapPointIds[idx] == (long int)nId)
+        vKFs[KFs[nKFid]].mvnMapPointIds[idx] = -1;
+    }
+    MPs.erase(nId);
+  }
+
+  for (size_t i = 0; i < record.mvnErasedKeyFrames.size(); i++) {
+    const long unsigned int nId = record.mvnErasedKeyFrames[i];
+    if (!KFs.count(nId))
+      continue;
+    // Same reparenting as KeyFrame::SetBadFlag when the children were not
+    // logged afterwards
+    const long int nParentId = vKFs[KFs[nId]].mnParentId;
+    for (size_t j = 0; j < vKFs.size(); j++)
+      if (vKFs[j].mnParentId == (long int)nId)
+        vKFs[j].mnParentId = nParentId;
+
+    // Same as MapPoint::EraseObservation, the points only seen by this
+    // keyframe are erased with it
+    const vector<long int> &vnMPIds = vKFs[KFs[nId]].mvnMapPointIds;
+    for (size_t j = 0; j < vnMPIds.size(); j++) {
+      if (vnMPIds[j] < 0 || !MPs.count(vnMPIds[j]))
+        continue;
+      MapPointState &state = vMPs[MPs[vnMPIds[j]]];
+      vector<pair<long unsigned int, size_t>> vObservations;
+      for (size_t k = 0; k < state.mvObservations.size(); k++)
+        if (state.mvObservations[k].first != nId)
+          vObservations.push_back(state.mvObservations[k]);
+      if (vObservations.empty()) {
+        MPs.erase(vnMPIds[j]);
+        continue;
+      }
+      state.mvObservations.swap(vObservations);
+      if (state.mnRefKFId == (long int)nId)
+        state.mnRefKFId = state.mvObservations.front().first;
+    }
+    KFs.erase(nId);
+  }
+
+  for (size_t i = 0; i < record.mvKeyFrames.size(); i++) {
+    const KeyFrameState &state = record.mvKeyFrames[i];
+    if (KFs.count(state.mnId)) {
+      vKFs[KFs[state.mnId]] = state;
+    } else {
+      KFs[state.mnId] = vKFs.size();
+      vKFs.push_back(state);
+    }
+  }
+
+  for (size_t i = 0; i < record.mvMapPoints.size(); i++) {
+    const MapPointState &state = record.mvMapPoints[i];
+    const long int nId = state.mnId;
+
+    if (MPs.count(state.mnId)) {
+      // Observations are replaced
+      MapPointState &old = vMPs[MPs[state.mnId]];
+      for (size_t j = 0; j < old.mvObservations.size(); j++) {
+        const long unsigned int nKFid = old.mvObservations[j].first;
+        const size_t idx = old.mvObservations[j].second;
+        if (KFs.count(nKFid) &&
+            idx < vKFs[KFs[nKFid]].mvnMapPointIds.size() &&
+            vKFs[KFs[nKFid]].mvnMapPointIds[idx] == nId)
+          vKFs[KFs[nKFid]].mvnMapPointIds[idx] = -1;
+      }
+      old = state;
+    } else {
+      MPs[state.mnId] = vMPs.size();
+      vMPs.push_back(state);
+    }
+
+    for (size_t j = 0; j < state.mvObservations.size(); j++) {
+      const long unsigned int nKFid = state.mvObservations[j].first;
+      const size_t idx = state.mvObservations[j].second;
+      if (KFs.count(nKFid) && idx < vKFs[KFs[nKFid]].mvnMapPointIds.size())
+        vKFs[KFs[nKFid]].mvnMapPointIds[idx] = nId;
+    }
+  }
+
+  for (size_t i = 0; i < record.mvKeyFrameUpdates.size(); i++) {
+    const KeyFrameUpdate &update = record.mvKeyFrameUpdates[i];
+    if (!KFs.count(update.mnId))
+      continue;
+    KeyFrameState &state = vKFs[KFs[update.mnId]];
+    state.Tcw = update.Tcw;
+    state.mnParentId = update.mnParentId;
+    state.mvnLoopEdgeIds = update.mvnLoopEdgeIds;
+    state.mvConnections = update.mvConnections;
+  }
+
+  for (size_t i = 0; i < record.mvMapPointPositions.size(); i++) {
+    const long unsigned int nId = record.mvMapPointPositions[i].first;
+    if (MPs.count(nId))
+      vMPs[MPs[nId]].mWorldPos = record.mvMapPointPositions[i].second;
+  }
+
+  if (!record.mvnOriginIds.empty())
+    snapshot.mvnOriginIds = record.mvnOriginIds;
+}
+
+bool MapJournal::Replay(MapSnapshot &snapshot) {
+  unordered_map<long unsigned int, size_t> KFs;
+  for (size_t i = 0; i < snapshot.mvKeyFrames.size(); i++)
+    KFs[snapshot.mvKeyFrames[i].mnId] = i;
+  unordered_map<long unsigned int, size_t> MPs;
+  for (size_t i = 0; i < snapshot.mvMapPoints.size(); i++)
+    MPs[snapshot.mvMapPoints[i].mnId] = i;
+
+  mnSeq = snapshot.mnJournalSeq;
+  mnSegment = snapshot.mnJournalSegment;
+
+  // Records older than the snapshot are skipped, unless they follow a reset
+  // (a new session started on the same map file)
+  bool bAcceptAll = false;
+  int nApplied = 0;
+
+  const vector<int> vnSegments = ListSegments();
+  for (size_t iS = 0; iS < vnSegments.size(); iS++) {
+    const string filename = SegmentName(vnSegments[iS]);
+    ifstream in(filename, ios_base::binary | ios_base::ate);
+    const streamoff nFileSize = in.tellg();
+    in.seekg(0);
+    mnSegment = max(mnSegment, vnSegments[iS] + 1);
+
+    while (in) {
+      uint32_t header[2];
+      if (!in.read(reinterpret_cast<char *>(header), sizeof(header)))
+        break;
+
+      if (in.tellg() + (streamoff)header[0] > nFileSize) {
+        cerr << "[journal] Incomplete record at the end of " << filename
+             << endl;
+        break;
+      }
+
+      string data(header[0], '\0');
+      if (!in.read(&data[0], data.size()) || Checksum(data) != header[1]) {
+        cerr << "[journal] Incomplete record at the end of " << filename
+             << endl;
+        break;
+      }
+
+      JournalRecord record;
+      try {
+        istringstream is(data);
+        boost::archive::binary_iarchive ia(is, boost::archive::no_header);
+        ia >> record;
+      } catch (const std::exception &e) {
+        cerr << "[journal] Cannot read " << filename << ": " << e.what()
+             << endl;
+        break;
+      }
+
+      if (record.mbReset)
+        bAcceptAll = true;
+      else if (!bAcceptAll && record.mnSeq <= snapshot.mnJournalSeq)
+        continue;
+
+      Apply(record, snapshot, KFs, MPs);
+      mnSeq = max(mnSeq, record.mnSeq);
+      nApplied++;
+    }
+  }
+
+  // Drop the erased keyframes and map points
+  vector<KeyFrameState> vKFs;
+  vKFs.reserve(KFs.size());
+  for (size_t i = 0; i < snapshot.mvKeyFrames.size(); i++) {
+    const long unsigned int nId = snapshot.mvKeyFrames[i].mnId;
+    if (KFs.count(nId) && KFs[nId] == i)
+      vKFs.push_back(snapshot.mvKeyFrames[i]);
+  }
+  snapshot.mvKeyFrames.swap(vKFs);
+
+  vector<MapPointState> vMPs;
+  vMPs.reserve(MPs.size());
+  for (size_t i = 0; i < snapshot.mvMapPoints.size(); i++) {
+    const long unsigned int nId = snapshot.mvMapPoints[i].mnId;
+    if (MPs.count(nId) && MPs[nId] == i)
+      vMPs.push_back(snapshot.mvMapPoints[i]);
+  }
+  snapshot.mvMapPoints.swap(vMPs);
+
+  if (nApplied > 0)
+    cout << "[journal] Replayed " << nApplied << " records from "
+         << vnSegments.size() << " segments" << endl;
+
+  mbReplayed = true;
+  return nApplied > 0;
+}
+
+void MapJournal::Recover() {
+  const vector<int> vnSegments = ListSegments();
+  if (vnSegments.empty())
+    return;
+
+  // New segments follow the ones of the previous session
+  mnSegment = vnSegments.back() + 1;
+
+  MapSnapshot snapshot;
+  if (!snapshot.Load(mMapFile) && access(mMapFile.c_str(), F_OK) == 0) {
+    cerr << "[journal] Cannot read " << mMapFile
+         << ", the journal of the previous session is kept" << endl;
+    return;
+  }
+
+  const bool bReplayed = Replay(snapshot);
+  mbReplayed = false;
+  if (bReplayed) {
+    snapshot.mnJournalSeq = mnSeq;
+    snapshot.mnJournalSegment = mnSegment;
+    if (!snapshot.Save(mMapFile)) {
+      cerr << "[journal] Cannot recover the previous session into "
+           << mMapFile << ", its journal is kept" << endl;
+      return;
+    }
+    cout << "[journal] Recovered the previous session into " << mMapFile
+         << endl;
+  }
+
+  // The map file includes every record of the previous session
+  for (size_t i = 0; i < vnSegments.size(); i++)
+    unlink(SegmentName(vnSegments[i]).c_str());
+}
+
+bool MapJournal::Open() {
+  if (!mbReplayed)
+    Recover();
+
+  unique_lock<mutex> lock(mMutexEntries);
+
+  Entry entry;
+  entry.mType = Entry::ROTATE;
+  entry.mnSegment = mnSegment;
+  mlEntries.push_back(entry);
+
+  mpMap->EnableJournal();
+
+  if (!mbReplayed) {
+    entry.mType = Entry::RECORD;
+    entry.mRecord.mnSeq = ++mnSeq;
+    entry.mRecord.mbReset = true;
+    mlEntries.push_back(entry);
+  }
+
+  mbOpen = true;
+  return true;
+}
+
+bool MapJournal::isOpen() {
+  unique_lock<mutex> lock(mMutexEntries);
+  return mbOpen;
+}
+
+void MapJournal::SetMaxSize(const size_t nMaxBytes) {
+  unique_lock<mutex> lock(mMutexEntries);
+  mnMaxBytes = nMaxBytes;
+}
+
+bool MapJournal::isFull() {
+  unique_lock<mutex> lock(mMutexEntries);
+  return mbWriteFailed || (mnMaxBytes > 0 && mnBytes > mnMaxBytes);
+}
+
+void MapJournal::TakeMapChanges(Entry &entry) {
+  JournalRecord &record = entry.mRecord;
+  mpMap->TakeJournalChanges(record.mvnErasedKeyFrames,
+                            record.mvnErasedMapPoints, record.mbReset);
+
+  if (record.mbReset) {
+    mKeyFrameSignatures.clear();
+    mLoggedMapPoints.clear();
+    mnGeneration++;
+  }
+  entry.mnGeneration = mnGeneration;
+  for (size_t i = 0; i < record.mvnErasedKeyFrames.size(); i++)
+    mKeyFrameSignatures.erase(record.mvnErasedKeyFrames[i]);
+  for (size_t i = 0; i < record.mvnErasedMapPoints.size(); i++)
+    mLoggedMapPoints.erase(record.mvnErasedMapPoints[i]);
+}
+
+void MapJournal::AddKeyFrameUpdate(KeyFrame *pKF, Entry &entry) {
+  KeyFrameUpdate update;
+  CaptureKeyFrameUpdate(pKF, update);
+
+  const uint64_t nSignature = Signature(update);
+  unordered_map<long unsigned int, uint64_t>::iterator it =
+      mKeyFrameSignatures.find(update.mnId);
+  if (it != mKeyFrameSignatures.end() && it->second == nSignature)
+    return;
+  entry.mvKeyFrameSignatures.push_back(make_pair(update.mnId, nSignature));
+  entry.mRecord.mvKeyFrameUpdates.push_back(update);
+}
+
+void MapJournal::AddMapPoint(MapPoint *pMP, Entry &entry) {
+  MapPointState state;
+  if (!MapSnapshot::CaptureMapPoint(pMP, state))
+    return;
+
+  const uint64_t nSignature = Signature(state);
+  unordered_map<long unsigned int, LoggedMapPoint>::iterator it =
+      mLoggedMapPoints.find(state.mnId);
+  if (it != mLoggedMapPoints.end() && it->second.mnSignature == nSignature) {
+    // Only moved by an optimization
+    AddMapPointPosition(state.mnId, state.mWorldPos, entry);
+    return;
+  }
+
+  LoggedMapPoint logged;
+  logged.mnSignature = nSignature;
+  memcpy(logged.mPos, state.mWorldPos.ptr<float>(), sizeof(logged.mPos));
+  entry.mvMapPoints.push_back(make_pair(state.mnId, logged));
+  entry.mRecord.mvMapPoints.push_back(state);
+}
+
+void MapJournal::AddMapPointPosition(const long unsigned int nId,
+                                     const cv::Mat &pos, Entry &entry) {
+  unordered_map<long unsigned int, LoggedMapPoint>::iterator it =
+      mLoggedMapPoints.find(nId);
+  if (it != mLoggedMapPoints.end()) {
+    if (!memcmp(it->second.mPos, pos.ptr<float>(), sizeof(it->second.mPos)))
+      return;
+    LoggedMapPoint logged = it->second;
+    memcpy(logged.mPos, pos.ptr<float>(), sizeof(logged.mPos));
+    entry.mvMapPoints.push_back(make_pair(nId, logged));
+  }
+  entry.mRecord.mvMapPointPositions.push_back(make_pair(nId, pos));
+}
+
+void MapJournal::Remember(const Entry &entry) {
+  unique_lock<mutex> lock(mMutexLog);
+  // States of a map cleared since then
+  if (entry.mnGeneration != mnGeneration)
+    return;
+
+  for (size_t i = 0; i < entry.mvKeyFrameSignatures.size(); i++)
+    mKeyFrameSignatures[entry.mvKeyFrameSignatures[i].first] =
+        entry.mvKeyFrameSignatures[i].second;
+  for (size_t i = 0; i < entry.mvMapPoints.size(); i++)
+    mLoggedMapPoints[entry.mvMapPoints[i].first] = entry.mvMapPoints[i].second;
+}
+
+void MapJournal::LogKeyFrame(KeyFrame *pKF) {
+  if (!isOpen() || pKF->isBad())
+    return;
+
+  unique_lock<mutex> lock(mMutexLog);
+
+  Entry entry;
+  TakeMapChanges(entry);
+  JournalRecord &record = entry.mRecord;
+
+  record.mvKeyFrames.push_back(KeyFrameState());
+  MapSnapshot::CaptureKeyFrame(pKF, record.mvKeyFrames.back());
+  pKF->CopyConstantState(record.mvKeyFrames.back());
+
+  // Its pose and graph are in the new state
+  KeyFrameUpdate update;
+  CaptureKeyFrameUpdate(pKF, update);
+  entry.mvKeyFrameSignatures.push_back(make_pair(pKF->mnId, Signature(update)));
+
+  set<MapPoint *> spMPs;
+  const vector<MapPoint *> vpMPs = pKF->GetMapPointMatches();
+  spMPs.insert(vpMPs.begin(), vpMPs.end());
+
+  const vector<KeyFrame *> vpNeighKFs = pKF->GetVectorCovisibleKeyFrames();
+  for (size_t i = 0; i < vpNeighKFs.size(); i++) {
+    KeyFrame *pKFi = vpNeighKFs[i];
+    if (pKFi->isBad())
+      continue;
+
+    AddKeyFrameUpdate(pKFi, entry);
+
+    const vector<MapPoint *> vpMPsi = pKFi->GetMapPointMatches();
+    spMPs.insert(vpMPsi.begin(), vpMPsi.end());
+  }
+
+  for (set<MapPoint *>::iterator sit = spMPs.begin(), send = spMPs.end();
+       sit != send; sit++) {
+    if (*sit)
+      AddMapPoint(*sit, entry);
+  }
+
+  for (size_t i = 0; i < mpMap->mvpKeyFrameOrigins.size(); i++)
+    record.mvnOriginIds.push_back(mpMap->mvpKeyFrameOrigins[i]->mnId);
+
+  Push(entry);
+}
+
+void MapJournal::LogMapCorrection(const vector<KeyFrame *> &vpFusedKFs) {
+  if (!isOpen())
+    return;
+
+  unique_lock<mutex> lock(mMutexLog);
+
+  Entry entry;
+  TakeMapChanges(entry);
+
+  const vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+  for (size_t i = 0; i < vpKFs.size(); i++) {
+    if (!vpKFs[i]->isBad())
+      AddKeyFrameUpdate(vpKFs[i], entry);
+  }
+
+  // Fused points first, their positions are then up to date
+  set<MapPoint *> spFusedMPs;
+  for (size_t i = 0; i < vpFusedKFs.size(); i++) {
+    if (vpFusedKFs[i]->isBad())
+      continue;
+    const vector<MapPoint *> vpMPsi = vpFusedKFs[i]->GetMapPointMatches();
+    spFusedMPs.insert(vpMPsi.begin(), vpMPsi.end());
+  }
+
+  for (set<MapPoint *>::iterator sit = spFusedMPs.begin(),
+                                 send = spFusedMPs.end();
+       sit != send; sit++) {
+    if (*sit)
+      AddMapPoint(*sit, entry);
+  }
+
+  const vector<MapPoint *> vpMPs = mpMap->GetAllMapPoints();
+  for (size_t i = 0; i < vpMPs.size(); i++) {
+    if (!vpMPs[i]->isBad() && !spFusedMPs.count(vpMPs[i]))
+      AddMapPointPosition(vpMPs[i]->mnId, vpMPs[i]->GetWorldPos(), entry);
+  }
+
+  Push(entry);
+}
+
+void MapJournal::Push(Entry &entry) {
+  unique_lock<mutex> lock(mMutexEntries);
+  entry.mType = Entry::RECORD;
+  entry.mnSegment = mnSegment;
+  entry.mRecord.mnSeq = ++mnSeq;
+  mlEntries.push_back(Entry());
+  swap(mlEntries.back(), entry);
+}
+
+void MapJournal::Rotate(long unsigned int &nLastSeq, int &nSegment) {
+  unique_lock<mutex> lock(mMutexEntries);
+  nLastSeq = mnSeq;
+  nSegment = ++mnSegment;
+  mnBytes = 0;
+  mbWriteFailed = false;
+
+  Entry entry;
+  entry.mType = Entry::ROTATE;
+  entry.mnSegment = mnSegment;
+  mlEntries.push_back(entry);
+}
+
+void MapJournal::Compact(const int nSegment) {
+  unique_lock<mutex> lock(mMutexEntries);
+  Entry entry;
+  entry.mType = Entry::COMPACT;
+  entry.mnSegment = nSegment;
+  mlEntries.push_back(entry);
+}
+
+bool MapJournal::OpenSegment(const int nSegment) {
+  if (mnFile >= 0)
+    close(mnFile);
+
+  const string filename = SegmentName(nSegment);
+  mnFile = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  mnFileSegment = nSegment;
+  if (mnFile < 0) {
+    cerr << "[journal] Cannot open " << filename << endl;
+    return false;
+  }
+  return true;
+}
+
+bool MapJournal::Write(const JournalRecord &record) {
+  if (mnFile < 0)
+    return false;
+
+  ostringstream os;
+  {
+    boost::archive::binary_oarchive oa(os, boost::archive::no_header);
+    oa << record;
+  }
+  const string data = os.str();
+
+  uint32_t header[2];
+  header[0] = data.size();
+  header[1] = Checksum(data);
+
+  string buffer(reinterpret_cast<const char *>(header), sizeof(header));
+  buffer += data;
+
+  // A failed write is cut back to the end of the previous record, a torn
+  // record would end the segment and the following records would be lost
+  const off_t nStart = lseek(mnFile, 0, SEEK_END);
+
+  size_t nWritten = 0;
+  while (nWritten < buffer.size()) {
+    const ssize_t n =
+        write(mnFile, buffer.data() + nWritten, buffer.size() - nWritten);
+    if (n < 0) {
+      cerr << "[journal] Write error, record " << record.mnSeq << " is lost"
+           << endl;
+      if (nWritten > 0 && (nStart < 0 || ftruncate(mnFile, nStart) != 0)) {
+        // The next records go to a new segment
+        cerr << "[journal] Cannot truncate " << SegmentName(mnFileSegment)
+             << ", continuing in a new segment" << endl;
+        unique_lock<mutex> lock(mMutexEntries);
+        OpenSegment(++mnSegment);
+      }
+      return false;
+    }
+    nWritten += n;
+  }
+
+  unique_lock<mutex> lock(mMutexEntries);
+  mnBytes += buffer.size();
+  return true;
+}
+
+void MapJournal::Run() {
+  mbFinished = false;
+
+  while (1) {
+    list<Entry> lEntries;
+    {
+      unique_lock<mutex> lock(mMutexEntries);
+      lEntries.swap(mlEntries);
+    }
+
+    bool bWritten = false;
+    for (list<Entry>::iterator lit = lEntries.begin(), lend = lEntries.end();
+         lit != lend; lit++) {
+      if (lit->mType == Entry::RECORD) {
+        if (Write(lit->mRecord)) {
+          Remember(*lit);
+          bWritten = true;
+        } else {
+          // The states of the lost record are not remembered, they are
+          // logged whole the next time. Saving the map file covers the
+          // objects that are not logged again.
+          unique_lock<mutex> lock(mMutexEntries);
+          mbWriteFailed = true;
+        }
+      } else if (lit->mType == Entry::ROTATE) {
+        if (bWritten)
+          fdatasync(mnFile);
+        bWritten = false;
+        // Unless a write error already moved to a later segment
+        if (lit->mnSegment > mnFileSegment)
+          OpenSegment(lit->mnSegment);
+      } else if (lit->mType == Entry::COMPACT) {
+        // The snapshot includes every record of the previous segments
+        const vector<int> vnSegments = ListSegments();
+        for (size_t i = 0; i < vnSegments.size(); i++)
+          if (vnSegments[i] < lit->mnSegment)
+            unlink(SegmentName(vnSegments[i]).c_str());
+      }
+    }
+
+    // Records are on disk before the next batch
+    if (bWritten)
+      fdatasync(mnFile);
+
+    if (lEntries.empty() && CheckFinish())
+      break;
+
+    usleep(10000);
+  }
+
+  if (mnFile >= 0)
+    close(mnFile);
+  mnFile = -1;
+
+  SetFinish();
+}
+
+void MapJournal::RequestFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  mbFinishRequested = true;
+}
+
+bool MapJournal::CheckFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  return mbFinishRequested;
+}
+
+void MapJournal::SetFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  mbFinished = true;
+}
+
+bool MapJournal::isFinished() {
+  unique_lock<mutex> lock(mMutexFinish);
+  return mbFinished;
+}
+
+} // namespace ORB_SLAM2
@@ -19,7 +19,9 @@
 */
 
 #include "MapPoint.h"
+#include "MapSnapshot.h"
 #include "ORBmatcher.h"
+#include "SlabAllocator.h"
 
 #include<mutex>
 
@@ -70,11 +72,25 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
     mnId=nNextId++;
 }
 
+void* MapPoint::operator new(size_t size)
+{
+    return SlabAllocator<MapPoint>::Allocate(size);
+}
+
+void MapPoint::operator delete(void *p, size_t size)
+{
+    SlabAllocator<MapPoint>::Deallocate(p,size);
+}
+
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
-    unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
-    Pos.copyTo(mWorldPos);
+    {
+        unique_lock<mutex> lock2(mGlobalMutex);
+        unique_lock<mutex> lock(mMutexPos);
+        Pos.copyTo(mWorldPos);
+    }
+    if(mpMap && mpMap->mPointIndex.IsEnabled())
+        mpMap->mPointIndex.Update(this);
 }
 
 cv::Mat MapPoint::GetWorldPos()
@@ -101,6 +117,7 @@ void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
     if(mObservations.count(pKF))
         return;
     mObservations[pKF]=idx;
+    AddRedundancy(pKF,idx);
 
     if(pKF->mvuRight[idx]>=0)
         nObs+=2;
@@ -121,6 +138,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
             else
                 nObs--;
 
+            EraseRedundancy(pKF,idx);
             mObservations.erase(pKF);
 
             if(mpRefKF==pKF)
@@ -136,12 +154,91 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
         SetBadFlag();
 }
 
+void MapPoint::UnloadObservation(KeyFrame* pKF)
+{
+    bool bBad=false;
+    {
+        unique_lock<mutex> lock(mMutexFeatures);
+        if(mObservations.count(pKF))
+        {
+            int idx = mObservations[pKF];
+            if(pKF->mvuRight[idx]>=0)
+                nObs-=2;
+            else
+                nObs--;
+
+            EraseRedundancy(pKF,idx);
+            mObservations.erase(pKF);
+
+            if(mObservations.empty())
+                bBad=true;
+            else if(mpRefKF==pKF)
+                mpRefKF=mObservations.begin()->first;
+        }
+    }
+
+    if(bBad)
+        SetBadFlag();
+}
+
+void MapPoint::AddRedundancy(KeyFrame* pKF, size_t idx)
+{
+    // Same scale test as LocalMapping::KeyFrameCulling, in both directions
+    const int level = pKF->mvKeysUn[idx].octave;
+    int nFiner=0;
+    for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+    {
+        KeyFrame* pKFi = mit->first;
+        if(pKFi==pKF)
+            continue;
+        const int leveli = pKFi->mvKeysUn[mit->second].octave;
+        if(leveli<=level+1)
+            nFiner++;
+        if(level<=leveli+1 && ++mFinerObservers[pKFi]==REDUNDANT_OBSERVERS)
+            pKFi->UpdateRedundancy(mit->second,0,1);
+    }
+
+    mFinerObservers[pKF]=nFiner;
+    pKF->UpdateRedundancy(idx,1,nFiner>=REDUNDANT_OBSERVERS ? 1 : 0);
+}
+
+void MapPoint::EraseRedundancy(KeyFrame* pKF, size_t idx)
+{
+    const int level = pKF->mvKeysUn[idx].octave;
+    for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+    {
+        KeyFrame* pKFi = mit->first;
+        if(pKFi==pKF)
+            continue;
+        const int leveli = pKFi->mvKeysUn[mit->second].octave;
+        if(level<=leveli+1 && mFinerObservers[pKFi]--==REDUNDANT_OBSERVERS)
+            pKFi->UpdateRedundancy(mit->second,0,-1);
+    }
+
+    pKF->UpdateRedundancy(idx,-1,mFinerObservers[pKF]>=REDUNDANT_OBSERVERS ? -1 : 0);
+    mFinerObservers.erase(pKF);
+}
+
+void MapPoint::ClearRedundancy()
+{
+    for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+        mit->first->UpdateRedundancy(mit->second,-1,mFinerObservers[mit->first]>=REDUNDANT_OBSERVERS ? -1 : 0);
+    mFinerObservers.clear();
+}
+
 map<KeyFrame*, size_t> MapPoint::GetObservations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
     return mObservations;
 }
 
+void MapPoint::GetObservingKeyFrames(vector<KeyFrame*> &vpKFs)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+        vpKFs.push_back(mit->first);
+}
+
 int MapPoint::Observations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -156,6 +253,7 @@ void MapPoint::SetBadFlag()
         unique_lock<mutex> lock2(mMutexPos);
         mbBad=true;
         obs = mObservations;
+        ClearRedundancy();
         mObservations.clear();
     }
     for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
@@ -185,6 +283,7 @@ void MapPoint::Replace(MapPoint* pMP)
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
         obs=mObservations;
+        ClearRedundancy();
         mObservations.clear();
         mbBad=true;
         nvisible = mnVisible;
@@ -416,11 +515,42 @@ int MapPoint::PredictScale(const float &currentDist, Frame* pF)
     return nScale;
 }
 
+MapPoint::MapPoint(const MapPointState &state, KeyFrame *pRefKF, Map* pMap):
+    mnId(state.mnId), mnFirstKFid(state.mnFirstKFid), mnFirstFrame(state.mnFirstFrame), nObs(0),
+    mnTrackReferenceForFrame(0), mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0),
+    mnLoopPointForKF(0), mnCorrectedByKF(0), mnCorrectedReference(0), mnBAGlobalForKF(0),
+    mWorldPos(state.mWorldPos.clone()), mNormalVector(state.mNormalVector.clone()),
+    mDescriptor(state.mDescriptor), mpRefKF(pRefKF), mnVisible(state.mnVisible),
+    mnFound(state.mnFound), mbBad(false), mpReplaced(static_cast<MapPoint*>(NULL)),
+    mfMinDistance(state.mfMinDistance), mfMaxDistance(state.mfMaxDistance), mpMap(pMap)
+{
+}
+
+void MapPoint::GetState(MapPointState &state)
+{
+    state.mnId = mnId;
+    state.mnFirstKFid = mnFirstKFid;
+    state.mnFirstFrame = mnFirstFrame;
+
+    {
+        unique_lock<mutex> lock(mMutexPos);
+        state.mWorldPos = mWorldPos.clone();
+        state.mNormalVector = mNormalVector.clone();
+        state.mfMinDistance = mfMinDistance;
+        state.mfMaxDistance = mfMaxDistance;
+    }
+
+    unique_lock<mutex> lock(mMutexFeatures);
+    state.mDescriptor = mDescriptor.clone();
+    state.mnVisible = mnVisible;
+    state.mnFound = mnFound;
+}
+
 MapPoint::MapPoint():
     nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0),mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0)
+    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(static_cast<Map*>(NULL))
 {}
 template<class Archive>
 void MapPoint::serialize(Archive &ar, const unsigned int version)
@@ -0,0 +1,318 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MapPointIndex.h"
+
+#include "MapPoint.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+namespace {
+const int KEY_BITS = 21;
+const long long int KEY_MASK = (1LL << KEY_BITS) - 1;
+const int KEY_OFFSET = 1 << (KEY_BITS - 1);
+} // namespace
+
+MapPointIndex::MapPointIndex()
+    : mfVoxelSize(0), mfInvVoxelSize(0), mbEnabled(false) {}
+
+void MapPointIndex::SetVoxelSize(const float voxelSize) {
+  unique_lock<mutex> lock(mMutexIndex);
+  mfVoxelSize = voxelSize;
+  mfInvVoxelSize = voxelSize > 0 ? 1.0f / voxelSize : 0;
+  mVoxels.clear();
+  mPoints.clear();
+  mbEnabled = voxelSize > 0;
+}
+
+bool MapPointIndex::IsEnabled() { return mbEnabled; }
+
+MapPointIndex::VoxelKey MapPointIndex::Key(const int i, const int j,
+                                           const int k) {
+  return (((VoxelKey)(i + KEY_OFFSET) & KEY_MASK) << (2 * KEY_BITS)) |
+         (((VoxelKey)(j + KEY_OFFSET) & KEY_MASK) << KEY_BITS) |
+         ((VoxelKey)(k + KEY_OFFSET) & KEY_MASK);
+}
+
+MapPointIndex::VoxelKey MapPointIndex::Key(const float x, const float y,
+                                           const float z) {
+  return Key((int)floor(x * mfInvVoxelSize), (int)floor(y * mfInvVoxelSize),
+             (int)floor(z * mfInvVoxelSize));
+}
+
+void MapPointIndex::Insert(MapPoint *pMP) {
+  if (!mbEnabled)
+    return;
+
+  unique_lock<mutex> lock(mMutexIndex);
+  if (mfVoxelSize <= 0 || mPoints.count(pMP))
+    return;
+
+  // Read under the index lock: a SetWorldPos racing with the insertion is
+  // either seen here or followed by its Update
+  const cv::Mat Pos = pMP->GetWorldPos();
+  Entry entry;
+  entry.x = Pos.at<float>(0);
+  entry.y = Pos.at<float>(1);
+  entry.z = Pos.at<float>(2);
+  entry.key = Key(entry.x, entry.y, entry.z);
+  mPoints[pMP] = entry;
+  mVoxels[entry.key].push_back(pMP);
+}
+
+void MapPointIndex::Update(MapPoint *pMP) {
+  if (!mbEnabled)
+    return;
+
+  unique_lock<mutex> lock(mMutexIndex);
+  if (mfVoxelSize <= 0)
+    return;
+
+  // Points not in the map (erased, or not added yet) are not indexed
+  unordered_map<MapPoint *, Entry>::iterator it = mPoints.find(pMP);
+  if (it == mPoints.end())
+    return;
+
+  // Concurrent SetWorldPos may call in any order, the last one to lock files
+  // the point at its current position
+  const cv::Mat Pos = pMP->GetWorldPos();
+  Entry &entry = it->second;
+  entry.x = Pos.at<float>(0);
+  entry.y = Pos.at<float>(1);
+  entry.z = Pos.at<float>(2);
+  const VoxelKey key = Key(entry.x, entry.y, entry.z);
+  if (key != entry.key) {
+    Remove(pMP, entry.key);
+    entry.key = key;
+    mVoxels[key].push_back(pMP);
+  }
+}
+
+void MapPointIndex::Erase(MapPoint *pMP) {
+  if (!mbEnabled)
+    return;
+
+  unique_lock<mutex> lock(mMutexIndex);
+  unordered_map<MapPoint *, Entry>::iterator it = mPoints.find(pMP);
+  if (it == mPoints.end())
+    return;
+  Remove(pMP, it->second.key);
+  mPoints.erase(it);
+}
+
+void MapPointIndex::Remove(MapPoint *pMP, const VoxelKey key) {
+  unordered_map<VoxelKey, vector<MapPoint *>>::iterator vit = mVoxels.find(key);
+  if (vit == mVoxels.end())
+    return;
+  vector<MapPoint *> &vpMPs = vit->second;
+  vector<MapPoint *>::iterator pit = find(vpMPs.begin(), vpMPs.end(), pMP);
+  if (pit != vpMPs.end()) {
+    *pit = vpMPs.back();
+    vpMPs.pop_back();
+  }
+  if (vpMPs.empty())
+    mVoxels.erase(vit);
+}
+
+void MapPointIndex::clear() {
+  unique_lock<mutex> lock(mMutexIndex);
+  mVoxels.clear();
+  mPoints.clear();
+}
+
+size_t MapPointIndex::size() {
+  unique_lock<mutex> lock(mMutexIndex);
+  return mPoints.size();
+}
+
+vector<MapPoint *> MapPointIndex::GetPointsInRadius(const cv::Mat &Pos,
+                                                   const float radius) {
+  vector<MapPoint *> vpMPs;
+
+  const float x = Pos.at<float>(0);
+  const float y = Pos.at<float>(1);
+  const float z = Pos.at<float>(2);
+  const float r2 = radius * radius;
+
+  unique_lock<mutex> lock(mMutexIndex);
+  if (mfVoxelSize <= 0)
+    return vpMPs;
+
+  const int i0 = floor((x - radius) * mfInvVoxelSize);
+  const int i1 = floor((x + radius) * mfInvVoxelSize);
+  const int j0 = floor((y - radius) * mfInvVoxelSize);
+  const int j1 = floor((y + radius) * mfInvVoxelSize);
+  const int k0 = floor((z - radius) * mfInvVoxelSize);
+  const int k1 = floor((z + radius) * mfInvVoxelSize);
+
+  for (int i = i0; i <= i1; i++)
+    for (int j = j0; j <= j1; j++)
+      for (int k = k0; k <= k1; k++) {
+        unordered_map<VoxelKey, vector<MapPoint *>>::const_iterator vit =
+            mVoxels.find(Key(i, j, k));
+        if (vit == mVoxels.end())
+          continue;
+        for (size_t n = 0; n < vit->second.size(); n++) {
+          const Entry &entry = mPoints[vit->second[n]];
+          const float dx = entry.x - x;
+          const float dy = entry.y - y;
+          const float dz = entry.z - z;
+          if (dx * dx + dy * dy + dz * dz <= r2)
+            vpMPs.push_back(vit->second[n]);
+        }
+      }
+
+  return vpMPs;
+}
+
+vector<MapPoint *> MapPointIndex::GetPointsInFrustum(
+    const cv::Mat &Tcw, const float fx, const float fy, const float cx,
+    const float cy, const float minX, const float maxX, const float minY,
+    const float maxY, const float maxDepth) {
+  vector<MapPoint *> vpMPs;
+
+  const cv::Mat Rcw = Tcw.rowRange(0, 3).colRange(0, 3);
+  const cv::Mat tcw = Tcw.rowRange(0, 3).col(3);
+  const cv::Mat Rwc = Rcw.t();
+  const cv::Mat Ow = -Rwc * tcw;
+
+  // Bounding box of the frustum: camera center and image corners at maxDepth
+  float bmin[3], bmax[3];
+  for (int d = 0; d < 3; d++)
+    bmin[d] = bmax[d] = Ow.at<float>(d);
+  const float us[2] = {minX, maxX};
+  const float vs[2] = {minY, maxY};
+  for (int a = 0; a < 2; a++)
+    for (int b = 0; b < 2; b++) {
+      const cv::Mat Xc = (cv::Mat_<float>(3, 1) << (us[a] - cx) * maxDepth / fx,
+                          (vs[b] - cy) * maxDepth / fy, maxDepth);
+      const cv::Mat Xw = Rwc * Xc + Ow;
+      for (int d = 0; d < 3; d++) {
+        bmin[d] = min(bmin[d], Xw.at<float>(d));
+        bmax[d] = max(bmax[d], Xw.at<float>(d));
+      }
+    }
+
+  // Side planes through the camera center (inner normals)
+  float planes[4][3] = {{fx, 0, cx - minX},
+                        {-fx, 0, maxX - cx},
+                        {0, fy, cy - minY},
+                        {0, -fy, maxY - cy}};
+  for (int p = 0; p < 4; p++) {
+    const float norm = sqrt(planes[p][0] * planes[p][0] +
+                            planes[p][1] * planes[p][1] +
+                            planes[p][2] * planes[p][2]);
+    for (int d = 0; d < 3; d++)
+      planes[p][d] /= norm;
+  }
+
+  float R[3][3], t[3];
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++)
+      R[r][c] = Rcw.at<float>(r, c);
+    t[r] = tcw.at<float>(r);
+  }
+
+  unique_lock<mutex> lock(mMutexIndex);
+  if (mfVoxelSize <= 0)
+    return vpMPs;
+
+  const float halfDiagonal = 0.5f * sqrt(3.0f) * mfVoxelSize;
+
+  // Whole voxels are discarded by the bounding sphere, then each point
+  auto voxelInFrustum = [&](const int i, const int j, const int k) {
+    const float x = (i + 0.5f) * mfVoxelSize;
+    const float y = (j + 0.5f) * mfVoxelSize;
+    const float z = (k + 0.5f) * mfVoxelSize;
+    float Xc[3];
+    for (int r = 0; r < 3; r++)
+      Xc[r] = R[r][0] * x + R[r][1] * y + R[r][2] * z + t[r];
+    if (Xc[2] < -halfDiagonal || Xc[2] > maxDepth + halfDiagonal)
+      return false;
+    for (int p = 0; p < 4; p++)
+      if (planes[p][0] * Xc[0] + planes[p][1] * Xc[1] + planes[p][2] * Xc[2] <
+          -halfDiagonal)
+        return false;
+    return true;
+  };
+
+  auto addPoints = [&](const vector<MapPoint *> &vpVoxel) {
+    for (size_t n = 0; n < vpVoxel.size(); n++) {
+      const Entry &entry = mPoints[vpVoxel[n]];
+      const float Xc = R[0][0] * entry.x + R[0][1] * entry.y +
+                       R[0][2] * entry.z + t[0];
+      const float Yc = R[1][0] * entry.x + R[1][1] * entry.y +
+                       R[1][2] * entry.z + t[1];
+      const float Zc = R[2][0] * entry.x + R[2][1] * entry.y +
+                       R[2][2] * entry.z + t[2];
+      if (Zc <= 0 || Zc > maxDepth)
+        continue;
+      const float u = fx * Xc / Zc + cx;
+      const float v = fy * Yc / Zc + cy;
+      if (u < minX || u > maxX || v < minY || v > maxY)
+        continue;
+      vpMPs.push_back(vpVoxel[n]);
+    }
+  };
+
+  const int i0 = floor(bmin[0] * mfInvVoxelSize);
+  const int i1 = floor(bmax[0] * mfInvVoxelSize);
+  const int j0 = floor(bmin[1] * mfInvVoxelSize);
+  const int j1 = floor(bmax[1] * mfInvVoxelSize);
+  const int k0 = floor(bmin[2] * mfInvVoxelSize);
+  const int k1 = floor(bmax[2] * mfInvVoxelSize);
+  const double nBoxVoxels =
+      (double)(i1 - i0 + 1) * (j1 - j0 + 1) * (k1 - k0 + 1);
+
+  if (nBoxVoxels <= mVoxels.size()) {
+    for (int i = i0; i <= i1; i++)
+      for (int j = j0; j <= j1; j++)
+        for (int k = k0; k <= k1; k++) {
+          unordered_map<VoxelKey, vector<MapPoint *>>::const_iterator vit =
+              mVoxels.find(Key(i, j, k));
+          if (vit != mVoxels.end() && voxelInFrustum(i, j, k))
+            addPoints(vit->second);
+        }
+  } else {
+    // Sparse map: fewer occupied voxels than voxels in the box
+    for (unordered_map<VoxelKey, vector<MapPoint *>>::const_iterator
+             vit = mVoxels.begin(),
+             vend = mVoxels.end();
+         vit != vend; vit++) {
+      const int i =
+          (int)((vit->first >> (2 * KEY_BITS)) & KEY_MASK) - KEY_OFFSET;
+      const int j = (int)((vit->first >> KEY_BITS) & KEY_MASK) - KEY_OFFSET;
+      const int k = (int)(vit->first & KEY_MASK) - KEY_OFFSET;
+      if (i < i0 || i > i1 || j < j0 || j > j1 || k < k0 || k > k1)
+        continue;
+      if (voxelInFrustum(i, j, k))
+        addPoints(vit->second);
+    }
+  }
+
+  return vpMPs;
+}
+
+} // namespace ORB_SLAM2
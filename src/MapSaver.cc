@@ -0,0 +1,193 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MapSaver.h"
+
+#include "LocalMapping.h"
+#include "Map.h"
+#include "MapJournal.h"
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+MapSaver::MapSaver(Map *pMap, LocalMapping *pLocalMapper)
+    : mpMap(pMap), mpLocalMapper(pLocalMapper), mpJournal(NULL),
+      mCheckpointPeriod(0), mnCheckpointMaxKFid(0), mnCheckpointBigChange(0),
+      mnCheckpointKFs(0), mnCheckpointMPs(0), mbSaving(false),
+      mbFinishRequested(false), mbFinished(true) {}
+
+void MapSaver::SetJournal(MapJournal *pJournal) { mpJournal = pJournal; }
+
+void MapSaver::SetCheckpoint(const string &filename, const double period) {
+  unique_lock<mutex> lock(mMutexRequests);
+  mCheckpointFile = filename;
+  mCheckpointPeriod = period;
+  mLastCheckpoint = chrono::steady_clock::now();
+}
+
+void MapSaver::Run() {
+  mbFinished = false;
+
+  while (1) {
+    string filename;
+    {
+      unique_lock<mutex> lock(mMutexRequests);
+      if (!mlSaveRequests.empty()) {
+        filename = mlSaveRequests.front();
+        mlSaveRequests.pop_front();
+        mbSaving = true;
+      }
+    }
+
+    if (!filename.empty()) {
+      Save(filename);
+      unique_lock<mutex> lock(mMutexRequests);
+      mbSaving = false;
+    } else if (CheckpointDue()) {
+      Save(mCheckpointFile);
+    } else if (mpJournal && mpJournal->isFull()) {
+      // Saving the map file compacts its journal
+      Save(mpJournal->GetMapFile());
+    }
+
+    // Pending requests are served before finishing
+    if (!isSaving() && CheckFinish())
+      break;
+
+    usleep(50000);
+  }
+
+  SetFinish();
+}
+
+bool MapSaver::CheckpointDue() {
+  {
+    unique_lock<mutex> lock(mMutexRequests);
+    if (mCheckpointPeriod <= 0 || mCheckpointFile.empty())
+      return false;
+
+    const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (chrono::duration<double>(now - mLastCheckpoint).count() <
+        mCheckpointPeriod)
+      return false;
+    mLastCheckpoint = now;
+  }
+
+  // Nothing new to write (localization mode, tracking lost)
+  const long unsigned int nMaxKFid = mpMap->GetMaxKFid();
+  const int nBigChange = mpMap->GetLastBigChangeIdx();
+  const long unsigned int nKFs = mpMap->KeyFramesInMap();
+  const long unsigned int nMPs = mpMap->MapPointsInMap();
+  if (nKFs == 0 ||
+      (nMaxKFid == mnCheckpointMaxKFid && nBigChange == mnCheckpointBigChange &&
+       nKFs == mnCheckpointKFs && nMPs == mnCheckpointMPs))
+    return false;
+
+  mnCheckpointMaxKFid = nMaxKFid;
+  mnCheckpointBigChange = nBigChange;
+  mnCheckpointKFs = nKFs;
+  mnCheckpointMPs = nMPs;
+  return true;
+}
+
+void MapSaver::TakeSnapshot(MapSnapshot &snapshot,
+                            const bool bRotateJournal) {
+  unique_lock<mutex> lockSnapshot(mpMap->mMutexSnapshot);
+
+  // Keyframes erased from now on are not deleted until their data is copied
+  const int nSlot = mpMap->mReclaimer.RegisterThread();
+
+  {
+    // Local Mapping between two keyframes, Tracking, Loop Closing and Global BA
+    // outside of their map updates
+    unique_lock<mutex> lockProcessing(mpLocalMapper->mMutexKeyFrameProcessing);
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    snapshot.Capture(mpMap);
+
+    // Records logged from now on are replayed over the snapshot
+    if (bRotateJournal)
+      mpJournal->Rotate(snapshot.mnJournalSeq, snapshot.mnJournalSegment);
+  }
+
+  // Tracking and mapping run again while the objects are copied
+  snapshot.CopyState();
+
+  mpMap->mReclaimer.UnregisterThread(nSlot);
+}
+
+bool MapSaver::Save(const string &filename) {
+  unique_lock<mutex> lock(mMutexSave);
+
+  const bool bJournal = mpJournal && mpJournal->isOpen() &&
+                        filename == mpJournal->GetMapFile();
+
+  MapSnapshot snapshot;
+  TakeSnapshot(snapshot, bJournal);
+
+  cout << "[saver] Saving " << snapshot.mvKeyFrames.size() << " keyframes and "
+       << snapshot.mvMapPoints.size() << " map points to " << filename << endl;
+
+  if (!snapshot.Save(filename)) {
+    cerr << "[saver] Failed to save the map to " << filename << endl;
+    return false;
+  }
+
+  if (bJournal)
+    mpJournal->Compact(snapshot.mnJournalSegment);
+
+  cout << "[saver] Map saved to " << filename << endl;
+  return true;
+}
+
+void MapSaver::RequestSave(const string &filename) {
+  unique_lock<mutex> lock(mMutexRequests);
+  mlSaveRequests.push_back(filename);
+}
+
+bool MapSaver::isSaving() {
+  unique_lock<mutex> lock(mMutexRequests);
+  return mbSaving || !mlSaveRequests.empty();
+}
+
+void MapSaver::RequestFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  mbFinishRequested = true;
+}
+
+bool MapSaver::CheckFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  return mbFinishRequested;
+}
+
+void MapSaver::SetFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  mbFinished = true;
+}
+
+bool MapSaver::isFinished() {
+  unique_lock<mutex> lock(mMutexFinish);
+  return mbFinished;
+}
+
+} // namespace ORB_SLAM2
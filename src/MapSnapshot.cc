@@ -0,0 +1,545 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MapSnapshot.h"
+
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "Map.h"
+#include "MapPoint.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+// Increase when the content of the archive changes
+static const int SNAPSHOT_VERSION = 3;
+
+// Flush a file or a directory to disk
+static bool Sync(const string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  const bool bSynced = fsync(fd) == 0;
+  close(fd);
+  return bSynced;
+}
+
+MapSnapshot::MapSnapshot()
+    : mnNextKFId(0), mnNextMPId(0), mnNextFrameId(0), mnJournalSeq(0),
+      mnJournalSegment(0) {}
+
+void MapSnapshot::Capture(Map *pMap) {
+  mvKeyFrames.clear();
+  mvMapPoints.clear();
+  mvnOriginIds.clear();
+  mvpPendingKeyFrames.clear();
+
+  vector<KeyFrame *> vpKFs = pMap->GetAllKeyFrames();
+  mvpPendingMapPoints = pMap->GetAllMapPoints();
+  sort(vpKFs.begin(), vpKFs.end(), KeyFrame::lId);
+
+  // The spanning tree is taken here, parents recorded at different times
+  // could form a cycle
+  mvKeyFrames.reserve(vpKFs.size());
+  mvpPendingKeyFrames.reserve(vpKFs.size());
+  for (size_t i = 0; i < vpKFs.size(); i++) {
+    KeyFrame *pKF = vpKFs[i];
+    if (pKF->isBad())
+      continue;
+
+    mvKeyFrames.push_back(KeyFrameState());
+    mvKeyFrames.back().mnId = pKF->mnId;
+    KeyFrame *pParent = pKF->GetParent();
+    mvKeyFrames.back().mnParentId =
+        (pParent && !pParent->isBad()) ? pParent->mnId : -1;
+    mvpPendingKeyFrames.push_back(pKF);
+  }
+
+  for (size_t i = 0; i < pMap->mvpKeyFrameOrigins.size(); i++)
+    if (!pMap->mvpKeyFrameOrigins[i]->isBad())
+      mvnOriginIds.push_back(pMap->mvpKeyFrameOrigins[i]->mnId);
+
+  mnNextKFId = KeyFrame::nNextId;
+  mnNextFrameId = Frame::nNextId;
+  {
+    unique_lock<mutex> lock(pMap->mMutexPointCreation);
+    mnNextMPId = MapPoint::nNextId;
+  }
+}
+
+void MapSnapshot::CaptureKeyFrame(KeyFrame *pKF, KeyFrameState &state) {
+  state.mnId = pKF->mnId;
+  state.Tcw = pKF->GetPose();
+
+  const vector<MapPoint *> vpMatches = pKF->GetMapPointMatches();
+  state.mvnMapPointIds.assign(vpMatches.size(), -1);
+  for (size_t i = 0; i < vpMatches.size(); i++)
+    if (vpMatches[i] && !vpMatches[i]->isBad())
+      state.mvnMapPointIds[i] = vpMatches[i]->mnId;
+
+  CaptureGraph(pKF, state.mnParentId, state.mvnLoopEdgeIds,
+               state.mvConnections);
+}
+
+void MapSnapshot::CaptureGraph(
+    KeyFrame *pKF, long int &nParentId,
+    vector<long unsigned int> &vnLoopEdgeIds,
+    vector<pair<long unsigned int, int>> &vConnections) {
+  KeyFrame *pParent = pKF->GetParent();
+  nParentId = (pParent && !pParent->isBad()) ? pParent->mnId : -1;
+
+  const set<KeyFrame *> spLoopEdges = pKF->GetLoopEdges();
+  vnLoopEdgeIds.clear();
+  for (set<KeyFrame *>::const_iterator sit = spLoopEdges.begin(),
+                                       send = spLoopEdges.end();
+       sit != send; sit++)
+    if (!(*sit)->isBad())
+      vnLoopEdgeIds.push_back((*sit)->mnId);
+
+  const map<KeyFrame *, int> weights = pKF->GetConnectionWeights();
+  vConnections.clear();
+  vConnections.reserve(weights.size());
+  for (map<KeyFrame *, int>::const_iterator mit = weights.begin(),
+                                            mend = weights.end();
+       mit != mend; mit++)
+    if (!mit->first->isBad())
+      vConnections.push_back(make_pair(mit->first->mnId, mit->second));
+}
+
+bool MapSnapshot::CaptureMapPoint(MapPoint *pMP, MapPointState &state) {
+  if (pMP->isBad())
+    return false;
+
+  pMP->GetState(state);
+
+  const map<KeyFrame *, size_t> observations = pMP->GetObservations();
+  state.mvObservations.clear();
+  for (map<KeyFrame *, size_t>::const_iterator mit = observations.begin(),
+                                               mend = observations.end();
+       mit != mend; mit++)
+    if (!mit->first->isBad())
+      state.mvObservations.push_back(make_pair(mit->first->mnId, mit->second));
+
+  if (state.mvObservations.empty())
+    return false;
+
+  KeyFrame *pRefKF = pMP->GetReferenceKeyFrame();
+  state.mnRefKFId = (pRefKF && !pRefKF->isBad()) ? pRefKF->mnId : -1;
+
+  return true;
+}
+
+void MapSnapshot::CopyState() {
+  for (size_t i = 0; i < mvpPendingKeyFrames.size(); i++) {
+    KeyFrameState &state = mvKeyFrames[i];
+    const long int nParentId = state.mnParentId;
+    CaptureKeyFrame(mvpPendingKeyFrames[i], state);
+    state.mnParentId = nParentId;
+    mvpPendingKeyFrames[i]->CopyConstantState(state);
+  }
+  mvpPendingKeyFrames.clear();
+
+  mvMapPoints.reserve(mvpPendingMapPoints.size());
+  for (size_t i = 0; i < mvpPendingMapPoints.size(); i++) {
+    MapPointState state;
+    if (CaptureMapPoint(mvpPendingMapPoints[i], state))
+      mvMapPoints.push_back(state);
+  }
+  mvpPendingMapPoints.clear();
+
+  Reconcile();
+}
+
+void MapSnapshot::Reconcile() {
+  unordered_map<long unsigned int, size_t> KFs;
+  for (size_t i = 0; i < mvKeyFrames.size(); i++)
+    KFs[mvKeyFrames[i].mnId] = i;
+
+  // Observations also matched by their keyframe, (keyframe id, index) -> map
+  // point id
+  map<pair<long unsigned int, size_t>, long unsigned int> observations;
+  vector<MapPointState> vMapPoints;
+  vMapPoints.reserve(mvMapPoints.size());
+  for (size_t i = 0; i < mvMapPoints.size(); i++) {
+    MapPointState &state = mvMapPoints[i];
+    vector<pair<long unsigned int, size_t>> vObservations;
+    vObservations.reserve(state.mvObservations.size());
+    for (size_t j = 0; j < state.mvObservations.size(); j++) {
+      const pair<long unsigned int, size_t> &obs = state.mvObservations[j];
+      if (!KFs.count(obs.first))
+        continue;
+      const vector<long int> &vnMPIds = mvKeyFrames[KFs[obs.first]].mvnMapPointIds;
+      if (obs.second < vnMPIds.size() &&
+          vnMPIds[obs.second] == (long int)state.mnId) {
+        vObservations.push_back(obs);
+        observations[obs] = state.mnId;
+      }
+    }
+    if (vObservations.empty())
+      continue;
+
+    state.mvObservations.swap(vObservations);
+    if (state.mnRefKFId < 0 ||
+        find_if(state.mvObservations.begin(), state.mvObservations.end(),
+                [&state](const pair<long unsigned int, size_t> &obs) {
+                  return (long int)obs.first == state.mnRefKFId;
+                }) == state.mvObservations.end())
+      state.mnRefKFId = state.mvObservations.front().first;
+    vMapPoints.push_back(state);
+  }
+  mvMapPoints.swap(vMapPoints);
+
+  for (size_t i = 0; i < mvKeyFrames.size(); i++) {
+    KeyFrameState &state = mvKeyFrames[i];
+    for (size_t j = 0; j < state.mvnMapPointIds.size(); j++) {
+      if (state.mvnMapPointIds[j] < 0)
+        continue;
+      map<pair<long unsigned int, size_t>, long unsigned int>::const_iterator
+          mit = observations.find(make_pair(state.mnId, j));
+      if (mit == observations.end() ||
+          (long int)mit->second != state.mvnMapPointIds[j])
+        state.mvnMapPointIds[j] = -1;
+    }
+
+    // Keyframes created after Capture() are not in the snapshot
+    vector<long unsigned int> vnLoopEdgeIds;
+    for (size_t j = 0; j < state.mvnLoopEdgeIds.size(); j++)
+      if (KFs.count(state.mvnLoopEdgeIds[j]))
+        vnLoopEdgeIds.push_back(state.mvnLoopEdgeIds[j]);
+    state.mvnLoopEdgeIds.swap(vnLoopEdgeIds);
+    vector<pair<long unsigned int, int>> vConnections;
+    for (size_t j = 0; j < state.mvConnections.size(); j++)
+      if (KFs.count(state.mvConnections[j].first) &&
+          state.mvConnections[j].second > 0)
+        vConnections.push_back(state.mvConnections[j]);
+    state.mvConnections.swap(vConnections);
+  }
+}
+
+bool MapSnapshot::Save(const string &filename) const {
+  const string tmpfile = filename + ".tmp";
+  ofstream out(tmpfile, ios_base::binary);
+  if (!out) {
+    cerr << "[snapshot] Cannot write to " << tmpfile << endl;
+    return false;
+  }
+
+  {
+    boost::archive::binary_oarchive oa(out, boost::archive::no_header);
+    oa << SNAPSHOT_VERSION;
+    oa << *this;
+  }
+  out.close();
+
+  // The content must be on disk before the rename makes it the snapshot, or a
+  // power loss can leave a truncated file under the final name
+  if (!out || !Sync(tmpfile)) {
+    cerr << "[snapshot] Error while writing " << tmpfile << endl;
+    return false;
+  }
+
+  if (rename(tmpfile.c_str(), filename.c_str()) != 0) {
+    cerr << "[snapshot] Cannot replace " << filename << endl;
+    return false;
+  }
+
+  // Make the rename itself durable
+  const size_t pos = filename.find_last_of('/');
+  const string dirname = pos == string::npos ? "." : filename.substr(0, pos);
+  if (!Sync(dirname.empty() ? "/" : dirname))
+    cerr << "[snapshot] Cannot sync the directory of " << filename << endl;
+
+  return true;
+}
+
+bool MapSnapshot::Load(const string &filename) {
+  ifstream in(filename, ios_base::binary);
+  if (!in)
+    return false;
+
+  try {
+    boost::archive::binary_iarchive ia(in, boost::archive::no_header);
+    int nVersion;
+    ia >> nVersion;
+    if (nVersion != SNAPSHOT_VERSION) {
+      cerr << "[snapshot] " << filename << " has version " << nVersion
+           << ", expected " << SNAPSHOT_VERSION << endl;
+      return false;
+    }
+    ia >> *this;
+  } catch (const std::exception &e) {
+    cerr << "[snapshot] Cannot read " << filename << ": " << e.what() << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool MapSnapshot::CheckConsistency() const {
+  // Only the first problems are reported
+  const int nMaxReports = 20;
+  int nErrors = 0;
+#define SNAPSHOT_ERROR(msg)                                                    \
+  do {                                                                         \
+    if (nErrors++ < nMaxReports)                                               \
+      cerr << "[snapshot] " << msg << endl;                                    \
+  } while (0)
+
+  unordered_map<long unsigned int, size_t> KFs;
+  for (size_t i = 0; i < mvKeyFrames.size(); i++)
+    if (!KFs.insert(make_pair(mvKeyFrames[i].mnId, i)).second)
+      SNAPSHOT_ERROR("Duplicated keyframe " << mvKeyFrames[i].mnId);
+
+  unordered_map<long unsigned int, size_t> MPs;
+  for (size_t i = 0; i < mvMapPoints.size(); i++)
+    if (!MPs.insert(make_pair(mvMapPoints[i].mnId, i)).second)
+      SNAPSHOT_ERROR("Duplicated map point " << mvMapPoints[i].mnId);
+
+  for (size_t i = 0; i < mvKeyFrames.size(); i++) {
+    const KeyFrameState &state = mvKeyFrames[i];
+    const size_t N = state.N;
+
+    if (state.mvKeysUn.size() != N || state.mvuRight.size() != N ||
+        state.mvDepth.size() != N || state.mvnMapPointIds.size() != N ||
+        (size_t)state.mDescriptors.rows != N)
+      SNAPSHOT_ERROR("Keyframe " << state.mnId << " has " << N
+                                 << " keypoints but inconsistent features");
+    if (state.Tcw.rows != 4 || state.Tcw.cols != 4)
+      SNAPSHOT_ERROR("Keyframe " << state.mnId << " has no pose");
+    if (state.mBowVec.empty() || state.mFeatVec.empty())
+      SNAPSHOT_ERROR("Keyframe " << state.mnId << " has no BoW vectors");
+
+    for (size_t j = 0; j < state.mvnMapPointIds.size(); j++) {
+      const long int nMPid = state.mvnMapPointIds[j];
+      if (nMPid < 0)
+        continue;
+      if (!MPs.count(nMPid)) {
+        SNAPSHOT_ERROR("Keyframe " << state.mnId
+                                   << " matches missing map point " << nMPid);
+        continue;
+      }
+      const vector<pair<long unsigned int, size_t>> &vObs =
+          mvMapPoints[MPs.at(nMPid)].mvObservations;
+      if (find(vObs.begin(), vObs.end(), make_pair(state.mnId, j)) ==
+          vObs.end())
+        SNAPSHOT_ERROR("Map point " << nMPid << " does not observe keyframe "
+                                    << state.mnId << " at " << j);
+    }
+
+    if (state.mnParentId >= 0 && !KFs.count(state.mnParentId))
+      SNAPSHOT_ERROR("Keyframe " << state.mnId << " has missing parent "
+                                 << state.mnParentId);
+    for (size_t j = 0; j < state.mvnLoopEdgeIds.size(); j++)
+      if (!KFs.count(state.mvnLoopEdgeIds[j]))
+        SNAPSHOT_ERROR("Keyframe " << state.mnId << " has missing loop edge "
+                                   << state.mvnLoopEdgeIds[j]);
+    for (size_t j = 0; j < state.mvConnections.size(); j++)
+      if (!KFs.count(state.mvConnections[j].first) ||
+          state.mvConnections[j].second <= 0)
+        SNAPSHOT_ERROR("Keyframe " << state.mnId << " has invalid connection "
+                                   << state.mvConnections[j].first);
+  }
+
+  // The spanning tree has no cycle
+  for (size_t i = 0; i < mvKeyFrames.size(); i++) {
+    long int nId = mvKeyFrames[i].mnParentId;
+    size_t nDepth = 0;
+    while (nId >= 0 && KFs.count(nId) && nDepth <= mvKeyFrames.size()) {
+      nId = mvKeyFrames[KFs.at(nId)].mnParentId;
+      nDepth++;
+    }
+    if (nDepth > mvKeyFrames.size()) {
+      SNAPSHOT_ERROR("Keyframe " << mvKeyFrames[i].mnId
+                                 << " is in a spanning tree cycle");
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < mvMapPoints.size(); i++) {
+    const MapPointState &state = mvMapPoints[i];
+
+    if (state.mvObservations.empty())
+      SNAPSHOT_ERROR("Map point " << state.mnId << " has no observation");
+    if (state.mDescriptor.empty() || state.mNormalVector.empty())
+      SNAPSHOT_ERROR("Map point " << state.mnId
+                                  << " has no descriptor or normal");
+
+    for (size_t j = 0; j < state.mvObservations.size(); j++) {
+      const long unsigned int nKFid = state.mvObservations[j].first;
+      const size_t idx = state.mvObservations[j].second;
+      if (!KFs.count(nKFid)) {
+        SNAPSHOT_ERROR("Map point " << state.mnId
+                                    << " is observed by missing keyframe "
+                                    << nKFid);
+        continue;
+      }
+      const vector<long int> &vnMPIds =
+          mvKeyFrames[KFs.at(nKFid)].mvnMapPointIds;
+      if (idx >= vnMPIds.size() || vnMPIds[idx] != (long int)state.mnId)
+        SNAPSHOT_ERROR("Keyframe " << nKFid << " does not match map point "
+                                   << state.mnId << " at " << idx);
+    }
+  }
+
+  for (size_t i = 0; i < mvnOriginIds.size(); i++)
+    if (!KFs.count(mvnOriginIds[i]))
+      SNAPSHOT_ERROR("Missing origin keyframe " << mvnOriginIds[i]);
+
+#undef SNAPSHOT_ERROR
+
+  if (nErrors > 0)
+    cerr << "[snapshot] " << nErrors << " consistency errors in "
+         << mvKeyFrames.size() << " keyframes and " << mvMapPoints.size()
+         << " map points" << endl;
+  return nErrors == 0;
+}
+
+void MapSnapshot::Restore(Map *pMap, KeyFrameDatabase *pKFDB,
+                          ORBVocabulary *pVoc) {
+  unordered_map<long unsigned int, KeyFrame *> KFs;
+  unordered_map<long unsigned int, MapPoint *> MPs;
+  Restore(pMap, pKFDB, pVoc, KFs, MPs, NULL);
+}
+
+void MapSnapshot::Restore(Map *pMap, KeyFrameDatabase *pKFDB,
+                          ORBVocabulary *pVoc,
+                          unordered_map<long unsigned int, KeyFrame *> &KFs,
+                          unordered_map<long unsigned int, MapPoint *> &MPs,
+                          KeyFrame *pDefaultParent) {
+  vector<KeyFrame *> vpKFs(mvKeyFrames.size(), static_cast<KeyFrame *>(NULL));
+  long unsigned int nMaxKFid = 0;
+  long unsigned int nMaxFrameId = 0;
+  for (size_t i = 0; i < mvKeyFrames.size(); i++) {
+    if (KFs.count(mvKeyFrames[i].mnId))
+      continue;
+    KeyFrame *pKF = new KeyFrame(mvKeyFrames[i], pMap, pKFDB, pVoc);
+    KFs[pKF->mnId] = pKF;
+    vpKFs[i] = pKF;
+    nMaxKFid = max(nMaxKFid, pKF->mnId);
+    nMaxFrameId = max(nMaxFrameId, pKF->mnFrameId);
+  }
+  const unordered_set<KeyFrame *> spNewKFs(vpKFs.begin(), vpKFs.end());
+
+  // Observations by keyframes already in the map are linked on both sides
+  long unsigned int nMaxMPid = 0;
+  for (size_t i = 0; i < mvMapPoints.size(); i++) {
+    const MapPointState &state = mvMapPoints[i];
+    if (MPs.count(state.mnId))
+      continue;
+
+    KeyFrame *pRefKF = NULL;
+    if (state.mnRefKFId >= 0 && KFs.count(state.mnRefKFId))
+      pRefKF = KFs[state.mnRefKFId];
+    for (size_t j = 0; !pRefKF && j < state.mvObservations.size(); j++)
+      if (KFs.count(state.mvObservations[j].first))
+        pRefKF = KFs[state.mvObservations[j].first];
+    if (!pRefKF)
+      continue;
+
+    MapPoint *pMP = new MapPoint(state, pRefKF, pMap);
+    for (size_t j = 0; j < state.mvObservations.size(); j++) {
+      const long unsigned int nKFid = state.mvObservations[j].first;
+      const size_t idx = state.mvObservations[j].second;
+      if (KFs.count(nKFid) && idx < (size_t)KFs[nKFid]->N) {
+        pMP->AddObservation(KFs[nKFid], idx);
+        KFs[nKFid]->AddMapPoint(pMP, idx);
+      }
+    }
+
+    MPs[pMP->mnId] = pMP;
+    nMaxMPid = max(nMaxMPid, pMP->mnId);
+    pMap->AddMapPoint(pMP);
+  }
+
+  for (size_t i = 0; i < vpKFs.size(); i++) {
+    KeyFrame *pKF = vpKFs[i];
+    if (!pKF)
+      continue;
+    const vector<long int> &vnMPIds = mvKeyFrames[i].mvnMapPointIds;
+    for (size_t j = 0; j < vnMPIds.size() && j < (size_t)pKF->N; j++) {
+      if (vnMPIds[j] >= 0 && MPs.count(vnMPIds[j])) {
+        MPs[vnMPIds[j]]->AddObservation(pKF, j);
+        pKF->AddMapPoint(MPs[vnMPIds[j]], j);
+      }
+    }
+    pMap->AddKeyFrame(pKF);
+  }
+
+  for (size_t i = 0; i < vpKFs.size(); i++) {
+    KeyFrame *pKF = vpKFs[i];
+    if (!pKF)
+      continue;
+    const KeyFrameState &state = mvKeyFrames[i];
+
+    map<KeyFrame *, int> weights;
+    for (size_t j = 0; j < state.mvConnections.size(); j++) {
+      if (!KFs.count(state.mvConnections[j].first))
+        continue;
+      KeyFrame *pKFj = KFs[state.mvConnections[j].first];
+      weights[pKFj] = state.mvConnections[j].second;
+      if (!spNewKFs.count(pKFj))
+        pKFj->AddConnection(pKF, state.mvConnections[j].second);
+    }
+    pKF->SetConnections(weights);
+
+    if (state.mnParentId >= 0 && KFs.count(state.mnParentId))
+      pKF->ChangeParent(KFs[state.mnParentId]);
+    else if (state.mnParentId >= 0 && pDefaultParent)
+      pKF->ChangeParent(pDefaultParent);
+    for (size_t j = 0; j < state.mvnLoopEdgeIds.size(); j++) {
+      if (!KFs.count(state.mvnLoopEdgeIds[j]))
+        continue;
+      KeyFrame *pKFj = KFs[state.mvnLoopEdgeIds[j]];
+      pKF->AddLoopEdge(pKFj);
+      if (!spNewKFs.count(pKFj))
+        pKFj->AddLoopEdge(pKF);
+    }
+
+    // Only computed if the BoW vectors were not stored
+    pKF->ComputeBoW();
+    pKFDB->add(pKF);
+  }
+
+  for (size_t i = 0; i < mvnOriginIds.size(); i++)
+    if (KFs.count(mvnOriginIds[i]) && spNewKFs.count(KFs[mvnOriginIds[i]]))
+      pMap->mvpKeyFrameOrigins.push_back(KFs[mvnOriginIds[i]]);
+
+  // New keyframes, map points and frames must not reuse the loaded ids
+  KeyFrame::nNextId = max(KeyFrame::nNextId, max(mnNextKFId, nMaxKFid + 1));
+  MapPoint::nNextId = max(MapPoint::nNextId, max(mnNextMPId, nMaxMPid + 1));
+  Frame::nNextId = max(Frame::nNextId, max(mnNextFrameId, nMaxFrameId + 1));
+}
+
+} // namespace ORB_SLAM2
@@ -0,0 +1,575 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MapTiles.h"
+
+#include "KeyFrame.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "SharedMap.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+// Increase when the content of the index changes
+static const int TILES_VERSION = 1;
+
+// Seconds before a tile that could not be read is read again
+static const int RETRY_DELAY = 1;
+
+MapTiles::MapTiles(Map *pMap, KeyFrameDatabase *pKFDB, ORBVocabulary *pVoc,
+                   const string &mapfile)
+    : mpMap(pMap), mpKeyFrameDB(pKFDB), mpORBVocabulary(pVoc),
+      mMapFile(mapfile), mpSharedMap(NULL), mnRadius(1), mnBudget(0), mLookahead(2.0),
+      mnResidentBytes(0), mnRelocTile(-1), mLastTimeStamp(-1),
+      mTimeStamp(-1), mbRelocRequested(false), mbResetRequested(false),
+      mbFinishRequested(false), mbFinished(true) {}
+
+void MapTiles::SetSharedMap(const SharedMap *pSharedMap) {
+  mpSharedMap = pSharedMap;
+}
+
+void MapTiles::SetPaging(const int nRadius, const double budget,
+                         const double lookahead) {
+  mnRadius = max(nRadius, 0);
+  mnBudget = budget > 0 ? (long unsigned int)(budget * 1024 * 1024) : 0;
+  mLookahead = max(lookahead, 0.0);
+}
+
+string MapTiles::TileName(const int nTile) {
+  return mMapFile + ".tile." + to_string(nTile);
+}
+
+int MapTiles::FindTile(const int nX, const int nZ) {
+  map<pair<int, int>, int>::const_iterator it =
+      mmCellTiles.find(make_pair(nX, nZ));
+  return it == mmCellTiles.end() ? -1 : it->second;
+}
+
+void MapTiles::Cell(const cv::Mat &pos, int &nX, int &nZ) {
+  nX = floor(pos.at<float>(0) / mIndex.mfTileSize);
+  nZ = floor(pos.at<float>(2) / mIndex.mfTileSize);
+}
+
+bool MapTiles::Open(const float fTileSize) {
+  bool bBuild = true;
+  if (ReadIndex() && mIndex.mfTileSize == fTileSize) {
+    struct stat mapStat, indexStat;
+    const string indexfile = mMapFile + ".tiles";
+    // The map file may have been removed, only the tiles are needed
+    bBuild = stat(mMapFile.c_str(), &mapStat) == 0 &&
+             stat(indexfile.c_str(), &indexStat) == 0 &&
+             mapStat.st_mtime > indexStat.st_mtime;
+  }
+
+  if (bBuild && !Build(fTileSize))
+    return false;
+
+  mmCellTiles.clear();
+  for (size_t i = 0; i < mIndex.mvTiles.size(); i++)
+    mmCellTiles[make_pair(mIndex.mvTiles[i].mnX, mIndex.mvTiles[i].mnZ)] = i;
+
+  cout << "[tiles] " << mIndex.mvTiles.size() << " tiles of "
+       << mIndex.mfTileSize << "m in " << mMapFile << ".tiles" << endl;
+
+  // The camera is lost until the first relocalization, the map starts with the
+  // tile of the anchor
+  return LoadTile(mIndex.mnAnchorTile);
+}
+
+bool MapTiles::Build(const float fTileSize) {
+  MapSnapshot snapshot;
+  if (!snapshot.Load(mMapFile) || snapshot.empty()) {
+    cerr << "[tiles] Cannot read the map from " << mMapFile << endl;
+    return false;
+  }
+
+  cout << "[tiles] Splitting " << mMapFile << " in tiles of " << fTileSize
+       << "m" << endl;
+
+  mIndex = MapTileIndex();
+  mIndex.mfTileSize = fTileSize;
+  mmCellTiles.clear();
+
+  mIndex.mnAnchorId = snapshot.mvKeyFrames[0].mnId;
+  for (size_t i = 0; i < snapshot.mvKeyFrames.size(); i++)
+    mIndex.mnAnchorId = min(mIndex.mnAnchorId, snapshot.mvKeyFrames[i].mnId);
+  if (!snapshot.mvnOriginIds.empty())
+    mIndex.mnAnchorId = snapshot.mvnOriginIds[0];
+
+  // Keyframes go to the tile of their camera center
+  vector<MapSnapshot> vTiles;
+  unordered_map<long unsigned int, int> KFTiles;
+  for (size_t i = 0; i < snapshot.mvKeyFrames.size(); i++) {
+    KeyFrameState &state = snapshot.mvKeyFrames[i];
+
+    const cv::Mat Rcw = state.Tcw.rowRange(0, 3).colRange(0, 3);
+    const cv::Mat tcw = state.Tcw.rowRange(0, 3).col(3);
+    const cv::Mat Ow = -Rcw.t() * tcw;
+
+    int nX, nZ;
+    Cell(Ow, nX, nZ);
+    int nTile = FindTile(nX, nZ);
+    if (nTile < 0) {
+      nTile = mIndex.mvTiles.size();
+      mmCellTiles[make_pair(nX, nZ)] = nTile;
+      TileInfo info;
+      info.mnX = nX;
+      info.mnZ = nZ;
+      info.mnKeyFrames = 0;
+      info.mnBytes = 0;
+      mIndex.mvTiles.push_back(info);
+      vTiles.push_back(MapSnapshot());
+    }
+    mIndex.mvTiles[nTile].mnKeyFrames++;
+    KFTiles[state.mnId] = nTile;
+
+    for (DBoW2::BowVector::const_iterator vit = state.mBowVec.begin(),
+                                          vend = state.mBowVec.end();
+         vit != vend; vit++)
+      mIndex.mvWordTiles.push_back(make_pair(vit->first, nTile));
+
+    vTiles[nTile].mvKeyFrames.push_back(std::move(state));
+  }
+  sort(mIndex.mvWordTiles.begin(), mIndex.mvWordTiles.end());
+  mIndex.mnAnchorTile = KFTiles[mIndex.mnAnchorId];
+
+  // Map points go to the tile of their reference keyframe
+  for (size_t i = 0; i < snapshot.mvMapPoints.size(); i++) {
+    MapPointState &state = snapshot.mvMapPoints[i];
+    int nTile = -1;
+    if (state.mnRefKFId >= 0 && KFTiles.count(state.mnRefKFId))
+      nTile = KFTiles[state.mnRefKFId];
+    for (size_t j = 0; nTile < 0 && j < state.mvObservations.size(); j++)
+      if (KFTiles.count(state.mvObservations[j].first))
+        nTile = KFTiles[state.mvObservations[j].first];
+    if (nTile >= 0)
+      vTiles[nTile].mvMapPoints.push_back(std::move(state));
+  }
+
+  for (size_t i = 0; i < vTiles.size(); i++) {
+    MapSnapshot &tile = vTiles[i];
+    tile.mnNextKFId = snapshot.mnNextKFId;
+    tile.mnNextMPId = snapshot.mnNextMPId;
+    tile.mnNextFrameId = snapshot.mnNextFrameId;
+    if ((int)i == mIndex.mnAnchorTile)
+      tile.mvnOriginIds = snapshot.mvnOriginIds;
+
+    const string filename = TileName(i);
+    struct stat tileStat;
+    if (!tile.Save(filename) || stat(filename.c_str(), &tileStat) != 0) {
+      cerr << "[tiles] Cannot write " << filename << endl;
+      return false;
+    }
+    mIndex.mvTiles[i].mnBytes = tileStat.st_size;
+  }
+
+  return WriteIndex();
+}
+
+bool MapTiles::ReadIndex() {
+  ifstream in(mMapFile + ".tiles", ios_base::binary);
+  if (!in)
+    return false;
+
+  try {
+    boost::archive::binary_iarchive ia(in, boost::archive::no_header);
+    int nVersion;
+    ia >> nVersion;
+    if (nVersion != TILES_VERSION)
+      return false;
+    ia >> mIndex;
+  } catch (const std::exception &e) {
+    cerr << "[tiles] Cannot read " << mMapFile << ".tiles: " << e.what()
+         << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool MapTiles::WriteIndex() {
+  const string filename = mMapFile + ".tiles";
+  const string tmpfile = filename + ".tmp";
+  ofstream out(tmpfile, ios_base::binary);
+  if (!out) {
+    cerr << "[tiles] Cannot write to " << tmpfile << endl;
+    return false;
+  }
+
+  {
+    boost::archive::binary_oarchive oa(out, boost::archive::no_header);
+    oa << TILES_VERSION;
+    oa << mIndex;
+  }
+  out.close();
+
+  if (!out || rename(tmpfile.c_str(), filename.c_str()) != 0) {
+    cerr << "[tiles] Cannot write " << filename << endl;
+    return false;
+  }
+
+  return true;
+}
+
+void MapTiles::Run() {
+  mbFinished = false;
+
+  while (1) {
+    ResetIfRequested();
+
+    DBoW2::BowVector BowVec;
+    bool bReloc;
+    {
+      unique_lock<mutex> lock(mMutexRequests);
+      bReloc = mbRelocRequested;
+      if (bReloc)
+        BowVec.swap(mRelocBowVec);
+      mbRelocRequested = false;
+    }
+    if (bReloc) {
+      const int nTile = BestRelocalizationTile(BowVec);
+      if (nTile >= 0)
+        mnRelocTile = nTile;
+    }
+
+    // Nearest missing tile first, tracking takes the map between two tiles
+    const vector<int> vnDesired = DesiredTiles();
+    const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    for (size_t i = 0; i < vnDesired.size(); i++) {
+      if (mmResident.count(vnDesired[i]))
+        continue;
+      map<int, chrono::steady_clock::time_point>::iterator rit =
+          mmRetry.find(vnDesired[i]);
+      if (rit != mmRetry.end() && now < rit->second)
+        continue;
+      LoadTile(vnDesired[i]);
+      break;
+    }
+
+    // Farthest tiles first
+    if (mnBudget > 0) {
+      const set<int> sDesired(vnDesired.begin(), vnDesired.end());
+      while (mnResidentBytes > mnBudget) {
+        int nFarthest = -1;
+        int nMaxDistance = -1;
+        for (map<int, ResidentTile>::iterator mit = mmResident.begin(),
+                                              mend = mmResident.end();
+             mit != mend; mit++) {
+          if (mit->first == mIndex.mnAnchorTile || sDesired.count(mit->first))
+            continue;
+          const int d = Distance(mit->first);
+          if (d > nMaxDistance) {
+            nMaxDistance = d;
+            nFarthest = mit->first;
+          }
+        }
+        if (nFarthest < 0 || !UnloadTile(nFarthest))
+          break;
+      }
+    }
+
+    if (CheckFinish())
+      break;
+
+    usleep(10000);
+  }
+
+  SetFinish();
+}
+
+void MapTiles::SetCameraCenter(const cv::Mat &Ow, const double &timestamp) {
+  unique_lock<mutex> lock(mMutexRequests);
+  if (!mOw.empty() && timestamp > mTimeStamp)
+    mPredictedOw = Ow + (Ow - mOw) * (mLookahead / (timestamp - mTimeStamp));
+  else
+    mPredictedOw = Ow.clone();
+  mOw = Ow.clone();
+  mTimeStamp = timestamp;
+}
+
+void MapTiles::RequestRelocalization(const DBoW2::BowVector &BowVec) {
+  unique_lock<mutex> lock(mMutexRequests);
+  mRelocBowVec = BowVec;
+  mbRelocRequested = true;
+}
+
+int MapTiles::Distance(const int nTile) {
+  cv::Mat Ow;
+  {
+    unique_lock<mutex> lock(mMutexRequests);
+    Ow = mOw.clone();
+  }
+  if (Ow.empty())
+    return 0;
+
+  int nX, nZ;
+  Cell(Ow, nX, nZ);
+  const TileInfo &info = mIndex.mvTiles[nTile];
+  return max(abs(info.mnX - nX), abs(info.mnZ - nZ));
+}
+
+vector<int> MapTiles::DesiredTiles() {
+  cv::Mat Ow, PredictedOw;
+  double timestamp;
+  {
+    unique_lock<mutex> lock(mMutexRequests);
+    Ow = mOw.clone();
+    PredictedOw = mPredictedOw.clone();
+    timestamp = mTimeStamp;
+  }
+
+  // The relocalization tile is kept until the camera is localized again
+  if (timestamp != mLastTimeStamp) {
+    mnRelocTile = -1;
+    mLastTimeStamp = timestamp;
+  }
+
+  vector<int> vnTiles;
+  if (Ow.empty() && mnRelocTile < 0)
+    return vnTiles;
+
+  vector<pair<int, int>> vDistTiles;
+  if (mnRelocTile >= 0)
+    vDistTiles.push_back(make_pair(0, mnRelocTile));
+
+  if (!Ow.empty()) {
+    const cv::Mat vCenters[2] = {Ow, PredictedOw};
+    for (int c = 0; c < 2; c++) {
+      int nX, nZ;
+      Cell(vCenters[c], nX, nZ);
+      for (int dx = -mnRadius; dx <= mnRadius; dx++) {
+        for (int dz = -mnRadius; dz <= mnRadius; dz++) {
+          const int nTile = FindTile(nX + dx, nZ + dz);
+          if (nTile >= 0)
+            vDistTiles.push_back(make_pair(Distance(nTile), nTile));
+        }
+      }
+    }
+  }
+
+  sort(vDistTiles.begin(), vDistTiles.end());
+
+  // The anchor is always loaded first, it adopts the keyframes whose parent is
+  // not in memory
+  vnTiles.push_back(mIndex.mnAnchorTile);
+  for (size_t i = 0; i < vDistTiles.size(); i++)
+    if (find(vnTiles.begin(), vnTiles.end(), vDistTiles[i].second) ==
+        vnTiles.end())
+      vnTiles.push_back(vDistTiles[i].second);
+
+  return vnTiles;
+}
+
+int MapTiles::BestRelocalizationTile(const DBoW2::BowVector &BowVec) {
+  // Votes of the words of the frame, weighted as in the BoW score
+  vector<float> vScores(mIndex.mvTiles.size(), 0);
+  for (DBoW2::BowVector::const_iterator vit = BowVec.begin(),
+                                        vend = BowVec.end();
+       vit != vend; vit++) {
+    vector<pair<DBoW2::WordId, int>>::const_iterator it =
+        lower_bound(mIndex.mvWordTiles.begin(), mIndex.mvWordTiles.end(),
+                    make_pair(vit->first, -1));
+    for (; it != mIndex.mvWordTiles.end() && it->first == vit->first; it++)
+      vScores[it->second] += vit->second;
+  }
+
+  // The keyframes in memory already failed
+  int nBest = -1;
+  float bestScore = 0;
+  for (size_t i = 0; i < vScores.size(); i++) {
+    if (mmResident.count(i) || mIndex.mvTiles[i].mnKeyFrames == 0)
+      continue;
+    const float score = vScores[i] / mIndex.mvTiles[i].mnKeyFrames;
+    if (score > bestScore) {
+      bestScore = score;
+      nBest = i;
+    }
+  }
+
+  return nBest;
+}
+
+bool MapTiles::LoadTile(const int nTile) {
+  MapSnapshot tile;
+  if (!tile.Load(TileName(nTile))) {
+    cerr << "[tiles] Cannot read " << TileName(nTile) << ", retrying in "
+         << RETRY_DELAY << "s" << endl;
+    mmRetry[nTile] =
+        chrono::steady_clock::now() + chrono::seconds(RETRY_DELAY);
+    return false;
+  }
+  mmRetry.erase(nTile);
+
+  ResidentTile &resident = mmResident[nTile];
+  if (mpSharedMap)
+    mpSharedMap->Share(tile);
+
+  {
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    KeyFrame *pAnchor =
+        mKFs.count(mIndex.mnAnchorId) ? mKFs[mIndex.mnAnchorId] : NULL;
+    tile.Restore(mpMap, mpKeyFrameDB, mpORBVocabulary, mKFs, mMPs, pAnchor);
+  }
+
+  for (size_t i = 0; i < tile.mvKeyFrames.size(); i++)
+    if (mKFs.count(tile.mvKeyFrames[i].mnId))
+      resident.mvnKeyFrameIds.push_back(tile.mvKeyFrames[i].mnId);
+  for (size_t i = 0; i < tile.mvMapPoints.size(); i++)
+    if (mMPs.count(tile.mvMapPoints[i].mnId))
+      resident.mvnMapPointIds.push_back(tile.mvMapPoints[i].mnId);
+  mnResidentBytes += mIndex.mvTiles[nTile].mnBytes;
+
+  cout << "[tiles] Loaded tile " << nTile << " (" << mIndex.mvTiles[nTile].mnX
+       << ", " << mIndex.mvTiles[nTile].mnZ << "): "
+       << resident.mvnKeyFrameIds.size() << " keyframes, "
+       << resident.mvnMapPointIds.size() << " map points, "
+       << mnResidentBytes / (1024 * 1024) << "MB in memory" << endl;
+  return true;
+}
+
+bool MapTiles::UnloadTile(const int nTile) {
+  // The evicted keyframes are reparented to the anchor, the tiles are kept
+  // while it is not loaded
+  unordered_map<long unsigned int, KeyFrame *>::iterator ait =
+      mKFs.find(mIndex.mnAnchorId);
+  if (ait == mKFs.end()) {
+    cerr << "[tiles] Cannot evict tile " << nTile
+         << ", the anchor keyframe is not loaded" << endl;
+    return false;
+  }
+  KeyFrame *pAnchor = ait->second;
+
+  const ResidentTile &resident = mmResident[nTile];
+
+  {
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+
+    // The points of the tile and of other tiles seen by the evicted keyframes.
+    // A point is retired once it has no observation left, the ones also
+    // observed by keyframes of other tiles stay in memory.
+    set<MapPoint *> spMPs;
+    for (size_t i = 0; i < resident.mvnMapPointIds.size(); i++) {
+      unordered_map<long unsigned int, MapPoint *>::iterator mit =
+          mMPs.find(resident.mvnMapPointIds[i]);
+      if (mit != mMPs.end())
+        spMPs.insert(mit->second);
+    }
+
+    for (size_t i = 0; i < resident.mvnKeyFrameIds.size(); i++) {
+      const long unsigned int nId = resident.mvnKeyFrameIds[i];
+      if (!mKFs.count(nId))
+        continue;
+      KeyFrame *pKF = mKFs[nId];
+      const vector<MapPoint *> vpMPs = pKF->GetMapPointMatches();
+      for (size_t j = 0; j < vpMPs.size(); j++)
+        if (vpMPs[j])
+          spMPs.insert(vpMPs[j]);
+      pKF->Unload(pAnchor);
+      mKFs.erase(nId);
+    }
+
+    for (set<MapPoint *>::iterator sit = spMPs.begin(), send = spMPs.end();
+         sit != send; sit++)
+      if ((*sit)->isBad())
+        mMPs.erase((*sit)->mnId);
+  }
+
+  mnResidentBytes -= min(mnResidentBytes, mIndex.mvTiles[nTile].mnBytes);
+  mmResident.erase(nTile);
+
+  cout << "[tiles] Evicted tile " << nTile << ", "
+       << mnResidentBytes / (1024 * 1024) << "MB in memory" << endl;
+  return true;
+}
+
+void MapTiles::RequestReset() {
+  {
+    unique_lock<mutex> lock(mMutexReset);
+    mbResetRequested = true;
+  }
+
+  while (1) {
+    {
+      unique_lock<mutex> lock2(mMutexReset);
+      if (!mbResetRequested || isFinished())
+        break;
+    }
+    usleep(3000);
+  }
+}
+
+void MapTiles::ResetIfRequested() {
+  unique_lock<mutex> lock(mMutexReset);
+  if (!mbResetRequested)
+    return;
+
+  // The objects are deleted by the map
+  mmResident.clear();
+  mmRetry.clear();
+  mnResidentBytes = 0;
+  mKFs.clear();
+  mMPs.clear();
+  mnRelocTile = -1;
+  {
+    unique_lock<mutex> lock2(mMutexRequests);
+    mOw.release();
+    mPredictedOw.release();
+    mTimeStamp = -1;
+    mbRelocRequested = false;
+  }
+  mLastTimeStamp = -1;
+  mbResetRequested = false;
+}
+
+void MapTiles::RequestFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  mbFinishRequested = true;
+}
+
+bool MapTiles::CheckFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  return mbFinishRequested;
+}
+
+void MapTiles::SetFinish() {
+  unique_lock<mutex> lock(mMutexFinish);
+  mbFinished = true;
+}
+
+bool MapTiles::isFinished() {
+  unique_lock<mutex> lock(mMutexFinish);
+  return mbFinished;
+}
+
+} // namespace ORB_SLAM2
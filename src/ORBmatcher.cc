@@ -181,8 +181,8 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     {
         if(KFit->first == Fit->first)
         {
-            const vector<unsigned int> vIndicesKF = KFit->second;
-            const vector<unsigned int> vIndicesF = Fit->second;
+            const DBoW2::FeatureVector::Features vIndicesKF = KFit->second;
+            const DBoW2::FeatureVector::Features vIndicesF = Fit->second;
 
             for(size_t iKF=0; iKF<vIndicesKF.size(); iKF++)
             {
@@ -823,6 +823,17 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
 }
 
 int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th)
+{
+    vector<int> vnMatches;
+    const int nFused = SearchForFusion(pKF,vpMapPoints,vnMatches,th);
+
+    int nReplaced, nAdded;
+    ApplyFusion(pKF,vpMapPoints,vnMatches,nReplaced,nAdded);
+
+    return nFused;
+}
+
+int ORBmatcher::SearchForFusion(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, vector<int> &vnMatches, const float th)
 {
     cv::Mat Rcw = pKF->GetRotation();
     cv::Mat tcw = pKF->GetTranslation();
@@ -839,6 +850,8 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
     const int nMPs = vpMapPoints.size();
 
+    vnMatches = vector<int>(nMPs,-1);
+
     for(int i=0; i<nMPs; i++)
     {
         MapPoint* pMP = vpMapPoints[i];
@@ -948,25 +961,10 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
             }
         }
 
-        // If there is already a MapPoint replace otherwise add new measurement
+        // Fused by ApplyFusion
         if(bestDist<=TH_LOW)
         {
-            MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
-            if(pMPinKF)
-            {
-                if(!pMPinKF->isBad())
-                {
-                    if(pMPinKF->Observations()>pMP->Observations())
-                        pMP->Replace(pMPinKF);
-                    else
-                        pMPinKF->Replace(pMP);
-                }
-            }
-            else
-            {
-                pMP->AddObservation(pKF,bestIdx);
-                pKF->AddMapPoint(pMP,bestIdx);
-            }
+            vnMatches[i]=bestIdx;
             nFused++;
         }
     }
@@ -974,6 +972,48 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
     return nFused;
 }
 
+void ORBmatcher::ApplyFusion(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const vector<int> &vnMatches, int &nReplaced, int &nAdded)
+{
+    nReplaced=0;
+    nAdded=0;
+
+    for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
+    {
+        if(vnMatches[i]<0)
+            continue;
+
+        // The point may have been fused with another since the search
+        MapPoint* pMP = vpMapPoints[i];
+        while(pMP && pMP->isBad())
+            pMP = pMP->GetReplaced();
+
+        if(!pMP || pMP->IsInKeyFrame(pKF))
+            continue;
+
+        const int &idx = vnMatches[i];
+
+        // If there is already a MapPoint replace otherwise add new measurement
+        MapPoint* pMPinKF = pKF->GetMapPoint(idx);
+        if(pMPinKF)
+        {
+            if(!pMPinKF->isBad())
+            {
+                if(pMPinKF->Observations()>pMP->Observations())
+                    pMP->Replace(pMPinKF);
+                else
+                    pMPinKF->Replace(pMP);
+                nReplaced++;
+            }
+        }
+        else
+        {
+            pMP->AddObservation(pKF,idx);
+            pKF->AddMapPoint(pMP,idx);
+            nAdded++;
+        }
+    }
+}
+
 int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint)
 {
     // Get Calibration Parameters for later projection
@@ -31,6 +31,7 @@
 #include <Eigen/StdVector>
 
 #include "Converter.h"
+#include "OptimizerWorkspace.h"
 
 #include <mutex>
 
@@ -53,22 +54,25 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
                                  const vector<MapPoint *> &vpMP,
                                  int nIterations, bool *pbStopFlag,
                                  const unsigned long nLoopKF,
-                                 const bool bRobust) {
+                                 const bool bRobust, const bool bBatched) {
   std::cout << "Optimizer::BundleAdjustment" << std::endl;
   vector<bool> vbNotIncludedMP;
   vbNotIncludedMP.resize(vpMP.size());
 
-  g2o::SparseOptimizer optimizer;
-  g2o::BlockSolver_6_3::LinearSolverType *linearSolver;
+  OptimizerWorkspace::Scope workspace(OptimizerWorkspace::BUNDLE_ADJUSTMENT);
+  g2o::SparseOptimizer &optimizer = workspace.Optimizer();
+  if (!optimizer.algorithm()) {
+    g2o::BlockSolver_6_3::LinearSolverType *linearSolver;
 
-  linearSolver =
-      new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    linearSolver =
+        new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
 
-  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
-  g2o::OptimizationAlgorithmLevenberg *solver =
-      new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-  optimizer.setAlgorithm(solver);
+    g2o::OptimizationAlgorithmLevenberg *solver =
+        new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+  }
 
   if (pbStopFlag)
     optimizer.setForceStopFlag(pbStopFlag);
@@ -80,7 +84,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
     KeyFrame *pKF = vpKFs[i];
     if (pKF->isBad())
       continue;
-    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+    g2o::VertexSE3Expmap *vSE3 = workspace.New<g2o::VertexSE3Expmap>();
     vSE3->setEstimate(Converter::toSE3Quat(pKF->GetPose()));
     vSE3->setId(pKF->mnId);
     vSE3->setFixed(pKF->mnId == 0);
@@ -97,7 +101,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
     MapPoint *pMP = vpMP[i];
     if (pMP->isBad())
       continue;
-    g2o::VertexSBAPointXYZ *vPoint = new g2o::VertexSBAPointXYZ();
+    g2o::VertexSBAPointXYZ *vPoint = workspace.New<g2o::VertexSBAPointXYZ>();
     vPoint->setEstimate(Converter::toVector3d(pMP->GetWorldPos()));
     const int id = pMP->mnId + maxKFid + 1;
     vPoint->setId(id);
@@ -123,7 +127,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
         Eigen::Matrix<double, 2, 1> obs;
         obs << kpUn.pt.x, kpUn.pt.y;
 
-        g2o::EdgeSE3ProjectXYZ *e = new g2o::EdgeSE3ProjectXYZ();
+        g2o::EdgeSE3ProjectXYZ *e = workspace.New<g2o::EdgeSE3ProjectXYZ>();
 
         e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                             optimizer.vertex(id)));
@@ -145,12 +149,15 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
         e->cy = pKF->cy;
 
         optimizer.addEdge(e);
+        if (bBatched)
+          workspace.Batch().add(e);
       } else {
         Eigen::Matrix<double, 3, 1> obs;
         const float kp_ur = pKF->mvuRight[mit->second];
         obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
 
-        g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
+        g2o::EdgeStereoSE3ProjectXYZ *e =
+            workspace.New<g2o::EdgeStereoSE3ProjectXYZ>();
 
         e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                             optimizer.vertex(id)));
@@ -174,6 +181,8 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
         e->bf = pKF->mbf;
 
         optimizer.addEdge(e);
+        if (bBatched)
+          workspace.Batch().add(e);
       }
     }
 
@@ -231,23 +240,33 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs,
   }
 }
 
-int Optimizer::PoseOptimization(Frame *pFrame) {
-  g2o::SparseOptimizer optimizer;
-  g2o::BlockSolver_6_3::LinearSolverType *linearSolver;
+int Optimizer::PoseOptimization(Frame *pFrame, const bool bBatched) {
+  vector<Frame> vRigFrames;
+  return PoseOptimization(pFrame, vRigFrames, vector<cv::Mat>(), bBatched);
+}
+
+int Optimizer::PoseOptimization(Frame *pFrame, vector<Frame> &vRigFrames,
+                                const vector<cv::Mat> &vTcb,
+                                const bool bBatched) {
+  OptimizerWorkspace::Scope workspace(OptimizerWorkspace::POSE_OPTIMIZATION);
+  g2o::SparseOptimizer &optimizer = workspace.Optimizer();
+  if (!optimizer.algorithm()) {
+    g2o::BlockSolver_6_3::LinearSolverType *linearSolver;
 
-  linearSolver =
-      new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
+    linearSolver =
+        new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
 
-  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
-  g2o::OptimizationAlgorithmLevenberg *solver =
-      new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-  optimizer.setAlgorithm(solver);
+    g2o::OptimizationAlgorithmLevenberg *solver =
+        new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+  }
 
   int nInitialCorrespondences = 0;
 
   // Set Frame vertex
-  g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+  g2o::VertexSE3Expmap *vSE3 = workspace.New<g2o::VertexSE3Expmap>();
   vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
   vSE3->setId(0);
   vSE3->setFixed(false);
@@ -266,6 +285,9 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
   vpEdgesStereo.reserve(N);
   vnIndexEdgeStereo.reserve(N);
 
+  vector<g2o::EdgeSE3ProjectXYZOnlyPoseRig *> vpEdgesRig;
+  vector<pair<size_t, int>> vRigIndexEdge;
+
   const float deltaMono = sqrt(5.991);
   const float deltaStereo = sqrt(7.815);
 
@@ -285,7 +307,7 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
           obs << kpUn.pt.x, kpUn.pt.y;
 
           g2o::EdgeSE3ProjectXYZOnlyPose *e =
-              new g2o::EdgeSE3ProjectXYZOnlyPose();
+              workspace.New<g2o::EdgeSE3ProjectXYZOnlyPose>();
 
           e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                               optimizer.vertex(0)));
@@ -307,6 +329,8 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
           e->Xw[2] = Xw.at<float>(2);
 
           optimizer.addEdge(e);
+          if (bBatched)
+            workspace.Batch().add(e);
 
           vpEdgesMono.push_back(e);
           vnIndexEdgeMono.push_back(i);
@@ -322,7 +346,7 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
           obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
 
           g2o::EdgeStereoSE3ProjectXYZOnlyPose *e =
-              new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+              workspace.New<g2o::EdgeStereoSE3ProjectXYZOnlyPose>();
 
           e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                               optimizer.vertex(0)));
@@ -346,12 +370,61 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
           e->Xw[2] = Xw.at<float>(2);
 
           optimizer.addEdge(e);
+          if (bBatched)
+            workspace.Batch().add(e);
 
           vpEdgesStereo.push_back(e);
           vnIndexEdgeStereo.push_back(i);
         }
       }
     }
+
+    // Monocular observations of the other cameras of the rig
+    for (size_t c = 0; c < vRigFrames.size(); c++) {
+      Frame &rigFrame = vRigFrames[c];
+      const g2o::SE3Quat Tcb = Converter::toSE3Quat(vTcb[c]);
+
+      for (int i = 0; i < rigFrame.N; i++) {
+        MapPoint *pMP = rigFrame.mvpMapPoints[i];
+        if (!pMP)
+          continue;
+
+        nInitialCorrespondences++;
+        rigFrame.mvbOutlier[i] = false;
+
+        Eigen::Matrix<double, 2, 1> obs;
+        const cv::KeyPoint &kpUn = rigFrame.mvKeysUn[i];
+        obs << kpUn.pt.x, kpUn.pt.y;
+
+        g2o::EdgeSE3ProjectXYZOnlyPoseRig *e =
+            workspace.New<g2o::EdgeSE3ProjectXYZOnlyPoseRig>();
+
+        e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
+                            optimizer.vertex(0)));
+        e->setMeasurement(obs);
+        const float invSigma2 = rigFrame.mvInvLevelSigma2[kpUn.octave];
+        e->setInformation(Eigen::Matrix2d::Identity() * invSigma2);
+
+        g2o::RobustKernelHuber *rk = new g2o::RobustKernelHuber;
+        e->setRobustKernel(rk);
+        rk->setDelta(deltaMono);
+
+        e->fx = rigFrame.fx;
+        e->fy = rigFrame.fy;
+        e->cx = rigFrame.cx;
+        e->cy = rigFrame.cy;
+        e->Tcb = Tcb;
+        cv::Mat Xw = pMP->GetWorldPos();
+        e->Xw[0] = Xw.at<float>(0);
+        e->Xw[1] = Xw.at<float>(1);
+        e->Xw[2] = Xw.at<float>(2);
+
+        optimizer.addEdge(e);
+
+        vpEdgesRig.push_back(e);
+        vRigIndexEdge.push_back(make_pair(c, i));
+      }
+    }
   }
 
   if (nInitialCorrespondences < 3)
@@ -420,6 +493,31 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
         e->setRobustKernel(0);
     }
 
+    for (size_t i = 0, iend = vpEdgesRig.size(); i < iend; i++) {
+      g2o::EdgeSE3ProjectXYZOnlyPoseRig *e = vpEdgesRig[i];
+
+      Frame &rigFrame = vRigFrames[vRigIndexEdge[i].first];
+      const int idx = vRigIndexEdge[i].second;
+
+      if (rigFrame.mvbOutlier[idx]) {
+        e->computeError();
+      }
+
+      const float chi2 = e->chi2();
+
+      if (chi2 > chi2Mono[it]) {
+        rigFrame.mvbOutlier[idx] = true;
+        e->setLevel(1);
+        nBad++;
+      } else {
+        rigFrame.mvbOutlier[idx] = false;
+        e->setLevel(0);
+      }
+
+      if (it == 2)
+        e->setRobustKernel(0);
+    }
+
     if (optimizer.edges().size() < 10)
       break;
   }
@@ -430,12 +528,14 @@ int Optimizer::PoseOptimization(Frame *pFrame) {
   g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
   cv::Mat pose = Converter::toCvMat(SE3quat_recov);
   pFrame->SetPose(pose);
+  for (size_t c = 0; c < vRigFrames.size(); c++)
+    vRigFrames[c].SetPose(vTcb[c] * pose);
 
   return nInitialCorrespondences - nBad;
 }
 
 void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
-                                      Map *pMap) {
+                                      Map *pMap, const bool bBatched) {
   // Local KeyFrames: First Breath Search from Current Keyframe
   list<KeyFrame *> lLocalKeyFrames;
 
@@ -490,17 +590,21 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
   }
 
   // Setup optimizer
-  g2o::SparseOptimizer optimizer;
-  g2o::BlockSolver_6_3::LinearSolverType *linearSolver;
+  OptimizerWorkspace::Scope workspace(
+      OptimizerWorkspace::LOCAL_BUNDLE_ADJUSTMENT);
+  g2o::SparseOptimizer &optimizer = workspace.Optimizer();
+  if (!optimizer.algorithm()) {
+    g2o::BlockSolver_6_3::LinearSolverType *linearSolver;
 
-  linearSolver =
-      new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    linearSolver =
+        new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
 
-  g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    g2o::BlockSolver_6_3 *solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
-  g2o::OptimizationAlgorithmLevenberg *solver =
-      new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-  optimizer.setAlgorithm(solver);
+    g2o::OptimizationAlgorithmLevenberg *solver =
+        new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+  }
 
   if (pbStopFlag)
     optimizer.setForceStopFlag(pbStopFlag);
@@ -512,7 +616,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
                                   lend = lLocalKeyFrames.end();
        lit != lend; lit++) {
     KeyFrame *pKFi = *lit;
-    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+    g2o::VertexSE3Expmap *vSE3 = workspace.New<g2o::VertexSE3Expmap>();
     vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
     vSE3->setId(pKFi->mnId);
     vSE3->setFixed(pKFi->mnId == 0);
@@ -526,7 +630,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
                                   lend = lFixedCameras.end();
        lit != lend; lit++) {
     KeyFrame *pKFi = *lit;
-    g2o::VertexSE3Expmap *vSE3 = new g2o::VertexSE3Expmap();
+    g2o::VertexSE3Expmap *vSE3 = workspace.New<g2o::VertexSE3Expmap>();
     vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
     vSE3->setId(pKFi->mnId);
     vSE3->setFixed(true);
@@ -564,7 +668,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
                                   lend = lLocalMapPoints.end();
        lit != lend; lit++) {
     MapPoint *pMP = *lit;
-    g2o::VertexSBAPointXYZ *vPoint = new g2o::VertexSBAPointXYZ();
+    g2o::VertexSBAPointXYZ *vPoint = workspace.New<g2o::VertexSBAPointXYZ>();
     vPoint->setEstimate(Converter::toVector3d(pMP->GetWorldPos()));
     int id = pMP->mnId + maxKFid + 1;
     vPoint->setId(id);
@@ -587,7 +691,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
           Eigen::Matrix<double, 2, 1> obs;
           obs << kpUn.pt.x, kpUn.pt.y;
 
-          g2o::EdgeSE3ProjectXYZ *e = new g2o::EdgeSE3ProjectXYZ();
+          g2o::EdgeSE3ProjectXYZ *e = workspace.New<g2o::EdgeSE3ProjectXYZ>();
 
           e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                               optimizer.vertex(id)));
@@ -607,6 +711,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
           e->cy = pKFi->cy;
 
           optimizer.addEdge(e);
+          if (bBatched)
+            workspace.Batch().add(e);
           vpEdgesMono.push_back(e);
           vpEdgeKFMono.push_back(pKFi);
           vpMapPointEdgeMono.push_back(pMP);
@@ -616,7 +722,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
           const float kp_ur = pKFi->mvuRight[mit->second];
           obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
 
-          g2o::EdgeStereoSE3ProjectXYZ *e = new g2o::EdgeStereoSE3ProjectXYZ();
+          g2o::EdgeStereoSE3ProjectXYZ *e =
+              workspace.New<g2o::EdgeStereoSE3ProjectXYZ>();
 
           e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                               optimizer.vertex(id)));
@@ -638,6 +745,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool *pbStopFlag,
           e->bf = pKFi->mbf;
 
           optimizer.addEdge(e);
+          if (bBatched)
+            workspace.Batch().add(e);
           vpEdgesStereo.push_back(e);
           vpEdgeKFStereo.push_back(pKFi);
           vpMapPointEdgeStereo.push_back(pMP);
@@ -770,16 +879,19 @@ void Optimizer::OptimizeEssentialGraph(
     const map<KeyFrame *, set<KeyFrame *>> &LoopConnections,
     const bool &bFixScale) {
   // Setup optimizer
-  g2o::SparseOptimizer optimizer;
-  optimizer.setVerbose(false);
-  g2o::BlockSolver_7_3::LinearSolverType *linearSolver =
-      new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
-  g2o::BlockSolver_7_3 *solver_ptr = new g2o::BlockSolver_7_3(linearSolver);
-  g2o::OptimizationAlgorithmLevenberg *solver =
-      new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-
-  solver->setUserLambdaInit(1e-16);
-  optimizer.setAlgorithm(solver);
+  OptimizerWorkspace::Scope workspace(OptimizerWorkspace::ESSENTIAL_GRAPH);
+  g2o::SparseOptimizer &optimizer = workspace.Optimizer();
+  if (!optimizer.algorithm()) {
+    optimizer.setVerbose(false);
+    g2o::BlockSolver_7_3::LinearSolverType *linearSolver =
+        new g2o::LinearSolverEigen<g2o::BlockSolver_7_3::PoseMatrixType>();
+    g2o::BlockSolver_7_3 *solver_ptr = new g2o::BlockSolver_7_3(linearSolver);
+    g2o::OptimizationAlgorithmLevenberg *solver =
+        new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+
+    solver->setUserLambdaInit(1e-16);
+    optimizer.setAlgorithm(solver);
+  }
 
   const vector<KeyFrame *> vpKFs = pMap->GetAllKeyFrames();
   const vector<MapPoint *> vpMPs = pMap->GetAllMapPoints();
@@ -798,7 +910,7 @@ void Optimizer::OptimizeEssentialGraph(
     KeyFrame *pKF = vpKFs[i];
     if (pKF->isBad())
       continue;
-    g2o::VertexSim3Expmap *VSim3 = new g2o::VertexSim3Expmap();
+    g2o::VertexSim3Expmap *VSim3 = workspace.New<g2o::VertexSim3Expmap>();
 
     const int nIDi = pKF->mnId;
 
@@ -856,7 +968,7 @@ void Optimizer::OptimizeEssentialGraph(
       const g2o::Sim3 Sjw = vScw[nIDj];
       const g2o::Sim3 Sji = Sjw * Swi;
 
-      g2o::EdgeSim3 *e = new g2o::EdgeSim3();
+      g2o::EdgeSim3 *e = workspace.New<g2o::EdgeSim3>();
       e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                           optimizer.vertex(nIDj)));
       e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
@@ -905,7 +1017,7 @@ void Optimizer::OptimizeEssentialGraph(
 
       g2o::Sim3 Sji = Sjw * Swi;
 
-      g2o::EdgeSim3 *e = new g2o::EdgeSim3();
+      g2o::EdgeSim3 *e = workspace.New<g2o::EdgeSim3>();
       e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                           optimizer.vertex(nIDj)));
       e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
@@ -934,7 +1046,7 @@ void Optimizer::OptimizeEssentialGraph(
           Slw = vScw[pLKF->mnId];
 
         g2o::Sim3 Sli = Slw * Swi;
-        g2o::EdgeSim3 *el = new g2o::EdgeSim3();
+        g2o::EdgeSim3 *el = workspace.New<g2o::EdgeSim3>();
         el->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                              optimizer.vertex(pLKF->mnId)));
         el->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
@@ -970,7 +1082,7 @@ void Optimizer::OptimizeEssentialGraph(
 
           g2o::Sim3 Sni = Snw * Swi;
 
-          g2o::EdgeSim3 *en = new g2o::EdgeSim3();
+          g2o::EdgeSim3 *en = workspace.New<g2o::EdgeSim3>();
           en->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                                optimizer.vertex(pKFn->mnId)));
           en->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
@@ -1044,17 +1156,20 @@ void Optimizer::OptimizeEssentialGraph(
 int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
                             vector<MapPoint *> &vpMatches1, g2o::Sim3 &g2oS12,
                             const float th2, const bool bFixScale) {
-  g2o::SparseOptimizer optimizer;
-  g2o::BlockSolverX::LinearSolverType *linearSolver;
+  OptimizerWorkspace::Scope workspace(OptimizerWorkspace::SIM3);
+  g2o::SparseOptimizer &optimizer = workspace.Optimizer();
+  if (!optimizer.algorithm()) {
+    g2o::BlockSolverX::LinearSolverType *linearSolver;
 
-  linearSolver =
-      new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
+    linearSolver =
+        new g2o::LinearSolverDense<g2o::BlockSolverX::PoseMatrixType>();
 
-  g2o::BlockSolverX *solver_ptr = new g2o::BlockSolverX(linearSolver);
+    g2o::BlockSolverX *solver_ptr = new g2o::BlockSolverX(linearSolver);
 
-  g2o::OptimizationAlgorithmLevenberg *solver =
-      new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-  optimizer.setAlgorithm(solver);
+    g2o::OptimizationAlgorithmLevenberg *solver =
+        new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+  }
 
   // Calibration
   const cv::Mat &K1 = pKF1->mK;
@@ -1067,7 +1182,7 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
   const cv::Mat t2w = pKF2->GetTranslation();
 
   // Set Sim3 vertex
-  g2o::VertexSim3Expmap *vSim3 = new g2o::VertexSim3Expmap();
+  g2o::VertexSim3Expmap *vSim3 = workspace.New<g2o::VertexSim3Expmap>();
   vSim3->_fix_scale = bFixScale;
   vSim3->setEstimate(g2oS12);
   vSim3->setId(0);
@@ -1111,7 +1226,8 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
 
     if (pMP1 && pMP2) {
       if (!pMP1->isBad() && !pMP2->isBad() && i2 >= 0) {
-        g2o::VertexSBAPointXYZ *vPoint1 = new g2o::VertexSBAPointXYZ();
+        g2o::VertexSBAPointXYZ *vPoint1 =
+            workspace.New<g2o::VertexSBAPointXYZ>();
         cv::Mat P3D1w = pMP1->GetWorldPos();
         cv::Mat P3D1c = R1w * P3D1w + t1w;
         vPoint1->setEstimate(Converter::toVector3d(P3D1c));
@@ -1119,7 +1235,8 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
         vPoint1->setFixed(true);
         optimizer.addVertex(vPoint1);
 
-        g2o::VertexSBAPointXYZ *vPoint2 = new g2o::VertexSBAPointXYZ();
+        g2o::VertexSBAPointXYZ *vPoint2 =
+            workspace.New<g2o::VertexSBAPointXYZ>();
         cv::Mat P3D2w = pMP2->GetWorldPos();
         cv::Mat P3D2c = R2w * P3D2w + t2w;
         vPoint2->setEstimate(Converter::toVector3d(P3D2c));
@@ -1138,7 +1255,7 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
     const cv::KeyPoint &kpUn1 = pKF1->mvKeysUn[i];
     obs1 << kpUn1.pt.x, kpUn1.pt.y;
 
-    g2o::EdgeSim3ProjectXYZ *e12 = new g2o::EdgeSim3ProjectXYZ();
+    g2o::EdgeSim3ProjectXYZ *e12 = workspace.New<g2o::EdgeSim3ProjectXYZ>();
     e12->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                           optimizer.vertex(id2)));
     e12->setVertex(
@@ -1157,7 +1274,8 @@ int Optimizer::OptimizeSim3(KeyFrame *pKF1, KeyFrame *pKF2,
     const cv::KeyPoint &kpUn2 = pKF2->mvKeysUn[i2];
     obs2 << kpUn2.pt.x, kpUn2.pt.y;
 
-    g2o::EdgeInverseSim3ProjectXYZ *e21 = new g2o::EdgeInverseSim3ProjectXYZ();
+    g2o::EdgeInverseSim3ProjectXYZ *e21 =
+        workspace.New<g2o::EdgeInverseSim3ProjectXYZ>();
 
     e21->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex *>(
                           optimizer.vertex(id1)));
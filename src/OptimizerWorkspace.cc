@@ -0,0 +1,89 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OptimizerWorkspace.h"
+
+#include <memory>
+
+namespace ORB_SLAM2 {
+
+OptimizerWorkspace::Scope::Scope(const eProblem problem) : mbOwned(false) {
+  static thread_local std::unique_ptr<OptimizerWorkspace>
+      workspaces[N_PROBLEMS];
+  if (!workspaces[problem])
+    workspaces[problem].reset(new OptimizerWorkspace());
+  mpWorkspace = workspaces[problem].get();
+
+  // Nested optimizations of the same problem
+  if (mpWorkspace->mbInUse) {
+    mpWorkspace = new OptimizerWorkspace();
+    mbOwned = true;
+  }
+  mpWorkspace->mbInUse = true;
+}
+
+OptimizerWorkspace::Scope::~Scope() {
+  mpWorkspace->Release();
+  if (mbOwned)
+    delete mpWorkspace;
+}
+
+g2o::ReprojectionBatch &OptimizerWorkspace::Scope::Batch() {
+  if (!mpWorkspace->mbBatchAdded) {
+    mpWorkspace->mOptimizer.addEdgeBatch(&mpWorkspace->mBatch);
+    mpWorkspace->mbBatchAdded = true;
+  }
+  return mpWorkspace->mBatch;
+}
+
+OptimizerWorkspace::OptimizerWorkspace()
+    : mbBatchAdded(false), mbInUse(false) {}
+
+OptimizerWorkspace::~OptimizerWorkspace() {
+  for (std::unordered_map<std::type_index, Elements>::iterator
+           it = mFree.begin();
+       it != mFree.end(); it++)
+    for (size_t i = 0; i < it->second.size(); i++)
+      delete it->second[i];
+}
+
+void OptimizerWorkspace::Release() {
+  if (mbBatchAdded) {
+    mOptimizer.removeEdgeBatch(&mBatch);
+    mBatch.clear();
+    mbBatchAdded = false;
+  }
+  mOptimizer.setForceStopFlag(0);
+
+  // Those removed from the graph during the optimization were deleted by it
+  const g2o::HyperGraph::VertexIDMap &vertices = mOptimizer.vertices();
+  for (g2o::HyperGraph::VertexIDMap::const_iterator it = vertices.begin();
+       it != vertices.end(); it++)
+    mFree[std::type_index(typeid(*it->second))].push_back(it->second);
+  const g2o::HyperGraph::EdgeList &edges = mOptimizer.edges();
+  for (g2o::HyperGraph::EdgeList::const_iterator it = edges.begin();
+       it != edges.end(); it++)
+    mFree[std::type_index(typeid(**it))].push_back(*it);
+  mOptimizer.release();
+
+  mbInUse = false;
+}
+
+} // namespace ORB_SLAM2
@@ -0,0 +1,297 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SharedMap.h"
+
+#include "MapSnapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+static const char SHARED_MAGIC[8] = {'O', 'R', 'B', 'S', 'H', 'M', 'A', 'P'};
+static const uint32_t SHARED_VERSION = 1;
+// Descriptor blocks start on a cache line
+static const size_t SHARED_ALIGN = 64;
+
+MappedFile::MappedFile() : mpData(NULL), mnSize(0) {}
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const string &filename) {
+  Close();
+
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  // The mapping stays valid once the descriptor is closed
+  void *pData = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (pData == MAP_FAILED)
+    return false;
+
+  mpData = static_cast<const unsigned char *>(pData);
+  mnSize = fileStat.st_size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (mpData)
+    munmap(const_cast<unsigned char *>(mpData), mnSize);
+  mpData = NULL;
+  mnSize = 0;
+}
+
+SharedMap::SharedMap() : mpHeader(NULL), mpKeyFrames(NULL), mpMapPoints(NULL) {}
+
+bool SharedMap::Open(const string &mapfile, const MapSnapshot *pSnapshot) {
+  const string filename = mapfile + ".shared";
+
+  struct stat mapStat, sharedStat;
+  const bool bBuild = stat(filename.c_str(), &sharedStat) != 0 ||
+                      (stat(mapfile.c_str(), &mapStat) == 0 &&
+                       mapStat.st_mtime > sharedStat.st_mtime);
+
+  if (bBuild) {
+    MapSnapshot snapshot;
+    if (!pSnapshot || pSnapshot->empty()) {
+      if (!snapshot.Load(mapfile))
+        return false;
+      pSnapshot = &snapshot;
+    }
+    if (!Write(*pSnapshot, filename))
+      return false;
+  }
+
+  if (!mFile.Open(filename) || !Validate()) {
+    cerr << "[shared] Cannot map " << filename << endl;
+    mFile.Close();
+    return false;
+  }
+
+  cout << "[shared] " << mpHeader->mnKeyFrames << " keyframes and "
+       << mpHeader->mnMapPoints << " map points shared from " << filename
+       << endl;
+  return true;
+}
+
+bool SharedMap::Validate() {
+  const unsigned char *pData = mFile.data();
+  const size_t nSize = mFile.size();
+  if (nSize < sizeof(Header))
+    return false;
+
+  mpHeader = reinterpret_cast<const Header *>(pData);
+  if (memcmp(mpHeader->mMagic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0 ||
+      mpHeader->mnVersion != SHARED_VERSION)
+    return false;
+
+  const size_t nTables = sizeof(Header) +
+                         mpHeader->mnKeyFrames * sizeof(KeyFrameEntry) +
+                         mpHeader->mnMapPoints * sizeof(MapPointEntry);
+  if (nSize < nTables)
+    return false;
+  mpKeyFrames =
+      reinterpret_cast<const KeyFrameEntry *>(pData + sizeof(Header));
+  mpMapPoints = reinterpret_cast<const MapPointEntry *>(
+      mpKeyFrames + mpHeader->mnKeyFrames);
+
+  // Every block is checked once, Share only compares the ids
+  for (uint64_t i = 0; i < mpHeader->mnKeyFrames; i++) {
+    const KeyFrameEntry &entry = mpKeyFrames[i];
+    if (entry.mnOffset < nTables ||
+        entry.mnOffset + (uint64_t)entry.mnRows * entry.mnCols > nSize)
+      return false;
+  }
+  for (uint64_t i = 0; i < mpHeader->mnMapPoints; i++) {
+    const MapPointEntry &entry = mpMapPoints[i];
+    if (entry.mnOffset < nTables ||
+        entry.mnOffset + mpHeader->mnDescriptorBytes > nSize)
+      return false;
+  }
+
+  return true;
+}
+
+size_t SharedMap::Share(MapSnapshot &snapshot) const {
+  if (!mpHeader)
+    return 0;
+
+  unsigned char *pData = const_cast<unsigned char *>(mFile.data());
+  size_t nShared = 0;
+
+  const KeyFrameEntry *pKFEnd = mpKeyFrames + mpHeader->mnKeyFrames;
+  for (size_t i = 0; i < snapshot.mvKeyFrames.size(); i++) {
+    cv::Mat &descriptors = snapshot.mvKeyFrames[i].mDescriptors;
+    const long unsigned int nId = snapshot.mvKeyFrames[i].mnId;
+    const KeyFrameEntry *pEntry = lower_bound(
+        mpKeyFrames, pKFEnd, nId,
+        [](const KeyFrameEntry &entry, const long unsigned int id) {
+          return entry.mnId < id;
+        });
+    if (pEntry == pKFEnd || pEntry->mnId != nId ||
+        descriptors.type() != CV_8U || !descriptors.isContinuous() ||
+        descriptors.rows != (int)pEntry->mnRows ||
+        descriptors.cols != (int)pEntry->mnCols ||
+        memcmp(descriptors.data, pData + pEntry->mnOffset,
+               descriptors.total()) != 0)
+      continue;
+
+    descriptors = cv::Mat(pEntry->mnRows, pEntry->mnCols, CV_8U,
+                          pData + pEntry->mnOffset);
+    nShared += pEntry->mnRows;
+  }
+
+  const MapPointEntry *pMPEnd = mpMapPoints + mpHeader->mnMapPoints;
+  for (size_t i = 0; i < snapshot.mvMapPoints.size(); i++) {
+    cv::Mat &descriptor = snapshot.mvMapPoints[i].mDescriptor;
+    const long unsigned int nId = snapshot.mvMapPoints[i].mnId;
+    const MapPointEntry *pEntry = lower_bound(
+        mpMapPoints, pMPEnd, nId,
+        [](const MapPointEntry &entry, const long unsigned int id) {
+          return entry.mnId < id;
+        });
+    // The descriptor of a map point changes with its observations
+    if (pEntry == pMPEnd || pEntry->mnId != nId ||
+        descriptor.type() != CV_8U || !descriptor.isContinuous() ||
+        descriptor.total() != mpHeader->mnDescriptorBytes ||
+        memcmp(descriptor.data, pData + pEntry->mnOffset,
+               descriptor.total()) != 0)
+      continue;
+
+    descriptor = cv::Mat(1, mpHeader->mnDescriptorBytes, CV_8U,
+                         pData + pEntry->mnOffset);
+    nShared++;
+  }
+
+  return nShared;
+}
+
+bool SharedMap::Write(const MapSnapshot &snapshot, const string &filename) {
+  Header header;
+  memcpy(header.mMagic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+  header.mnVersion = SHARED_VERSION;
+  header.mnDescriptorBytes = 0;
+
+  // Only binary descriptors, all of the same size
+  vector<pair<long unsigned int, const cv::Mat *>> vKFs, vMPs;
+  for (size_t i = 0; i < snapshot.mvKeyFrames.size(); i++) {
+    const cv::Mat &descriptors = snapshot.mvKeyFrames[i].mDescriptors;
+    if (descriptors.empty() || descriptors.type() != CV_8U)
+      continue;
+    if (header.mnDescriptorBytes == 0)
+      header.mnDescriptorBytes = descriptors.cols;
+    if ((uint32_t)descriptors.cols == header.mnDescriptorBytes)
+      vKFs.push_back(make_pair(snapshot.mvKeyFrames[i].mnId, &descriptors));
+  }
+  for (size_t i = 0; i < snapshot.mvMapPoints.size(); i++) {
+    const cv::Mat &descriptor = snapshot.mvMapPoints[i].mDescriptor;
+    if (descriptor.type() == CV_8U &&
+        descriptor.total() == header.mnDescriptorBytes)
+      vMPs.push_back(make_pair(snapshot.mvMapPoints[i].mnId, &descriptor));
+  }
+  sort(vKFs.begin(), vKFs.end());
+  sort(vMPs.begin(), vMPs.end());
+  header.mnKeyFrames = vKFs.size();
+  header.mnMapPoints = vMPs.size();
+
+  const size_t nTables = sizeof(Header) + vKFs.size() * sizeof(KeyFrameEntry) +
+                         vMPs.size() * sizeof(MapPointEntry);
+  uint64_t nOffset = (nTables + SHARED_ALIGN - 1) / SHARED_ALIGN * SHARED_ALIGN;
+
+  vector<KeyFrameEntry> vKFEntries(vKFs.size());
+  for (size_t i = 0; i < vKFs.size(); i++) {
+    vKFEntries[i].mnId = vKFs[i].first;
+    vKFEntries[i].mnOffset = nOffset;
+    vKFEntries[i].mnRows = vKFs[i].second->rows;
+    vKFEntries[i].mnCols = vKFs[i].second->cols;
+    nOffset += vKFs[i].second->total();
+    nOffset = (nOffset + SHARED_ALIGN - 1) / SHARED_ALIGN * SHARED_ALIGN;
+  }
+  vector<MapPointEntry> vMPEntries(vMPs.size());
+  for (size_t i = 0; i < vMPs.size(); i++) {
+    vMPEntries[i].mnId = vMPs[i].first;
+    vMPEntries[i].mnOffset = nOffset;
+    nOffset += header.mnDescriptorBytes;
+  }
+
+  // Several processes may write it at once, the last rename wins
+  const string tmpfile = filename + ".tmp." + to_string(getpid());
+  ofstream out(tmpfile, ios_base::binary);
+  if (!out) {
+    cerr << "[shared] Cannot write to " << tmpfile << endl;
+    return false;
+  }
+
+  const vector<char> padding(SHARED_ALIGN, 0);
+  uint64_t nWritten = nTables;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(vKFEntries.data()),
+            vKFEntries.size() * sizeof(KeyFrameEntry));
+  out.write(reinterpret_cast<const char *>(vMPEntries.data()),
+            vMPEntries.size() * sizeof(MapPointEntry));
+  for (size_t i = 0; i < vKFs.size(); i++) {
+    out.write(padding.data(), vKFEntries[i].mnOffset - nWritten);
+    const cv::Mat descriptors = vKFs[i].second->isContinuous()
+                                    ? *vKFs[i].second
+                                    : vKFs[i].second->clone();
+    out.write(reinterpret_cast<const char *>(descriptors.data),
+              descriptors.total());
+    nWritten = vKFEntries[i].mnOffset + descriptors.total();
+  }
+  for (size_t i = 0; i < vMPs.size(); i++) {
+    out.write(padding.data(), vMPEntries[i].mnOffset - nWritten);
+    const cv::Mat descriptor = vMPs[i].second->isContinuous()
+                                   ? *vMPs[i].second
+                                   : vMPs[i].second->clone();
+    out.write(reinterpret_cast<const char *>(descriptor.data),
+              descriptor.total());
+    nWritten = vMPEntries[i].mnOffset + descriptor.total();
+  }
+  out.close();
+
+  if (!out || rename(tmpfile.c_str(), filename.c_str()) != 0) {
+    cerr << "[shared] Cannot write " << filename << endl;
+    unlink(tmpfile.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace ORB_SLAM2
@@ -20,8 +20,7 @@
 
 #include "System.h"
 #include "Converter.h"
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
+#include "MapSnapshot.h"
 #include <iomanip>
 #include <pangolin/pangolin.h>
 #include <thread>
@@ -48,8 +47,18 @@ System::System(const string &strVocFile, const string &strSettingsFile,
   cout << endl
        << "[system] Loading ORB Vocabulary. This could take a while..." << endl;
   mpVocabulary = new ORBVocabulary();
+  mpVocabularyFile = static_cast<MappedFile *>(NULL);
   // bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
-  bool bVocLoad = mpVocabulary->loadFromBinFile(strVocFile);
+  bool bVocLoad;
+  if (mbSharedMap) {
+    // The node descriptors stay in the mapped file
+    mpVocabularyFile = new MappedFile();
+    bVocLoad = mpVocabularyFile->Open(strVocFile) &&
+               mpVocabulary->loadFromBinBuffer(mpVocabularyFile->data(),
+                                               mpVocabularyFile->size());
+  } else {
+    bVocLoad = mpVocabulary->loadFromBinFile(strVocFile);
+  }
   if (!bVocLoad) {
     cerr << "[system] Wrong path to vocabulary. " << endl;
     cerr << "[system] Falied to open at: " << strVocFile << endl;
@@ -62,6 +71,11 @@ System::System(const string &strVocFile, const string &strSettingsFile,
 
   // Create the Map
   mpMap = new Map();
+  if (mVoxelSize > 0) {
+    mpMap->mPointIndex.SetVoxelSize(mVoxelSize);
+    cout << "[system] Map points indexed in " << mVoxelSize << "m voxels"
+         << endl;
+  }
 
   // Create Drawers. These are used by the Viewer
   mpFrameDrawer = new FrameDrawer(mpMap);
@@ -72,17 +86,79 @@ System::System(const string &strVocFile, const string &strSettingsFile,
   // constructor)
   mpTracker = new Tracking(this, mpVocabulary, mpFrameDrawer, mpMapDrawer,
                            mpMap, mpKeyFrameDatabase, strSettingsFile, mSensor);
+  if (mVoxelSize > 0)
+    mpTracker->SetSpatialSearch(mSpatialDepth);
+
+  // Live pose log, only a bounded part of the trajectory is kept in memory
+  if (!mTrajectoryFile.empty()) {
+    if (mnTrajectoryHistory > 0)
+      mpTracker->mTrajectory.SetMaxHistory(mnTrajectoryHistory);
+    if (mpTracker->mTrajectory.Open(mTrajectoryFile,
+                                    mbTrajectoryKITTI ? TrajectorySink::KITTI
+                                                      : TrajectorySink::TUM))
+      cout << "[system] Streaming trajectory to " << mTrajectoryFile << endl;
+  }
 
   // Initialize the Local Mapping thread and launch
   mpLocalMapper = new LocalMapping(mpMap, mSensor == MONOCULAR);
+  mpLocalMapper->SetBatchedBA(mbBatchedBA);
   mptLocalMapping = new thread(&ORB_SLAM2::LocalMapping::Run, mpLocalMapper);
 
   // Initialize the Loop Closing thread and launch
   mpLoopCloser = new LoopClosing(mpMap, mpKeyFrameDatabase, mpVocabulary,
                                  mSensor != MONOCULAR);
+  mpLoopCloser->SetQueuePolicy(mnLoopQueueLimit, mLoopMaxLag);
+  if (mVoxelSize > 0)
+    mpLoopCloser->SetSpatialSearch(mSpatialDepth);
   mptLoopClosing = new thread(&ORB_SLAM2::LoopClosing::Run, mpLoopCloser);
 
-  if (mbOnlyRelocalization) {
+  // A paged map is read-only, it is neither journaled nor checkpointed
+  mpMapTiles = static_cast<MapTiles *>(NULL);
+  mpSharedMap = static_cast<SharedMap *>(NULL);
+  const bool bTiles =
+      mbOnlyRelocalization && mTileSize > 0 && !mMapFile.empty();
+
+  // Map journal, the map file is recovered from its last snapshot and the
+  // changes logged since
+  mpJournal = static_cast<MapJournal *>(NULL);
+  if (mbJournal && !mMapFile.empty() && !bTiles) {
+    mpJournal = new MapJournal(mpMap, mMapFile);
+    mpJournal->SetMaxSize((size_t)(mJournalMaxSize * 1024 * 1024));
+  }
+
+  // Initialize the Map Saver thread and launch
+  mpMapSaver = new MapSaver(mpMap, mpLocalMapper);
+  mpMapSaver->SetJournal(mpJournal);
+  if (mCheckpointPeriod > 0 && !mMapFile.empty() && !bTiles) {
+    mpMapSaver->SetCheckpoint(mMapFile, mCheckpointPeriod);
+    cout << "[system] Map checkpoint every " << mCheckpointPeriod
+         << "s to " << mMapFile << endl;
+  }
+  mptMapSaver = new thread(&ORB_SLAM2::MapSaver::Run, mpMapSaver);
+
+  if (bTiles) {
+    std::cout << "[system] page map from : " << mMapFile << std::endl;
+    mpMapTiles =
+        new MapTiles(mpMap, mpKeyFrameDatabase, mpVocabulary, mMapFile);
+    mpMapTiles->SetPaging(mnTileRadius, mTileBudget, mTileLookahead);
+    if (mbSharedMap) {
+      mpSharedMap = new SharedMap();
+      if (mpSharedMap->Open(mMapFile)) {
+        mpMapTiles->SetSharedMap(mpSharedMap);
+      } else {
+        delete mpSharedMap;
+        mpSharedMap = static_cast<SharedMap *>(NULL);
+      }
+    }
+    if (mpMapTiles->Open(mTileSize)) {
+      mptMapTiles = new thread(&ORB_SLAM2::MapTiles::Run, mpMapTiles);
+      mpTracker->SetMapTiles(mpMapTiles);
+      ActivateLocalizationMode();
+    } else {
+      delete mpMapTiles;
+      mpMapTiles = static_cast<MapTiles *>(NULL);
+    }
+  } else if (mbOnlyRelocalization) {
     std::cout << "[system] load map from : " << mMapFile << std::endl;
     if (LoadMap(mMapFile)) {
       ActivateLocalizationMode();
@@ -90,6 +166,15 @@ System::System(const string &strVocFile, const string &strSettingsFile,
     }
   }
 
+  if (mpJournal) {
+    mpJournal->Open();
+    mptJournal = new thread(&ORB_SLAM2::MapJournal::Run, mpJournal);
+    mpLocalMapper->SetJournal(mpJournal);
+    mpLoopCloser->SetJournal(mpJournal);
+    cout << "[system] Journaling map changes to " << mMapFile << ".journal.*"
+         << endl;
+  }
+
   // Initialize the Viewer thread and launch
   if (bUseViewer) {
     mpViewer = new Viewer(this, mpFrameDrawer, mpMapDrawer, mpTracker,
@@ -124,10 +209,57 @@ void System::SetSlamParams(const string &strSettingsFile) {
   if (!mapfilen.empty()) {
     mMapFile = mapfilen.string();
   }
+
+  cv::FileNode trajfilen = fsSettings["Trajectory.StreamFile"];
+  if (!trajfilen.empty()) {
+    mTrajectoryFile = trajfilen.string();
+  }
+  cv::FileNode trajformatn = fsSettings["Trajectory.StreamFormat"];
+  mbTrajectoryKITTI = !trajformatn.empty() && trajformatn.string() == "KITTI";
+  mnTrajectoryHistory = 0;
+  fsSettings["Trajectory.MaxHistory"] >> mnTrajectoryHistory;
+
+  mCheckpointPeriod = 0;
+  fsSettings["map.CheckpointPeriod"] >> mCheckpointPeriod;
+  int nJournal = 0;
+  fsSettings["map.Journal"] >> nJournal;
+  mbJournal = nJournal != 0;
+  mJournalMaxSize = 64;
+  if (!fsSettings["map.JournalMaxSize"].empty())
+    fsSettings["map.JournalMaxSize"] >> mJournalMaxSize;
+  int nShared = 0;
+  fsSettings["map.Shared"] >> nShared;
+  mbSharedMap = nShared != 0;
+
+  mTileSize = 0;
+  mnTileRadius = 1;
+  mTileBudget = 0;
+  mTileLookahead = 2.0;
+  fsSettings["map.TileSize"] >> mTileSize;
+  if (!fsSettings["map.TileRadius"].empty())
+    fsSettings["map.TileRadius"] >> mnTileRadius;
+  fsSettings["map.TileBudget"] >> mTileBudget;
+  if (!fsSettings["map.TileLookahead"].empty())
+    fsSettings["map.TileLookahead"] >> mTileLookahead;
+
+  mVoxelSize = 0;
+  mSpatialDepth = 0;
+  fsSettings["map.VoxelSize"] >> mVoxelSize;
+  fsSettings["map.SpatialDepth"] >> mSpatialDepth;
+
+  mnLoopQueueLimit = 0;
+  mLoopMaxLag = 0;
+  fsSettings["LoopClosing.QueueLimit"] >> mnLoopQueueLimit;
+  fsSettings["LoopClosing.MaxLag"] >> mLoopMaxLag;
+
+  int nBatchedBA = 0;
+  fsSettings["LocalMapping.BatchedBA"] >> nBatchedBA;
+  mbBatchedBA = nBatchedBA != 0;
 }
 
 cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
-                            const double &timestamp) {
+                            const double &timestamp,
+                            const vector<cv::Mat> &vRigImages) {
   if (mSensor != STEREO) {
     cerr << "[system] ERROR: you called TrackStereo but input sensor was not "
             "set to "
@@ -166,7 +298,8 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
     }
   }
 
-  cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft, imRight, timestamp);
+  cv::Mat Tcw =
+      mpTracker->GrabImageStereo(imLeft, imRight, timestamp, vRigImages);
 
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
@@ -176,7 +309,8 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight,
 }
 
 cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap,
-                          const double &timestamp) {
+                          const double &timestamp,
+                          const vector<cv::Mat> &vRigImages) {
   if (mSensor != RGBD) {
     cerr << "[system] ERROR: you called TrackRGBD but input sensor was not set "
             "to RGBD."
@@ -214,7 +348,8 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap,
     }
   }
 
-  cv::Mat Tcw = mpTracker->GrabImageRGBD(im, depthmap, timestamp);
+  cv::Mat Tcw =
+      mpTracker->GrabImageRGBD(im, depthmap, timestamp, vRigImages);
 
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
@@ -223,7 +358,8 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap,
   return Tcw;
 }
 
-cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp) {
+cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp,
+                               const vector<cv::Mat> &vRigImages) {
   if (mSensor != MONOCULAR) {
     cerr << "[system] ERROR: you called TrackMonocular but input sensor was "
             "not set to "
@@ -262,7 +398,7 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp) {
     }
   }
   std::cout << "[system] TrackMonocular" << std::endl;
-  cv::Mat Tcw = mpTracker->GrabImageMonocular(im, timestamp);
+  cv::Mat Tcw = mpTracker->GrabImageMonocular(im, timestamp, vRigImages);
   // std::cout << "[system] Tcw" << Tcw << std::endl;
 
   unique_lock<mutex> lock2(mMutexState);
@@ -279,6 +415,12 @@ void System::ActivateLocalizationMode() {
 }
 
 void System::DeactivateLocalizationMode() {
+  if (mpMapTiles) {
+    cerr << "[system] The map is paged from tiles, staying in localization "
+            "mode"
+         << endl;
+    return;
+  }
   unique_lock<mutex> lock(mMutexMode);
   mbDeactivateLocalizationMode = true;
 }
@@ -313,6 +455,30 @@ void System::Shutdown() {
     usleep(5000);
   }
 
+  // Pending background saves are completed
+  mpMapSaver->RequestFinish();
+  while (!mpMapSaver->isFinished())
+    usleep(5000);
+
+  // Every change is on disk
+  if (mpJournal) {
+    mpJournal->RequestFinish();
+    while (!mpJournal->isFinished())
+      usleep(5000);
+  }
+
+  if (mpMapTiles) {
+    mpMapTiles->RequestFinish();
+    while (!mpMapTiles->isFinished())
+      usleep(5000);
+  }
+
+  const LoopQueueStats loopStats = mpLoopCloser->GetQueueStats();
+  cout << "[system] Loop closing: " << loopStats.mnProcessed
+       << " keyframes processed, " << loopStats.mnCoalesced << " coalesced, "
+       << loopStats.mnStale << " stale, max queue " << loopStats.mnMaxQueued
+       << ", max lag " << loopStats.mMaxLag << " s" << endl;
+
   //   if (mpViewer) {
   //     pangolin::BindToContext("ORB-SLAM2: Map Viewer");
   //   }
@@ -327,58 +493,13 @@ void System::SaveTrajectoryTUM(const string &filename) {
     return;
   }
 
-  vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
-  sort(vpKFs.begin(), vpKFs.end(), KeyFrame::lId);
-
-  // Transform all keyframes so that the first keyframe is at the origin.
-  // After a loop closure the first keyframe might not be at the origin.
-  cv::Mat Two = vpKFs[0]->GetPoseInverse();
-
-  ofstream f;
-  f.open(filename.c_str());
-  f << fixed;
-
   // Frame pose is stored relative to its reference keyframe (which is optimized
-  // by BA and pose graph). We need to get first the keyframe pose and then
-  // concatenate the relative transformation. Frames not localized (tracking
-  // failure) are not saved.
-
-  // For each frame we have a reference keyframe (lRit), the timestamp (lT) and
-  // a flag which is true when tracking failed (lbL).
-  list<ORB_SLAM2::KeyFrame *>::iterator lRit = mpTracker->mlpReferences.begin();
-  list<double>::iterator lT = mpTracker->mlFrameTimes.begin();
-  list<bool>::iterator lbL = mpTracker->mlbLost.begin();
-  for (list<cv::Mat>::iterator lit = mpTracker->mlRelativeFramePoses.begin(),
-                               lend = mpTracker->mlRelativeFramePoses.end();
-       lit != lend; lit++, lRit++, lT++, lbL++) {
-    if (*lbL)
-      continue;
-
-    KeyFrame *pKF = *lRit;
-
-    cv::Mat Trw = cv::Mat::eye(4, 4, CV_32F);
-
-    // If the reference keyframe was culled, traverse the spanning tree to get a
-    // suitable keyframe.
-    while (pKF->isBad()) {
-      Trw = Trw * pKF->mTcp;
-      pKF = pKF->GetParent();
-    }
-
-    Trw = Trw * pKF->GetPose() * Two;
-
-    cv::Mat Tcw = (*lit) * Trw;
-    cv::Mat Rwc = Tcw.rowRange(0, 3).colRange(0, 3).t();
-    cv::Mat twc = -Rwc * Tcw.rowRange(0, 3).col(3);
-
-    vector<float> q = Converter::toQuaternion(Rwc);
-
-    f << setprecision(6) << *lT << " " << setprecision(9) << twc.at<float>(0)
-      << " " << twc.at<float>(1) << " " << twc.at<float>(2) << " " << q[0]
-      << " " << q[1] << " " << q[2] << " " << q[3] << endl;
-  }
-  f.close();
-  cout << endl << "[system] trajectory saved!" << endl;
+  // by BA and pose graph). Frames not localized (tracking failure) are not
+  // saved.
+  if (mpTracker->mTrajectory.Save(filename, TrajectorySink::TUM))
+    cout << endl << "[system] trajectory saved!" << endl;
+  else
+    cout << endl << "[system] partial trajectory saved!" << endl;
 }
 
 void System::SaveKeyFrameTrajectoryTUM(const string &filename) {
@@ -424,71 +545,62 @@ void System::SaveTrajectoryKITTI(const string &filename) {
     return;
   }
 
-  vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
-  sort(vpKFs.begin(), vpKFs.end(), KeyFrame::lId);
+  if (mpTracker->mTrajectory.Save(filename, TrajectorySink::KITTI))
+    cout << endl << "trajectory saved!" << endl;
+  else
+    cout << endl << "partial trajectory saved!" << endl;
+}
 
-  // Transform all keyframes so that the first keyframe is at the origin.
-  // After a loop closure the first keyframe might not be at the origin.
-  cv::Mat Two = vpKFs[0]->GetPoseInverse();
+void System::SetTrajectoryCallback(
+    const TrajectorySink::PoseCallback &callback) {
+  mpTracker->mTrajectory.SetCallback(callback);
+}
 
-  ofstream f;
-  f.open(filename.c_str());
-  f << fixed;
+void System::SaveMap(const string &filename) {
+  if (mpMapTiles) {
+    cerr << "[system] Only part of a paged map is in memory, not saved"
+         << std::endl;
+    return;
+  }
+  if (!mpMapSaver->Save(filename))
+    cerr << "[system] Cannot Write to Mapfile: " << filename << std::endl;
+}
 
-  // Frame pose is stored relative to its reference keyframe (which is optimized
-  // by BA and pose graph). We need to get first the keyframe pose and then
-  // concatenate the relative transformation. Frames not localized (tracking
-  // failure) are not saved.
-
-  // For each frame we have a reference keyframe (lRit), the timestamp (lT) and
-  // a flag which is true when tracking failed (lbL).
-  list<ORB_SLAM2::KeyFrame *>::iterator lRit = mpTracker->mlpReferences.begin();
-  list<double>::iterator lT = mpTracker->mlFrameTimes.begin();
-  for (list<cv::Mat>::iterator lit = mpTracker->mlRelativeFramePoses.begin(),
-                               lend = mpTracker->mlRelativeFramePoses.end();
-       lit != lend; lit++, lRit++, lT++) {
-    ORB_SLAM2::KeyFrame *pKF = *lRit;
-
-    cv::Mat Trw = cv::Mat::eye(4, 4, CV_32F);
-
-    while (pKF->isBad()) {
-      //  cout << "bad parent" << endl;
-      Trw = Trw * pKF->mTcp;
-      pKF = pKF->GetParent();
-    }
+void System::SaveMapInBackground(const string &filename) {
+  if (mpMapTiles) {
+    cerr << "[system] Only part of a paged map is in memory, not saved"
+         << std::endl;
+    return;
+  }
+  mpMapSaver->RequestSave(filename);
+}
 
-    Trw = Trw * pKF->GetPose() * Two;
+CompactionReport System::CompactMap(const long unsigned int nMaxKeyFrames,
+                                    const long unsigned int nMaxMapPoints) {
+  CompactionReport report = CompactionReport();
+  if (mpMapTiles) {
+    cerr << "[system] Only part of a paged map is in memory, not compacted"
+         << std::endl;
+    return report;
+  }
 
-    cv::Mat Tcw = (*lit) * Trw;
-    cv::Mat Rwc = Tcw.rowRange(0, 3).colRange(0, 3).t();
-    cv::Mat twc = -Rwc * Tcw.rowRange(0, 3).col(3);
+  mpLocalMapper->RequestStop();
+  while (!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+    usleep(1000);
 
-    f << setprecision(9) << Rwc.at<float>(0, 0) << " " << Rwc.at<float>(0, 1)
-      << " " << Rwc.at<float>(0, 2) << " " << twc.at<float>(0) << " "
-      << Rwc.at<float>(1, 0) << " " << Rwc.at<float>(1, 1) << " "
-      << Rwc.at<float>(1, 2) << " " << twc.at<float>(1) << " "
-      << Rwc.at<float>(2, 0) << " " << Rwc.at<float>(2, 1) << " "
-      << Rwc.at<float>(2, 2) << " " << twc.at<float>(2) << endl;
+  {
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    MapCompactor compactor(mpMap, mSensor == MONOCULAR);
+    report = compactor.Compact(nMaxKeyFrames, nMaxMapPoints);
+
+    // The observations of every remaining map point may have changed
+    if (mpJournal)
+      mpJournal->LogMapCorrection(mpMap->GetAllKeyFrames());
+    mpMap->InformNewBigChange();
   }
-  f.close();
-  cout << endl << "trajectory saved!" << endl;
-}
 
-void System::SaveMap(const string &filename) {
-  std::ofstream out(filename, std::ios_base::binary);
-  if (!out) {
-    cerr << "[system] Cannot Write to Mapfile: " << mMapFile << std::endl;
-    exit(-1);
-  }
-  std::cout << "[system] Saving Mapfile: " << mMapFile << std::flush;
-  boost::archive::binary_oarchive oa(out, boost::archive::no_header);
-  std::vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
-  std::vector<MapPoint *> vMapPoints = mpMap->GetAllMapPoints();
-  sort(vpKFs.begin(), vpKFs.end(), KeyFrame::lId);
-  oa << vpKFs;
-  oa << vMapPoints;
-  std::cout << "[system] mapfile saved successfully!" << std::endl;
-  out.close();
+  mpLocalMapper->Release();
+  return report;
 }
 
 bool System::LoadMap(const string &filename) {
@@ -496,39 +608,38 @@ bool System::LoadMap(const string &filename) {
     std::cout << "[system] Mapfile is empty" << std::endl;
     return false;
   }
-  std::ifstream in(filename, std::ios_base::binary);
-  if (!in) {
-    cerr << "[system] Cannot Open Mapfile: " << mMapFile << ", Create a new one"
+  MapSnapshot snapshot;
+  const bool bLoaded = snapshot.Load(filename);
+  // Changes logged after the snapshot (all of them if it was never written)
+  const bool bReplayed = mpJournal && filename == mpJournal->GetMapFile() &&
+                         mpJournal->Replay(snapshot);
+  if (!bLoaded && !bReplayed) {
+    cerr << "[system] Cannot Open Mapfile: " << filename << ", Create a new one"
          << std::endl;
     return false;
   }
-  std::vector<KeyFrame *> vpKFs;
-  std::vector<MapPoint *> vMapPoints;
-  boost::archive::binary_iarchive ia(in, boost::archive::no_header);
-  ia >> vpKFs;
-  ia >> vMapPoints;
   std::cout << "[system] Mapfile loaded successfully from " << filename
             << std::endl;
-  std::cout << "[system] Map Reconstructing" << flush;
-  const size_t total_size = vpKFs.size();
-  std::atomic_size_t count = 0;
-  std::atomic_bool is_finished = false;
-  std::thread load_keyframe(&System::LoadKeyFrames, this, vpKFs, mpMap, &count,
-                            &is_finished);
-  while (!is_finished) {
-    usleep(30000);
-  }
-  load_keyframe.join();
-  std::cout << "[system] Insert KeyFrame Current/Total: " << (count - 1) << "/"
-            << total_size << " , Done !" << std::endl;
-
-  std::thread load_map_point_thread(&System::LoadMapPoints, this, vMapPoints,
-                                    mpMap);
-  for (size_t i = 0; i < vpKFs.size(); i++) {
-    vpKFs[i]->UpdateConnections();
+  // Broken references are dropped by Restore
+  if (!snapshot.CheckConsistency())
+    cerr << "[system] Mapfile " << filename << " is inconsistent" << std::endl;
+  // Read-only localization processes of the same map share its descriptors
+  if (mbSharedMap && mbOnlyRelocalization && filename == mMapFile) {
+    if (!mpSharedMap) {
+      mpSharedMap = new SharedMap();
+      if (!mpSharedMap->Open(filename, &snapshot)) {
+        delete mpSharedMap;
+        mpSharedMap = static_cast<SharedMap *>(NULL);
+      }
+    }
+    if (mpSharedMap)
+      std::cout << "[system] " << mpSharedMap->Share(snapshot)
+                << " descriptors shared" << std::endl;
   }
-  load_map_point_thread.join();
-  in.close();
+  std::cout << "[system] Map Reconstructing" << std::endl;
+  snapshot.Restore(mpMap, mpKeyFrameDatabase, mpVocabulary);
+  std::cout << "[system] KeyFrames: " << mpMap->KeyFramesInMap()
+            << ", MapPoints: " << mpMap->MapPointsInMap() << std::endl;
   return true;
 }
 
@@ -547,57 +658,8 @@ vector<cv::KeyPoint> System::GetTrackedKeyPointsUn() {
   return mTrackedKeyPointsUn;
 }
 
-void System::LoadMapPoints(const std::vector<MapPoint *> &saved_map_points,
-                           Map *pMap) {
-  for (size_t i = 0; i < saved_map_points.size(); i++) {
-    saved_map_points[i]->ComputeDistinctiveDescriptors();
-    saved_map_points[i]->UpdateNormalAndDepth();
-    pMap->AddMapPoint(saved_map_points[i]);
-  }
-  const auto &points = pMap->GetAllMapPoints();
-  std::cout << "[system] Load Map Points size : " << points.size() << std::endl;
-}
-
-void System::LoadKeyFrames(const std::vector<KeyFrame *> &vpKFs, Map *pMap,
-                           std::atomic_size_t *const pCount,
-                           std::atomic_bool *const p_is_finished) {
-  for (auto &pKF : vpKFs) {
-    if (pKF == nullptr || pKF->isBad()) {
-      continue;
-    }
-    AddKeyFrame(pKF, pMap);
-    pCount->fetch_add(1);
-  }
-  *p_is_finished = true;
-}
-
-void System::AddKeyFrame(KeyFrame *keyframe, Map *pMap) {
-  // Frame frame(cv::Size((int)mWidth, (int)mHeight), keyframe->GetPose(),
-  //             keyframe->mvKeys, keyframe->mvKeysUn, keyframe->mDescriptors,
-  //             keyframe->_globaldescriptors, keyframe->mTimeStamp,
-  //             mpVocabulary, mk, mbf);
-
-  // KeyFrame *pKF = KeyFrame::CreateNewKeyFrame(frame, pMap,
-  // mpKeyFrameDatabase); pKF->SetPose(keyframe->GetPose());
-  // std::vector<cv::Mat> vDesc =
-  // Converter::toDescriptorVector(pKF->mDescriptors);
-  // mpVocabulary->transform(pKF->mDescriptors, 4, pKF->mBowVec, pKF->mFeatVec);
-
-  pMap->AddKeyFrame(keyframe);
-  mpKeyFrameDatabase->add(keyframe);
-  std::vector<MapPoint *> vpMaps = keyframe->GetMapPointMatches();
-
-  for (unsigned i = 0; i < vpMaps.size(); i++) {
-    MapPoint *pMP = vpMaps[i];
-    if (pMP == nullptr || pMP->isBad()) {
-      std::cout << "nullptr/bad map point detected while adding a keyframe!"
-                << std::endl;
-      continue;
-    }
-    pMP->AddObservation(keyframe, i);
-    keyframe->AddMapPoint(pMP, i);
-    pMap->AddMapPoint(pMP);
-  }
+LoopQueueStats System::GetLoopQueueStats() {
+  return mpLoopCloser->GetQueueStats();
 }
 
 } // namespace ORB_SLAM2
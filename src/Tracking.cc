@@ -27,11 +27,13 @@
 #include "FrameDrawer.h"
 #include "Initializer.h"
 #include "Map.h"
+#include "MapTiles.h"
 #include "ORBmatcher.h"
 
 #include "Optimizer.h"
 #include "PnPsolver.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <mutex>
@@ -43,11 +45,18 @@ namespace ORB_SLAM2 {
 Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
                    MapDrawer *pMapDrawer, Map *pMap, KeyFrameDatabase *pKFDB,
                    const string &strSettingPath, const int sensor)
-    : mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false),
-      mbVO(false), mpORBVocabulary(pVoc), mpKeyFrameDB(pKFDB),
+    : mState(NO_IMAGES_YET), mSensor(sensor), mTrajectory(pMap),
+      mbOnlyTracking(false), mbVO(false),
+      mpMapTiles(static_cast<MapTiles *>(NULL)), mfSpatialDepth(0),
+      mpORBVocabulary(pVoc),
+      mpKeyFrameDB(pKFDB),
       mpInitializer(static_cast<Initializer *>(NULL)), mpSystem(pSys),
       mpViewer(NULL), mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer),
-      mpMap(pMap), mnLastRelocFrameId(0) {
+      mpMap(pMap), mbRigMismatchReported(false), mnLastRelocFrameId(0) {
+  // The tracking runs in the thread that feeds the images
+  mnReclaimSlot = mpMap->mReclaimer.RegisterThread();
+  mnLastReclaimEpoch = mpMap->mReclaimer.GetEpoch();
+
   // Load camera parameters from settings file
 
   cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
@@ -132,6 +141,50 @@ Tracking::Tracking(System *pSys, ORBVocabulary *pVoc, FrameDrawer *pFrameDrawer,
   cout << "- Initial Fast Threshold: " << fIniThFAST << endl;
   cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
 
+  // Other cameras of the rig: Rig.CameraN.fx, ..., Rig.CameraN.k3 and the pose
+  // of the camera in the main camera Rig.CameraN.Tbc, for N from 1 to
+  // Rig.nCameras
+  int nRigCameras = 0;
+  fSettings["Rig.nCameras"] >> nRigCameras;
+  for (int i = 1; i <= nRigCameras; i++) {
+    const string prefix = "Rig.Camera" + to_string(i) + ".";
+
+    cv::Mat Tbc;
+    fSettings[prefix + "Tbc"] >> Tbc;
+    if (Tbc.rows != 4 || Tbc.cols != 4) {
+      cerr << "Rig camera " << i << " has no pose " << prefix << "Tbc" << endl;
+      continue;
+    }
+    Tbc.convertTo(Tbc, CV_32F);
+
+    RigCamera camera;
+    camera.K = cv::Mat::eye(3, 3, CV_32F);
+    camera.K.at<float>(0, 0) = fSettings[prefix + "fx"];
+    camera.K.at<float>(1, 1) = fSettings[prefix + "fy"];
+    camera.K.at<float>(0, 2) = fSettings[prefix + "cx"];
+    camera.K.at<float>(1, 2) = fSettings[prefix + "cy"];
+
+    camera.DistCoef = cv::Mat(4, 1, CV_32F);
+    camera.DistCoef.at<float>(0) = fSettings[prefix + "k1"];
+    camera.DistCoef.at<float>(1) = fSettings[prefix + "k2"];
+    camera.DistCoef.at<float>(2) = fSettings[prefix + "p1"];
+    camera.DistCoef.at<float>(3) = fSettings[prefix + "p2"];
+    const float rigk3 = fSettings[prefix + "k3"];
+    if (rigk3 != 0) {
+      camera.DistCoef.resize(5);
+      camera.DistCoef.at<float>(4) = rigk3;
+    }
+
+    camera.Tcb = Tbc.inv();
+    // Each camera extracts its features in its own thread
+    camera.pORBextractor = new ORBextractor(nFeatures, fScaleFactor, nLevels,
+                                            fIniThFAST, fMinThFAST);
+    mvRigCameras.push_back(camera);
+    mvRigTcb.push_back(camera.Tcb);
+  }
+  if (!mvRigCameras.empty())
+    cout << "- Rig cameras: " << mvRigCameras.size() << endl;
+
   if (sensor == System::STEREO || sensor == System::RGBD) {
     mThDepth = mbf * (float)fSettings["ThDepth"] / fx;
     cout << endl << "Depth Threshold (Close/Far Points): " << mThDepth << endl;
@@ -156,9 +209,14 @@ void Tracking::SetLoopClosing(LoopClosing *pLoopClosing) {
 
 void Tracking::SetViewer(Viewer *pViewer) { mpViewer = pViewer; }
 
+void Tracking::SetMapTiles(MapTiles *pMapTiles) { mpMapTiles = pMapTiles; }
+
+void Tracking::SetSpatialSearch(const float depth) { mfSpatialDepth = depth; }
+
 cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft,
                                   const cv::Mat &imRectRight,
-                                  const double &timestamp) {
+                                  const double &timestamp,
+                                  const vector<cv::Mat> &vRigImages) {
   mImGray = imRectLeft;
   cv::Mat imGrayRight = imRectRight;
 
@@ -180,17 +238,24 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft,
     }
   }
 
-  mCurrentFrame =
-      Frame(mImGray, imGrayRight, timestamp, mpORBextractorLeft,
-            mpORBextractorRight, mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+  {
+    RigExtractionGuard rigGuard(this);
+    StartRigExtraction(vRigImages, timestamp);
+    mCurrentFrame = Frame(mImGray, imGrayRight, timestamp, mpORBextractorLeft,
+                          mpORBextractorRight, mpORBVocabulary, mK, mDistCoef,
+                          mbf, mThDepth);
+  }
 
   Track();
 
+  ReleaseRetired();
+
   return mCurrentFrame.mTcw.clone();
 }
 
 cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, const cv::Mat &imD,
-                                const double &timestamp) {
+                                const double &timestamp,
+                                const vector<cv::Mat> &vRigImages) {
   mImGray = imRGB;
   cv::Mat imDepth = imD;
 
@@ -209,16 +274,23 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB, const cv::Mat &imD,
   if ((fabs(mDepthMapFactor - 1.0f) > 1e-5) || imDepth.type() != CV_32F)
     imDepth.convertTo(imDepth, CV_32F, mDepthMapFactor);
 
-  mCurrentFrame = Frame(mImGray, imDepth, timestamp, mpORBextractorLeft,
-                        mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+  {
+    RigExtractionGuard rigGuard(this);
+    StartRigExtraction(vRigImages, timestamp);
+    mCurrentFrame = Frame(mImGray, imDepth, timestamp, mpORBextractorLeft,
+                          mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+  }
 
   Track();
 
+  ReleaseRetired();
+
   return mCurrentFrame.mTcw.clone();
 }
 
 cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im,
-                                     const double &timestamp) {
+                                     const double &timestamp,
+                                     const vector<cv::Mat> &vRigImages) {
   mImGray = im;
 
   if (mImGray.channels() == 3) {
@@ -233,18 +305,98 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im,
       cvtColor(mImGray, mImGray, CV_BGRA2GRAY);
   }
 
-  if (mState == NOT_INITIALIZED || mState == NO_IMAGES_YET)
-    mCurrentFrame = Frame(mImGray, timestamp, mpIniORBextractor,
-                          mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
-  else
-    mCurrentFrame = Frame(mImGray, timestamp, mpORBextractorLeft,
-                          mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+  {
+    RigExtractionGuard rigGuard(this);
+    StartRigExtraction(vRigImages, timestamp);
+    if (mState == NOT_INITIALIZED || mState == NO_IMAGES_YET)
+      mCurrentFrame = Frame(mImGray, timestamp, mpIniORBextractor,
+                            mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+    else
+      mCurrentFrame = Frame(mImGray, timestamp, mpORBextractorLeft,
+                            mpORBVocabulary, mK, mDistCoef, mbf, mThDepth);
+  }
 
   Track();
 
+  ReleaseRetired();
+
   return mCurrentFrame.mTcw.clone();
 }
 
+void Tracking::StartRigExtraction(const vector<cv::Mat> &vRigImages,
+                                  const double &timestamp) {
+  mvRigFrames.clear();
+  if (mvRigCameras.empty())
+    return;
+  // Such frames are tracked with the main camera only, reported once
+  if (vRigImages.size() != mvRigCameras.size()) {
+    if (!mbRigMismatchReported)
+      cerr << "Expected " << mvRigCameras.size() << " rig images, got "
+           << vRigImages.size()
+           << ", frames with another count are tracked without the rig"
+           << endl;
+    mbRigMismatchReported = true;
+    return;
+  }
+
+  // The current frame, built next by this thread, takes the next frame id
+  mvRigFrames.resize(mvRigCameras.size());
+  for (size_t i = 0; i < mvRigCameras.size(); i++)
+    mvRigThreads.push_back(thread(&Tracking::ExtractRigFrame, this, i,
+                                  vRigImages[i], timestamp, Frame::nNextId));
+}
+
+void Tracking::ExtractRigFrame(const size_t i, const cv::Mat &im,
+                               const double timestamp,
+                               const long unsigned int nId) {
+  cv::Mat imGray = im;
+  if (imGray.channels() == 3)
+    cvtColor(imGray, imGray, mbRGB ? CV_RGB2GRAY : CV_BGR2GRAY);
+  else if (imGray.channels() == 4)
+    cvtColor(imGray, imGray, mbRGB ? CV_RGBA2GRAY : CV_BGRA2GRAY);
+
+  RigCamera &camera = mvRigCameras[i];
+  mvRigFrames[i] = Frame(imGray, timestamp, camera.pORBextractor, camera.K,
+                         camera.DistCoef, nId);
+}
+
+void Tracking::FinishRigExtraction() {
+  for (size_t i = 0; i < mvRigThreads.size(); i++)
+    mvRigThreads[i].join();
+  mvRigThreads.clear();
+}
+
+void Tracking::SearchRigPoints() {
+  ORBmatcher matcher(0.8);
+  int th = 1;
+  // If the camera has been relocalised recently, perform a coarser search
+  if (mCurrentFrame.mnId < mnLastRelocFrameId + 2)
+    th = 5;
+
+  for (size_t i = 0; i < mvRigFrames.size(); i++) {
+    Frame &rigFrame = mvRigFrames[i];
+    if (rigFrame.N == 0)
+      continue;
+    rigFrame.SetPose(mvRigTcb[i] * mCurrentFrame.mTcw);
+
+    // Project points in the rig camera (this overwrites the MapPoint
+    // variables filled for the current frame, which are no longer used)
+    int nToMatch = 0;
+    for (vector<MapPoint *>::iterator vit = mvpLocalMapPoints.begin(),
+                                      vend = mvpLocalMapPoints.end();
+         vit != vend; vit++) {
+      MapPoint *pMP = *vit;
+      if (pMP->isBad())
+        continue;
+      if (rigFrame.isInFrustum(pMP, 0.5))
+        nToMatch++;
+    }
+
+    if (nToMatch > 0)
+      matcher.SearchByProjection(rigFrame, mvpLocalMapPoints, th);
+  }
+}
+
 void Tracking::Track() {
   std::cout << "[tracking] start track " << std::endl;
   if (mState == NO_IMAGES_YET) {
@@ -295,6 +447,9 @@ void Tracking::Track() {
 
       if (mState == LOST) {
         bOK = Relocalization();
+        // The keyframes of the tiles in memory are not enough
+        if (!bOK && mpMapTiles)
+          mpMapTiles->RequestRelocalization(mCurrentFrame.mBowVec);
       } else {
         if (!mbVO) {
           // In last frame we tracked enough MapPoints in the map
@@ -384,6 +539,11 @@ void Tracking::Track() {
 
       mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.mTcw);
 
+      // Tiles are paged in around the camera
+      if (mpMapTiles && mbOnlyTracking)
+        mpMapTiles->SetCameraCenter(mCurrentFrame.GetCameraCenter(),
+                                    mCurrentFrame.mTimeStamp);
+
       // Clean VO matches
       for (int i = 0; i < mCurrentFrame.N; i++) {
         MapPoint *pMP = mCurrentFrame.mvpMapPoints[i];
@@ -420,7 +580,8 @@ void Tracking::Track() {
 
     // Reset if the camera get lost soon after initialization
     if (mState == LOST) {
-      if (mpMap->KeyFramesInMap() <= 5) {
+      // A paged map may hold few keyframes while the camera is lost
+      if (mpMap->KeyFramesInMap() <= 5 && !mpMapTiles) {
         cout << "[tracking] Track lost soon after initialisation, reseting..."
              << endl;
         mpSystem->Reset();
@@ -439,17 +600,16 @@ void Tracking::Track() {
   if (!mCurrentFrame.mTcw.empty()) {
     cv::Mat Tcr =
         mCurrentFrame.mTcw * mCurrentFrame.mpReferenceKF->GetPoseInverse();
-    mlRelativeFramePoses.push_back(Tcr);
-    mlpReferences.push_back(mpReferenceKF);
-    mlFrameTimes.push_back(mCurrentFrame.mTimeStamp);
-    mlbLost.push_back(mState == LOST);
+    mTrajectory.Add(Tcr, mpReferenceKF, mCurrentFrame.mTimeStamp,
+                    mState == LOST);
   } else {
     // This can happen if tracking is lost
-    mlRelativeFramePoses.push_back(mlRelativeFramePoses.back());
-    mlpReferences.push_back(mlpReferences.back());
-    mlFrameTimes.push_back(mlFrameTimes.back());
-    mlbLost.push_back(mState == LOST);
+    mTrajectory.RepeatLast(mState == LOST);
   }
+
+  // Stream the frames that Local BA will not refine anymore
+  if (mpLastKeyFrame)
+    mTrajectory.Flush(mpLastKeyFrame->mnId);
 }
 
 void Tracking::StereoInitialization() {
@@ -680,6 +840,86 @@ void Tracking::CheckReplacedInLastFrame() {
   }
 }
 
+void Tracking::ReleaseRetired() {
+  EpochReclaimer &reclaimer = mpMap->mReclaimer;
+
+  // Read the epoch before dropping the references, anything retired meanwhile
+  // waits for the next quiescent state
+  const unsigned long nEpoch = reclaimer.GetEpoch();
+
+  if (nEpoch != mnLastReclaimEpoch && (mState == OK || mState == LOST)) {
+    // Follow replaced MapPoints as CheckReplacedInLastFrame() would do
+    for (int i = 0; i < mLastFrame.N; i++) {
+      MapPoint *pMP = mLastFrame.mvpMapPoints[i];
+      while (pMP && pMP->isBad())
+        pMP = pMP->GetReplaced();
+      mLastFrame.mvpMapPoints[i] = pMP;
+    }
+
+    for (int i = 0; i < mCurrentFrame.N; i++) {
+      MapPoint *pMP = mCurrentFrame.mvpMapPoints[i];
+      if (pMP && pMP->isBad())
+        mCurrentFrame.mvpMapPoints[i] = static_cast<MapPoint *>(NULL);
+    }
+
+    vector<MapPoint *> vpLocalMapPoints;
+    vpLocalMapPoints.reserve(mvpLocalMapPoints.size());
+    for (size_t i = 0; i < mvpLocalMapPoints.size(); i++)
+      if (!mvpLocalMapPoints[i]->isBad())
+        vpLocalMapPoints.push_back(mvpLocalMapPoints[i]);
+    mvpLocalMapPoints.swap(vpLocalMapPoints);
+    mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
+
+    vector<KeyFrame *> vpLocalKeyFrames;
+    vpLocalKeyFrames.reserve(mvpLocalKeyFrames.size());
+    for (size_t i = 0; i < mvpLocalKeyFrames.size(); i++)
+      if (!mvpLocalKeyFrames[i]->isBad())
+        vpLocalKeyFrames.push_back(mvpLocalKeyFrames[i]);
+    mvpLocalKeyFrames.swap(vpLocalKeyFrames);
+
+    // The last keyframe might still wait in the Local Mapping queue with
+    // matches that went bad before it was processed
+    if (mpLastKeyFrame && !mpLastKeyFrame->isBad()) {
+      const vector<MapPoint *> vpMPs = mpLastKeyFrame->GetMapPointMatches();
+      for (size_t i = 0; i < vpMPs.size(); i++)
+        if (vpMPs[i] && vpMPs[i]->isBad())
+          mpLastKeyFrame->EraseMapPointMatch(i);
+    }
+  }
+
+  reclaimer.Quiescent(mnReclaimSlot, nEpoch);
+  mnLastReclaimEpoch = nEpoch;
+
+  // KeyFrames are deleted here because the trajectory references them
+  vector<KeyFrame *> vpKFs;
+  reclaimer.CollectKeyFrames(vpKFs);
+  if (vpKFs.empty())
+    return;
+
+  // Keep the retirement order so that the parent of a culled keyframe is
+  // never deleted before it
+  size_t nFree = 0;
+  for (; nFree < vpKFs.size(); nFree++) {
+    KeyFrame *pKF = vpKFs[nFree];
+    if (pKF == mpReferenceKF || pKF == mpLastKeyFrame ||
+        pKF == mCurrentFrame.mpReferenceKF || pKF == mLastFrame.mpReferenceKF)
+      break;
+  }
+  if (nFree < vpKFs.size())
+    reclaimer.DeferKeyFrames(
+        vector<KeyFrame *>(vpKFs.begin() + nFree, vpKFs.end()));
+  vpKFs.resize(nFree);
+  if (vpKFs.empty())
+    return;
+
+  // Move the frames referenced to a deleted keyframe to its parent in the
+  // spanning tree, as done when the trajectory is saved
+  mTrajectory.ReplaceReferences(set<KeyFrame *>(vpKFs.begin(), vpKFs.end()));
+
+  for (size_t i = 0; i < vpKFs.size(); i++)
+    delete vpKFs[i];
+}
+
 bool Tracking::TrackReferenceKeyFrame() {
   // Compute Bag of Words vector
   mCurrentFrame.ComputeBoW();
@@ -723,7 +963,9 @@ bool Tracking::TrackReferenceKeyFrame() {
 void Tracking::UpdateLastFrame() {
   // Update pose according to reference keyframe
   KeyFrame *pRef = mLastFrame.mpReferenceKF;
-  cv::Mat Tlr = mlRelativeFramePoses.back();
+  cv::Mat Tlr = mTrajectory.LastRelativePose();
+  if (Tlr.empty())
+    return;
 
   mLastFrame.SetPose(Tlr * pRef->GetPose());
 
@@ -848,8 +1090,13 @@ bool Tracking::TrackLocalMap() {
 
   SearchLocalPoints();
 
-  // Optimize Pose
-  Optimizer::PoseOptimization(&mCurrentFrame);
+  // Optimize Pose, with the observations of the other cameras of the rig
+  if (mvRigFrames.empty()) {
+    Optimizer::PoseOptimization(&mCurrentFrame);
+  } else {
+    SearchRigPoints();
+    Optimizer::PoseOptimization(&mCurrentFrame, mvRigFrames, mvRigTcb);
+  }
   mnMatchesInliers = 0;
 
   // Update MapPoints Statistics
@@ -867,13 +1114,23 @@ bool Tracking::TrackLocalMap() {
     }
   }
 
+  // The rig inliers only count for the tracking decision, keyframes are
+  // inserted by the ratio of main camera inliers
+  int nRigInliers = 0;
+  for (size_t c = 0; c < mvRigFrames.size(); c++) {
+    const Frame &rigFrame = mvRigFrames[c];
+    for (int i = 0; i < rigFrame.N; i++)
+      if (rigFrame.mvpMapPoints[i] && !rigFrame.mvbOutlier[i])
+        nRigInliers++;
+  }
+
   // Decide if the tracking was succesful
   // More restrictive if there was a relocalization recently
   if (mCurrentFrame.mnId < mnLastRelocFrameId + mMaxFrames &&
-      mnMatchesInliers < 50)
+      mnMatchesInliers + nRigInliers < 50)
     return false;
 
-  if (mnMatchesInliers < 30)
+  if (mnMatchesInliers + nRigInliers < 30)
     return false;
   else
     return true;
@@ -1061,6 +1318,7 @@ void Tracking::SearchLocalPoints() {
       continue;
     if (pMP->isBad())
       continue;
+    pMP->mnTrackReferenceForFrame = mCurrentFrame.mnId;
     // Project (this fills MapPoint variables for matching)
     if (mCurrentFrame.isInFrustum(pMP, 0.5)) {
       pMP->IncreaseVisible();
@@ -1068,6 +1326,30 @@ void Tracking::SearchLocalPoints() {
     }
   }
 
+  // Points in view that are not in the local map
+  mvpSpatialMapPoints.clear();
+  if (mfSpatialDepth > 0 && mpMap->mPointIndex.IsEnabled()) {
+    const vector<MapPoint *> vpMPs = mpMap->mPointIndex.GetPointsInFrustum(
+        mCurrentFrame.mTcw, mCurrentFrame.fx, mCurrentFrame.fy,
+        mCurrentFrame.cx, mCurrentFrame.cy, mCurrentFrame.mnMinX,
+        mCurrentFrame.mnMaxX, mCurrentFrame.mnMinY, mCurrentFrame.mnMaxY,
+        mfSpatialDepth);
+    for (size_t i = 0; i < vpMPs.size(); i++) {
+      MapPoint *pMP = vpMPs[i];
+      if (pMP->mnTrackReferenceForFrame == mCurrentFrame.mnId ||
+          pMP->mnLastFrameSeen == mCurrentFrame.mnId)
+        continue;
+      if (pMP->isBad())
+        continue;
+      pMP->mnTrackReferenceForFrame = mCurrentFrame.mnId;
+      if (mCurrentFrame.isInFrustum(pMP, 0.5)) {
+        pMP->IncreaseVisible();
+        mvpSpatialMapPoints.push_back(pMP);
+        nToMatch++;
+      }
+    }
+  }
+
   if (nToMatch > 0) {
     ORBmatcher matcher(0.8);
     int th = 1;
@@ -1077,6 +1359,8 @@ void Tracking::SearchLocalPoints() {
     if (mCurrentFrame.mnId < mnLastRelocFrameId + 2)
       th = 5;
     matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, th);
+    if (!mvpSpatialMapPoints.empty())
+      matcher.SearchByProjection(mCurrentFrame, mvpSpatialMapPoints, th);
   }
 }
 
@@ -1090,6 +1374,19 @@ void Tracking::UpdateLocalMap() {
 }
 
 void Tracking::UpdateLocalPoints() {
+  // The local map points of the last frame are kept if the local keyframes are
+  // the same and none of their map points changed
+  mvLocalKeyFrameVersions.clear();
+  for (size_t i = 0; i < mvpLocalKeyFrames.size(); i++)
+    mvLocalKeyFrameVersions.push_back(make_pair(
+        mvpLocalKeyFrames[i], mvpLocalKeyFrames[i]->GetMapPointsVersion()));
+  sort(mvLocalKeyFrameVersions.begin(), mvLocalKeyFrameVersions.end());
+
+  if (!mvpLocalMapPoints.empty() &&
+      mvLocalKeyFrameVersions == mvLastLocalKeyFrameVersions)
+    return;
+  mvLastLocalKeyFrameVersions.swap(mvLocalKeyFrameVersions);
+
   mvpLocalMapPoints.clear();
 
   for (vector<KeyFrame *>::const_iterator itKF = mvpLocalKeyFrames.begin(),
@@ -1115,48 +1412,56 @@ void Tracking::UpdateLocalPoints() {
 }
 
 void Tracking::UpdateLocalKeyFrames() {
-  // Each map point vote for the keyframes in which it has been observed
-  map<KeyFrame *, int> keyframeCounter;
+  // Each map point vote for the keyframes in which it has been observed. Votes
+  // are indexed by keyframe id and only the voted entries are reset.
+  if (mvnKeyFrameVotes.size() < KeyFrame::nNextId)
+    mvnKeyFrameVotes.resize(KeyFrame::nNextId, 0);
+  mvpVotedKeyFrames.clear();
   for (int i = 0; i < mCurrentFrame.N; i++) {
     if (mCurrentFrame.mvpMapPoints[i]) {
       MapPoint *pMP = mCurrentFrame.mvpMapPoints[i];
       if (!pMP->isBad()) {
-        const map<KeyFrame *, size_t> observations = pMP->GetObservations();
-        for (map<KeyFrame *, size_t>::const_iterator it = observations.begin(),
-                                                     itend = observations.end();
-             it != itend; it++)
-          keyframeCounter[it->first]++;
+        mvpObservingKeyFrames.clear();
+        pMP->GetObservingKeyFrames(mvpObservingKeyFrames);
+        for (size_t j = 0; j < mvpObservingKeyFrames.size(); j++) {
+          KeyFrame *pKF = mvpObservingKeyFrames[j];
+          if (pKF->mnId >= mvnKeyFrameVotes.size())
+            mvnKeyFrameVotes.resize(pKF->mnId + 1, 0);
+          if (mvnKeyFrameVotes[pKF->mnId]++ == 0)
+            mvpVotedKeyFrames.push_back(pKF);
+        }
       } else {
         mCurrentFrame.mvpMapPoints[i] = NULL;
       }
     }
   }
 
-  if (keyframeCounter.empty())
+  if (mvpVotedKeyFrames.empty())
     return;
 
   int max = 0;
   KeyFrame *pKFmax = static_cast<KeyFrame *>(NULL);
 
   mvpLocalKeyFrames.clear();
-  mvpLocalKeyFrames.reserve(3 * keyframeCounter.size());
+  mvpLocalKeyFrames.reserve(3 * mvpVotedKeyFrames.size());
 
   // All keyframes that observe a map point are included in the local map. Also
   // check which keyframe shares most points
-  for (map<KeyFrame *, int>::const_iterator it = keyframeCounter.begin(),
-                                            itEnd = keyframeCounter.end();
-       it != itEnd; it++) {
-    KeyFrame *pKF = it->first;
+  for (size_t i = 0; i < mvpVotedKeyFrames.size(); i++) {
+    KeyFrame *pKF = mvpVotedKeyFrames[i];
+    int &nVotes = mvnKeyFrameVotes[pKF->mnId];
+    const int nKFVotes = nVotes;
+    nVotes = 0;
 
     if (pKF->isBad())
       continue;
 
-    if (it->second > max) {
-      max = it->second;
+    if (nKFVotes > max) {
+      max = nKFVotes;
       pKFmax = pKF;
     }
 
-    mvpLocalKeyFrames.push_back(it->first);
+    mvpLocalKeyFrames.push_back(pKF);
     pKF->mnTrackReferenceForFrame = mCurrentFrame.mnId;
   }
 
@@ -1389,6 +1694,10 @@ void Tracking::Reset() {
   mpKeyFrameDB->clear();
   cout << " done" << endl;
 
+  // Forget the paged tiles
+  if (mpMapTiles)
+    mpMapTiles->RequestReset();
+
   // Clear Map (this erase MapPoints and KeyFrames)
   mpMap->clear();
 
@@ -1401,10 +1710,13 @@ void Tracking::Reset() {
     mpInitializer = static_cast<Initializer *>(NULL);
   }
 
-  mlRelativeFramePoses.clear();
-  mlpReferences.clear();
-  mlFrameTimes.clear();
-  mlbLost.clear();
+  mTrajectory.clear();
+
+  mvpLocalKeyFrames.clear();
+  mvpLocalMapPoints.clear();
+  mvLastLocalKeyFrameVersions.clear();
+  mpReferenceKF = static_cast<KeyFrame *>(NULL);
+  mpLastKeyFrame = static_cast<KeyFrame *>(NULL);
 
   if (mpViewer)
     mpViewer->Release();
@@ -1437,8 +1749,6 @@ void Tracking::ChangeCalibration(const string &strSettingPath) {
   DistCoef.copyTo(mDistCoef);
 
   mbf = fSettings["Camera.bf"];
-
-  Frame::mbInitialComputations = true;
 }
 
 void Tracking::InformOnlyTracking(const bool &flag) { mbOnlyTracking = flag; }
@@ -0,0 +1,335 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TrajectorySink.h"
+
+#include "Converter.h"
+#include "KeyFrame.h"
+#include "Map.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+TrajectorySink::TrajectorySink(Map *pMap)
+    : mpMap(pMap), mnDropped(0), mbStreaming(false), mFormat(TUM),
+      mnMaxHistory(3000), mnKeyFrameLag(20), mnGeneration(0) {}
+
+bool TrajectorySink::Open(const string &filename, const eFormat format) {
+  unique_lock<mutex> lock(mMutex);
+
+  mfStream.open(filename.c_str());
+  mRecordsFile = filename + ".rec";
+  mfRecords.open(mRecordsFile.c_str(), ios_base::binary);
+  if (!mfStream.is_open() || !mfRecords.is_open()) {
+    cerr << "[trajectory] Cannot write to " << filename << endl;
+    mfStream.close();
+    mfRecords.close();
+    return false;
+  }
+
+  mfStream << fixed;
+  mFormat = format;
+  mbStreaming = true;
+  return true;
+}
+
+void TrajectorySink::SetCallback(const PoseCallback &callback) {
+  unique_lock<mutex> lock(mMutex);
+  mCallback = callback;
+}
+
+void TrajectorySink::SetMaxHistory(const size_t nMaxFrames) {
+  unique_lock<mutex> lock(mMutex);
+  mnMaxHistory = nMaxFrames;
+}
+
+void TrajectorySink::Add(const cv::Mat &Tcr, KeyFrame *pRef,
+                         const double &timestamp, const bool bLost) {
+  unique_lock<mutex> lock(mMutex);
+  FramePose pose;
+  pose.Tcr = Tcr;
+  pose.pRef = pRef;
+  pose.timestamp = timestamp;
+  pose.bLost = bLost;
+  mdHistory.push_back(pose);
+}
+
+void TrajectorySink::RepeatLast(const bool bLost) {
+  unique_lock<mutex> lock(mMutex);
+  if (mdHistory.empty())
+    return;
+  FramePose pose = mdHistory.back();
+  pose.bLost = bLost;
+  mdHistory.push_back(pose);
+}
+
+bool TrajectorySink::empty() {
+  unique_lock<mutex> lock(mMutex);
+  return mdHistory.empty();
+}
+
+cv::Mat TrajectorySink::LastRelativePose() {
+  unique_lock<mutex> lock(mMutex);
+  if (mdHistory.empty())
+    return cv::Mat();
+  return mdHistory.back().Tcr;
+}
+
+void TrajectorySink::ReplaceReferences(const set<KeyFrame *> &spKFs) {
+  unique_lock<mutex> lock(mMutex);
+  for (deque<FramePose>::iterator it = mdHistory.begin(),
+                                  end = mdHistory.end();
+       it != end; it++) {
+    while (spKFs.count(it->pRef)) {
+      it->Tcr = it->Tcr * it->pRef->mTcp;
+      it->pRef = it->pRef->GetParent();
+    }
+  }
+}
+
+void TrajectorySink::Flush(const long unsigned int nLastKFid) {
+  unique_lock<mutex> lock(mMutex);
+  if (!mbStreaming && !mCallback)
+    return;
+
+  vector<pair<double, cv::Mat>> vCallbackPoses;
+  cv::Mat Two;
+  bool bWritten = false;
+  // The newest frame is kept, the next one can be relative to it
+  while (mdHistory.size() > 1) {
+    const FramePose &pose = mdHistory.front();
+
+    // Past the bound, frames are finalized whatever their keyframe
+    if (mdHistory.size() <= mnMaxHistory) {
+      KeyFrame *pKF = pose.pRef;
+      while (pKF->isBad())
+        pKF = pKF->GetParent();
+      if (pKF->mnId + mnKeyFrameLag >= nLastKFid)
+        break;
+    }
+
+    if (Two.empty())
+      Two = GetOriginInverse();
+
+    Finalize(pose, Two, vCallbackPoses);
+    bWritten = true;
+
+    // Without a stream file the history would grow with the session
+    if (!mbStreaming)
+      mnDropped++;
+    mdHistory.pop_front();
+  }
+
+  // The pose log is flushed at every line
+  if (bWritten && mbStreaming)
+    mfRecords.flush();
+
+  // The callback may be slow or call back into the system
+  if (vCallbackPoses.empty())
+    return;
+  const PoseCallback callback = mCallback;
+  lock.unlock();
+  for (size_t i = 0; i < vCallbackPoses.size(); i++)
+    callback(vCallbackPoses[i].first, vCallbackPoses[i].second);
+}
+
+void TrajectorySink::Finalize(const FramePose &pose, const cv::Mat &Two,
+                              vector<pair<double, cv::Mat>> &vCallbackPoses) {
+  KeyFrame *pKF;
+  cv::Mat Tck;
+  cv::Mat Twc = ComputeTwc(pose, Two, pKF, Tck);
+
+  if (!pose.bLost && mCallback)
+    vCallbackPoses.push_back(make_pair(pose.timestamp, Twc));
+
+  if (!mbStreaming)
+    return;
+
+  if (!pose.bLost || mFormat == KITTI)
+    WritePose(mfStream, mFormat, pose.timestamp, Twc);
+
+  // Record layout: generation, timestamp, keyframe id, lost flag, pose of the
+  // camera relative to the keyframe (3x4) and streamed pose Twc (3x4)
+  const unsigned long long nKFid = pKF->mnId;
+  const unsigned char bLost = pose.bLost;
+  mfRecords.write(reinterpret_cast<const char *>(&mnGeneration),
+                  sizeof(mnGeneration));
+  mfRecords.write(reinterpret_cast<const char *>(&pose.timestamp),
+                  sizeof(pose.timestamp));
+  mfRecords.write(reinterpret_cast<const char *>(&nKFid), sizeof(nKFid));
+  mfRecords.write(reinterpret_cast<const char *>(&bLost), sizeof(bLost));
+  for (int i = 0; i < 3; i++)
+    mfRecords.write(reinterpret_cast<const char *>(Tck.ptr<float>(i)),
+                    4 * sizeof(float));
+  for (int i = 0; i < 3; i++)
+    mfRecords.write(reinterpret_cast<const char *>(Twc.ptr<float>(i)),
+                    4 * sizeof(float));
+}
+
+bool TrajectorySink::Save(const string &filename, const eFormat format) {
+  unique_lock<mutex> lock(mMutex);
+
+  ofstream f;
+  f.open(filename.c_str());
+  f << fixed;
+
+  // Transform all keyframes so that the first keyframe is at the origin.
+  // After a loop closure the first keyframe might not be at the origin.
+  cv::Mat Two = GetOriginInverse();
+
+  // Frames already streamed are corrected with the final pose of the keyframe
+  // they were finalized against, if it is still in the map
+  if (mbStreaming) {
+    mfRecords.flush();
+
+    map<long unsigned int, KeyFrame *> mKFs;
+    const vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+    for (size_t i = 0; i < vpKFs.size(); i++)
+      if (!vpKFs[i]->isBad())
+        mKFs[vpKFs[i]->mnId] = vpKFs[i];
+
+    ifstream fr(mRecordsFile.c_str(), ios_base::binary);
+    unsigned int nGeneration;
+    while (fr.read(reinterpret_cast<char *>(&nGeneration),
+                   sizeof(nGeneration))) {
+      double timestamp;
+      unsigned long long nKFid;
+      unsigned char bLost;
+      cv::Mat Tck = cv::Mat::eye(4, 4, CV_32F);
+      cv::Mat Twc = cv::Mat::eye(4, 4, CV_32F);
+      fr.read(reinterpret_cast<char *>(&timestamp), sizeof(timestamp));
+      fr.read(reinterpret_cast<char *>(&nKFid), sizeof(nKFid));
+      fr.read(reinterpret_cast<char *>(&bLost), sizeof(bLost));
+      for (int i = 0; i < 3; i++)
+        fr.read(reinterpret_cast<char *>(Tck.ptr<float>(i)),
+                4 * sizeof(float));
+      for (int i = 0; i < 3; i++)
+        fr.read(reinterpret_cast<char *>(Twc.ptr<float>(i)),
+                4 * sizeof(float));
+      if (!fr)
+        break;
+
+      if (bLost && format == TUM)
+        continue;
+
+      map<long unsigned int, KeyFrame *>::iterator mit = mKFs.find(nKFid);
+      if (nGeneration == mnGeneration && mit != mKFs.end()) {
+        cv::Mat Tcw = Tck * mit->second->GetPose() * Two;
+        cv::Mat Rwc = Tcw.rowRange(0, 3).colRange(0, 3).t();
+        cv::Mat twc = -Rwc * Tcw.rowRange(0, 3).col(3);
+        Rwc.copyTo(Twc.rowRange(0, 3).colRange(0, 3));
+        twc.copyTo(Twc.rowRange(0, 3).col(3));
+      }
+
+      WritePose(f, format, timestamp, Twc);
+    }
+  }
+
+  for (deque<FramePose>::iterator it = mdHistory.begin(),
+                                  end = mdHistory.end();
+       it != end; it++) {
+    if (it->bLost && format == TUM)
+      continue;
+
+    KeyFrame *pKF;
+    cv::Mat Tck;
+    WritePose(f, format, it->timestamp, ComputeTwc(*it, Two, pKF, Tck));
+  }
+
+  f.close();
+
+  if (mnDropped > 0) {
+    cerr << "[trajectory] The first " << mnDropped
+         << " frames were only passed to the callback, set a stream file to "
+            "keep them"
+         << endl;
+    return false;
+  }
+  return true;
+}
+
+void TrajectorySink::clear() {
+  unique_lock<mutex> lock(mMutex);
+  mdHistory.clear();
+  mnDropped = 0;
+  mnGeneration++;
+}
+
+cv::Mat TrajectorySink::ComputeTwc(const FramePose &pose, const cv::Mat &Two,
+                                   KeyFrame *&pKF, cv::Mat &Tck) {
+  pKF = pose.pRef;
+  cv::Mat Trw = cv::Mat::eye(4, 4, CV_32F);
+
+  // If the reference keyframe was culled, traverse the spanning tree to get a
+  // suitable keyframe.
+  while (pKF->isBad()) {
+    Trw = Trw * pKF->mTcp;
+    pKF = pKF->GetParent();
+  }
+
+  Tck = pose.Tcr * Trw;
+  cv::Mat Tcw = Tck * pKF->GetPose() * Two;
+
+  cv::Mat Twc = cv::Mat::eye(4, 4, CV_32F);
+  cv::Mat Rwc = Tcw.rowRange(0, 3).colRange(0, 3).t();
+  cv::Mat twc = -Rwc * Tcw.rowRange(0, 3).col(3);
+  Rwc.copyTo(Twc.rowRange(0, 3).colRange(0, 3));
+  twc.copyTo(Twc.rowRange(0, 3).col(3));
+  return Twc;
+}
+
+cv::Mat TrajectorySink::GetOriginInverse() {
+  if (!mpMap->mvpKeyFrameOrigins.empty())
+    return mpMap->mvpKeyFrameOrigins[0]->GetPoseInverse();
+
+  vector<KeyFrame *> vpKFs = mpMap->GetAllKeyFrames();
+  if (vpKFs.empty())
+    return cv::Mat::eye(4, 4, CV_32F);
+  return (*min_element(vpKFs.begin(), vpKFs.end(), KeyFrame::lId))
+      ->GetPoseInverse();
+}
+
+void TrajectorySink::WritePose(ostream &f, const eFormat format,
+                               const double &timestamp, const cv::Mat &Twc) {
+  cv::Mat Rwc = Twc.rowRange(0, 3).colRange(0, 3);
+  cv::Mat twc = Twc.rowRange(0, 3).col(3);
+
+  if (format == TUM) {
+    vector<float> q = Converter::toQuaternion(Rwc);
+    f << setprecision(6) << timestamp << " " << setprecision(9)
+      << twc.at<float>(0) << " " << twc.at<float>(1) << " " << twc.at<float>(2)
+      << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
+  } else {
+    f << setprecision(9) << Rwc.at<float>(0, 0) << " " << Rwc.at<float>(0, 1)
+      << " " << Rwc.at<float>(0, 2) << " " << twc.at<float>(0) << " "
+      << Rwc.at<float>(1, 0) << " " << Rwc.at<float>(1, 1) << " "
+      << Rwc.at<float>(1, 2) << " " << twc.at<float>(1) << " "
+      << Rwc.at<float>(2, 0) << " " << Rwc.at<float>(2, 1) << " "
+      << Rwc.at<float>(2, 2) << " " << twc.at<float>(2) << endl;
+  }
+}
+
+} // namespace ORB_SLAM2
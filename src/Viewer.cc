@@ -92,6 +92,10 @@ void Viewer::Run()
     bool bFollow = true;
     bool bLocalizationMode = false;
 
+    // The drawers read MapPoints and KeyFrames from the map at every iteration
+    EpochReclaimer &reclaimer = mpMapDrawer->mpMap->mReclaimer;
+    const int nReclaimSlot = reclaimer.RegisterThread();
+
     while(1)
     {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -153,10 +157,13 @@ void Viewer::Run()
             menuReset = false;
         }
 
+        reclaimer.Quiescent(nReclaimSlot,reclaimer.GetEpoch());
+
         if(Stop())
         {
             while(isStopped())
             {
+                reclaimer.Quiescent(nReclaimSlot,reclaimer.GetEpoch());
                 usleep(3000);
             }
         }
@@ -165,6 +172,8 @@ void Viewer::Run()
             break;
     }
 
+    reclaimer.UnregisterThread(nReclaimSlot);
+
     SetFinish();
 }
 
@@ -0,0 +1,358 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "VocabularyTrainer.h"
+
+#include "Parallel.h"
+#include "Thirdparty/DBoW2/DBoW2/BowVector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+using namespace std;
+
+namespace ORB_SLAM2 {
+
+VocabularyTrainer::VocabularyTrainer(const int k, const int L,
+                                     const int nThreads)
+    : mnMaxIterations(30), mk(k), mL(L), mnThreads(nThreads), mnWords(0) {
+  if (mnThreads <= 0)
+    mnThreads = max(1u, thread::hardware_concurrency());
+  mvImageOffsets.push_back(0);
+}
+
+void VocabularyTrainer::AddImage(const cv::Mat &descriptors) {
+  if (descriptors.empty())
+    return;
+  if (descriptors.type() != CV_8U || descriptors.cols != 32) {
+    cerr << "[vocabulary] ORB descriptors must be 32 bytes (CV_8U)" << endl;
+    return;
+  }
+
+  for (int i = 0; i < descriptors.rows; i++) {
+    Descriptor d;
+    memcpy(d.mBits, descriptors.ptr<unsigned char>(i), sizeof(d.mBits));
+    mvDescriptors.push_back(d);
+  }
+  mvImageOffsets.push_back(mvDescriptors.size());
+}
+
+int VocabularyTrainer::Distance(const Descriptor &a, const Descriptor &b) {
+  return __builtin_popcountll(a.mBits[0] ^ b.mBits[0]) +
+         __builtin_popcountll(a.mBits[1] ^ b.mBits[1]) +
+         __builtin_popcountll(a.mBits[2] ^ b.mBits[2]) +
+         __builtin_popcountll(a.mBits[3] ^ b.mBits[3]);
+}
+
+void VocabularyTrainer::Train() {
+  mvNodes.clear();
+  mnWords = 0;
+
+  Node root;
+  root.mnParent = -1;
+  memset(root.mDescriptor.mBits, 0, sizeof(root.mDescriptor.mBits));
+  root.mWeight = 0;
+  mvNodes.push_back(root);
+  if (mvDescriptors.empty())
+    return;
+
+  vector<Job> vJobs(1);
+  vJobs[0].mnNode = 0;
+  vJobs[0].mvIndices.resize(mvDescriptors.size());
+  iota(vJobs[0].mvIndices.begin(), vJobs[0].mvIndices.end(), 0);
+
+  for (int level = 1; level <= mL && !vJobs.empty(); level++) {
+    vector<Clusters> vClusters(vJobs.size());
+    if ((int)vJobs.size() < mnThreads) {
+      // Top of the tree, the descriptors of each node are shared
+      for (size_t j = 0; j < vJobs.size(); j++)
+        Cluster(vJobs[j], mnThreads, vClusters[j]);
+    } else {
+      atomic<size_t> nNextJob(0);
+      vector<thread> vThreads;
+      for (int t = 0; t < mnThreads; t++)
+        vThreads.push_back(thread([&]() {
+          for (size_t j = nNextJob++; j < vJobs.size(); j = nNextJob++)
+            Cluster(vJobs[j], 1, vClusters[j]);
+        }));
+      for (size_t t = 0; t < vThreads.size(); t++)
+        vThreads[t].join();
+    }
+
+    // Nodes of the level in the order of their parents
+    vector<Job> vNextJobs;
+    for (size_t j = 0; j < vJobs.size(); j++) {
+      const int nParent = vJobs[j].mnNode;
+      Clusters &clusters = vClusters[j];
+      for (size_t c = 0; c < clusters.mvCenters.size(); c++) {
+        const int nId = mvNodes.size();
+        Node node;
+        node.mnParent = nParent;
+        node.mDescriptor = clusters.mvCenters[c];
+        node.mWeight = 0;
+        mvNodes.push_back(node);
+        mvNodes[nParent].mvChildren.push_back(nId);
+
+        if (level < mL && clusters.mvGroups[c].size() > 1) {
+          vNextJobs.push_back(Job());
+          vNextJobs.back().mnNode = nId;
+          vNextJobs.back().mvIndices.swap(clusters.mvGroups[c]);
+        }
+      }
+    }
+    vJobs.swap(vNextJobs);
+
+    cout << "[vocabulary] Level " << level << ": " << mvNodes.size()
+         << " nodes" << endl;
+  }
+
+  for (size_t i = 1; i < mvNodes.size(); i++)
+    if (mvNodes[i].mvChildren.empty())
+      mnWords++;
+
+  ComputeWeights();
+}
+
+void VocabularyTrainer::Cluster(const Job &job, const int nThreads,
+                                Clusters &clusters) const {
+  const vector<uint32_t> &vIndices = job.mvIndices;
+  const size_t N = vIndices.size();
+  clusters.mvCenters.clear();
+  clusters.mvGroups.clear();
+
+  if ((int)N <= mk) {
+    // One cluster per descriptor
+    for (size_t i = 0; i < N; i++) {
+      clusters.mvCenters.push_back(mvDescriptors[vIndices[i]]);
+      clusters.mvGroups.push_back(vector<uint32_t>(1, vIndices[i]));
+    }
+    return;
+  }
+
+  // Seeded by node, the tree does not depend on the number of threads
+  mt19937 rng(job.mnNode);
+  vector<Descriptor> vCenters;
+  Seed(vIndices, nThreads, rng, vCenters);
+  vector<vector<uint32_t>> vGroups(vCenters.size());
+
+  vector<int> vAssociation(N, -1);
+  for (int it = 0; it < mnMaxIterations; it++) {
+    atomic<bool> bChanged(false);
+    ParallelFor(
+        N, 1,
+        [&](const size_t begin, const size_t end) {
+          bool bChangedBlock = false;
+          for (size_t i = begin; i < end; i++) {
+            const Descriptor &d = mvDescriptors[vIndices[i]];
+            int bestDist = Distance(d, vCenters[0]);
+            int bestCluster = 0;
+            for (size_t c = 1; c < vCenters.size(); c++) {
+              const int dist = Distance(d, vCenters[c]);
+              if (dist < bestDist) {
+                bestDist = dist;
+                bestCluster = c;
+              }
+            }
+            if (vAssociation[i] != bestCluster) {
+              vAssociation[i] = bestCluster;
+              bChangedBlock = true;
+            }
+          }
+          if (bChangedBlock)
+            bChanged = true;
+        },
+        nThreads);
+    if (!bChanged)
+      break;
+
+    for (size_t c = 0; c < vGroups.size(); c++)
+      vGroups[c].clear();
+    for (size_t i = 0; i < N; i++)
+      vGroups[vAssociation[i]].push_back(vIndices[i]);
+
+    ParallelFor(
+        vCenters.size(), 1,
+        [&](const size_t begin, const size_t end) {
+          for (size_t c = begin; c < end; c++)
+            Majority(vGroups[c], vCenters[c]);
+        },
+        nThreads);
+  }
+
+  // Clusters left without descriptors are dropped
+  for (size_t c = 0; c < vCenters.size(); c++) {
+    if (vGroups[c].empty())
+      continue;
+    clusters.mvCenters.push_back(vCenters[c]);
+    clusters.mvGroups.push_back(vector<uint32_t>());
+    clusters.mvGroups.back().swap(vGroups[c]);
+  }
+}
+
+void VocabularyTrainer::Seed(const vector<uint32_t> &vIndices,
+                             const int nThreads, mt19937 &rng,
+                             vector<Descriptor> &vCenters) const {
+  // k-means++: the next center is drawn with a probability proportional to
+  // the distance to the closest center
+  const size_t N = vIndices.size();
+  vector<double> vMinDists(N, numeric_limits<double>::max());
+
+  vCenters.clear();
+  vCenters.push_back(
+      mvDescriptors[vIndices[uniform_int_distribution<size_t>(0, N - 1)(rng)]]);
+
+  while ((int)vCenters.size() < mk) {
+    const Descriptor &last = vCenters.back();
+    ParallelFor(
+        N, 1,
+        [&](const size_t begin, const size_t end) {
+          for (size_t i = begin; i < end; i++) {
+            if (vMinDists[i] > 0)
+              vMinDists[i] =
+                  min(vMinDists[i],
+                      (double)Distance(mvDescriptors[vIndices[i]], last));
+          }
+        },
+        nThreads);
+
+    const double sum = accumulate(vMinDists.begin(), vMinDists.end(), 0.0);
+    if (sum <= 0)
+      break;
+
+    double cut;
+    do {
+      cut = uniform_real_distribution<double>(0, sum)(rng);
+    } while (cut == 0.0);
+
+    size_t i = 0;
+    for (double acc = 0; i < N; i++) {
+      acc += vMinDists[i];
+      if (acc >= cut)
+        break;
+    }
+    vCenters.push_back(mvDescriptors[vIndices[min(i, N - 1)]]);
+  }
+}
+
+void VocabularyTrainer::Majority(const vector<uint32_t> &vIndices,
+                                 Descriptor &center) const {
+  if (vIndices.empty())
+    return;
+
+  // Same rounding as DBoW2::FORB::meanValue
+  int counts[256] = {0};
+  for (size_t i = 0; i < vIndices.size(); i++) {
+    const uint64_t *bits = mvDescriptors[vIndices[i]].mBits;
+    for (int w = 0; w < 4; w++)
+      for (int b = 0; b < 64; b++)
+        counts[w * 64 + b] += (bits[w] >> b) & 1;
+  }
+
+  const int N2 = vIndices.size() / 2 + vIndices.size() % 2;
+  for (int w = 0; w < 4; w++) {
+    center.mBits[w] = 0;
+    for (int b = 0; b < 64; b++)
+      if (counts[w * 64 + b] >= N2)
+        center.mBits[w] |= (uint64_t)1 << b;
+  }
+}
+
+int VocabularyTrainer::Transform(const Descriptor &d) const {
+  int nId = 0;
+  while (!mvNodes[nId].mvChildren.empty()) {
+    const vector<int> &vChildren = mvNodes[nId].mvChildren;
+    int best = vChildren[0];
+    int bestDist = Distance(d, mvNodes[best].mDescriptor);
+    for (size_t i = 1; i < vChildren.size(); i++) {
+      const int dist = Distance(d, mvNodes[vChildren[i]].mDescriptor);
+      if (dist < bestDist) {
+        bestDist = dist;
+        best = vChildren[i];
+      }
+    }
+    nId = best;
+  }
+  return nId;
+}
+
+void VocabularyTrainer::ComputeWeights() {
+  // idf of every word: ln(N/Ni), Ni training images with the word
+  const size_t nImages = Images();
+  vector<int> vNi(mvNodes.size(), 0);
+  mutex mutexNi;
+
+  ParallelFor(
+      nImages, 1,
+      [&](const size_t begin, const size_t end) {
+        vector<int> vBlockNi(mvNodes.size(), 0);
+        vector<size_t> vLastImage(mvNodes.size(), nImages);
+        for (size_t i = begin; i < end; i++) {
+          for (size_t j = mvImageOffsets[i]; j < mvImageOffsets[i + 1]; j++) {
+            const int nWord = Transform(mvDescriptors[j]);
+            if (vLastImage[nWord] != i) {
+              vLastImage[nWord] = i;
+              vBlockNi[nWord]++;
+            }
+          }
+        }
+
+        unique_lock<mutex> lock(mutexNi);
+        for (size_t n = 0; n < vNi.size(); n++)
+          vNi[n] += vBlockNi[n];
+      },
+      mnThreads);
+
+  for (size_t n = 1; n < mvNodes.size(); n++)
+    if (mvNodes[n].mvChildren.empty() && vNi[n] > 0)
+      mvNodes[n].mWeight = log((double)nImages / vNi[n]);
+}
+
+bool VocabularyTrainer::Save(const string &filename) const {
+  ofstream f(filename.c_str(), ios::binary);
+  if (!f.is_open())
+    return false;
+
+  // Header of 4 ints, then for every node but the root: parent id, leaf flag,
+  // descriptor and weight
+  const int header[4] = {mk, mL, DBoW2::L1_NORM, DBoW2::TF_IDF};
+  f.write((const char *)header, sizeof(header));
+  for (size_t i = 1; i < mvNodes.size(); i++) {
+    const Node &node = mvNodes[i];
+    const unsigned char nIsLeaf = node.mvChildren.empty() ? 1 : 0;
+    const DBoW2::WordValue weight = node.mWeight;
+    f.write((const char *)&node.mnParent, sizeof(node.mnParent));
+    f.write((const char *)&nIsLeaf, sizeof(nIsLeaf));
+    f.write((const char *)node.mDescriptor.mBits,
+            sizeof(node.mDescriptor.mBits));
+    f.write((const char *)&weight, sizeof(weight));
+  }
+
+  return f.good();
+}
+
+} // namespace ORB_SLAM2